@@ -342,6 +342,17 @@ static void rxAssemble(uint8_t *in, uint16_t len, uint32_t t_us)
             return;
         }
 
+        // Whole payload in one transfer: deliver straight from the transfer buffer, no copy.
+        if (len >= payloadLen) {
+            if (shtp.chan[chan].callback != 0) {
+                shtp.chan[chan].callback(shtp.chan[chan].cookie,
+                                           in+SHTP_HDR_LEN, payloadLen-SHTP_HDR_LEN,
+                                           t_us);
+            }
+            shtp.chan[chan].nextInSeq = seq + 1;
+            return;
+        }
+
         if (payloadLen-SHTP_HDR_LEN > SHTP_MAX_PAYLOAD_IN) {
             // Error: This payload won't fit! Discard it.
             shtp.tooLargePayloads++;
@@ -0,0 +1,19 @@
+/*
+ * File: i2c.h
+ * ----------------------------
+ * Simulation: Ersatz für ESP-IDF. Geräte sprechen über die Busfunktionen aus sensing/i2c.h,
+ * Host-Tests ersetzen diese durch einen Mock (siehe test/hub.c).
+ */
+
+
+#pragma once
+
+
+#include "esp_system.h"
+
+
+typedef enum {
+    I2C_NUM_0 = 0,
+    I2C_NUM_1,
+    I2C_NUM_MAX
+} i2c_port_t;
@@ -0,0 +1,65 @@
+/*
+ * File: rmt.h
+ * ----------------------------
+ * Simulation: Ersatz für ESP-IDF 4.0. Gesendete Pulsfolgen werden dekodiert an das Modell weitergegeben.
+ */
+
+
+#pragma once
+
+
+#include "esp_system.h"
+#include "driver/gpio.h"
+
+
+#define APB_CLK_FREQ    80000000
+
+typedef enum {
+    RMT_CHANNEL_0,
+    RMT_CHANNEL_MAX = 8
+} rmt_channel_t;
+
+typedef enum {
+    RMT_MODE_TX,
+    RMT_MODE_RX
+} rmt_mode_t;
+
+typedef enum {
+    RMT_IDLE_LEVEL_LOW,
+    RMT_IDLE_LEVEL_HIGH
+} rmt_idle_level_t;
+
+typedef struct {
+    bool loop_en;
+    bool carrier_en;
+    rmt_idle_level_t idle_level;
+    bool idle_output_en;
+} rmt_tx_config_t;
+
+typedef struct {
+    rmt_mode_t rmt_mode;
+    rmt_channel_t channel;
+    uint8_t clk_div;
+    gpio_num_t gpio_num;
+    uint8_t mem_block_num;
+    union {
+        rmt_tx_config_t tx_config;
+    };
+} rmt_config_t;
+
+typedef struct {
+    union {
+        struct {
+            uint32_t duration0 : 15;
+            uint32_t level0 : 1;
+            uint32_t duration1 : 15;
+            uint32_t level1 : 1;
+        };
+        uint32_t val;
+    };
+} rmt_item32_t;
+
+esp_err_t rmt_config(const rmt_config_t *config);
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rxBufferSize, int interruptFlags);
+esp_err_t rmt_fill_tx_items(rmt_channel_t channel, const rmt_item32_t *items, uint16_t count, uint16_t offset);
+esp_err_t rmt_tx_start(rmt_channel_t channel, bool resetIndex);
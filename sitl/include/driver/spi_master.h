@@ -0,0 +1,70 @@
+/*
+ * File: spi_master.h
+ * ----------------------------
+ * Simulation: Ersatz für ESP-IDF 4.0, nur was bno.c benötigt. Nicht in shim.c, Host-Tests
+ * stellen einen Mock bereit (siehe test/hub.c).
+ */
+
+
+#pragma once
+
+
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+
+
+#define SPI_TRANS_CS_KEEP_ACTIVE    (1 << 8)
+
+typedef enum {
+    SPI_HOST = 0,
+    HSPI_HOST = 1,
+    VSPI_HOST = 2
+} spi_host_device_t;
+
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+    int max_transfer_sz;
+    uint32_t flags;
+    int intr_flags;
+} spi_bus_config_t;
+
+typedef struct {
+    uint8_t command_bits;
+    uint8_t address_bits;
+    uint8_t dummy_bits;
+    uint8_t mode;
+    uint16_t duty_cycle_pos;
+    uint16_t cs_ena_pretrans;
+    uint8_t cs_ena_posttrans;
+    int clock_speed_hz;
+    int input_delay_ns;
+    int spics_io_num;
+    uint32_t flags;
+    int queue_size;
+} spi_device_interface_config_t;
+
+typedef struct {
+    uint32_t flags;
+    uint16_t cmd;
+    uint64_t addr;
+    size_t length;      // Bits
+    size_t rxlength;
+    void *user;
+    const void *tx_buffer;
+    void *rx_buffer;
+} spi_transaction_t;
+
+typedef struct spi_device_t *spi_device_handle_t;
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dmaChannel);
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config,
+                             spi_device_handle_t *handle);
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait);
+void spi_device_release_bus(spi_device_handle_t device);
+esp_err_t spi_device_polling_transmit(spi_device_handle_t device, spi_transaction_t *transaction);
+esp_err_t spi_device_transmit(spi_device_handle_t device, spi_transaction_t *transaction);
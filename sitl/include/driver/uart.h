@@ -0,0 +1,102 @@
+/*
+ * File: uart.h
+ * ----------------------------
+ * Simulation: Ersatz für ESP-IDF 4.0 samt Registern (soc/uart_struct.h), nur was sensing/uart.c
+ * benötigt. Nicht in shim.c, Host-Tests stellen die Funktionen bereit.
+ */
+
+
+#pragma once
+
+
+#include "esp_system.h"
+#include "driver/gpio.h"
+
+
+#define DRAM_ATTR
+#define APB_CLK_FREQ                80000000
+#define ETS_UART0_INTR_SOURCE       34
+#define UART_FIFO_LEN               128
+#define UART_PIN_NO_CHANGE          (-1)
+
+#define UART_RXFIFO_FULL_INT_ENA_M  (1 << 0)
+#define UART_TXFIFO_EMPTY_INT_ENA_M (1 << 1)
+#define UART_RXFIFO_OVF_INT_ENA_M   (1 << 4)
+#define UART_RXFIFO_TOUT_INT_ENA_M  (1 << 8)
+#define UART_RXFIFO_FULL_INT_ST_M   UART_RXFIFO_FULL_INT_ENA_M
+#define UART_TXFIFO_EMPTY_INT_ST_M  UART_TXFIFO_EMPTY_INT_ENA_M
+#define UART_RXFIFO_OVF_INT_ST_M    UART_RXFIFO_OVF_INT_ENA_M
+#define UART_RXFIFO_TOUT_INT_ST_M   UART_RXFIFO_TOUT_INT_ENA_M
+#define UART_INTR_MASK              0x1ff
+
+typedef enum {
+    UART_NUM_0,
+    UART_NUM_1,
+    UART_NUM_2,
+    UART_NUM_MAX
+} uart_port_t;
+
+typedef enum {
+    UART_DATA_5_BITS,
+    UART_DATA_6_BITS,
+    UART_DATA_7_BITS,
+    UART_DATA_8_BITS
+} uart_word_length_t;
+
+typedef enum {
+    UART_STOP_BITS_1 = 1,
+    UART_STOP_BITS_1_5,
+    UART_STOP_BITS_2
+} uart_stop_bits_t;
+
+typedef union {
+    struct {
+        uint32_t rxfifo_full: 1;
+        uint32_t txfifo_empty: 1;
+        uint32_t reserved: 30;
+    };
+    uint32_t val;
+} uart_int_reg_t;
+
+// Ein Lesen von fifo.rw_byte entnimmt auf dem ESP32 ein Byte aus dem rx-FIFO. Hier ruft der Zugriff
+// die vom Test gesetzte Funktion auf, diese liefert das nächste Byte. tx wird nicht simuliert.
+typedef struct {
+    struct {
+        uint32_t bit_num;
+        uint32_t parity_en;
+        uint32_t stop_bit_num;
+        uint32_t tx_flow_en;
+        uint32_t err_wr_mask;
+        uint32_t tick_ref_always_on;
+    } conf0;
+    struct {
+        uint32_t rx_flow_en;
+        uint32_t rxfifo_full_thrhd;
+        uint32_t txfifo_empty_thrhd;
+        uint32_t rx_tout_thrhd;
+        uint32_t rx_tout_en;
+    } conf1;
+    struct {
+        uint32_t div_int;
+        uint32_t div_frag;
+    } clk_div;
+    struct {
+        uint32_t rxfifo_cnt;
+        uint32_t txfifo_cnt;
+    } status;
+    struct {
+        uint8_t *(*access)(void);
+    } fifo;
+    uart_int_reg_t int_ena;
+    uart_int_reg_t int_clr;
+    uart_int_reg_t int_st;
+} uart_dev_t;
+
+#define rw_byte access()[0]
+
+typedef void (*intr_handler_t)(void *arg);
+typedef struct intr_handle_data_t *intr_handle_t;
+
+esp_err_t uart_set_pin(uart_port_t uartNum, int txPin, int rxPin, int rtsPin, int ctsPin);
+void periph_module_enable(int module);
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void *arg, intr_handle_t *handle);
@@ -0,0 +1,18 @@
+/*
+ * File: esp_err.h
+ * ----------------------------
+ * Simulation: Ersatz für ESP-IDF, nur was Regelung und Intercom benötigen.
+ */
+
+
+#pragma once
+
+
+typedef int esp_err_t;
+
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+#define ESP_ERR_NVS_NOT_INITIALIZED     0x1101
+#define ESP_ERR_NVS_NOT_FOUND           0x1102
+#define ESP_ERR_NVS_INVALID_LENGTH      0x110c
+#define ESP_ERR_NVS_KEY_TOO_LONG        0x1113
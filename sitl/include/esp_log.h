@@ -0,0 +1,33 @@
+/*
+ * File: esp_log.h
+ * ----------------------------
+ * Simulation: Ersatz für ESP-IDF. Logs mit Simulationszeit auf stderr, Stufe per shim_logLevel.
+ */
+
+
+#pragma once
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "esp_system.h"
+
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+void shim_log(esp_log_level_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, format, ...)  shim_log(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  shim_log(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  shim_log(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  shim_log(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)  shim_log(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
@@ -0,0 +1,17 @@
+/*
+ * File: esp_system.h
+ * ----------------------------
+ * Simulation: Ersatz für ESP-IDF, nur was Regelung und Intercom benötigen.
+ */
+
+
+#pragma once
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+
+#define IRAM_ATTR
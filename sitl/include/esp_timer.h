@@ -0,0 +1,31 @@
+/*
+ * File: esp_timer.h
+ * ----------------------------
+ * Simulation: Ersatz für ESP-IDF. Zeit ist die Simulationszeit, Timer werden von shim_advance ausgelöst.
+ */
+
+
+#pragma once
+
+
+#include "esp_system.h"
+
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum {
+    ESP_TIMER_TASK
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+int64_t esp_timer_get_time(void);
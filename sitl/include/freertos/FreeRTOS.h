@@ -0,0 +1,37 @@
+/*
+ * File: FreeRTOS.h
+ * ----------------------------
+ * Simulation: Ersatz für FreeRTOS. Tasks laufen als Threads im Gleichschritt mit der Simulation.
+ */
+
+
+#pragma once
+
+
+#include <assert.h>
+#include "esp_system.h"
+#include "esp_timer.h" // in ESP-IDF transitiv verfügbar
+
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef struct shim_queue *QueueHandle_t;
+typedef struct shim_task *TaskHandle_t;
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define pdTRUE                          1
+#define pdFALSE                         0
+#define pdPASS                          pdTRUE
+#define portMAX_DELAY                   0xffffffffU
+#define portMUX_INITIALIZER_UNLOCKED    {0}
+#define portENTER_CRITICAL(mux)         ((void)(mux)) // Simulation rechnet nie parallel zur Task
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux)     ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)      ((void)(mux))
+#define portTICK_PERIOD_MS              5 // CONFIG_FREERTOS_HZ 200
+#define portYIELD_FROM_ISR()            ((void)0)
+#define configASSERT(condition)         assert(condition)
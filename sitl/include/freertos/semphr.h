@@ -0,0 +1,11 @@
+/*
+ * File: semphr.h
+ * ----------------------------
+ * Simulation: Ersatz für FreeRTOS. Semaphoren sind in queue.h deklariert.
+ */
+
+
+#pragma once
+
+
+#include "queue.h"
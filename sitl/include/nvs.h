@@ -0,0 +1,27 @@
+/*
+ * File: nvs.h
+ * ----------------------------
+ * Simulation: Ersatz für ESP-IDF. Flüchtiger Speicher, wird von der Simulation mit Einstellungen vorbelegt.
+ */
+
+
+#pragma once
+
+
+#include "esp_system.h"
+
+
+typedef uint32_t nvs_handle;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode mode, nvs_handle *handle);
+void nvs_close(nvs_handle handle);
+esp_err_t nvs_commit(nvs_handle handle);
+esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *value);
+esp_err_t nvs_set_u32(nvs_handle handle, const char *key, uint32_t value);
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *value, size_t *length);
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length);
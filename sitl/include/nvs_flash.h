@@ -0,0 +1,15 @@
+/*
+ * File: nvs_flash.h
+ * ----------------------------
+ * Simulation: Ersatz für ESP-IDF.
+ */
+
+
+#pragma once
+
+
+#include "esp_system.h"
+
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
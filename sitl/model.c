@@ -0,0 +1,139 @@
+/*
+ * File: model.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-04
+ * ----------------------------
+ * Starrkörpermodell eines Quadrokopters mit 6 Freiheitsgraden für die Simulation.
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <math.h>
+#include <string.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "model.h"
+
+
+/** Variablendeklaration **/
+
+#define MODEL_GRAVITY   9.81    // m/s^2
+#define MODEL_IDLE      0.05    // ESC-Stellwert bei Throttle 0, wie CONTROL_MOTOR_IDLE
+
+static const double model_curve[][2] = { // Throttle, Schub in g bei 12.6 V (Motorprofil main.c)
+    {0.0, 0.0}, {0.03, 16.0}, {0.1, 44.0}, {0.2, 79.0}, {0.3, 107.0}, {0.4, 145.0},
+    {0.5, 175.0}, {0.6, 211.0}, {0.7, 250.0}, {1.0, 367.0} // linear bis Vollgas wie thrust_build
+};
+
+static const double model_geometry[MODEL_MOTORS][3] = { // x vorne, y links (Anteil der Arme), Drehrichtung
+    { 1.0,  1.0,  1.0}, // vorne links
+    { 1.0, -1.0, -1.0}, // vorne rechts
+    {-1.0,  1.0, -1.0}, // hinten links
+    {-1.0, -1.0,  1.0}  // hinten rechts
+};
+
+
+/** Implementierung **/
+
+void model_defaults(model_parameters_t *parameters) {
+    parameters->mass = 0.75;
+    parameters->inertia[0] = 0.0075;
+    parameters->inertia[1] = 0.0075;
+    parameters->inertia[2] = 0.013;
+    parameters->armRoll = 0.12;
+    parameters->armPitch = 0.12 * 0.775; // wide-X wie mixer_quadWide
+    parameters->torque = 0.016;
+    parameters->motorLag = 0.03;
+    parameters->drag = 0.1;
+    parameters->effectiveness = 1.0;
+    parameters->delay = 0.0;
+}
+
+void model_reset(model_t *model) {
+    memset(&model->state, 0, sizeof(model->state));
+    memset(model->delayed, 0, sizeof(model->delayed));
+    model->delayIndex = 0;
+    model->state.attitude[0] = 1.0;
+}
+
+double model_thrust(double command) {
+    if (command < MODEL_IDLE) return 0.0; // aus bzw. unbewaffnet
+    double throttle = (command - MODEL_IDLE) / (1.0 - MODEL_IDLE);
+    uint8_t i = 1;
+    while (i < sizeof(model_curve) / sizeof(model_curve[0]) - 1 && model_curve[i][0] < throttle) ++i;
+    double fraction = (throttle - model_curve[i - 1][0]) / (model_curve[i][0] - model_curve[i - 1][0]);
+    return (model_curve[i - 1][1] + fraction * (model_curve[i][1] - model_curve[i - 1][1])) * MODEL_GRAVITY * 1e-3;
+}
+
+void model_step(model_t *model, const float command[MODEL_MOTORS], double dt) {
+    const model_parameters_t *p = &model->parameters;
+    model_state_t *s = &model->state;
+    // Totzeit
+    uint32_t delay = lround(p->delay / dt);
+    if (delay >= MODEL_DELAY_MAX) delay = MODEL_DELAY_MAX - 1;
+    for (uint8_t i = 0; i < MODEL_MOTORS; ++i) model->delayed[model->delayIndex][i] = command[i];
+    const double *delayed = model->delayed[(model->delayIndex + MODEL_DELAY_MAX - delay) % MODEL_DELAY_MAX];
+    model->delayIndex = (model->delayIndex + 1) % MODEL_DELAY_MAX;
+    // Motoren als Tiefpass erster Ordnung
+    double lag = 1.0 - exp(-dt / p->motorLag);
+    double total = 0.0, torque[3] = {0.0, 0.0, 0.0};
+    for (uint8_t i = 0; i < MODEL_MOTORS; ++i) {
+        s->thrust[i] += lag * (model_thrust(delayed[i]) - s->thrust[i]);
+        total += s->thrust[i];
+        torque[0] += model_geometry[i][1] * p->armRoll * s->thrust[i];
+        torque[1] -= model_geometry[i][0] * p->armPitch * s->thrust[i];
+        torque[2] += model_geometry[i][2] * p->torque * s->thrust[i];
+    }
+    for (uint8_t i = 0; i < 3; ++i) torque[i] *= p->effectiveness;
+    // Rotation: I dw/dt = M - w x Iw
+    const double *w = s->rates;
+    double h[3] = {p->inertia[0] * w[0], p->inertia[1] * w[1], p->inertia[2] * w[2]};
+    double gyroscopic[3] = {w[1] * h[2] - w[2] * h[1], w[2] * h[0] - w[0] * h[2], w[0] * h[1] - w[1] * h[0]};
+    for (uint8_t i = 0; i < 3; ++i) s->rates[i] += (torque[i] - gyroscopic[i]) / p->inertia[i] * dt;
+    // Lage: dq/dt = 1/2 q * (0, w)
+    double *q = s->attitude;
+    double dq[4] = {
+        0.5 * (-q[1] * w[0] - q[2] * w[1] - q[3] * w[2]),
+        0.5 * ( q[0] * w[0] + q[2] * w[2] - q[3] * w[1]),
+        0.5 * ( q[0] * w[1] - q[1] * w[2] + q[3] * w[0]),
+        0.5 * ( q[0] * w[2] + q[1] * w[1] - q[2] * w[0])
+    };
+    double norm = 0.0;
+    for (uint8_t i = 0; i < 4; ++i) {
+        q[i] += dq[i] * dt;
+        norm += q[i] * q[i];
+    }
+    norm = sqrt(norm);
+    for (uint8_t i = 0; i < 4; ++i) q[i] /= norm;
+    // Translation: Schub entlang z des Körpers, Gravitation, Luftwiderstand
+    double up[3] = { // dritte Spalte der Rotationsmatrix
+        2.0 * (q[1] * q[3] + q[0] * q[2]),
+        2.0 * (q[2] * q[3] - q[0] * q[1]),
+        1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2])
+    };
+    for (uint8_t i = 0; i < 3; ++i) {
+        double force = up[i] * total - p->drag * s->velocity[i] - ((i == 2) ? p->mass * MODEL_GRAVITY : 0.0);
+        s->velocity[i] += force / p->mass * dt;
+        s->position[i] += s->velocity[i] * dt;
+    }
+    if (s->position[2] < 0.0) { // Boden
+        s->position[2] = 0.0;
+        if (s->velocity[2] < 0.0) s->velocity[2] = 0.0;
+    }
+}
+
+void model_euler(const model_state_t *state, double euler[3]) {
+    const double *q = state->attitude;
+    double m20 = 2.0 * (q[1] * q[3] - q[0] * q[2]);
+    double m21 = 2.0 * (q[2] * q[3] + q[0] * q[1]);
+    double m22 = 1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2]);
+    double m10 = 2.0 * (q[1] * q[2] + q[0] * q[3]);
+    double m00 = 1.0 - 2.0 * (q[2] * q[2] + q[3] * q[3]);
+    euler[0] = atan2(m21, m22);
+    euler[1] = asin(fmax(-1.0, fmin(1.0, -m20)));
+    euler[2] = atan2(m10, m00);
+}
@@ -0,0 +1,103 @@
+/*
+ * File: model.h
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-04
+ * ----------------------------
+ * Starrkörpermodell eines Quadrokopters mit 6 Freiheitsgraden für die Simulation.
+ * Körpersystem x vorne, y links, z oben, Weltsystem z oben. Motoren in der Reihenfolge und
+ * Geometrie des Frames quadWide (siehe mixer.c), Schubkurve aus dem Motorprofil von main.c.
+ */
+
+
+#pragma once
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/** Variablendeklaration **/
+
+#define MODEL_MOTORS        4
+#define MODEL_DELAY_MAX     2048    // Integrationsschritte Totzeit der Motoren
+
+typedef struct {
+    double mass;            // kg
+    double inertia[3];      // kg m^2, Hauptträgheitsmomente
+    double armRoll;         // m, Abstand der Motoren quer zur Flugrichtung
+    double armPitch;        // m, Abstand der Motoren längs zur Flugrichtung
+    double torque;          // m, Reaktionsmoment pro Schub
+    double motorLag;        // s, Zeitkonstante der Motoren
+    double drag;            // N s/m, linearer Luftwiderstand
+    double effectiveness;   // Faktor auf Lagemomente, 1.0 nominal, für Amplitudenreserve
+    double delay;           // s, zusätzliche Totzeit der Motoren, für Phasenreserve
+} model_parameters_t;
+
+typedef struct {
+    double position[3];     // m, Welt
+    double velocity[3];     // m/s, Welt
+    double attitude[4];     // Quaternion Körper -> Welt, w x y z
+    double rates[3];        // rad/s, Körper
+    double thrust[MODEL_MOTORS]; // N, aktueller Schub pro Motor
+} model_state_t;
+
+typedef struct {
+    model_parameters_t parameters;
+    model_state_t state;
+    double delayed[MODEL_DELAY_MAX][MODEL_MOTORS]; // Ringpuffer der ESC-Stellwerte
+    uint32_t delayIndex;
+} model_t;
+
+
+/*
+ * Function: model_defaults
+ * ----------------------------
+ * Parameter des Referenzkopters: 750 g, 450 mm Frame, 4 x 3.6 N bei 12.6 V.
+ *
+ * model_parameters_t *parameters: Ziel
+ */
+void model_defaults(model_parameters_t *parameters);
+
+/*
+ * Function: model_reset
+ * ----------------------------
+ * Setzt den Kopter in Ruhe auf den Ursprung, Motoren aus.
+ *
+ * model_t *model: Modell
+ */
+void model_reset(model_t *model);
+
+/*
+ * Function: model_step
+ * ----------------------------
+ * Integriert das Modell über einen Zeitschritt (semi-implizit Euler).
+ *
+ * model_t *model: Modell
+ * const float command[MODEL_MOTORS]: ESC-Stellwerte 0.0 (aus) bis 1.0, wie shim_motor
+ * double dt: s, Zeitschritt, Totzeit wird in ganzen Schritten umgesetzt
+ */
+void model_step(model_t *model, const float command[MODEL_MOTORS], double dt);
+
+/*
+ * Function: model_thrust
+ * ----------------------------
+ * Statischer Schub eines Motors.
+ *
+ * double command: ESC-Stellwert 0.0 (aus) bis 1.0
+ *
+ * returns: N
+ */
+double model_thrust(double command);
+
+/*
+ * Function: model_euler
+ * ----------------------------
+ * Eulerwinkel (ZYX) der Lage, wie bno_rotationUpdate.
+ *
+ * const model_state_t *state: Zustand
+ * double euler[3]: Ziel, Roll, Pitch, Heading in rad
+ */
+void model_euler(const model_state_t *state, double euler[3]);
@@ -0,0 +1,580 @@
+/*
+ * File: shim.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-04
+ * ----------------------------
+ * Ersatz für FreeRTOS und ESP-IDF, damit die Regelung unverändert auf Linux läuft.
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <pthread.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "driver/ledc.h"
+#include "driver/rmt.h"
+
+
+/** Interne Abhängigkeiten **/
+
+#include "esc.h"
+#include "shim.h"
+
+
+/** Variablendeklaration **/
+
+#define SHIM_QUEUES     8
+#define SHIM_TIMERS     4
+#define SHIM_NVS        64
+#define SHIM_SPACES     8
+#define SHIM_NAME       16
+
+struct shim_queue {
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint32_t waiting;       // blockierte Empfänger
+};
+
+struct shim_task {
+    pthread_t thread;
+    TaskFunction_t function;
+    void *arg;
+};
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    uint64_t period;        // us
+    int64_t next;           // us, nächste Auslösung
+    bool active;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint32_t running;       // Tasks die gerade rechnen
+    int64_t time;           // us, Simulationszeit
+    esp_log_level_t logLevel;
+    struct shim_queue queues[SHIM_QUEUES];
+    uint8_t queueCount;
+    struct esp_timer timers[SHIM_TIMERS];
+    uint8_t timerCount;
+    struct {
+        uint32_t frequency;             // Hz, 0 -> RMT
+        uint32_t resolution;            // Bits
+        uint32_t clock[SHIM_MOTORS];    // Hz, RMT-Takt pro Kanal
+        uint32_t duty[SHIM_MOTORS];
+        rmt_item32_t items[SHIM_MOTORS][ESC_ITEMS];
+        float value[SHIM_MOTORS];
+    } motors;
+    struct {
+        struct timespec start;          // CPU-Zeit beim Aufwachen der Task
+        shim_load_t load;
+    } cpu;
+    struct {
+        char space[SHIM_NAME];
+        char key[SHIM_NAME];
+        size_t length;
+        uint8_t *data;
+    } nvs[SHIM_NVS];
+    uint8_t nvsCount;
+    const char *spaces[SHIM_SPACES];
+    uint8_t spaceCount;
+} shim = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .changed = PTHREAD_COND_INITIALIZER,
+    .logLevel = ESP_LOG_WARN
+};
+
+
+/** Private Functions **/
+
+/*
+ * Function: shim_taskMain
+ * ----------------------------
+ * Einstieg der Threads, ruft die Funktion der Task auf.
+ *
+ * void *arg: struct shim_task
+ */
+static void *shim_taskMain(void *arg);
+
+/*
+ * Function: shim_idle
+ * ----------------------------
+ * Prüft ob alle Tasks blockieren und keine Events mehr anstehen. Nur mit shim.lock aufrufen.
+ *
+ * returns: true -> Simulation darf weiterrechnen
+ */
+static bool shim_idle();
+
+/*
+ * Function: shim_push
+ * ----------------------------
+ * Legt ein Element in eine Queue. Nur mit shim.lock aufrufen.
+ *
+ * QueueHandle_t queue: Queue
+ * const void *item: Element
+ * bool front: vorne statt hinten anfügen
+ *
+ * returns: pdTRUE -> Erfolg, pdFALSE -> Queue voll
+ */
+static BaseType_t shim_push(QueueHandle_t queue, const void *item, bool front);
+
+/*
+ * Function: shim_nvsFind
+ * ----------------------------
+ * Sucht einen Eintrag im flüchtigen NVS.
+ *
+ * const char *space: Namensraum
+ * const char *key: Schlüssel
+ *
+ * returns: Index, shim.nvsCount falls nicht vorhanden
+ */
+static uint8_t shim_nvsFind(const char *space, const char *key);
+
+/*
+ * Function: shim_nvsKey
+ * ----------------------------
+ * Prüft die Länge eines Schlüssels wie ESP-IDF, max. 15 Zeichen. Meldet zu lange Schlüssel.
+ *
+ * const char *key: Schlüssel
+ *
+ * returns: false -> gültig, true -> zu lang
+ */
+static bool shim_nvsKey(const char *key);
+
+/*
+ * Function: shim_nvsStore
+ * ----------------------------
+ * Speichert einen Eintrag im flüchtigen NVS.
+ *
+ * const char *space: Namensraum
+ * const char *key: Schlüssel
+ * const void *data: Daten
+ * size_t length: Länge in Bytes
+ *
+ * returns: ESP_OK, ESP_ERR_NVS_KEY_TOO_LONG oder ESP_FAIL
+ */
+static esp_err_t shim_nvsStore(const char *space, const char *key, const void *data, size_t length);
+
+
+/** Implementierung Simulation **/
+
+void shim_logLevel(esp_log_level_t level) {
+    shim.logLevel = level;
+}
+
+void shim_log(esp_log_level_t level, const char *tag, const char *format, ...) {
+    if (level > shim.logLevel) return;
+    static const char letters[] = "NEWIDV";
+    fprintf(stderr, "%c (%.3f s) %s: ", letters[level], shim.time * 1e-6, tag);
+    va_list arguments;
+    va_start(arguments, format);
+    vfprintf(stderr, format, arguments);
+    va_end(arguments);
+    fputc('\n', stderr);
+}
+
+void shim_advance(int64_t time) {
+    while (true) {
+        pthread_mutex_lock(&shim.lock);
+        struct esp_timer *due = NULL;
+        for (uint8_t i = 0; i < shim.timerCount; ++i) {
+            struct esp_timer *timer = &shim.timers[i];
+            if (timer->active && timer->next <= time && (!due || timer->next < due->next)) due = timer;
+        }
+        if (!due) {
+            shim.time = time;
+            pthread_mutex_unlock(&shim.lock);
+            return;
+        }
+        shim.time = due->next;
+        due->next += due->period;
+        pthread_mutex_unlock(&shim.lock);
+        due->callback(due->arg); // wie ESP_TIMER_TASK ausserhalb der Tasks
+        shim_settle();
+    }
+}
+
+void shim_settle() {
+    pthread_mutex_lock(&shim.lock);
+    while (!shim_idle()) pthread_cond_wait(&shim.changed, &shim.lock);
+    pthread_mutex_unlock(&shim.lock);
+}
+
+float shim_motor(uint8_t channel) {
+    return (channel < SHIM_MOTORS) ? shim.motors.value[channel] : 0.0f;
+}
+
+uint32_t shim_motorPeriod() {
+    return shim.motors.frequency ? 1000000 / shim.motors.frequency : 0;
+}
+
+void shim_load(shim_load_t *load) {
+    pthread_mutex_lock(&shim.lock);
+    *load = shim.cpu.load;
+    memset(&shim.cpu.load, 0, sizeof(shim.cpu.load));
+    pthread_mutex_unlock(&shim.lock);
+}
+
+void shim_nvsSet(const char *space, const char *key, uint32_t value) {
+    shim_nvsStore(space, key, &value, sizeof(value));
+}
+
+
+/** Implementierung FreeRTOS **/
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    struct shim_task *task = malloc(sizeof(struct shim_task));
+    if (!task) return pdFALSE;
+    task->function = function;
+    task->arg = arg;
+    pthread_mutex_lock(&shim.lock);
+    ++shim.running; // vor dem Start zählen, damit shim_settle auf das erste Blockieren wartet
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &shim.cpu.start);
+    pthread_mutex_unlock(&shim.lock);
+    if (pthread_create(&task->thread, NULL, &shim_taskMain, task)) {
+        pthread_mutex_lock(&shim.lock);
+        --shim.running;
+        pthread_mutex_unlock(&shim.lock);
+        free(task);
+        return pdFALSE;
+    }
+    if (handle) *handle = task;
+    return pdTRUE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    pthread_mutex_lock(&shim.lock);
+    QueueHandle_t queue = NULL;
+    if (shim.queueCount < SHIM_QUEUES) {
+        queue = &shim.queues[shim.queueCount++];
+        queue->items = calloc(length, itemSize);
+        queue->length = length;
+        queue->size = itemSize;
+    }
+    pthread_mutex_unlock(&shim.lock);
+    return queue;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t wait) {
+    if (!queue) return pdFALSE;
+    pthread_mutex_lock(&shim.lock);
+    BaseType_t ret = shim_push(queue, item, false);
+    pthread_mutex_unlock(&shim.lock);
+    return ret;
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t wait) {
+    if (!queue) return pdFALSE;
+    pthread_mutex_lock(&shim.lock);
+    BaseType_t ret = shim_push(queue, item, true);
+    pthread_mutex_unlock(&shim.lock);
+    return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait) {
+    if (!queue) return pdFALSE;
+    pthread_mutex_lock(&shim.lock);
+    while (!queue->count) {
+        if (!wait) {
+            pthread_mutex_unlock(&shim.lock);
+            return pdFALSE;
+        }
+        // Rechenphase abschliessen und an Simulation abgeben
+        struct timespec now;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        uint64_t busy = (now.tv_sec - shim.cpu.start.tv_sec) * 1000000000ULL + now.tv_nsec - shim.cpu.start.tv_nsec;
+        shim.cpu.load.total += busy;
+        if (busy > shim.cpu.load.max) shim.cpu.load.max = busy;
+        ++shim.cpu.load.count;
+        ++queue->waiting;
+        --shim.running;
+        pthread_cond_broadcast(&shim.changed);
+        while (!queue->count) pthread_cond_wait(&shim.changed, &shim.lock);
+        ++shim.running;
+        --queue->waiting;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &shim.cpu.start);
+    }
+    memcpy(item, queue->items + queue->head * queue->size, queue->size);
+    queue->head = (queue->head + 1) % queue->length;
+    --queue->count;
+    pthread_mutex_unlock(&shim.lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    if (!queue) return pdFALSE;
+    pthread_mutex_lock(&shim.lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_mutex_unlock(&shim.lock);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    if (!queue) return 0;
+    pthread_mutex_lock(&shim.lock);
+    UBaseType_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&shim.lock);
+    return spaces;
+}
+
+
+/** Implementierung ESP-IDF **/
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    ;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+    pthread_mutex_lock(&shim.lock);
+    esp_err_t ret = ESP_FAIL;
+    if (shim.timerCount < SHIM_TIMERS) {
+        struct esp_timer *timer = &shim.timers[shim.timerCount++];
+        timer->callback = args->callback;
+        timer->arg = args->arg;
+        *handle = timer;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&shim.lock);
+    return ret;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    if (!period) return ESP_FAIL;
+    pthread_mutex_lock(&shim.lock);
+    timer->period = period;
+    timer->next = shim.time + period;
+    timer->active = true;
+    pthread_mutex_unlock(&shim.lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&shim.lock);
+    timer->active = false;
+    pthread_mutex_unlock(&shim.lock);
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void) {
+    return shim.time; // steht während eine Task rechnet
+}
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    pthread_mutex_lock(&shim.lock);
+    for (uint8_t i = 0; i < shim.nvsCount; ++i) free(shim.nvs[i].data);
+    shim.nvsCount = 0;
+    pthread_mutex_unlock(&shim.lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode mode, nvs_handle *handle) {
+    // Handle ist der Index des Namensraums plus 1, Namen sind statische Strings der Module
+    pthread_mutex_lock(&shim.lock);
+    uint8_t i = 0;
+    while (i < shim.spaceCount && strcmp(shim.spaces[i], name)) ++i;
+    if (i == shim.spaceCount && shim.spaceCount < SHIM_SPACES) shim.spaces[shim.spaceCount++] = name;
+    pthread_mutex_unlock(&shim.lock);
+    if (i == SHIM_SPACES) return ESP_FAIL;
+    *handle = i + 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle handle) {
+    ;
+}
+
+esp_err_t nvs_commit(nvs_handle handle) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *value) {
+    size_t length = sizeof(*value);
+    esp_err_t err = nvs_get_blob(handle, key, value, &length);
+    if (!err && length != sizeof(*value)) err = ESP_ERR_NVS_NOT_FOUND;
+    return err;
+}
+
+esp_err_t nvs_set_u32(nvs_handle handle, const char *key, uint32_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *value, size_t *length) {
+    if (!handle || handle > shim.spaceCount) return ESP_ERR_NVS_NOT_FOUND;
+    if (shim_nvsKey(key)) return ESP_ERR_NVS_KEY_TOO_LONG;
+    const char *space = shim.spaces[handle - 1];
+    pthread_mutex_lock(&shim.lock);
+    uint8_t i = shim_nvsFind(space, key);
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    if (i < shim.nvsCount) {
+        if (*length < shim.nvs[i].length) {
+            err = ESP_ERR_NVS_INVALID_LENGTH;
+        } else {
+            memcpy(value, shim.nvs[i].data, shim.nvs[i].length);
+            *length = shim.nvs[i].length;
+            err = ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&shim.lock);
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length) {
+    if (!handle || handle > shim.spaceCount) return ESP_FAIL;
+    const char *space = shim.spaces[handle - 1];
+    return shim_nvsStore(space, key, value, length);
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config) {
+    shim.motors.frequency = config->freq_hz;
+    shim.motors.resolution = config->duty_resolution;
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config) {
+    if (config->channel >= SHIM_MOTORS) return ESP_FAIL;
+    ledc_set_duty(config->speed_mode, config->channel, config->duty);
+    return ledc_update_duty(config->speed_mode, config->channel);
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty) {
+    if (channel >= SHIM_MOTORS) return ESP_FAIL;
+    shim.motors.duty[channel] = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel) {
+    if (channel >= SHIM_MOTORS || !shim.motors.frequency) return ESP_FAIL;
+    // Puls 1 ms (aus) bis 2 ms (voll)
+    float pulse = (float)shim.motors.duty[channel] / ((1UL << shim.motors.resolution) - 1) * 1e6f / shim.motors.frequency;
+    float value = (pulse - 1000.0f) / 1000.0f;
+    shim.motors.value[channel] = (value < 0.0f) ? 0.0f : (value > 1.0f) ? 1.0f : value;
+    return ESP_OK;
+}
+
+esp_err_t rmt_config(const rmt_config_t *config) {
+    if (config->channel >= SHIM_MOTORS || !config->clk_div) return ESP_FAIL;
+    shim.motors.frequency = 0;
+    shim.motors.clock[config->channel] = APB_CLK_FREQ / config->clk_div;
+    return ESP_OK;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rxBufferSize, int interruptFlags) {
+    return (channel < SHIM_MOTORS) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t rmt_fill_tx_items(rmt_channel_t channel, const rmt_item32_t *items, uint16_t count, uint16_t offset) {
+    if (channel >= SHIM_MOTORS || offset + count > ESC_ITEMS) return ESP_FAIL;
+    memcpy(&shim.motors.items[channel][offset], items, count * sizeof(rmt_item32_t));
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_start(rmt_channel_t channel, bool resetIndex) {
+    if (channel >= SHIM_MOTORS || !shim.motors.clock[channel]) return ESP_FAIL;
+    const rmt_item32_t *items = shim.motors.items[channel];
+    float value;
+    if (!items[1].val) { // OneShot125, ein Puls von 125 bis 250 us
+        float pulse = items[0].duration0 * 1e6f / shim.motors.clock[channel];
+        value = (pulse - ESC_ONESHOT_MIN) / (ESC_ONESHOT_MAX - ESC_ONESHOT_MIN);
+    } else { // DShot, 16 Bits, 1 mit langem High-Anteil
+        uint16_t frame = 0;
+        for (uint8_t i = 0; i < ESC_DSHOT_BITS; ++i) {
+            frame = frame << 1 | (items[i].duration0 > items[i].duration1);
+        }
+        uint16_t dshot = frame >> 5;
+        value = (dshot < ESC_DSHOT_MIN) ? 0.0f : (float)(dshot - ESC_DSHOT_MIN) / (ESC_DSHOT_MAX - ESC_DSHOT_MIN);
+    }
+    shim.motors.value[channel] = (value < 0.0f) ? 0.0f : (value > 1.0f) ? 1.0f : value;
+    return ESP_OK;
+}
+
+
+/** Implementierung privat **/
+
+static void *shim_taskMain(void *arg) {
+    struct shim_task *task = arg;
+    task->function(task->arg);
+    pthread_mutex_lock(&shim.lock); // Task beendet
+    --shim.running;
+    pthread_cond_broadcast(&shim.changed);
+    pthread_mutex_unlock(&shim.lock);
+    return NULL;
+}
+
+static bool shim_idle() {
+    if (shim.running) return false;
+    for (uint8_t i = 0; i < shim.queueCount; ++i) {
+        if (shim.queues[i].waiting && shim.queues[i].count) return false; // Empfänger wacht gleich auf
+    }
+    return true;
+}
+
+static BaseType_t shim_push(QueueHandle_t queue, const void *item, bool front) {
+    if (queue->count >= queue->length) return pdFALSE;
+    UBaseType_t index;
+    if (front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        index = queue->head;
+    } else {
+        index = (queue->head + queue->count) % queue->length;
+    }
+    memcpy(queue->items + index * queue->size, item, queue->size);
+    ++queue->count;
+    pthread_cond_broadcast(&shim.changed);
+    return pdTRUE;
+}
+
+static uint8_t shim_nvsFind(const char *space, const char *key) {
+    uint8_t i = 0;
+    while (i < shim.nvsCount && (strcmp(shim.nvs[i].space, space) || strcmp(shim.nvs[i].key, key))) ++i;
+    return i;
+}
+
+static bool shim_nvsKey(const char *key) {
+    if (strlen(key) < SHIM_NAME) return false;
+    shim_log(ESP_LOG_ERROR, "nvs", "key '%s' longer than %d characters", key, SHIM_NAME - 1);
+    return true;
+}
+
+static esp_err_t shim_nvsStore(const char *space, const char *key, const void *data, size_t length) {
+    if (shim_nvsKey(key)) return ESP_ERR_NVS_KEY_TOO_LONG;
+    pthread_mutex_lock(&shim.lock);
+    esp_err_t err = ESP_FAIL;
+    uint8_t i = shim_nvsFind(space, key);
+    if (i == shim.nvsCount && shim.nvsCount < SHIM_NVS) {
+        ++shim.nvsCount;
+        strncpy(shim.nvs[i].space, space, SHIM_NAME - 1);
+        strncpy(shim.nvs[i].key, key, SHIM_NAME - 1);
+        shim.nvs[i].data = NULL;
+    }
+    if (i < shim.nvsCount) {
+        uint8_t *copy = realloc(shim.nvs[i].data, length);
+        if (copy) {
+            memcpy(copy, data, length);
+            shim.nvs[i].data = copy;
+            shim.nvs[i].length = length;
+            err = ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&shim.lock);
+    return err;
+}
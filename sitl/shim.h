@@ -0,0 +1,99 @@
+/*
+ * File: shim.h
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-04
+ * ----------------------------
+ * Ersatz für FreeRTOS und ESP-IDF, damit die Regelung unverändert auf Linux läuft.
+ * Tasks sind Threads, rechnen aber nie gleichzeitig mit der Simulation: shim_advance löst fällige
+ * Timer aus und wartet bis alle Tasks wieder in xQueueReceive blockieren. So ist der Ablauf
+ * deterministisch und die Simulation schneller als Echtzeit.
+ */
+
+
+#pragma once
+
+
+/** Externe Abhängigkeiten **/
+
+#include "esp_system.h"
+#include "esp_log.h"
+
+
+/** Variablendeklaration **/
+
+#define SHIM_MOTORS     8
+
+typedef struct {
+    uint64_t total;     // ns CPU-Zeit der Tasks
+    uint64_t max;       // ns längste Rechenphase
+    uint32_t count;     // Rechenphasen, von Aufwachen bis erneutem Blockieren
+} shim_load_t;
+
+
+/*
+ * Function: shim_logLevel
+ * ----------------------------
+ * Setzt die Stufe bis zu der ESP_LOGx ausgegeben wird.
+ *
+ * esp_log_level_t level: Stufe
+ */
+void shim_logLevel(esp_log_level_t level);
+
+/*
+ * Function: shim_advance
+ * ----------------------------
+ * Rückt die Simulationszeit vor. Fällige Timer werden in zeitlicher Reihenfolge ausgelöst,
+ * nach jedem wird gewartet bis die Tasks ihre Events abgearbeitet haben.
+ *
+ * int64_t time: us, neue Simulationszeit
+ */
+void shim_advance(int64_t time);
+
+/*
+ * Function: shim_settle
+ * ----------------------------
+ * Wartet bis alle Tasks blockieren und keine Events mehr anstehen. Nach direkten Intercom-Aufrufen
+ * der Simulation (Befehle, Parameter) aufrufen.
+ */
+void shim_settle();
+
+/*
+ * Function: shim_motor
+ * ----------------------------
+ * Zuletzt an einen Motor gesendeter Wert, dekodiert aus PWM-Duty, OneShot125- oder DShot-Pulsfolge.
+ *
+ * uint8_t channel: LEDC- bzw. RMT-Kanal
+ *
+ * returns: Stellwert des ESC von 0.0 (aus) bis 1.0
+ */
+float shim_motor(uint8_t channel);
+
+/*
+ * Function: shim_motorPeriod
+ * ----------------------------
+ * Periode nach der ein ESC neue Werte übernimmt.
+ *
+ * returns: us, PWM-Periode bei LEDC, 0 bei RMT (sofort)
+ */
+uint32_t shim_motorPeriod();
+
+/*
+ * Function: shim_load
+ * ----------------------------
+ * Rechenzeit der Tasks seit dem letzten Aufruf, setzt die Statistik zurück.
+ *
+ * shim_load_t *load: Ziel
+ */
+void shim_load(shim_load_t *load);
+
+/*
+ * Function: shim_nvsSet
+ * ----------------------------
+ * Belegt den flüchtigen NVS vor, z.B. mit Einstellungen vor dem Registrieren bei Intercom.
+ *
+ * const char *space: Namensraum, entspricht dem Task
+ * const char *key: Schlüssel, entspricht dem Namen der Einstellung
+ * uint32_t value: Wert
+ */
+void shim_nvsSet(const char *space, const char *key, uint32_t value);
@@ -0,0 +1,570 @@
+/*
+ * File: sitl.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-04
+ * ----------------------------
+ * Software-in-the-Loop: die unveränderte Regelung (control.c, mixer.c, esc.c, thrust.c, tune.c) und
+ * Orientierungsberechnung (rotation.c) gegen ein Starrkörpermodell mit Motorverzögerung, Sensorrauschen
+ * und Latenz. Schneller als Echtzeit und deterministisch, als Benchmark für jede Änderung der Regelung.
+ *
+ * Aufruf: ./sitl [-s settings.txt] [-m] [-o trace.csv] [-r seed] [-v]
+ *  -s  Einstellungen von control, eine pro Zeile "name wert", Floats mit Dezimalpunkt
+ *  -m  Amplituden- und Phasenreserve per Bisektion bestimmen (dauert einige Sekunden)
+ *  -o  Verlauf als CSV für Plots, eine Zeile pro Regelzyklus
+ *  -r  Seed des Sensorrauschens
+ *  -v  Logs von control ausgeben, mehrfach für Debug
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_timer.h"
+
+
+/** Interne Abhängigkeiten **/
+
+#include "intercom.h"
+#include "resources.h"
+#include "sensor_types.h"
+#include "sensors.h"
+#include "bno.h"
+#include "control.h"
+#include "shim.h"
+#include "model.h"
+
+
+/** Compiler Einstellungen **/
+
+#define SITL_STEP               100     // us, Integrationsschritt des Modells
+#define SITL_SENSOR_PERIOD      2500    // us, Orientierung und Gyro mit 400 Hz wie bewaffnet
+#define SITL_SENSOR_DELAY       3000    // us, Messung bis Verfügbarkeit im Navigationszustand
+#define SITL_SENSOR_SAMPLES     32      // Ringpuffer, muss Latenz abdecken
+#define SITL_NOISE_GYRO         0.005f  // rad/s, Standardabweichung
+#define SITL_NOISE_ANGLE        0.002f  // rad, Standardabweichung pro Achse
+#define SITL_PILOT_PERIOD       20000   // us, Sollwerte mit 50 Hz wie remote
+#define SITL_HEIGHT             1.0     // m, Schwebehöhe
+#define SITL_SETTINGS_MAX       64
+#define SITL_SETTLE_BAND        0.05    // Anteil der Sprunghöhe
+#define SITL_UNSTABLE_RATE      0.3     // rad/s, RMS der Drehrate in der letzten Sekunde
+#define SITL_BISECTIONS         8
+
+
+/** Variablendeklaration **/
+
+typedef struct {
+    int64_t time;           // us, Simulationszeit relativ zum Versuchsbeginn
+    control_parameter_t parameter;
+    float value;
+} sitl_event_t;
+
+typedef struct {
+    const char *name;
+    control_parameter_t parameter;
+    int64_t start;          // us
+    int64_t end;            // us, nächstes Ereignis
+    float from;
+    float to;
+} sitl_step_t;
+
+typedef struct {
+    float rise;             // s, 10 % bis 90 %
+    float overshoot;        // Anteil der Sprunghöhe
+    float settling;         // s, bis dauerhaft im Band von SITL_SETTLE_BAND
+    float error;            // rad, mittlere Abweichung der letzten 0.5 s
+} sitl_metrics_t;
+
+static const sitl_event_t sitl_scenario[] = { // Sprünge der Sollwerte, je 2 s halten
+    {1000000, CONTROL_PARAMETER_SETPOINT_ROLL, 0.2f},
+    {3000000, CONTROL_PARAMETER_SETPOINT_ROLL, 0.0f},
+    {5000000, CONTROL_PARAMETER_SETPOINT_PITCH, 0.2f},
+    {7000000, CONTROL_PARAMETER_SETPOINT_PITCH, 0.0f},
+    {9000000, CONTROL_PARAMETER_SETPOINT_HEADING, 0.5f},
+    {11000000, CONTROL_PARAMETER_SETPOINT_HEADING, 0.0f}
+};
+
+#define SITL_SCENARIO_LENGTH    (sizeof(sitl_scenario) / sizeof(sitl_scenario[0]))
+#define SITL_SCENARIO_END       13000000 // us
+#define SITL_TRIAL_DURATION     4000000 // us, Versuch der Stabilitätsreserven
+#define SITL_TRIAL_KICK         500000  // us, Störung mit Sollwinkel
+#define SITL_HISTORY            (SITL_SCENARIO_END / SITL_STEP)
+
+static struct {
+    model_t model;
+    struct {
+        sensors_event_t orientation[SITL_SENSOR_SAMPLES];
+        sensors_event_t rates[SITL_SENSOR_SAMPLES];
+        uint32_t head;              // nächster Schreibplatz
+        int64_t next;               // us, nächste Messung
+        sensors_state_t state;      // von sensors_stateGet gelesen
+        uint64_t random;            // xorshift
+    } sensors;
+    struct {
+        float command[MODEL_MOTORS];
+        int64_t next;               // us, nächste Übernahme durch den ESC
+    } motors;
+    struct {
+        float throttle;
+        float integral;
+        int64_t next;
+    } pilot;
+    struct {
+        char name[16];
+        char value[32];
+    } settings[SITL_SETTINGS_MAX];
+    uint8_t settingCount;
+    int64_t start;                  // us, Simulationszeit bei Versuchsbeginn
+    float *history[3];              // Eulerwinkel pro Integrationsschritt
+    FILE *trace;
+} sitl;
+
+
+/** Private Functions **/
+
+/*
+ * Function: sitl_settingsLoad
+ * ----------------------------
+ * Liest Einstellungen und belegt den NVS vor, damit auch Einstellungen gelten die control_init
+ * bereits beim Start verwendet (motorProtocol, frame, loopRate).
+ *
+ * const char *file: Pfad
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+static bool sitl_settingsLoad(const char *file);
+
+/*
+ * Function: sitl_settingsApply
+ * ----------------------------
+ * Setzt alle gelesenen Einstellungen per Intercom mit dem richtigen Typ.
+ *
+ * returns: false -> Erfolg, true -> Error (unbekannte Einstellung)
+ */
+static bool sitl_settingsApply();
+
+/*
+ * Function: sitl_trialStart
+ * ----------------------------
+ * Entwaffnet, setzt Modell und Sollwerte zurück und bewaffnet wieder. Der Kopter schwebt mit
+ * Schwebeschub auf SITL_HEIGHT.
+ */
+static void sitl_trialStart();
+
+/*
+ * Function: sitl_run
+ * ----------------------------
+ * Simuliert ab dem aktuellen Versuchsbeginn bis zu einer Zeit.
+ *
+ * int64_t end: us, relativ zum Versuchsbeginn
+ * const sitl_event_t *events: Sollwertsprünge, zeitlich sortiert
+ * uint32_t count: Anzahl Sprünge
+ *
+ * returns: RMS der Drehraten in der letzten Sekunde, INFINITY falls entwaffnet
+ */
+static double sitl_run(int64_t end, const sitl_event_t *events, uint32_t count);
+
+/*
+ * Function: sitl_sensors
+ * ----------------------------
+ * Misst das Modell mit Rauschen und stellt die um die Latenz verzögerte Messung bereit.
+ *
+ * int64_t now: us, Simulationszeit
+ */
+static void sitl_sensors(int64_t now);
+
+/*
+ * Function: sitl_pilot
+ * ----------------------------
+ * Hält die Höhe über den Throttle-Parameter, wie ein Pilot über remote.
+ *
+ * int64_t now: us, Simulationszeit
+ */
+static void sitl_pilot(int64_t now);
+
+/*
+ * Function: sitl_parameter
+ * ----------------------------
+ * Setzt einen Float-Parameter von control, wie remote direkt im Speicher der Task.
+ *
+ * control_parameter_t parameter: Parameter
+ * float value: Wert
+ */
+static void sitl_parameter(control_parameter_t parameter, float value);
+
+/*
+ * Function: sitl_metrics
+ * ----------------------------
+ * Kennwerte einer Sprungantwort aus dem aufgezeichneten Verlauf.
+ *
+ * const sitl_step_t *step: Sprung
+ * sitl_metrics_t *metrics: Ziel
+ */
+static void sitl_metrics(const sitl_step_t *step, sitl_metrics_t *metrics);
+
+/*
+ * Function: sitl_margin
+ * ----------------------------
+ * Sucht per Bisektion die Grenze eines Modellparameters ab der die Regelung instabil wird.
+ *
+ * double *parameter: zu variierender Modellparameter, danach wieder nominal
+ * double low: stabiler Wert
+ * double high: obere Grenze der Suche
+ *
+ * returns: grösster stabiler Wert, high falls bis dahin stabil, NAN falls low bereits instabil
+ */
+static double sitl_margin(double *parameter, double low, double high);
+
+/*
+ * Function: sitl_gaussian
+ * ----------------------------
+ * Normalverteilte Zufallszahl (Box-Muller) aus reproduzierbarem xorshift.
+ *
+ * returns: Standardnormalverteilt
+ */
+static float sitl_gaussian();
+
+
+/** Implementierung **/
+
+int main(int argc, char *argv[]) {
+    const char *settings = "settings.txt";
+    const char *trace = NULL;
+    bool margins = false;
+    esp_log_level_t level = ESP_LOG_WARN;
+    sitl.sensors.random = 88172645463325252ULL;
+    int option;
+    while ((option = getopt(argc, argv, "s:mo:r:vh")) != -1) {
+        switch (option) {
+            case ('s'): settings = optarg; break;
+            case ('m'): margins = true; break;
+            case ('o'): trace = optarg; break;
+            case ('r'): sitl.sensors.random ^= strtoull(optarg, NULL, 0) * 0x9e3779b97f4a7c15ULL; break;
+            case ('v'): if (level < ESP_LOG_VERBOSE) ++level; break;
+            default:
+                fprintf(stderr, "usage: %s [-s settings.txt] [-m] [-o trace.csv] [-r seed] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+    shim_logLevel(level);
+    if (sitl_settingsLoad(settings)) return 1;
+    if (trace && !(sitl.trace = fopen(trace, "w"))) {
+        fprintf(stderr, "can't open %s\n", trace);
+        return 1;
+    }
+    for (uint8_t i = 0; i < 3; ++i) sitl.history[i] = malloc(SITL_HISTORY * sizeof(float));
+    model_defaults(&sitl.model.parameters);
+    // Regelung wie in main.c starten, Pins ohne Bedeutung
+    static const gpio_num_t motors[MODEL_MOTORS] = {GPIO_NUM_0, GPIO_NUM_0, GPIO_NUM_0, GPIO_NUM_0};
+    if (control_init(motors, MODEL_MOTORS)) {
+        fprintf(stderr, "control_init failed\n");
+        return 1;
+    }
+    shim_settle();
+    if (sitl_settingsApply()) return 1;
+    // Sprungantworten
+    struct timespec wallStart, wallEnd;
+    clock_gettime(CLOCK_MONOTONIC, &wallStart);
+    shim_load_t load;
+    shim_load(&load); // Start nicht mitzählen
+    sitl_trialStart();
+    double rms = sitl_run(SITL_SCENARIO_END, sitl_scenario, SITL_SCENARIO_LENGTH);
+    shim_load(&load);
+    clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+    double wall = (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) * 1e-9;
+    if (sitl.trace) fclose(sitl.trace);
+    printf("step response (%s)\n", settings);
+    printf("  %-14s %8s %10s %10s %10s\n", "step", "rise s", "overshoot", "settle s", "error rad");
+    float last[3] = {0.0f, 0.0f, 0.0f};
+    for (uint32_t i = 0; i < SITL_SCENARIO_LENGTH; ++i) {
+        const sitl_event_t *event = &sitl_scenario[i];
+        uint8_t axis = event->parameter - CONTROL_PARAMETER_SETPOINT_ROLL;
+        static const char *names[3] = {"roll", "pitch", "heading"};
+        sitl_step_t step = {
+            .name = names[axis],
+            .parameter = event->parameter,
+            .start = event->time,
+            .end = (i + 1 < SITL_SCENARIO_LENGTH) ? sitl_scenario[i + 1].time : SITL_SCENARIO_END,
+            .from = last[axis],
+            .to = event->value
+        };
+        last[axis] = event->value;
+        sitl_metrics_t metrics;
+        sitl_metrics(&step, &metrics);
+        char label[32];
+        snprintf(label, sizeof(label), "%s %+.2f", step.name, step.to - step.from);
+        printf("  %-14s %8.3f %9.1f%% %10.3f %10.4f\n", label, metrics.rise, metrics.overshoot * 100.0f,
+               metrics.settling, metrics.error);
+    }
+    printf("  %s, body rate rms %.3f rad/s over the last second\n", isinf(rms) ? "DISARMED" : "armed", rms);
+    printf("control task\n");
+    printf("  cpu %.2f us mean, %.2f us max per wakeup (%u wakeups, host)\n",
+           load.count ? load.total * 1e-3 / load.count : 0.0, load.max * 1e-3, load.count);
+    printf("  %.1f s simulated in %.3f s, %.0fx real time\n", SITL_SCENARIO_END * 1e-6, wall, SITL_SCENARIO_END * 1e-6 / wall);
+    if (margins) { // Reserven des geschlossenen Kreises über Lagemomente und Totzeit der Motoren
+        double gain = sitl_margin(&sitl.model.parameters.effectiveness, 1.0, 64.0);
+        double delay = sitl_margin(&sitl.model.parameters.delay, 0.0, 0.15);
+        printf("stability margins\n");
+        if (isnan(gain)) printf("  gain   unstable at nominal gain\n");
+        else printf("  gain   %s%.1f dB (torque x %.2f)\n", (gain >= 64.0) ? ">" : "", 20.0 * log10(gain), gain);
+        if (isnan(delay)) printf("  delay  unstable at nominal delay\n");
+        else printf("  delay  %s%.1f ms additional motor delay\n", (delay >= 0.15) ? ">" : "", delay * 1e3);
+    }
+    return isinf(rms) || rms > SITL_UNSTABLE_RATE;
+}
+
+void sensors_stateGet(sensors_state_t *state) {
+    *state = sitl.sensors.state;
+}
+
+static bool sitl_settingsLoad(const char *file) {
+    FILE *f = fopen(file, "r");
+    if (!f) {
+        fprintf(stderr, "can't open %s\n", file);
+        return true;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        char name[16], value[32];
+        if (sscanf(line, "%15s %31s", name, value) != 2) continue;
+        if (sitl.settingCount >= SITL_SETTINGS_MAX) break;
+        strcpy(sitl.settings[sitl.settingCount].name, name);
+        strcpy(sitl.settings[sitl.settingCount].value, value);
+        ++sitl.settingCount;
+        // Typ noch unbekannt, mit Dezimalpunkt als Float
+        value_t v;
+        if (strpbrk(value, ".eE")) v.f = strtof(value, NULL);
+        else v.ui = strtoul(value, NULL, 0);
+        shim_nvsSet("control", name, v.ui);
+    }
+    fclose(f);
+    return false;
+}
+
+static bool sitl_settingsApply() {
+    for (uint8_t i = 0; i < sitl.settingCount; ++i) {
+        uint32_t setting = 0;
+        const char *name;
+        while ((name = intercom_settingNameSetting(0, setting)) && strcmp(name, sitl.settings[i].name)) ++setting;
+        if (!name) {
+            fprintf(stderr, "unknown setting %s\n", sitl.settings[i].name);
+            return true;
+        }
+        value_t value;
+        switch (intercom_settingType(xControl, setting)) {
+            case (VALUE_TYPE_FLOAT): value.f = strtof(sitl.settings[i].value, NULL); break;
+            case (VALUE_TYPE_INT): value.i = strtol(sitl.settings[i].value, NULL, 0); break;
+            default: value.ui = strtoul(sitl.settings[i].value, NULL, 0); break;
+        }
+        if (intercom_settingSet(xControl, setting, &value)) return true;
+    }
+    shim_settle();
+    return false;
+}
+
+static void sitl_trialStart() {
+    intercom_commandSend(xControl, CONTROL_COMMAND_DISARM);
+    shim_settle();
+    for (control_parameter_t i = CONTROL_PARAMETER_SETPOINT_ROLL; i <= CONTROL_PARAMETER_SETPOINT_HEADING; ++i) {
+        sitl_parameter(i, 0.0f);
+    }
+    model_reset(&sitl.model);
+    model_state_t *state = &sitl.model.state;
+    state->position[2] = SITL_HEIGHT;
+    for (uint8_t i = 0; i < MODEL_MOTORS; ++i) state->thrust[i] = sitl.model.parameters.mass * 9.81 / MODEL_MOTORS;
+    sitl.start = esp_timer_get_time();
+    memset(sitl.sensors.orientation, 0, sizeof(sitl.sensors.orientation));
+    memset(sitl.sensors.rates, 0, sizeof(sitl.sensors.rates));
+    sitl.sensors.next = sitl.start;
+    sitl.motors.next = sitl.start;
+    sitl_sensors(sitl.start);
+    sitl.pilot.integral = 0.0f;
+    sitl.pilot.next = sitl.start;
+    sitl_pilot(sitl.start);
+    intercom_commandSend(xControl, CONTROL_COMMAND_ARM);
+    shim_settle();
+}
+
+static double sitl_run(int64_t end, const sitl_event_t *events, uint32_t count) {
+    uint32_t event = 0;
+    double squares = 0.0;
+    uint32_t samples = 0;
+    for (int64_t t = 0; t < end; t += SITL_STEP) {
+        int64_t now = sitl.start + t;
+        while (event < count && events[event].time <= t) {
+            sitl_parameter(events[event].parameter, events[event].value);
+            ++event;
+        }
+        sitl_sensors(now);
+        sitl_pilot(now);
+        shim_advance(now); // fällige Regelzyklen
+        // ESC übernimmt bei PWM erst mit der nächsten Periode
+        uint32_t period = shim_motorPeriod();
+        if (now >= sitl.motors.next) {
+            for (uint8_t i = 0; i < MODEL_MOTORS; ++i) sitl.motors.command[i] = shim_motor(i);
+            sitl.motors.next = period ? sitl.motors.next + period : now;
+        }
+        bool armed = false;
+        for (uint8_t i = 0; i < MODEL_MOTORS; ++i) armed |= shim_motor(i) > 0.0f;
+        if (!armed && t > 10000) return INFINITY; // entwaffnet, nach erstem Regelzyklus
+        model_step(&sitl.model, sitl.motors.command, SITL_STEP * 1e-6);
+        double euler[3];
+        model_euler(&sitl.model.state, euler);
+        for (uint8_t i = 0; i < 3; ++i) sitl.history[i][t / SITL_STEP] = euler[i];
+        if (end - t <= 1000000) { // letzte Sekunde
+            const double *w = sitl.model.state.rates;
+            squares += w[0] * w[0] + w[1] * w[1] + w[2] * w[2];
+            ++samples;
+        }
+        if (sitl.trace && t % (1000000 / CONTROL_LOOP_RATE) == 0) {
+            value_t setpoint[3];
+            for (uint8_t i = 0; i < 3; ++i) intercom_parameterGet(xControl, CONTROL_PARAMETER_SETPOINT_ROLL + i, &setpoint[i]);
+            fprintf(sitl.trace, "%.4f;%.5f;%.5f;%.5f;%.4f;%.4f;%.4f;%.5f;%.5f;%.5f;%.4f;%.4f;%.4f;%.4f;%.3f\n", t * 1e-6,
+                    setpoint[0].f, setpoint[1].f, setpoint[2].f, euler[0], euler[1], euler[2],
+                    sitl.model.state.rates[0], sitl.model.state.rates[1], sitl.model.state.rates[2],
+                    sitl.motors.command[0], sitl.motors.command[1], sitl.motors.command[2], sitl.motors.command[3],
+                    sitl.model.state.position[2]);
+        }
+    }
+    return samples ? sqrt(squares / samples) : 0.0;
+}
+
+static void sitl_sensors(int64_t now) {
+    // neue Messung in den Ringpuffer
+    while (now >= sitl.sensors.next) {
+        uint32_t i = sitl.sensors.head;
+        sitl.sensors.head = (i + 1) % SITL_SENSOR_SAMPLES;
+        const model_state_t *s = &sitl.model.state;
+        // kleine Drehung als Rauschen, q * (1, n/2)
+        double n[3] = {SITL_NOISE_ANGLE * sitl_gaussian(), SITL_NOISE_ANGLE * sitl_gaussian(), SITL_NOISE_ANGLE * sitl_gaussian()};
+        const double *q = s->attitude;
+        double r[4] = {
+            q[0] - 0.5 * (q[1] * n[0] + q[2] * n[1] + q[3] * n[2]),
+            q[1] + 0.5 * (q[0] * n[0] + q[2] * n[2] - q[3] * n[1]),
+            q[2] + 0.5 * (q[0] * n[1] - q[1] * n[2] + q[3] * n[0]),
+            q[3] + 0.5 * (q[0] * n[2] + q[1] * n[1] - q[2] * n[0])
+        };
+        double norm = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]);
+        sensors_event_t *orientation = &sitl.sensors.orientation[i];
+        orientation->type = SENSORS_ORIENTATION;
+        orientation->timestamp = sitl.sensors.next;
+        orientation->orientation.real = r[0] / norm;
+        orientation->orientation.i = r[1] / norm;
+        orientation->orientation.j = r[2] / norm;
+        orientation->orientation.k = r[3] / norm;
+        sensors_event_t *rates = &sitl.sensors.rates[i];
+        rates->type = SENSORS_ROTATION;
+        rates->timestamp = sitl.sensors.next;
+        for (uint8_t a = 0; a < 3; ++a) rates->vector.v[a] = s->rates[a] + SITL_NOISE_GYRO * sitl_gaussian();
+        sitl.sensors.next += SITL_SENSOR_PERIOD;
+    }
+    // neueste Messung die nach der Latenz verfügbar ist
+    sensors_state_t *state = &sitl.sensors.state;
+    for (uint32_t k = 1; k <= SITL_SENSOR_SAMPLES; ++k) {
+        uint32_t i = (sitl.sensors.head + SITL_SENSOR_SAMPLES - k) % SITL_SENSOR_SAMPLES;
+        const sensors_event_t *orientation = &sitl.sensors.orientation[i];
+        if (!orientation->timestamp) break; // vor Versuchsbeginn, Ausgangslage bleibt
+        if (orientation->timestamp + SITL_SENSOR_DELAY > now && k > 1) continue;
+        if (orientation->timestamp == state->orientation.timestamp) break;
+        state->orientation = *orientation;
+        state->rates = sitl.sensors.rates[i];
+        bno_rotationUpdate(&state->rotation, &state->orientation);
+        state->timestamp = now;
+        state->valid = (0x1 << SENSORS_ORIENTATION) | (0x1 << SENSORS_ROTATION);
+        ++state->generation;
+        break;
+    }
+}
+
+static void sitl_pilot(int64_t now) {
+    if (now < sitl.pilot.next) return;
+    sitl.pilot.next += SITL_PILOT_PERIOD;
+    // PID auf die Höhe, Schwebeschub etwa 0.5
+    const model_state_t *s = &sitl.model.state;
+    float error = SITL_HEIGHT - s->position[2];
+    sitl.pilot.integral += 0.2f * error * SITL_PILOT_PERIOD * 1e-6f;
+    float throttle = 0.5f + sitl.pilot.integral + 0.3f * error - 0.2f * s->velocity[2];
+    sitl.pilot.throttle = fminf(fmaxf(throttle, 0.0f), 1.0f);
+    sitl_parameter(CONTROL_PARAMETER_THROTTLE, sitl.pilot.throttle);
+}
+
+static void sitl_parameter(control_parameter_t parameter, float value) {
+    value_t v = {.f = value};
+    intercom_parameterSet(xControl, parameter, &v);
+}
+
+static void sitl_metrics(const sitl_step_t *step, sitl_metrics_t *metrics) {
+    uint8_t axis = step->parameter - CONTROL_PARAMETER_SETPOINT_ROLL;
+    const float *history = sitl.history[axis];
+    uint32_t start = step->start / SITL_STEP, end = step->end / SITL_STEP;
+    float height = step->to - step->from;
+    float t10 = NAN, t90 = NAN, peak = 0.0f, error = 0.0f;
+    uint32_t settled = start, tail = 0;
+    for (uint32_t i = start; i < end; ++i) {
+        float progress = (history[i] - step->from) / height; // 0 -> Anfang, 1 -> Ziel
+        float t = (i - start) * SITL_STEP * 1e-6f;
+        if (isnan(t10) && progress >= 0.1f) t10 = t;
+        if (isnan(t90) && progress >= 0.9f) t90 = t;
+        if (progress - 1.0f > peak) peak = progress - 1.0f;
+        if (fabsf(progress - 1.0f) > SITL_SETTLE_BAND) settled = i + 1;
+        if (end - i <= 500000 / SITL_STEP) {
+            error += fabsf(history[i] - step->to);
+            ++tail;
+        }
+    }
+    metrics->rise = t90 - t10;
+    metrics->overshoot = peak;
+    metrics->settling = (settled < end) ? (settled - start) * SITL_STEP * 1e-6f : NAN;
+    metrics->error = tail ? error / tail : NAN;
+}
+
+static double sitl_margin(double *parameter, double low, double high) {
+    static const sitl_event_t kick[] = { // kurze Störung damit eine Schwingung sicher angeregt wird
+        {SITL_TRIAL_KICK, CONTROL_PARAMETER_SETPOINT_ROLL, 0.1f},
+        {SITL_TRIAL_KICK, CONTROL_PARAMETER_SETPOINT_PITCH, 0.1f},
+        {SITL_TRIAL_KICK + 200000, CONTROL_PARAMETER_SETPOINT_ROLL, 0.0f},
+        {SITL_TRIAL_KICK + 200000, CONTROL_PARAMETER_SETPOINT_PITCH, 0.0f}
+    };
+    double nominal = *parameter;
+    FILE *trace = sitl.trace; // Versuche nicht aufzeichnen
+    sitl.trace = NULL;
+    double result = NAN;
+    for (uint8_t i = 0; i <= SITL_BISECTIONS + 1; ++i) {
+        // erst beide Grenzen, dann Bisektion
+        *parameter = (i == 0) ? low : (i == 1) ? high : (low + high) / 2.0;
+        sitl_trialStart();
+        bool stable = sitl_run(SITL_TRIAL_DURATION, kick, sizeof(kick) / sizeof(kick[0])) < SITL_UNSTABLE_RATE;
+        if (i == 0 && !stable) break;
+        if (i == 1 && stable) {
+            result = high;
+            break;
+        }
+        if (i > 1) {
+            if (stable) low = *parameter;
+            else high = *parameter;
+        }
+        result = low;
+    }
+    sitl.trace = trace;
+    *parameter = nominal;
+    return result;
+}
+
+static float sitl_gaussian() {
+    uint64_t *x = &sitl.sensors.random;
+    float u[2];
+    for (uint8_t i = 0; i < 2; ++i) {
+        *x ^= *x << 13;
+        *x ^= *x >> 7;
+        *x ^= *x << 17;
+        u[i] = ((*x >> 40) + 1.0f) / 16777217.0f; // (0, 1)
+    }
+    return sqrtf(-2.0f * logf(u[0])) * cosf(2.0f * (float)M_PI * u[1]);
+}
@@ -0,0 +1,376 @@
+/*
+ * File: hub.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-07
+ * ----------------------------
+ * Host-Test Ersatz für SensorHub, FreeRTOS, GPIO, SPI- und I2C-Treiber, siehe hub.h.
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+
+
+/** Interne Abhängigkeiten **/
+
+#include "intercom.h"
+#include "resources.h"
+#include "i2c.h"
+#include "hub.h"
+
+
+/** Variablendeklaration **/
+
+hub_t hub;
+gpio_dev_t GPIO;
+
+struct shim_queue { // nur als Semaphore genutzt
+    uint32_t count;
+};
+
+static struct shim_queue hub_semaphores[8];
+static uint32_t hub_semaphoreCount;
+
+
+/** Private Functions **/
+
+/*
+ * Function: hub_log
+ * ----------------------------
+ * Hängt einen Eintrag an die Busbelegung an.
+ */
+static void hub_log(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/*
+ * Function: hub_select
+ * ----------------------------
+ * Beginnt oder beendet einen Transfer. Am Ende wird das Gesendete als Fortschritt des ältesten
+ * Pakets verbucht und ein Hostpaket aufgezeichnet.
+ *
+ * bool active: true -> Chipselect aktiv
+ */
+static void hub_select(bool active);
+
+/*
+ * Function: hub_clock
+ * ----------------------------
+ * Überträgt Bytes im laufenden Transfer vollduplex.
+ *
+ * const uint8_t *tx: vom Host, NULL -> Nullen
+ * uint8_t *rx: zum Host, NULL -> verwerfen
+ * size_t length: Anzahl Bytes
+ */
+static void hub_clock(const uint8_t *tx, uint8_t *rx, size_t length);
+
+
+/** Implementierung **/
+
+void hub_reset(void) {
+    memset(&hub, 0, sizeof(hub));
+    memset(&GPIO, 0, sizeof(GPIO));
+    hub.interruptPin = GPIO_NUM_NC;
+    hub.wakePin = GPIO_NUM_NC;
+    hub_semaphoreCount = 0;
+}
+
+void hub_send(uint8_t channel, const uint8_t *payload, uint16_t length) {
+    if (length > HUB_PAYLOAD_MAX || hub.outHead - hub.outTail >= HUB_QUEUE_LENGTH) {
+        printf("hub: queue full\n");
+        return;
+    }
+    uint32_t index = hub.outHead++ % HUB_QUEUE_LENGTH;
+    hub.out[index].channel = channel;
+    hub.out[index].length = length;
+    memcpy(hub.out[index].payload, payload, length);
+}
+
+void hub_traffic(uint32_t n) {
+    static const uint8_t payload[280];
+    uint16_t length = 5 + 14 + 10;
+    if (!(n % 32)) length = sizeof(payload);
+    else if (!(n % 4)) length += 10 + 8;
+    hub_send(3, payload, length);
+}
+
+bool hub_pending(void) {
+    bool wake = hub.wakePin != GPIO_NUM_NC && !hub.levels[hub.wakePin];
+    return hub.outHead != hub.outTail || wake;
+}
+
+bool hub_interrupt(void) {
+    bool pending = hub_pending();
+    if (hub.interruptPin != GPIO_NUM_NC) {
+        if (hub.interruptPin < 32) {
+            GPIO.in = pending ? GPIO.in & ~(1u << hub.interruptPin) : GPIO.in | (1u << hub.interruptPin);
+        } else {
+            uint32_t mask = 1u << (hub.interruptPin - 32);
+            GPIO.in1.data = pending ? GPIO.in1.data & ~mask : GPIO.in1.data | mask;
+        }
+    }
+    if (!pending || !hub.isr) return false;
+    hub.isr(NULL);
+    return true;
+}
+
+void hub_drain(void) {
+    for (uint32_t n = 0; n < hub.queuedCount && hub.eventCount < HUB_EVENT_MAX; ++n) {
+        hub.events[hub.eventCount++] = *hub.queued[n];
+    }
+    hub.queuedCount = 0;
+}
+
+static void hub_log(const char *format, ...) {
+    size_t used = strlen(hub.log);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(hub.log + used, sizeof(hub.log) - used, format, args);
+    va_end(args);
+}
+
+static void hub_select(bool active) {
+    if (active == hub.selected) return;
+    hub.selected = active;
+    if (active) { // Header des ältesten Pakets bzw. seiner Fortsetzung bereitstellen
+        hub.position = 0;
+        hub.reading = false;
+        memset(hub.header, 0, sizeof(hub.header));
+        if (hub.outHead != hub.outTail) {
+            uint32_t index = hub.outTail % HUB_QUEUE_LENGTH;
+            uint16_t length = hub.out[index].length - hub.outOffset + 4;
+            if (hub.outOffset) length |= 0x8000;
+            hub.header[0] = length & 0xff;
+            hub.header[1] = length >> 8;
+            hub.header[2] = hub.out[index].channel;
+            hub.header[3] = hub.seq[hub.out[index].channel & 0x7];
+        }
+        return;
+    }
+    // Hub -> Host: gelesene Nutzdaten verbuchen
+    if (hub.reading && hub.outHead != hub.outTail && hub.position > 4) {
+        uint32_t index = hub.outTail % HUB_QUEUE_LENGTH;
+        uint32_t remaining = hub.out[index].length - hub.outOffset;
+        uint32_t read = hub.position - 4;
+        ++hub.seq[hub.out[index].channel & 0x7];
+        if (read >= remaining) {
+            ++hub.outTail;
+            hub.outOffset = 0;
+        } else hub.outOffset += read;
+    }
+    // Host -> Hub: Paket aufzeichnen
+    uint16_t length = (hub.transfer[0] | (hub.transfer[1] << 8)) & 0x7fff;
+    if (hub.position >= 4 && length && hub.hostCount < HUB_HOST_MAX) {
+        if (length > hub.position) length = hub.position;
+        if (length > HUB_TRANSFER_MAX) length = HUB_TRANSFER_MAX;
+        hub.host[hub.hostCount].length = length;
+        memcpy(hub.host[hub.hostCount].data, hub.transfer, length);
+        ++hub.hostCount;
+    }
+}
+
+static void hub_clock(const uint8_t *tx, uint8_t *rx, size_t length) {
+    uint32_t index = hub.outTail % HUB_QUEUE_LENGTH;
+    bool sending = hub.outHead != hub.outTail;
+    if (rx) hub.reading = true;
+    for (size_t i = 0; i < length; ++i, ++hub.position) {
+        if (hub.position < HUB_TRANSFER_MAX) hub.transfer[hub.position] = tx ? tx[i] : 0;
+        if (!rx) continue;
+        if (hub.position < 4) rx[i] = hub.header[hub.position];
+        else if (sending && hub.outOffset + hub.position - 4 < hub.out[index].length) {
+            rx[i] = hub.out[index].payload[hub.outOffset + hub.position - 4];
+        } else rx[i] = 0;
+    }
+    if (hub.spiClock) hub.now += (int64_t)length * 8 * 1000000 / hub.spiClock;
+    if (hub.i2cClock) hub.now += (int64_t)length * 9 * 1000000 / hub.i2cClock; // mit ACK
+}
+
+
+/** Ersatz für FreeRTOS **/
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    hub.task = function; // läuft nicht, der Test ruft dessen Schritte selbst auf
+    if (handle) *handle = (TaskHandle_t)&hub;
+    return pdTRUE;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    hub.now += (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t wait) {
+    if (!hub.notified) {
+        vTaskDelay(wait);
+        return pdFALSE;
+    }
+    hub.notified = false;
+    if (value) *value = hub.notification;
+    return pdTRUE;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken) {
+    if (action == eSetValueWithoutOverwrite && hub.notified) return pdFALSE;
+    hub.notified = true;
+    hub.notification = value;
+    if (woken) *woken = pdTRUE;
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    if (hub_semaphoreCount >= sizeof(hub_semaphores) / sizeof(hub_semaphores[0])) return NULL;
+    SemaphoreHandle_t semaphore = &hub_semaphores[hub_semaphoreCount++];
+    semaphore->count = 0;
+    return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+    for (uint32_t i = 0; !semaphore->count && hub.idle && i < 1000; ++i) hub.idle();
+    if (!semaphore->count) {
+        vTaskDelay(wait);
+        return pdFALSE;
+    }
+    --semaphore->count;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    if (semaphore->count) return pdFALSE; // binär
+    semaphore->count = 1;
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t wait) {
+    const event_t *event = item;
+    if (queue != xSensors) return pdFALSE;
+    if (hub.queuedCount >= SENSORS_QUEUE_LENGTH) {
+        ++hub.dropped;
+        return pdFALSE;
+    }
+    hub.queued[hub.queuedCount++] = event->data; // nur der Pointer, wie FreeRTOS
+    return pdTRUE;
+}
+
+
+/** Ersatz für ESP-IDF **/
+
+int64_t esp_timer_get_time(void) {
+    return hub.now;
+}
+
+void shim_log(esp_log_level_t level, const char *tag, const char *format, ...) {
+    if (level > ESP_LOG_WARN) return;
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s: ", tag);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level) {
+    if (gpio < 0 || gpio >= GPIO_NUM_MAX) return ESP_FAIL;
+    hub.levels[gpio] = level;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio) {
+    if (gpio == hub.interruptPin) return !hub_pending();
+    return (gpio >= 0 && gpio < GPIO_NUM_MAX) ? hub.levels[gpio] : 0;
+}
+
+esp_err_t gpio_install_isr_service(int flags) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t handler, void *arg) {
+    hub.interruptPin = gpio;
+    hub.isr = handler;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dmaChannel) {
+    hub.spiMaxTransfer = config->max_transfer_sz;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config,
+                             spi_device_handle_t *handle) {
+    hub.spiMode = config->mode;
+    hub.spiClock = config->clock_speed_hz;
+    *handle = (spi_device_handle_t)&hub;
+    return ESP_OK;
+}
+
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait) {
+    if (hub.acquired) ++hub.errors;
+    hub.acquired = true;
+    hub_log("acquire ");
+    return ESP_OK;
+}
+
+void spi_device_release_bus(spi_device_handle_t device) {
+    if (!hub.acquired || hub.selected) ++hub.errors; // Chipselect muss bereits frei sein
+    hub.acquired = false;
+    hub_log("release ");
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t device, spi_transaction_t *transaction) {
+    bool keep = transaction->flags & SPI_TRANS_CS_KEEP_ACTIVE;
+    if (keep && !hub.acquired) ++hub.errors; // KEEP_ACTIVE nur mit belegtem Bus erlaubt
+    if (hub.spiMaxTransfer && transaction->length > hub.spiMaxTransfer * 8) ++hub.errors;
+    hub_log("%s%u ", keep ? "keep" : "xfer", (unsigned)(transaction->length / 8));
+    hub_select(true);
+    hub_clock(transaction->tx_buffer, transaction->rx_buffer, transaction->length / 8);
+    if (!keep) hub_select(false);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t device, spi_transaction_t *transaction) {
+    return spi_device_polling_transmit(device, transaction);
+}
+
+
+/** Ersatz für I2C-Bus (i2c.c) **/
+
+bool i2c_deviceAdd(i2c_device_t device, uint8_t deviceAddr) {
+    return false;
+}
+
+bool i2c_write(i2c_device_t device, uint8_t* pData, size_t dataLength) {
+    if (hub.i2cClock) hub.now += (2 + 9) * 1000000 / hub.i2cClock; // Start, Adresse, Stop
+    hub_select(true);
+    hub_clock(pData, NULL, dataLength);
+    hub_select(false);
+    return false;
+}
+
+bool i2c_read(i2c_device_t device, uint8_t* pData, size_t dataLength) {
+    if (hub.i2cClock) hub.now += (2 + 9) * 1000000 / hub.i2cClock; // Start, Adresse, Stop
+    hub_select(true);
+    hub_clock(NULL, pData, dataLength);
+    hub_select(false);
+    return false;
+}
+
+
+/** Ersatz für Intercom **/
+
+void intercom_pvPublish(QueueHandle_t publisher, uint32_t pvNum, value_t value) {
+    ++hub.published;
+}
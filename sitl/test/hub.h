@@ -0,0 +1,157 @@
+/*
+ * File: hub.h
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-07
+ * ----------------------------
+ * Host-Test Ersatz für einen SensorHub (BNO080) samt Umgebung von bno.c. Einfädig und
+ * deterministisch: Semaphoren sind Zähler, Notifications eine Variable, Zeit läuft nur wenn ein
+ * Test sie weiterstellt oder ein Aufruf blockieren würde.
+ *
+ * Der Hub sendet SHTP-Pakete wie das Original: Header mit Gesamtlänge, wird weniger gelesen folgt
+ * der Rest als Fortsetzung (Bit 15) mit eigenem Header, die Sequenznummer zählt pro Kanal und
+ * Transfer. Was der Host sendet wird als Paket aufgezeichnet. Beide Transporte sprechen mit dem
+ * selben Hub: SPI vollduplex mit Chipselect über mehrere Transaktionen, I2C je Aufruf ein Transfer.
+ *
+ * xSensors hält wie auf dem ESP32 nur Pointer auf die Events und ist SENSORS_QUEUE_LENGTH lang. Der
+ * Test liest sie mit hub_drain, z.B. erst nach einem ganzen Transfer wie ein beschäftigter Sensortask.
+ */
+
+
+#pragma once
+
+
+/** Externe Abhängigkeiten **/
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+
+
+/** Interne Abhängigkeiten **/
+
+#include "sensor_types.h"
+#include "sensors.h"
+
+
+/** Compiler Einstellungen **/
+
+#define HUB_PAYLOAD_MAX     1024    // grösstes ausgehendes Paket ohne Header
+#define HUB_QUEUE_LENGTH    32      // ausgehende Pakete
+#define HUB_TRANSFER_MAX    256     // grösster aufgezeichneter Hosttransfer
+#define HUB_HOST_MAX        16      // aufgezeichnete Hostpakete
+#define HUB_EVENT_MAX       4096    // aufgezeichnete Sensorevents
+
+
+/** Variablendeklaration **/
+
+typedef struct {
+    int64_t now;                    // us, esp_timer
+    uint32_t levels[GPIO_NUM_MAX];  // zuletzt gesetzte Ausgänge
+    gpio_isr_t isr;
+    gpio_num_t interruptPin;
+    gpio_num_t wakePin;             // low -> Host möchte senden, GPIO_NUM_NC wenn nicht verdrahtet
+    void (*idle)(void);             // wird aufgerufen solange eine Semaphore blockieren würde
+
+    TaskFunction_t task;
+    bool notified;
+    uint32_t notification;
+
+    // SPI Busbelegung als Text, z.B. "acquire keep4 xfer16 release "
+    char log[1024];
+    bool acquired;
+    int spiMode;
+    int spiClock;
+    int i2cClock;                   // Hz, 0 -> I2C-Transfers ohne Buszeit
+    int spiMaxTransfer;
+    uint32_t errors;                // Transaktionen ausserhalb von acquire/release
+
+    // ausgehende Pakete, Kopf wird gerade übertragen
+    struct {
+        uint8_t channel;
+        uint16_t length;
+        uint8_t payload[HUB_PAYLOAD_MAX];
+    } out[HUB_QUEUE_LENGTH];
+    uint32_t outHead, outTail;
+    uint16_t outOffset;             // bereits übertragene Bytes des ältesten Pakets
+    uint8_t seq[8];
+
+    // laufender Transfer (Chipselect aktiv)
+    bool selected;
+    bool reading;                   // Host hat gelesen, nicht nur geschrieben (I2C)
+    uint32_t position;
+    uint8_t header[4];
+    uint8_t transfer[HUB_TRANSFER_MAX];
+
+    // vom Host gesendete Pakete inkl. Header
+    struct {
+        uint16_t length;
+        uint8_t data[HUB_TRANSFER_MAX];
+    } host[HUB_HOST_MAX];
+    uint32_t hostCount;
+
+    const sensors_event_t *queued[SENSORS_QUEUE_LENGTH]; // in xSensors, noch nicht gelesen
+    uint32_t queuedCount;
+    uint32_t dropped;               // xSensors voll
+    sensors_event_t events[HUB_EVENT_MAX]; // aus xSensors gelesen
+    uint32_t eventCount;
+    uint32_t published;             // Prozessvariablen
+} hub_t;
+
+extern hub_t hub;
+
+
+/** Öffentliche Functions **/
+
+/*
+ * Function: hub_reset
+ * ----------------------------
+ * Setzt Hub und Umgebung auf den Startzustand zurück.
+ */
+void hub_reset(void);
+
+/*
+ * Function: hub_send
+ * ----------------------------
+ * Reiht ein SHTP-Paket zum Senden an den Host ein.
+ *
+ * uint8_t channel: SHTP-Kanal
+ * const uint8_t *payload: Nutzdaten ohne Header
+ * uint16_t length: Anzahl Nutzdaten, maximal HUB_PAYLOAD_MAX
+ */
+void hub_send(uint8_t channel, const uint8_t *payload, uint16_t length);
+
+/*
+ * Function: hub_traffic
+ * ----------------------------
+ * Reiht Paket n einer typischen Paketmischung ein: Zeitreferenz, Rotation Vector und Gyro, jedes
+ * vierte mit Beschleunigung und Druck, jedes 32. ein Batch über mehrere Fragmente.
+ *
+ * uint32_t n: Nummer des Pakets
+ */
+void hub_traffic(uint32_t n);
+
+/*
+ * Function: hub_pending
+ * ----------------------------
+ * Hat der Hub etwas zu senden oder möchte der Host senden? Entspricht dem Interruptpin low.
+ *
+ * returns: true -> Interrupt steht an
+ */
+bool hub_pending(void);
+
+/*
+ * Function: hub_interrupt
+ * ----------------------------
+ * Aktualisiert den Interruptpin im GPIO-Register und löst bei anstehendem Interrupt die ISR aus.
+ *
+ * returns: true -> ISR wurde ausgelöst
+ */
+bool hub_interrupt(void);
+
+/*
+ * Function: hub_drain
+ * ----------------------------
+ * Liest xSensors leer wie der Sensortask, die Events werden erst jetzt nach hub.events kopiert.
+ */
+void hub_drain(void);
@@ -0,0 +1,68 @@
+/*
+ * File: test.h
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-06
+ * ----------------------------
+ * Minimale Hilfen für Host-Tests einzelner Module. Jeder Test ist ein eigenes Programm, der
+ * Exitcode ist ungleich 0 sobald eine Prüfung fehlschlägt. Ausführen mit "make test".
+ */
+
+
+#pragma once
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdio.h>
+#include <time.h>
+
+
+/** Variablendeklaration **/
+
+static int test_failures;
+
+
+/*
+ * Macro: TEST_CHECK
+ * ----------------------------
+ * Prüft eine Bedingung, gibt bei Fehlschlag Ort und Meldung aus und zählt den Fehler.
+ *
+ * condition: zu prüfende Bedingung
+ * ...: printf-Format und Argumente der Meldung
+ */
+#define TEST_CHECK(condition, ...) do {                         \
+    if (!(condition)) {                                         \
+        ++test_failures;                                        \
+        printf("%s:%d: ", __FILE__, __LINE__);                  \
+        printf(__VA_ARGS__);                                    \
+        printf("\n");                                           \
+    }                                                           \
+} while (0)
+
+/*
+ * Function: test_seconds
+ * ----------------------------
+ * Monotone Zeit für Benchmarks.
+ *
+ * returns: s seit beliebigem Zeitpunkt
+ */
+static inline double test_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+ * Function: test_result
+ * ----------------------------
+ * Gibt das Resultat aus.
+ *
+ * const char *name: Name des Tests
+ *
+ * returns: Exitcode, 0 wenn alle Prüfungen bestanden
+ */
+static inline int test_result(const char *name) {
+    printf("%s: %s\n", name, test_failures ? "FAILED" : "ok");
+    return test_failures ? 1 : 0;
+}
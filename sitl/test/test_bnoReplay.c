@@ -0,0 +1,579 @@
+/*
+ * File: test_bnoReplay.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-07
+ * ----------------------------
+ * Host-Test der Aufzeichnung (bno_captureStart) und Wiedergabe von SHTP-Transfers durch die
+ * unveränderte sh2-Bibliothek und bno_sensorEvent.
+ *
+ * Zuerst startet bno_init gegen den simulierten SensorHub (hub.c, I2C) mit laufender Aufzeichnung.
+ * Der Hub sendet Advertisement, Reset und danach Reports, einzeln und gebatcht über mehrere
+ * Fragmente. Zuletzt kommen Beschleunigung und Druck in einem Batch mit mehr Reports als früher in
+ * xSensors Platz hatten, während die Orientierungen einzeln vorausgingen. xSensors wird erst nach
+ * jedem Transfer gelesen (hub_drain), so fällt auf, wenn Events eines Transfers denselben Speicher
+ * teilen. Die an xSensors gesendeten Events werden mit den erzeugten Werten verglichen. Danach
+ * wird die Aufzeichnung wiedergegeben, sie muss exakt die selben Events ergeben. Zuletzt werden der
+ * Durchsatz des I2C-Transports (Gegenstück zu test_bnoSpi) und der Wiedergabe gemessen.
+ *
+ * Aufruf: ./test_bnoReplay [Aufzeichnung.shtp]
+ * Eine Aufzeichnung vom Quadcopter (GET /bno.shtp) wird zusätzlich wiedergegeben und ausgewertet.
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "test.h"
+#include "hub.h"
+#include "shtp.h"
+#include "bno.c"
+
+
+/** Compiler Einstellungen **/
+
+#define TEST_START          10000000LL  // us, esp_timer beim ersten Sample
+#define TEST_PERIOD         2500        // us, 400 Hz
+#define TEST_LATENCY        10          // 100 us, Sample bis Interrupt
+#define TEST_SINGLES        300         // einzeln gesendete Samples
+#define TEST_BATCHES        10          // danach gebatchte Pakete
+#define TEST_BATCH          12          // Samples pro Paket, ergibt Fragmente
+#define TEST_DEFERRED       48          // Samples mit einzelner Orientierung, Beschleunigung & Druck am Ende gebatcht
+#define TEST_BENCHMARK      0.5         // s
+
+// Kanäle wie beim BNO080
+#define TEST_CHAN_COMMAND       0
+#define TEST_CHAN_EXECUTABLE    1
+#define TEST_CHAN_CONTROL       2
+#define TEST_CHAN_NORMAL        3
+#define TEST_CHAN_WAKE          4
+#define TEST_CHAN_GYRO_RV       5
+
+
+/** Variablendeklaration **/
+
+static struct {
+    sensors_event_t expected[HUB_EVENT_MAX];
+    uint32_t expectedCount;
+    sensors_event_t live[HUB_EVENT_MAX];
+    uint32_t liveCount;
+    uint8_t sequence;       // Sequenznummer der Reports
+    uint8_t packet[HUB_PAYLOAD_MAX];
+    uint16_t cursor;
+} test;
+
+
+/** Private Functions **/
+
+/*
+ * Function: test_tlv
+ * ----------------------------
+ * Hängt einen Eintrag an das Advertisement an.
+ */
+static void test_tlv(uint8_t tag, uint8_t length, const void *value) {
+    test.packet[test.cursor++] = tag;
+    test.packet[test.cursor++] = length;
+    memcpy(test.packet + test.cursor, value, length);
+    test.cursor += length;
+}
+
+/*
+ * Function: test_boot
+ * ----------------------------
+ * Reiht die Pakete eines SensorHubs nach dem Reset ein: Advertisement aller Apps und Kanäle,
+ * Reset abgeschlossen.
+ */
+static void test_boot(void) {
+    const uint8_t lengths[] = {
+        0xf1, 16,   // Command Response
+        0xfb, 5,    // Base Timestamp Reference
+        0xfa, 5,    // Timestamp Rebase
+        SH2_GYROSCOPE_CALIBRATED, 10,
+        SH2_LINEAR_ACCELERATION, 10,
+        SH2_ROTATION_VECTOR, 14,
+        SH2_GAME_ROTATION_VECTOR, 12,
+        SH2_PRESSURE, 8,
+        SH2_GYRO_INTEGRATED_RV, 14
+    };
+    uint32_t guid;
+    uint8_t channel;
+    test.cursor = 0;
+    test.packet[test.cursor++] = 0; // RESP_ADVERTISE
+    guid = 0;
+    test_tlv(TAG_GUID, 4, &guid);
+    test_tlv(TAG_APP_NAME, 5, "SHTP");
+    channel = TEST_CHAN_COMMAND;
+    test_tlv(TAG_NORMAL_CHANNEL, 1, &channel);
+    test_tlv(TAG_CHANNEL_NAME, 8, "command");
+    guid = 1;
+    test_tlv(TAG_GUID, 4, &guid);
+    test_tlv(TAG_APP_NAME, 11, "executable");
+    channel = TEST_CHAN_EXECUTABLE;
+    test_tlv(TAG_NORMAL_CHANNEL, 1, &channel);
+    test_tlv(TAG_CHANNEL_NAME, 7, "device");
+    guid = 2;
+    test_tlv(TAG_GUID, 4, &guid);
+    test_tlv(TAG_APP_NAME, 10, "sensorhub");
+    test_tlv(0x80, 6, "1.0.0"); // TAG_SH2_VERSION
+    test_tlv(0x81, sizeof(lengths), lengths); // TAG_SH2_REPORT_LENGTHS
+    channel = TEST_CHAN_CONTROL;
+    test_tlv(TAG_NORMAL_CHANNEL, 1, &channel);
+    test_tlv(TAG_CHANNEL_NAME, 8, "control");
+    channel = TEST_CHAN_NORMAL;
+    test_tlv(TAG_NORMAL_CHANNEL, 1, &channel);
+    test_tlv(TAG_CHANNEL_NAME, 12, "inputNormal");
+    channel = TEST_CHAN_WAKE;
+    test_tlv(TAG_WAKE_CHANNEL, 1, &channel);
+    test_tlv(TAG_CHANNEL_NAME, 10, "inputWake");
+    channel = TEST_CHAN_GYRO_RV;
+    test_tlv(TAG_NORMAL_CHANNEL, 1, &channel);
+    test_tlv(TAG_CHANNEL_NAME, 12, "inputGyroRv");
+    hub_send(TEST_CHAN_COMMAND, test.packet, test.cursor);
+    test.cursor = 0;
+    const uint8_t resetComplete = 1;
+    hub_send(TEST_CHAN_EXECUTABLE, &resetComplete, 1);
+}
+
+/*
+ * Function: test_step
+ * ----------------------------
+ * Ein Durchlauf von bno_task: Interrupt abholen, lesen, aufzeichnen und an sh2 übergeben.
+ */
+static void test_step(void) {
+    if (!hub_interrupt()) return;
+    uint32_t notified;
+    if (xTaskNotifyWait(0, 0, &notified, bno.timeout) != pdTRUE) return;
+    int64_t timestamp = esp_timer_get_time();
+    timestamp -= (uint32_t)((uint32_t)timestamp - notified);
+    uint16_t length;
+    if (bno_receive(&length)) return;
+    bno_captureRecord(timestamp, length);
+    bno.onRx(NULL, bno.rxBuffer, length, timestamp);
+    hub_drain(); // Sensortask kommt erst nach dem ganzen Transfer dran
+}
+
+/*
+ * Function: test_deliver
+ * ----------------------------
+ * Sendet das aufgebaute Paket und lässt bno_task alle Fragmente lesen.
+ *
+ * uint8_t channel: SHTP-Kanal
+ * int64_t interrupt: us, Zeit des ersten Interrupts
+ */
+static void test_deliver(uint8_t channel, int64_t interrupt) {
+    hub_send(channel, test.packet, test.cursor);
+    hub.now = interrupt;
+    for (int i = 0; hub_pending() && i < 20; ++i) {
+        test_step();
+        hub.now += 50; // Fragmente folgen kurz darauf
+    }
+    test.cursor = 0;
+}
+
+/*
+ * Function: test_report
+ * ----------------------------
+ * Hängt einen Sensorreport an das Paket an.
+ *
+ * uint8_t id: Report Id
+ * uint16_t delay: 100 us, Verzögerung gegenüber der Referenz
+ * const int16_t *values: Festkommawerte
+ * uint8_t count: Anzahl Werte
+ */
+static void test_report(uint8_t id, uint16_t delay, const int16_t *values, uint8_t count) {
+    uint8_t *p = test.packet + test.cursor;
+    p[0] = id;
+    p[1] = test.sequence++;
+    p[2] = ((delay >> 8) << 2) | 0x3; // Genauigkeit hoch
+    p[3] = delay & 0xff;
+    memcpy(p + 4, values, 2 * count);
+    test.cursor += 4 + 2 * count;
+}
+
+/*
+ * Function: test_reference
+ * ----------------------------
+ * Beginnt ein Paket mit der Zeitreferenz.
+ *
+ * uint32_t reference: 100 us, Alter der Referenz beim Interrupt
+ */
+static void test_reference(uint32_t reference) {
+    test.packet[test.cursor++] = 0xfb;
+    memcpy(test.packet + test.cursor, &reference, 4);
+    test.cursor += 4;
+}
+
+/*
+ * Function: test_expect
+ * ----------------------------
+ * Fügt ein erwartetes Event an.
+ */
+static sensors_event_t *test_expect(sensors_event_type_t type, int64_t timestamp) {
+    sensors_event_t *event = &test.expected[test.expectedCount++];
+    memset(event, 0, sizeof(*event));
+    event->type = type;
+    event->timestamp = timestamp;
+    return event;
+}
+
+/*
+ * Function: test_rotation
+ * ----------------------------
+ * Orientierung eines Samples als Festkommawerte des Rotation Vectors. Sie dreht langsam um z und
+ * schwankt um x.
+ *
+ * uint32_t n: Nummer des Samples
+ * int16_t rotation[5]: i, j, k, real (Q14) und Genauigkeit (Q12)
+ */
+static void test_rotation(uint32_t n, int16_t rotation[5]) {
+    double yaw = 0.01 * n, roll = 0.2 * sin(0.05 * n);
+    double q[4] = { // i, j, k, real
+        sin(roll / 2) * cos(yaw / 2),
+        sin(roll / 2) * sin(yaw / 2),
+        cos(roll / 2) * sin(yaw / 2),
+        cos(roll / 2) * cos(yaw / 2)
+    };
+    for (int i = 0; i < 4; ++i) rotation[i] = lround(q[i] * 16384.0);
+    rotation[4] = lround(0.1 * 4096.0);
+}
+
+/*
+ * Function: test_attitude
+ * ----------------------------
+ * Hängt Orientierung und Rotation eines Samples an und notiert die erwarteten Events.
+ *
+ * uint32_t n: Nummer des Samples
+ * uint16_t delay: 100 us, Verzögerung gegenüber der Referenz
+ * bool game: zusätzlich Game Rotation Vector senden, darf nicht weitergeleitet werden
+ */
+static void test_attitude(uint32_t n, uint16_t delay, bool game) {
+    int64_t timestamp = TEST_START + (int64_t)n * TEST_PERIOD;
+    // Orientierung
+    int16_t rotation[5];
+    test_rotation(n, rotation);
+    test_report(SH2_ROTATION_VECTOR, delay, rotation, 5);
+    sensors_event_t *event = test_expect(SENSORS_ORIENTATION, timestamp);
+    event->orientation.i = rotation[0] / 16384.0f;
+    event->orientation.j = rotation[1] / 16384.0f;
+    event->orientation.k = rotation[2] / 16384.0f;
+    event->orientation.real = rotation[3] / 16384.0f;
+    event->accuracy = rotation[4] / 4096.0f;
+    if (game) test_report(SH2_GAME_ROTATION_VECTOR, delay, rotation, 4);
+    // Rotation
+    int16_t gyro[3] = {lround(0.5 * sin(0.1 * n) * 512.0), -128, 512};
+    test_report(SH2_GYROSCOPE_CALIBRATED, delay, gyro, 3);
+    event = test_expect(SENSORS_ROTATION, timestamp);
+    for (int i = 0; i < 3; ++i) event->vector.v[i] = gyro[i] / 512.0f;
+}
+
+/*
+ * Function: test_acceleration
+ * ----------------------------
+ * Hängt Beschleunigung und Druck eines Samples an und notiert die erwarteten Events. Die
+ * Beschleunigung wird mit der Orientierung desselben Samples in Weltkoordinaten erwartet.
+ *
+ * uint32_t n: Nummer des Samples
+ * uint16_t delay: 100 us, Verzögerung gegenüber der Referenz
+ */
+static void test_acceleration(uint32_t n, uint16_t delay) {
+    int64_t timestamp = TEST_START + (int64_t)n * TEST_PERIOD;
+    int16_t rotation[5];
+    test_rotation(n, rotation);
+    // Beschleunigung, lokal gemessen und in Weltkoordinaten erwartet
+    int16_t acceleration[3] = {256, -512, lround((0.5 + 0.01 * n) * 256.0)};
+    test_report(SH2_LINEAR_ACCELERATION, delay, acceleration, 3);
+    double r[3] = {rotation[0] / 16384.0, rotation[1] / 16384.0, rotation[2] / 16384.0};
+    double w = rotation[3] / 16384.0;
+    double v[3] = {acceleration[0] / 256.0, acceleration[1] / 256.0, acceleration[2] / 256.0};
+    double t[3] = { // t = 2 r x v, v' = v + w t + r x t
+        2.0 * (r[1] * v[2] - r[2] * v[1]),
+        2.0 * (r[2] * v[0] - r[0] * v[2]),
+        2.0 * (r[0] * v[1] - r[1] * v[0])
+    };
+    sensors_event_t *event = test_expect(SENSORS_ACCELERATION, timestamp);
+    event->vector.x = v[0] + w * t[0] + (r[1] * t[2] - r[2] * t[1]);
+    event->vector.y = v[1] + w * t[1] + (r[2] * t[0] - r[0] * t[2]);
+    event->vector.z = v[2] + w * t[2] + (r[0] * t[1] - r[1] * t[0]);
+    event->accuracy = 3.0f;
+    // Druck, hPa Q20
+    uint32_t pressure = lround((950.0 + 0.01 * n) * 1048576.0);
+    int16_t words[2];
+    memcpy(words, &pressure, 4);
+    test_report(SH2_PRESSURE, delay, words, 2);
+    event = test_expect(SENSORS_ALTIMETER, timestamp);
+    event->vector.z = (228.15 / 0.0065) * (1.0 - pow(pressure / 1048576.0 / 1013.25, 1.0 / 5.255));
+    event->accuracy = 3.0f;
+}
+
+/*
+ * Function: test_sample
+ * ----------------------------
+ * Hängt die Reports eines Samples an, jedes vierte Sample kommen Beschleunigung und Druck dazu.
+ *
+ * uint32_t n: Nummer des Samples
+ * uint16_t delay: 100 us, Verzögerung gegenüber der Referenz
+ * bool game: zusätzlich Game Rotation Vector senden, darf nicht weitergeleitet werden
+ */
+static void test_sample(uint32_t n, uint16_t delay, bool game) {
+    test_attitude(n, delay, game);
+    if (!(n % 4)) test_acceleration(n, delay);
+}
+
+/*
+ * Function: test_compare
+ * ----------------------------
+ * Vergleicht zwei Eventlisten.
+ *
+ * float tolerance: zulässige Abweichung der Werte
+ *
+ * returns: Anzahl abweichender Events
+ */
+static uint32_t test_compare(const char *name, const sensors_event_t *a, uint32_t countA,
+                             const sensors_event_t *b, uint32_t countB, float tolerance) {
+    uint32_t failures = 0;
+    TEST_CHECK(countA == countB, "%s: %u events, expected %u", name, countA, countB);
+    for (uint32_t n = 0; n < countA && n < countB; ++n) {
+        bool equal = a[n].type == b[n].type && a[n].timestamp == b[n].timestamp
+                  && fabsf(a[n].accuracy - b[n].accuracy) <= tolerance;
+        const float *x = &a[n].orientation.i, *y = &b[n].orientation.i;
+        int values = (a[n].type == SENSORS_ORIENTATION) ? 4 : 3;
+        float scale = (a[n].type == SENSORS_ALTIMETER) ? 1000.0f : 1.0f; // float Auflösung bei ~500 m
+        for (int i = 0; i < values; ++i) equal &= fabsf(x[i] - y[i]) <= tolerance * scale;
+        if (!equal && ++failures <= 5) {
+            TEST_CHECK(false, "%s: event %u type %d/%d at %lld/%lld: %f %f %f %f / %f %f %f %f", name, n,
+                       a[n].type, b[n].type, (long long)a[n].timestamp, (long long)b[n].timestamp,
+                       x[0], x[1], x[2], x[3], y[0], y[1], y[2], y[3]);
+        }
+    }
+    if (failures > 5) TEST_CHECK(false, "%s: %u events differ", name, failures);
+    return failures;
+}
+
+/*
+ * Function: test_replay
+ * ----------------------------
+ * Gibt eine Aufzeichnung an sh2 wie bno_task es täte. Events landen in hub.events.
+ *
+ * const uint8_t *data: Aufzeichnung im Format von bno_captureStart
+ * uint32_t length: Länge in Bytes
+ *
+ * returns: Anzahl Transfers, -1 falls die Aufzeichnung ungültig ist
+ */
+static int32_t test_replay(const uint8_t *data, uint32_t length) {
+    uint32_t version;
+    if (length < 8 || memcmp(data, "SHTP", 4)) return -1;
+    memcpy(&version, data + 4, 4);
+    if (version != 1) return -1;
+    int32_t transfers = 0;
+    for (uint32_t position = 8; position < length; ++transfers) {
+        uint32_t timestamp;
+        uint16_t size;
+        if (position + 6 > length) return -1;
+        memcpy(&timestamp, data + position, 4);
+        memcpy(&size, data + position + 4, 2);
+        position += 6;
+        if (size > SH2_HAL_MAX_TRANSFER || position + size > length) return -1;
+        memcpy(bno.rxBuffer, data + position, size);
+        position += size;
+        hub.now = timestamp; // obere Bits für timebase_toLocal egal
+        bno.onRx(NULL, bno.rxBuffer, size, timestamp);
+        hub_drain();
+    }
+    return transfers;
+}
+
+/*
+ * Function: test_replayInit
+ * ----------------------------
+ * Startet sh2 neu für eine Wiedergabe, Kanäle lernt es aus dem aufgezeichneten Advertisement.
+ */
+static void test_replayInit(void) {
+    hub.idle = NULL;
+    hub.eventCount = 0;
+    hub.queuedCount = 0;
+    memset(&bno.cache, 0, sizeof(bno.cache));
+    bno.historyLength = 0;
+    TEST_CHECK(sh2_initialize(&bno_initDone, NULL) == SH2_OK, "sh2 init for replay");
+    TEST_CHECK(sh2_setSensorCallback(&bno_sensorEvent, NULL) == SH2_OK, "sensor callback");
+}
+
+/*
+ * Function: test_benchmark
+ * ----------------------------
+ * Misst den Durchsatz der Wiedergabe.
+ */
+static void test_benchmark(const char *name, const uint8_t *data, uint32_t length) {
+    uint32_t rounds = 0;
+    uint64_t events = 0;
+    double start = test_seconds(), elapsed;
+    do {
+        hub.eventCount = 0;
+        test_replay(data, length);
+        events += hub.eventCount;
+        ++rounds;
+    } while ((elapsed = test_seconds() - start) < TEST_BENCHMARK);
+    printf("%s: %.1f MB/s, %.2f M events/s\n", name, rounds * (double)length / elapsed * 1e-6,
+           events / elapsed * 1e-6);
+}
+
+/*
+ * Function: test_transport
+ * ----------------------------
+ * Liest die typische Paketmischung des Hubs (hub_traffic) und gibt Pakete pro Sekunde Rechenzeit,
+ * Transfers und simulierte Buszeit pro Paket aus. Gegenstück für SPI in test_bnoSpi.
+ */
+static void test_transport(void) {
+    uint32_t packets = 0, transfers = bno.statistics.transfers;
+    hub.i2cClock = I2C_CLOCK;
+    int64_t bus = hub.now; // läuft nur mit dem I2C-Takt
+    uint16_t length;
+    double start = test_seconds(), elapsed;
+    do {
+        for (int i = 0; i < 64; ++i, ++packets) {
+            hub_traffic(packets);
+            while (hub_pending()) bno_receive(&length);
+        }
+    } while ((elapsed = test_seconds() - start) < TEST_BENCHMARK);
+    printf("i2c: %.2f M packets/s, %.2f transfers and %.0f us bus per packet\n", packets / elapsed * 1e-6,
+           (double)(bno.statistics.transfers - transfers) / packets, (double)(hub.now - bus) / packets);
+    hub.i2cClock = 0;
+}
+
+/*
+ * Function: test_file
+ * ----------------------------
+ * Gibt eine Aufzeichnung vom Quadcopter wieder und zählt die Events pro Typ.
+ */
+static void test_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    TEST_CHECK(file, "can't open %s", path);
+    if (!file) return;
+    static uint8_t data[4 * BNO_CAPTURE_SIZE];
+    uint32_t length = fread(data, 1, sizeof(data), file);
+    fclose(file);
+    test_replayInit();
+    int32_t transfers = test_replay(data, length);
+    TEST_CHECK(transfers > 0, "%s: invalid capture", path);
+    uint32_t counts[SENSORS_MAX] = {0};
+    for (uint32_t n = 0; n < hub.eventCount; ++n) ++counts[hub.events[n].type];
+    printf("%s: %d transfers, %u bytes, orientation %u, rotation %u, acceleration %u, altimeter %u\n", path,
+           transfers, length, counts[SENSORS_ORIENTATION], counts[SENSORS_ROTATION],
+           counts[SENSORS_ACCELERATION], counts[SENSORS_ALTIMETER]);
+    test_benchmark(path, data, length);
+}
+
+
+/** Implementierung **/
+
+int main(int argc, char *argv[]) {
+    hub_reset();
+    hub.now = TEST_START - 1000000;
+    hub.idle = &test_step;
+    bno.readPredict = SHTP_HEADER_LEN; // wie beim Start von bno_task
+
+    // Start mit Aufzeichnung: Advertisement (unaufgefordert) und Reset vom Hub, Konfiguration vom Host
+    TEST_CHECK(!bno_captureStart(), "capture start");
+    test_boot();
+    TEST_CHECK(!bno_init(0x4a, GPIO_NUM_4, GPIO_NUM_5, 5, 20, 100, 5, BNO_ORIENTATION_ROTATION_VECTOR, 0),
+               "bno init");
+    TEST_CHECK(!hub_pending(), "boot packets not read");
+    const uint8_t enabled[] = {SH2_ROTATION_VECTOR, SH2_LINEAR_ACCELERATION, SH2_PRESSURE, SH2_GYROSCOPE_CALIBRATED};
+    const uint32_t intervals[] = {5000, 20000, 100000, 5000};
+    TEST_CHECK(hub.hostCount == 4, "%u host packets", hub.hostCount);
+    for (uint32_t n = 0; n < hub.hostCount && n < 4; ++n) {
+        const uint8_t *p = hub.host[n].data;
+        uint32_t interval;
+        memcpy(&interval, p + 4 + 5, 4);
+        TEST_CHECK(p[2] == TEST_CHAN_CONTROL && p[4] == 0xfd && p[5] == enabled[n]
+                   && interval == intervals[n], "set feature %u: chan %u id %02x, %u us", n, p[2], p[5],
+                   interval);
+    }
+
+    // Samples einzeln, dann gebatcht mit mehreren Fragmenten und ignoriertem Game Rotation Vector
+    uint32_t n = 0;
+    for (; n < TEST_SINGLES; ++n) {
+        test_reference(TEST_LATENCY);
+        test_sample(n, 0, false);
+        test_deliver(TEST_CHAN_NORMAL, TEST_START + (int64_t)n * TEST_PERIOD + TEST_LATENCY * 100);
+    }
+    for (uint32_t batch = 0; batch < TEST_BATCHES; ++batch) {
+        uint32_t step = TEST_PERIOD / 100;
+        test_reference(TEST_LATENCY + (TEST_BATCH - 1) * step);
+        for (uint32_t i = 0; i < TEST_BATCH; ++i, ++n) test_sample(n, i * step, true);
+        test_deliver(TEST_CHAN_NORMAL, TEST_START + (int64_t)(n - 1) * TEST_PERIOD + TEST_LATENCY * 100);
+    }
+    // Orientierung einzeln, Beschleunigung & Druck danach in einem Batch ab dem ersten Sample
+    uint32_t first = n, deferred = 0;
+    for (; n < first + TEST_DEFERRED; ++n) {
+        test_reference(TEST_LATENCY);
+        test_attitude(n, 0, false);
+        test_deliver(TEST_CHAN_NORMAL, TEST_START + (int64_t)n * TEST_PERIOD + TEST_LATENCY * 100);
+    }
+    test_reference(TEST_LATENCY + (n - first) * (TEST_PERIOD / 100));
+    for (uint32_t i = first; i < n; ++i) {
+        if (i % 4) continue;
+        test_acceleration(i, (i - first) * (TEST_PERIOD / 100));
+        deferred += 2;
+    }
+    test_deliver(TEST_CHAN_NORMAL, TEST_START + (int64_t)n * TEST_PERIOD + TEST_LATENCY * 100);
+    TEST_CHECK(deferred > 16 && deferred <= BNO_BATCH_MAX, "%u reports deferred", deferred);
+    TEST_CHECK(!hub.dropped, "%u events dropped, xSensors full", hub.dropped);
+    bno_captureStop();
+    TEST_CHECK(bno.statistics.transfers > TEST_SINGLES + 2 * TEST_BATCHES, "batches not fragmented, %u transfers",
+               bno.statistics.transfers);
+    test_compare("live", hub.events, hub.eventCount, test.expected, test.expectedCount, 1e-4f);
+    memcpy(test.live, hub.events, hub.eventCount * sizeof(sensors_event_t));
+    test.liveCount = hub.eventCount;
+
+    // Wiedergabe muss exakt die selben Events ergeben
+    const uint8_t *capture;
+    uint32_t length = bno_captureGet(&capture);
+    TEST_CHECK(length > 8, "no capture");
+    // wie ein laufender Download (remote_sendCapture): kein Neustart, der Buffer bleibt unverändert
+    TEST_CHECK(!bno_captureReadBegin() && !bno_captureReadBegin(), "read begin failed");
+    TEST_CHECK(bno_captureStart(), "capture restarted while read");
+    bno_captureReadEnd();
+    TEST_CHECK(bno_captureStart(), "capture restarted while still read");
+    TEST_CHECK(bno_captureGet(&capture) == length, "capture changed while read");
+    test_replayInit();
+    int32_t transfers = test_replay(capture, length);
+    printf("capture: %d transfers, %u bytes, %u events\n", transfers, length, hub.eventCount);
+    TEST_CHECK(transfers == (int32_t)bno.statistics.transfers, "%d transfers replayed, %u read", transfers,
+               bno.statistics.transfers);
+    test_compare("replay", hub.events, hub.eventCount, test.live, test.liveCount, 0.0f);
+
+    // ungültige Aufzeichnungen werden erkannt
+    TEST_CHECK(test_replay((const uint8_t *)"SHTX\1\0\0\0", 8) < 0, "bad magic accepted");
+    TEST_CHECK(test_replay(capture, length - 1) < 0, "truncated capture accepted");
+
+    // gelernte Leselänge: sofort auf ein grosses Paket, danach genau zurück auf die kleinen
+    uint8_t payload[200] = {0};
+    uint16_t read, small = 24 + SHTP_HEADER_LEN;
+    hub_send(TEST_CHAN_WAKE, payload, sizeof(payload));
+    for (int i = 0; hub_pending() && i < 10; ++i) bno_receive(&read);
+    TEST_CHECK(bno.readPredict == SH2_HAL_MAX_TRANSFER, "predict %u after large packet", bno.readPredict);
+    uint32_t reads = bno.statistics.transfers, bytes = 0;
+    for (int i = 0; i < 64; ++i) {
+        if (i == 56) bytes = bno.statistics.bytes;
+        hub_send(TEST_CHAN_WAKE, payload, small - SHTP_HEADER_LEN);
+        TEST_CHECK(!bno_receive(&read) && !hub_pending(), "small packet %d not read in one transfer", i);
+    }
+    TEST_CHECK(bno.readPredict == small, "predict %u, expected %u", bno.readPredict, small);
+    TEST_CHECK(bno.statistics.transfers - reads == 64 && bno.statistics.bytes - bytes == 8 * small,
+               "%u transfers, %u bytes for the last 8 packets", bno.statistics.transfers - reads,
+               bno.statistics.bytes - bytes);
+
+    test_transport();
+    test_benchmark("replay", capture, length);
+    bno_captureReadEnd(); // Ende des Downloads
+    TEST_CHECK(!bno_captureStart() && bno_captureReadBegin(), "capture not restarted after read");
+    bno_captureStop();
+    if (argc > 1) test_file(argv[1]);
+    return test_result("bnoReplay");
+}
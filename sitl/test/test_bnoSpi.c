@@ -0,0 +1,177 @@
+/*
+ * File: test_bnoSpi.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-07
+ * ----------------------------
+ * Host-Test des SPI-Transports von bno.c gegen den simulierten SensorHub (hub.c). Geprüft werden
+ * Busbelegung und Chipselect, Wake-Anforderung, vollduplexes Senden, Fragmentierung grosser Pakete
+ * und das Zusammenfassen von Interrupts. bno.c wird eingebunden um die statischen Funktionen zu
+ * erreichen. Zuletzt wird der Durchsatz gemessen, test_bnoReplay misst dasselbe für I2C.
+ *
+ * Aufruf: ./test_bnoSpi
+ */
+
+
+#define BNO_TRANSPORT BNO_TRANSPORT_SPI
+
+
+/** Externe Abhängigkeiten **/
+
+#include <string.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "test.h"
+#include "hub.h"
+#include "bno.c"
+
+
+/** Compiler Einstellungen **/
+
+#define TEST_BENCHMARK      0.5         // s
+
+
+/** Private Functions **/
+
+/*
+ * Function: test_payload
+ * ----------------------------
+ * Füllt Nutzdaten mit einem Muster.
+ *
+ * uint8_t *payload: Ziel
+ * uint16_t length: Anzahl Bytes
+ * uint8_t seed: Startwert des Musters
+ */
+static void test_payload(uint8_t *payload, uint16_t length, uint8_t seed) {
+    for (uint16_t i = 0; i < length; ++i) payload[i] = (uint8_t)(seed + 7 * i);
+}
+
+/*
+ * Function: test_transport
+ * ----------------------------
+ * Liest die typische Paketmischung des Hubs (hub_traffic) und gibt Pakete pro Sekunde Rechenzeit,
+ * Transfers und simulierte Buszeit pro Paket aus. Gegenstück für I2C in test_bnoReplay.
+ */
+static void test_transport(void) {
+    uint32_t packets = 0, transfers = bno.statistics.transfers;
+    int64_t bus = hub.now; // läuft nur mit dem SPI-Takt
+    uint16_t length;
+    double start = test_seconds(), elapsed;
+    do {
+        for (int i = 0; i < 64; ++i, ++packets) {
+            hub.log[0] = '\0'; // Busbelegung hier nicht geprüft
+            hub_traffic(packets);
+            while (hub_pending()) bno_receive(&length);
+        }
+    } while ((elapsed = test_seconds() - start) < TEST_BENCHMARK);
+    TEST_CHECK(!hub.errors, "%u bus errors", hub.errors);
+    printf("spi: %.2f M packets/s, %.2f transfers and %.0f us bus per packet\n", packets / elapsed * 1e-6,
+           (double)(bno.statistics.transfers - transfers) / packets, (double)(hub.now - bus) / packets);
+}
+
+
+/** Implementierung **/
+
+int main(int argc, char *argv[]) {
+    hub_reset();
+    hub.wakePin = BNO_SPI_WAKE;
+    uint16_t length;
+    uint8_t payload[300];
+
+    // Initialisierung: Wake hoch (SPI-Modus beim Reset), Modus 3, DMA-Grösse
+    TEST_CHECK(!bno_transportInit(0), "transport init");
+    TEST_CHECK(hub.levels[BNO_SPI_WAKE] == 1, "wake low after init");
+    TEST_CHECK(hub.spiMode == 3, "SPI mode %d", hub.spiMode);
+    TEST_CHECK(hub.spiMaxTransfer == SH2_HAL_MAX_TRANSFER, "max transfer %d", hub.spiMaxTransfer);
+    TEST_CHECK(!hub_pending(), "interrupt pending after init");
+
+    // einzelnes Paket: Header mit gehaltenem CS, Rest im zweiten Transfer, Bus erst danach frei
+    test_payload(payload, 16, 1);
+    hub_send(3, payload, 16);
+    TEST_CHECK(!bno_receive(&length), "receive failed");
+    TEST_CHECK(length == 20, "length %u", length);
+    TEST_CHECK(bno.rxBuffer[0] == 20 && bno.rxBuffer[1] == 0 && bno.rxBuffer[2] == 3 && bno.rxBuffer[3] == 0,
+               "header %02x %02x %02x %02x", bno.rxBuffer[0], bno.rxBuffer[1], bno.rxBuffer[2], bno.rxBuffer[3]);
+    TEST_CHECK(!memcmp(bno.rxBuffer + 4, payload, 16), "payload differs");
+    TEST_CHECK(!strcmp(hub.log, "acquire keep4 xfer16 release "), "bus: %s", hub.log);
+    TEST_CHECK(!hub.errors && !hub.selected && !hub.acquired, "bus state, %u errors", hub.errors);
+    TEST_CHECK(!hub_pending(), "packet not consumed");
+
+    // nichts anstehend: CS wird trotzdem mit einem zweiten Transfer freigegeben
+    hub.log[0] = '\0';
+    TEST_CHECK(bno_receive(&length), "empty receive delivered data");
+    TEST_CHECK(!strcmp(hub.log, "acquire keep4 xfer1 release "), "bus: %s", hub.log);
+    TEST_CHECK(!hub.errors && !hub.selected, "bus state, %u errors", hub.errors);
+
+    // Senden: vormerken und per Wake anfordern, zweite Sendung scheitert solange die erste aussteht
+    uint8_t command[12] = {12, 0, 2, 0};
+    test_payload(command + 4, 8, 100);
+    TEST_CHECK(sh2_hal_tx(command, sizeof(command)) == SH2_OK, "tx failed");
+    TEST_CHECK(hub.levels[BNO_SPI_WAKE] == 0, "wake not asserted");
+    TEST_CHECK(hub_pending(), "wake does not request interrupt");
+    TEST_CHECK(sh2_hal_tx(command, sizeof(command)) == SH2_ERR, "second tx accepted while pending");
+
+    // vollduplex: Hostpaket geht im selben Transfer wie ein längeres Hubpaket
+    test_payload(payload, 40, 50);
+    hub_send(3, payload, 40);
+    hub.log[0] = '\0';
+    TEST_CHECK(!bno_receive(&length), "duplex receive failed");
+    TEST_CHECK(length == 44 && !memcmp(bno.rxBuffer + 4, payload, 40), "duplex rx length %u", length);
+    TEST_CHECK(!strcmp(hub.log, "acquire keep4 xfer40 release "), "bus: %s", hub.log);
+    TEST_CHECK(hub.hostCount == 1 && hub.host[0].length == sizeof(command)
+               && !memcmp(hub.host[0].data, command, sizeof(command)), "host packet differs");
+    TEST_CHECK(hub.levels[BNO_SPI_WAKE] == 1 && !bno.txLength, "tx not completed");
+    TEST_CHECK(!hub_pending(), "still pending after duplex transfer");
+
+    // Senden ohne Hubdaten: Paket geht raus, an sh2 wird nichts geliefert
+    TEST_CHECK(sh2_hal_tx(command, sizeof(command)) == SH2_OK, "tx after completion failed");
+    hub.log[0] = '\0';
+    TEST_CHECK(bno_receive(&length), "tx-only transfer delivered data");
+    TEST_CHECK(!strcmp(hub.log, "acquire keep4 xfer8 release "), "bus: %s", hub.log);
+    TEST_CHECK(hub.hostCount == 2 && !memcmp(hub.host[1].data, command, sizeof(command)), "tx-only packet lost");
+    TEST_CHECK(xSemaphoreTake(bno.txFree, 0) == pdTRUE, "txFree not released");
+    xSemaphoreGive(bno.txFree);
+
+    // grosses Paket: Fragmente à MAX_TRANSFER, Fortsetzungen mit Restlänge und nächster Sequenz
+    test_payload(payload, 300, 200);
+    hub_send(5, payload, 300);
+    uint8_t assembled[300];
+    uint16_t cursor = 0, fragments = 0;
+    while (hub_pending() && fragments < 10) {
+        TEST_CHECK(!bno_receive(&length), "fragment %u failed", fragments);
+        uint16_t header = bno.rxBuffer[0] | (bno.rxBuffer[1] << 8);
+        uint16_t expected = (300 - cursor + 4) | (fragments ? 0x8000 : 0);
+        TEST_CHECK(header == expected, "fragment %u header %04x, expected %04x", fragments, header, expected);
+        TEST_CHECK(bno.rxBuffer[2] == 5 && bno.rxBuffer[3] == fragments, "fragment %u channel %u seq %u",
+                   fragments, bno.rxBuffer[2], bno.rxBuffer[3]);
+        TEST_CHECK(length <= SH2_HAL_MAX_TRANSFER, "fragment %u length %u", fragments, length);
+        uint16_t cargo = (header & 0x7fff) < length ? (header & 0x7fff) : length;
+        memcpy(assembled + cursor, bno.rxBuffer + 4, cargo - 4);
+        cursor += cargo - 4;
+        ++fragments;
+    }
+    TEST_CHECK(fragments == 3 && cursor == 300, "%u fragments, %u bytes", fragments, cursor);
+    TEST_CHECK(!memcmp(assembled, payload, 300), "reassembled payload differs");
+    TEST_CHECK(!hub.errors, "%u bus errors", hub.errors);
+
+    // Interrupts: Zeitstempel als Notification, ein zweiter vor dem Abholen wird zusammengefasst
+    bno.interruptPin = GPIO_NUM_4;
+    bno.task = (TaskHandle_t)&hub;
+    hub.interruptPin = bno.interruptPin;
+    hub.isr = &bno_interrupt;
+    hub.now = 0x123456789LL;
+    hub_send(3, payload, 16);
+    TEST_CHECK(hub_interrupt() && hub_interrupt(), "no interrupt");
+    uint32_t notified;
+    TEST_CHECK(xTaskNotifyWait(0, 0, &notified, 0) == pdTRUE && notified == 0x23456789, "notification %08x",
+               notified);
+    TEST_CHECK(bno.statistics.interrupts == 2 && bno.statistics.coalesced == 1, "interrupts %u, coalesced %u",
+               bno.statistics.interrupts, bno.statistics.coalesced);
+    TEST_CHECK(!bno_receive(&length) && !hub_interrupt(), "interrupt after last packet");
+    TEST_CHECK(gpio_get_level(bno.interruptPin) == 1, "interrupt pin low");
+
+    test_transport();
+    return test_result("bnoSpi");
+}
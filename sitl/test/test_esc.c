@@ -0,0 +1,136 @@
+/*
+ * File: test_esc.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-08
+ * ----------------------------
+ * Host-Test der ESC-Kodierung (esc.c). Geprüft wird:
+ *  - DShot-Frame gegen den veröffentlichten Wert 1046 -> 0x82C6, Telemetrie-Bit und CRC aller Werte
+ *  - Abbildung von Throttle auf den DShot-Wertebereich
+ *  - Bitzeiten von DShot300/600 gegen die Spezifikation, MSB zuerst, Endmarke
+ *  - Pulsbreiten von OneShot125 und die Übertragungsdauer
+ *
+ * Aufruf: ./test_esc
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdlib.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "test.h"
+#include "esc.h"
+
+
+/** Compiler Einstellungen **/
+
+#define TEST_TOLERANCE  2   // RMT-Takte, Rundung der Bitdauer
+
+
+/** Variablendeklaration **/
+
+typedef struct {
+    uint32_t high, low;     // RMT-Takte
+    bool level0, level1;
+} test_item_t;
+
+static const struct {
+    const char *name;
+    esc_protocol_t protocol;
+    uint32_t bit, one, zero; // RMT-Takte laut Spezifikation: 1.67/1.25/0.625 us bei 600 kBit/s
+    uint32_t duration;       // us, 16 Bit
+} test_dshot[] = {
+    {"DShot600", ESC_PROTOCOL_DSHOT600, 133, 100, 50, 26},
+    {"DShot300", ESC_PROTOCOL_DSHOT300, 267, 200, 100, 53}
+};
+
+
+/** Private Functions **/
+
+/*
+ * Function: test_decode
+ * ----------------------------
+ * Zerlegt ein RMT-Item (duration0:15, level0:1, duration1:15, level1:1).
+ *
+ * uint32_t item: RMT-Item
+ *
+ * returns: Dauer und Pegel beider Hälften
+ */
+static test_item_t test_decode(uint32_t item) {
+    return (test_item_t){item & 0x7FFF, item >> 16 & 0x7FFF, item >> 15 & 1, item >> 31};
+}
+
+/*
+ * Function: test_near
+ * ----------------------------
+ * Liegt ein Wert innerhalb der Toleranz?
+ */
+static bool test_near(uint32_t value, uint32_t expected) {
+    return abs((int32_t)value - (int32_t)expected) <= TEST_TOLERANCE;
+}
+
+
+/** Implementierung **/
+
+int main(int argc, char *argv[]) {
+    // Frame: 11 Bit Wert, Telemetrie, CRC als XOR der drei oberen Nibbles
+    TEST_CHECK(esc_dshotFrame(1046, false) == 0x82C6, "frame 1046: %04x", esc_dshotFrame(1046, false));
+    TEST_CHECK(esc_dshotFrame(1046, true) == 0x82D7, "frame 1046 telemetry: %04x", esc_dshotFrame(1046, true));
+    TEST_CHECK(esc_dshotFrame(ESC_DSHOT_STOP, false) == 0x0000, "stop frame: %04x", esc_dshotFrame(0, false));
+    for (uint16_t value = 0; value <= ESC_DSHOT_MAX; ++value) {
+        for (uint8_t telemetry = 0; telemetry < 2; ++telemetry) {
+            uint16_t frame = esc_dshotFrame(value, telemetry);
+            uint8_t crc = (frame ^ frame >> 4 ^ frame >> 8 ^ frame >> 12) & 0xF;
+            TEST_CHECK(frame >> 5 == value && (frame >> 4 & 1) == telemetry && !crc, "frame %u/%u: %04x", value,
+                       telemetry, frame);
+        }
+    }
+
+    // Throttle: negativ stoppt, 0.0 bis 1.0 linear auf 48 bis 2047, darüber begrenzt
+    TEST_CHECK(esc_dshotValue(-0.1f) == ESC_DSHOT_STOP, "negative: %u", esc_dshotValue(-0.1f));
+    TEST_CHECK(esc_dshotValue(0.0f) == ESC_DSHOT_MIN, "zero: %u", esc_dshotValue(0.0f));
+    TEST_CHECK(esc_dshotValue(0.5f) == 1048, "half: %u", esc_dshotValue(0.5f));
+    TEST_CHECK(esc_dshotValue(1.0f) == ESC_DSHOT_MAX, "full: %u", esc_dshotValue(1.0f));
+    TEST_CHECK(esc_dshotValue(1.5f) == ESC_DSHOT_MAX, "above: %u", esc_dshotValue(1.5f));
+
+    // Bitzeiten: high zuerst, Summe eine Bitdauer, MSB zuerst, danach Endmarke
+    for (size_t p = 0; p < sizeof(test_dshot) / sizeof(test_dshot[0]); ++p) {
+        uint32_t items[ESC_ITEMS];
+        esc_dshotEncode(0x82C6, test_dshot[p].protocol, items);
+        for (uint8_t i = 0; i < ESC_DSHOT_BITS; ++i) {
+            test_item_t item = test_decode(items[i]);
+            bool one = 0x82C6 & (0x8000 >> i);
+            TEST_CHECK(item.level0 && !item.level1, "%s bit %u levels", test_dshot[p].name, i);
+            TEST_CHECK(test_near(item.high, one ? test_dshot[p].one : test_dshot[p].zero), "%s bit %u high %u",
+                       test_dshot[p].name, i, item.high);
+            TEST_CHECK(test_near(item.high + item.low, test_dshot[p].bit), "%s bit %u period %u", test_dshot[p].name,
+                       i, item.high + item.low);
+        }
+        TEST_CHECK(items[ESC_DSHOT_BITS] == 0, "%s end marker %08x", test_dshot[p].name, items[ESC_DSHOT_BITS]);
+        uint32_t duration = esc_duration(test_dshot[p].protocol, 0.0f);
+        TEST_CHECK(duration == test_dshot[p].duration, "%s duration %u us", test_dshot[p].name, duration);
+    }
+
+    // OneShot125: 125 bis 250 us high, 1 us low, begrenzt
+    const struct {
+        float throttle;
+        uint32_t pulse; // us
+    } oneshot[] = {{-1.0f, 125}, {0.0f, 125}, {0.5f, 187}, {1.0f, 250}, {2.0f, 250}};
+    for (size_t n = 0; n < sizeof(oneshot) / sizeof(oneshot[0]); ++n) {
+        uint32_t items[ESC_ITEMS];
+        esc_oneshotEncode(oneshot[n].throttle, items);
+        test_item_t item = test_decode(items[0]);
+        uint32_t ticks = ESC_CLOCK / 1000000;
+        TEST_CHECK(item.level0 && !item.level1 && item.low == ticks, "oneshot %.1f levels", oneshot[n].throttle);
+        TEST_CHECK(abs((int32_t)item.high - (int32_t)(oneshot[n].pulse * ticks)) <= (int32_t)ticks,
+                   "oneshot %.1f pulse %u ticks", oneshot[n].throttle, item.high);
+        TEST_CHECK(items[1] == 0, "oneshot %.1f end marker", oneshot[n].throttle);
+        uint32_t duration = esc_duration(ESC_PROTOCOL_ONESHOT125, oneshot[n].throttle);
+        TEST_CHECK(duration == oneshot[n].pulse, "oneshot %.1f duration %u us", oneshot[n].throttle, duration);
+    }
+    TEST_CHECK(esc_duration(ESC_PROTOCOL_PWM, 0.5f) == 0, "PWM duration not 0");
+    return test_result("esc");
+}
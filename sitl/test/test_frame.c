@@ -0,0 +1,337 @@
+/*
+ * File: test_frame.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-06
+ * ----------------------------
+ * Host-Test und Durchsatz-Benchmark des Frame-Decoders (frame.c). Grundlage ist die Aufzeichnung
+ * des GNSS-Empfängers in sensing/gpsTest: NMEA mit Störungen beim Einschalten. Darin werden UBX-
+ * bzw. MSPv2-Frames eingestreut, u.a. die Beispiele aus gpsTest/crc.py, und der Strom in
+ * verschiedenen Stückelungen dekodiert. Erwartet wird jedes Frame genau einmal mit richtiger
+ * Payload und Startposition, unabhängig von der Stückelung.
+ *
+ * Aufruf: ./test_frame [aufzeichnung.txt]
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "test.h"
+#include "frame.h"
+
+
+/** Compiler Einstellungen **/
+
+#define TEST_CAPTURE        "../src/sensing/gpsTest/2020-01-15_19-31-50.txt"
+#define TEST_STREAM_MAX     16384
+#define TEST_FRAMES_MAX     32
+#define TEST_BUFFER         64      // Decoder-Buffer, wie gps.c bzw. flow.c klein gehalten
+#define TEST_BENCH_BYTES    (64 * 1024 * 1024)
+
+
+/** Variablendeklaration **/
+
+typedef struct {
+    uint16_t id;
+    uint8_t payload[TEST_BUFFER];
+    uint16_t length;
+    uint32_t start;
+} test_frame_t;
+
+static struct {
+    uint8_t stream[TEST_STREAM_MAX];
+    size_t length;
+    test_frame_t expected[TEST_FRAMES_MAX];
+    uint8_t expectedCount;
+    test_frame_t received[TEST_FRAMES_MAX];
+    uint8_t receivedCount;
+    uint32_t handled;   // im Benchmark nur zählen
+    bool bench;
+} test;
+
+// Namen der Steuerzeichen wie im Export des Logic-Analyzers
+static const char *test_controls[32] = {
+    "NUL", "SOH", "STX", "ETX", "EOT", "ENQ", "ACK", "BEL", "BS", "HT", "LF", "VT", "FF", "CR", "SO", "SI",
+    "DLE", "DC1", "DC2", "DC3", "DC4", "NAK", "SYN", "ETB", "CAN", "EM", "SUB", "ESC", "FS", "GS", "RS", "US"
+};
+
+// Beispiele aus gpsTest/crc.py mit dort berechneter Prüfsumme
+static const uint8_t test_ubxPrt[] = {
+    0xb5, 0x62, 0x06, 0x00, 0x14, 0x00, 0x01, 0x00, 0x00, 0x00, 0xc0, 0x08, 0x00, 0x00,
+    0x00, 0xe8, 0x03, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0xd0, 0xf8
+};
+static const uint8_t test_ubxPms[] = {
+    0xb5, 0x62, 0x06, 0x86, 0x08, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x95, 0x61
+};
+
+
+/** Private Functions **/
+
+/*
+ * Function: test_capture
+ * ----------------------------
+ * Liest die CSV-Aufzeichnung "Time [s],Value,Parity Error,Framing Error" in Bytes. Wie test.py:
+ * ein Komma im Wert ergibt ein leeres Feld und eine zusätzliche Spalte.
+ *
+ * const char *path: Datei
+ * uint8_t *data: Ziel
+ * size_t size: Grösse des Ziels
+ *
+ * returns: Anzahl Bytes, 0 bei Fehler
+ */
+static size_t test_capture(const char *path, uint8_t *data, size_t size) {
+    FILE *file = fopen(path, "r");
+    if (!file) return 0;
+    char line[128];
+    size_t length = 0;
+    if (!fgets(line, sizeof(line), file)) length = size; // Kopfzeile
+    while (length < size && fgets(line, sizeof(line), file)) {
+        char *value = strchr(line, ',');
+        if (!value) continue;
+        ++value;
+        char *end = strchr(value, ',');
+        if (!end) continue;
+        *end = '\0';
+        while (end > value && end[-1] == ' ') *--end = '\0'; // "CR " usw.
+        uint8_t fields = 3; // bis und mit Feld nach dem Wert
+        for (char *c = end + 1; *c; ++c) fields += *c == ',';
+        int byte = -1;
+        if (!*value) byte = (fields == 5) ? ',' : -1;
+        else if (!strcmp(value, "(SP)")) byte = ' ';
+        else if (!strcmp(value, "DEL")) byte = 0x7f;
+        else if (value[0] == '(') byte = atoi(value + 1);
+        else if (!value[1]) byte = (uint8_t)value[0];
+        else for (uint8_t i = 0; i < 32; ++i) if (!strcmp(value, test_controls[i])) byte = i;
+        if (byte < 0) continue;
+        data[length++] = byte;
+    }
+    fclose(file);
+    return length;
+}
+
+/*
+ * Function: test_nmea
+ * ----------------------------
+ * Zählt NMEA-Sätze mit gültiger Prüfsumme, um das Einlesen der Aufzeichnung zu prüfen.
+ *
+ * returns: Anzahl gültige Sätze
+ */
+static uint32_t test_nmea(const uint8_t *data, size_t length) {
+    uint32_t valid = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (data[i] != '$') continue;
+        uint8_t sum = 0;
+        size_t j = i + 1;
+        while (j < length && data[j] != '*' && data[j] != '$') sum ^= data[j++];
+        unsigned int expected;
+        if (j + 2 < length && data[j] == '*' && sscanf((const char*)&data[j + 1], "%2x", &expected) == 1
+            && expected == sum) ++valid;
+    }
+    return valid;
+}
+
+/*
+ * Function: test_crc8
+ * ----------------------------
+ * Bitweise CRC8 DVB-S2 als Referenz zur Tabelle in frame.c.
+ */
+static uint8_t test_crc8(uint8_t crc, const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (uint8_t b = 0; b < 8; ++b) crc = (crc & 0x80) ? (crc << 1) ^ 0xd5 : crc << 1;
+    }
+    return crc;
+}
+
+/*
+ * Function: test_insert
+ * ----------------------------
+ * Fügt ein Frame an einer Position in den Strom ein und merkt es sich wenn es erwartet wird.
+ *
+ * size_t position: Einfügeposition, auch mitten in einem NMEA-Satz
+ * const uint8_t *frame: vollständiges Frame
+ * size_t length: Länge des Frames
+ * uint16_t id: Id des Frames
+ * size_t header: Bytes vor der Payload
+ * bool expected: wird an den Handler weitergeleitet
+ */
+static void test_insert(size_t position, const uint8_t *frame, size_t length, uint16_t id, size_t header, bool expected) {
+    memmove(&test.stream[position + length], &test.stream[position], test.length - position);
+    memcpy(&test.stream[position], frame, length);
+    test.length += length;
+    for (uint8_t i = 0; i < test.expectedCount; ++i) { // bereits eingefügte verschieben
+        if (test.expected[i].start >= position) test.expected[i].start += length;
+    }
+    if (!expected) return;
+    uint8_t i = test.expectedCount++; // nach Position sortiert, wie sie empfangen werden
+    while (i && test.expected[i - 1].start > position) {
+        test.expected[i] = test.expected[i - 1];
+        --i;
+    }
+    test_frame_t *e = &test.expected[i];
+    e->id = id;
+    e->start = position;
+    e->length = length - header - ((frame[0] == 0xb5) ? 2 : 1);
+    memcpy(e->payload, &frame[header], e->length);
+}
+
+/*
+ * Function: test_handler
+ * ----------------------------
+ * Handler aller Routen, zeichnet empfangene Frames auf.
+ */
+static void test_handler(const frame_t *frame) {
+    ++test.handled;
+    if (test.bench || test.receivedCount >= TEST_FRAMES_MAX) return;
+    test_frame_t *r = &test.received[test.receivedCount++];
+    r->id = frame->id;
+    r->start = frame->start;
+    r->length = frame->length;
+    memcpy(r->payload, frame->payload, frame->length <= TEST_BUFFER ? frame->length : TEST_BUFFER);
+}
+
+/*
+ * Function: test_decode
+ * ----------------------------
+ * Dekodiert den ganzen Strom mit neuem Decoder in Stücken der gegebenen Grösse und vergleicht
+ * die empfangenen mit den erwarteten Frames.
+ *
+ * const char *name: Bezeichnung für Meldungen
+ * frame_decoder_t *decoder: Decoder, wird neu initialisiert
+ * size_t chunk: Stückgrösse, 0 für zufällige Stücke von 1 bis 300 Bytes
+ * uint32_t errors: erwartete Prüfsummenfehler
+ * uint32_t dropped: erwartete verworfene Frames
+ */
+static void test_decode(const char *name, frame_decoder_t *decoder, size_t chunk, uint32_t errors, uint32_t dropped) {
+    static uint8_t buffer[TEST_BUFFER];
+    frame_init(decoder, decoder->protocol, decoder->routes, decoder->routeCount, buffer, sizeof(buffer));
+    test.receivedCount = 0;
+    for (size_t i = 0; i < test.length;) {
+        size_t n = chunk ? chunk : 1 + rand() % 300;
+        if (n > test.length - i) n = test.length - i;
+        frame_decode(decoder, &test.stream[i], n, i);
+        i += n;
+    }
+    const frame_statistics_t *s = &decoder->statistics;
+    TEST_CHECK(test.receivedCount == test.expectedCount, "%s chunk %zu: %u of %u frames", name, chunk,
+               test.receivedCount, test.expectedCount);
+    TEST_CHECK(s->errors == errors, "%s chunk %zu: %u errors, expected %u", name, chunk, s->errors, errors);
+    TEST_CHECK(s->dropped == dropped, "%s chunk %zu: %u dropped, expected %u", name, chunk, s->dropped, dropped);
+    if (chunk == 1) TEST_CHECK(s->copied == s->frames, "%s chunk 1: only %u of %u copied", name, s->copied, s->frames);
+    if (chunk >= test.length) TEST_CHECK(!s->copied, "%s whole stream: %u copied", name, s->copied);
+    for (uint8_t i = 0; i < test.receivedCount && i < test.expectedCount; ++i) {
+        const test_frame_t *r = &test.received[i], *e = &test.expected[i];
+        TEST_CHECK(r->id == e->id && r->length == e->length && r->start == e->start
+                   && !memcmp(r->payload, e->payload, e->length),
+                   "%s chunk %zu: frame %u id 0x%04x at %u, expected id 0x%04x at %u", name, chunk, i,
+                   r->id, r->start, e->id, e->start);
+    }
+}
+
+/*
+ * Function: test_bench
+ * ----------------------------
+ * Misst den Durchsatz des Decoders über den wiederholten Strom.
+ *
+ * size_t chunk: Stückgrösse
+ *
+ * returns: MB/s
+ */
+static double test_bench(frame_decoder_t *decoder, size_t chunk) {
+    static uint8_t buffer[TEST_BUFFER];
+    frame_init(decoder, decoder->protocol, decoder->routes, decoder->routeCount, buffer, sizeof(buffer));
+    test.bench = true;
+    test.handled = 0;
+    uint32_t rounds = TEST_BENCH_BYTES / test.length, position = 0;
+    double start = test_seconds();
+    for (uint32_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < test.length; i += chunk) {
+            size_t n = (chunk < test.length - i) ? chunk : test.length - i;
+            frame_decode(decoder, &test.stream[i], n, position);
+            position += n;
+        }
+    }
+    double seconds = test_seconds() - start;
+    test.bench = false;
+    TEST_CHECK(test.handled == rounds * test.expectedCount, "bench chunk %zu: %u of %u frames", chunk,
+               test.handled, rounds * test.expectedCount);
+    return (double)rounds * test.length / seconds * 1e-6;
+}
+
+
+/** Implementierung **/
+
+int main(int argc, char *argv[]) {
+    static uint8_t capture[TEST_STREAM_MAX];
+    const char *path = (argc > 1) ? argv[1] : TEST_CAPTURE;
+    size_t captured = test_capture(path, capture, sizeof(capture) - 1024);
+    if (!captured) {
+        printf("%s: can't read capture\n", path);
+        return 1;
+    }
+    uint32_t sentences = test_nmea(capture, captured);
+    printf("capture: %zu bytes, %u valid NMEA sentences\n", captured, sentences);
+    TEST_CHECK(sentences >= 300, "only %u valid NMEA sentences, capture misparsed", sentences);
+    srand(1);
+
+    // UBX, Prüfsummen von crc.py, zusätzlich ein fehlerhaftes und ein unbekanntes Frame
+    frame_decoder_t decoder;
+    static const frame_route_t ubxRoutes[] = {{0x0600, test_handler}, {0x0686, test_handler}};
+    decoder.protocol = FRAME_UBX;
+    decoder.routes = ubxRoutes;
+    decoder.routeCount = sizeof(ubxRoutes) / sizeof(frame_route_t);
+    memcpy(test.stream, capture, captured);
+    test.length = captured;
+    test.expectedCount = 0;
+    test_decode("UBX NMEA only", &decoder, 64, 0, 0);
+    uint8_t corrupt[sizeof(test_ubxPrt)], unknown[sizeof(test_ubxPms)];
+    memcpy(corrupt, test_ubxPrt, sizeof(corrupt));
+    corrupt[10] ^= 0x01;
+    memcpy(unknown, test_ubxPms, sizeof(unknown));
+    unknown[3] = 0x87;
+    for (uint8_t i = 0; i < 8; ++i) {
+        size_t position = captured * i / 8;
+        if (i & 1) test_insert(position, test_ubxPms, sizeof(test_ubxPms), 0x0686, 6, true);
+        else test_insert(position, test_ubxPrt, sizeof(test_ubxPrt), 0x0600, 6, true);
+    }
+    test_insert(captured * 3 / 16, corrupt, sizeof(corrupt), 0, 0, false);
+    test_insert(captured * 11 / 16, unknown, sizeof(unknown), 0, 0, false);
+    // direkt an Störungen und am Ende des Stroms
+    test_insert(0, test_ubxPms, sizeof(test_ubxPms), 0x0686, 6, true);
+    test_insert(test.length, test_ubxPrt, sizeof(test_ubxPrt), 0x0600, 6, true);
+    static const size_t chunks[] = {1, 2, 3, 5, 7, 13, 64, 256, 0, TEST_STREAM_MAX};
+    for (uint8_t i = 0; i < sizeof(chunks) / sizeof(size_t); ++i) test_decode("UBX", &decoder, chunks[i], 1, 1);
+    double ubxWhole = test_bench(&decoder, test.length), ubxChunk = test_bench(&decoder, 64);
+
+    // MSPv2 wie vom Flowsensor, Referenz-CRC bitweise gegen Prüfwert des Standards
+    TEST_CHECK(test_crc8(0, (const uint8_t*)"123456789", 9) == 0xbc, "CRC8 DVB-S2 reference broken");
+    static const frame_route_t mspRoutes[] = {{0x1f01, test_handler}, {0x1f02, test_handler}};
+    decoder.protocol = FRAME_MSPV2;
+    decoder.routes = mspRoutes;
+    decoder.routeCount = sizeof(mspRoutes) / sizeof(frame_route_t);
+    memcpy(test.stream, capture, captured);
+    test.length = captured;
+    test.expectedCount = 0;
+    test_decode("MSPv2 NMEA only", &decoder, 64, 0, 0);
+    for (uint8_t i = 0; i < 10; ++i) {
+        uint8_t frame[8 + 9 + 1] = {'$', 'X', '<', 0x00, 0x01 + (i & 1), 0x1f, 5 + 4 * (i & 1), 0x00};
+        size_t length = 8 + frame[6];
+        for (uint8_t j = 8; j < length; ++j) frame[j] = i * 17 + j;
+        frame[length] = test_crc8(0, &frame[3], length - 3);
+        if (i == 3) frame[length] ^= 0x80;
+        if (i == 7) frame[5] = 0x1e;
+        test_insert(captured * i / 10, frame, length + 1, frame[5] << 8 | frame[4], 8, i != 3 && i != 7);
+    }
+    for (uint8_t i = 0; i < sizeof(chunks) / sizeof(size_t); ++i) test_decode("MSPv2", &decoder, chunks[i], 1, 1);
+    double mspWhole = test_bench(&decoder, test.length), mspChunk = test_bench(&decoder, 64);
+
+    printf("throughput UBX: %.0f MB/s whole, %.0f MB/s in 64 byte chunks\n", ubxWhole, ubxChunk);
+    printf("throughput MSPv2: %.0f MB/s whole, %.0f MB/s in 64 byte chunks\n", mspWhole, mspChunk);
+    return test_result("frame");
+}
@@ -0,0 +1,386 @@
+/*
+ * File: test_gps.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-09
+ * ----------------------------
+ * Host-Test der AssistNow Daten (gps.c). gps_assistCheck prüft eine synthetische MGA-Datei: gültig,
+ * an jeder Stelle abgeschnitten, mit je einem veränderten Byte und mit einem Frame fremder Class.
+ * Danach wird die Datei hochgeladen, im NVS gespeichert und von gps_assistReplay an einen simulierten
+ * Empfänger gesendet: mit UBX-MGA-ACK, ohne (Pausen) und mit einem Empfänger der nicht mehr bestätigt.
+ * Der Empfänger zählt jedes Frame das vor der Bestätigung bzw. Pause des vorherigen ankommt.
+ *
+ * Aufruf: ./test_gps
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "test.h"
+#include "gps.c"
+
+
+/** Compiler Einstellungen **/
+
+#define TEST_FRAMES     40      // MGA Frames der Datei, über mehrere NVS Blöcke
+#define TEST_REJECTED   5       // dieses Frame lehnt der Empfänger ab
+#define TEST_CHUNK      100     // Bytes pro gps_assistWrite, wie der Upload über HTTP
+#define TEST_NVS_MAX    16
+
+
+/** Variablendeklaration **/
+
+typedef enum {
+    TEST_RECEIVER_ACK,          // bestätigt ackAiding und jedes MGA Frame
+    TEST_RECEIVER_PACED,        // lehnt ackAiding ab, älterer Empfänger
+    TEST_RECEIVER_SILENT        // bestätigt ackAiding, danach kein UBX-MGA-ACK
+} test_receiver_t;
+
+static const struct {
+    uint8_t id;
+    uint8_t length;
+} test_types[] = {
+    {0x40, 24},                 // MGA-INI-TIME_UTC
+    {0x00, 68},                 // MGA-GPS-EPH
+    {0x06, 48},                 // MGA-GLO-EPH
+    {0x20, 76}                  // MGA-ANO
+};
+
+static struct {
+    // Datei
+    uint8_t file[GPS_ASSIST_SIZE];
+    uint32_t length;
+    uint32_t starts[TEST_FRAMES + 1]; // Anfang jedes Frames, zuletzt Dateiende
+    // Empfänger
+    test_receiver_t receiver;
+    uint8_t received[GPS_ASSIST_SIZE];
+    uint32_t receivedLength;
+    uint16_t receivedFrames;
+    bool outstanding;           // UBX-MGA-ACK noch nicht gelesen
+    uint32_t overruns;          // Frame zu früh
+    TickType_t lastFrame;
+    // rx-Ringbuffer
+    uint8_t rx[256];
+    uint32_t rxLength;
+    uint32_t rxRead;
+    uint32_t rxPosition;
+    TickType_t now;
+    // NVS
+    struct {
+        char key[16];
+        uint8_t data[GPS_ASSIST_BLOCK];
+        size_t length;
+    } nvs[TEST_NVS_MAX];
+    uint8_t nvsCount;
+} test;
+
+
+/** Private Functions **/
+
+/*
+ * Function: test_checksum
+ * ----------------------------
+ * Setzt die Prüfsumme eines UBX-Frames.
+ */
+static void test_checksum(uint8_t *frame, uint16_t length) {
+    uint8_t ckA = 0, ckB = 0;
+    for (uint16_t i = 2; i < length - 2; ++i) {
+        ckA += frame[i];
+        ckB += ckA;
+    }
+    frame[length - 2] = ckA;
+    frame[length - 1] = ckB;
+}
+
+/*
+ * Function: test_generate
+ * ----------------------------
+ * Erzeugt die MGA-Datei mit zufälligem Payload.
+ */
+static void test_generate(void) {
+    uint32_t random = 1;
+    for (uint16_t n = 0; n < TEST_FRAMES; ++n) {
+        uint8_t *frame = test.file + test.length;
+        uint8_t length = test_types[n % 4].length;
+        test.starts[n] = test.length;
+        frame[0] = 0xb5;
+        frame[1] = 0x62;
+        frame[2] = 0x13;
+        frame[3] = test_types[n % 4].id;
+        frame[4] = length;
+        frame[5] = 0;
+        for (uint8_t i = 0; i < length; ++i) {
+            random = random * 1664525u + 1013904223u;
+            frame[6 + i] = random >> 24;
+        }
+        test_checksum(frame, 8 + length);
+        test.length += 8 + length;
+    }
+    test.starts[TEST_FRAMES] = test.length;
+}
+
+/*
+ * Function: test_respond
+ * ----------------------------
+ * Hängt eine Antwort des Empfängers an den rx-Ringbuffer, verworfen wenn dieser voll ist.
+ */
+static void test_respond(uint8_t class, uint8_t id, const uint8_t *payload, uint8_t length) {
+    if (test.rxLength + 8 + length > sizeof(test.rx)) return;
+    uint8_t *frame = test.rx + test.rxLength;
+    frame[0] = 0xb5;
+    frame[1] = 0x62;
+    frame[2] = class;
+    frame[3] = id;
+    frame[4] = length;
+    frame[5] = 0;
+    memcpy(frame + 6, payload, length);
+    test_checksum(frame, 8 + length);
+    test.rxLength += 8 + length;
+}
+
+/*
+ * Function: test_replay
+ * ----------------------------
+ * Spielt die gespeicherte Datei an einen Empfänger.
+ *
+ * test_receiver_t receiver: Verhalten des Empfängers
+ *
+ * returns: Ticks der Wiedergabe
+ */
+static TickType_t test_replay(test_receiver_t receiver) {
+    test.receiver = receiver;
+    test.receivedLength = 0;
+    test.receivedFrames = 0;
+    test.overruns = 0;
+    test.outstanding = false;
+    TickType_t start = test.now;
+    gps_assistReplay();
+    return test.now - start;
+}
+
+
+/** Ersatz für UART (uart.c) **/
+
+bool uart_init(uart_port_t uartNum, gpio_num_t txPin, gpio_num_t rxPin, uint32_t baud_rate) {
+    return false;
+}
+
+bool uart_baud(uart_port_t uartNum, uint32_t baud_rate) {
+    return false;
+}
+
+void uart_rxFifoReset(uart_port_t uartNum) {
+}
+
+bool uart_rxWait(uart_port_t uartNum, int64_t *timestamp, TickType_t timeout) {
+    if (test.rxRead < test.rxLength) return false;
+    test.now += timeout;
+    return true;
+}
+
+int64_t uart_rxTimestamp(uart_port_t uartNum, uint32_t position) {
+    return 0;
+}
+
+uint32_t uart_rxPosition(uart_port_t uartNum) {
+    return test.rxPosition;
+}
+
+size_t uart_rxPeek(uart_port_t uartNum, const uint8_t **data) {
+    *data = test.rx + test.rxRead;
+    return test.rxLength - test.rxRead;
+}
+
+void uart_rxConsume(uart_port_t uartNum, size_t length) {
+    test.rxRead += length;
+    test.rxPosition += length;
+    if (test.rxRead < test.rxLength) return;
+    test.rxRead = test.rxLength = 0;
+    test.outstanding = false;
+}
+
+bool uart_writeBlock(uart_port_t uartNum, const uint8_t *data, size_t length, TickType_t timeout) {
+    if (data[2] == 0x06 && data[3] == 0x23) { // UBX-CFG-NAVX5, ackAiding
+        const uint8_t ack[2] = {0x06, 0x23};
+        test_respond(0x05, (test.receiver == TEST_RECEIVER_PACED) ? 0x00 : 0x01, ack, 2);
+        return false;
+    }
+    if (data[2] != 0x13) return false;
+    // zu früh: UBX-MGA-ACK des vorherigen nicht gelesen oder Pause nicht abgewartet
+    if (test.outstanding) ++test.overruns;
+    if (test.receiver == TEST_RECEIVER_PACED && test.receivedFrames && test.now - test.lastFrame < GPS_ASSIST_PACING) {
+        ++test.overruns;
+    }
+    test.lastFrame = test.now;
+    if (test.receivedLength + length <= sizeof(test.received)) {
+        memcpy(test.received + test.receivedLength, data, length);
+        test.receivedLength += length;
+    }
+    if (test.receiver != TEST_RECEIVER_PACED) test.outstanding = true;
+    if (test.receiver == TEST_RECEIVER_ACK) { // UBX-MGA-ACK-DATA0
+        bool accepted = test.receivedFrames != TEST_REJECTED;
+        const uint8_t ack[8] = {accepted, 0, accepted ? 0 : 1, data[3], data[6], data[7], data[8], data[9]};
+        test_respond(0x13, 0x60, ack, 8);
+    }
+    ++test.receivedFrames;
+    return false;
+}
+
+bool uart_txWait(uart_port_t uartNum, TickType_t timeout) {
+    return false;
+}
+
+
+/** Ersatz für FreeRTOS, ESP-IDF und übrige Module **/
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    return pdTRUE; // läuft nicht, der Test ruft die Wiedergabe selbst auf
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return test.now;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    test.now += ticks;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t wait) {
+    return pdTRUE;
+}
+
+int64_t esp_timer_get_time(void) {
+    return (int64_t)test.now * portTICK_PERIOD_MS * 1000;
+}
+
+void shim_log(esp_log_level_t level, const char *tag, const char *format, ...) {
+}
+
+void intercom_pvPublish(QueueHandle_t publisher, uint32_t pvNum, value_t value) {
+}
+
+void timebase_gpsEpoch(uint32_t iTow, int64_t timestamp) {
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode mode, nvs_handle *handle) {
+    *handle = 0;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle handle) {
+}
+
+esp_err_t nvs_commit(nvs_handle handle) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *value, size_t *length) {
+    for (uint8_t i = 0; i < test.nvsCount; ++i) {
+        if (strcmp(test.nvs[i].key, key)) continue;
+        if (*length < test.nvs[i].length) return ESP_FAIL;
+        memcpy(value, test.nvs[i].data, test.nvs[i].length);
+        *length = test.nvs[i].length;
+        return ESP_OK;
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length) {
+    uint8_t i = 0;
+    while (i < test.nvsCount && strcmp(test.nvs[i].key, key)) ++i;
+    if (i >= TEST_NVS_MAX || length > GPS_ASSIST_BLOCK) return ESP_FAIL;
+    if (i == test.nvsCount) ++test.nvsCount;
+    strcpy(test.nvs[i].key, key);
+    memcpy(test.nvs[i].data, value, length);
+    test.nvs[i].length = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *value) {
+    size_t length = sizeof(*value);
+    return nvs_get_blob(handle, key, value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle handle, const char *key, uint32_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+
+/** Implementierung **/
+
+int main(int argc, char *argv[]) {
+    test_generate();
+    TEST_CHECK(gps_assistCheck(test.file, test.length) == TEST_FRAMES, "valid file: %u frames",
+               gps_assistCheck(test.file, test.length));
+    TEST_CHECK(gps_assistCheck(test.file, 0) == 0, "empty file accepted");
+
+    // abgeschnitten: nur an Framegrenzen gültig, mit den vollständigen Frames davor
+    uint32_t boundary = 0;
+    for (uint32_t length = 1; length < test.length; ++length) {
+        while (test.starts[boundary + 1] <= length) ++boundary;
+        uint16_t expected = (test.starts[boundary] == length) ? boundary : 0;
+        uint16_t frames = gps_assistCheck(test.file, length);
+        TEST_CHECK(frames == expected, "truncated to %u: %u frames, expected %u", length, frames, expected);
+    }
+
+    // jedes Byte verändert: Sync, Class, Länge, Payload oder Prüfsumme
+    for (uint32_t i = 0; i < test.length; ++i) {
+        test.file[i] ^= 0x01;
+        uint16_t frames = gps_assistCheck(test.file, test.length);
+        TEST_CHECK(frames == 0, "byte %u corrupt: %u frames", i, frames);
+        test.file[i] ^= 0x01;
+    }
+
+    // gültiges Frame fremder Class (UBX-NAV)
+    uint8_t *frame = test.file + test.starts[1];
+    frame[2] = 0x01;
+    test_checksum(frame, test.starts[2] - test.starts[1]);
+    TEST_CHECK(gps_assistCheck(test.file, test.length) == 0, "UBX-NAV frame accepted");
+    frame[2] = 0x13;
+    test_checksum(frame, test.starts[2] - test.starts[1]);
+
+    // Upload: ungültige Daten werden nicht gespeichert, gültige in Blöcken
+    TEST_CHECK(gps_init(GPIO_NUM_0, GPIO_NUM_0, 100) == false, "gps init");
+    TEST_CHECK(gps_assistBegin(GPS_ASSIST_SIZE + 1), "oversized upload started");
+    TEST_CHECK(!gps_assistBegin(test.length - 1), "upload begin");
+    TEST_CHECK(!gps_assistWrite(test.file, test.length - 1), "upload write");
+    TEST_CHECK(gps_assistEnd(true) && test.nvsCount == 0 && !gps.assist.pending, "truncated upload stored");
+    TEST_CHECK(!gps_assistBegin(test.length), "upload begin");
+    for (uint32_t i = 0; i < test.length; i += TEST_CHUNK) {
+        uint32_t length = (test.length - i < TEST_CHUNK) ? test.length - i : TEST_CHUNK;
+        TEST_CHECK(!gps_assistWrite(test.file + i, length), "upload write at %u", i);
+    }
+    TEST_CHECK(gps_assistWrite(test.file, 1), "write beyond announced length");
+    TEST_CHECK(!gps_assistEnd(true) && gps.assist.pending, "upload not stored");
+    TEST_CHECK(test.nvsCount == 2 + (test.length - 1) / GPS_ASSIST_BLOCK, "%u NVS entries for %u bytes",
+               test.nvsCount, test.length);
+
+    // Wiedergabe mit UBX-MGA-ACK: jedes Frame erst nach der Bestätigung des vorherigen
+    TickType_t acknowledged = test_replay(TEST_RECEIVER_ACK);
+    TEST_CHECK(test.receivedLength == test.length && !memcmp(test.received, test.file, test.length),
+               "acknowledged: %u of %u bytes", test.receivedLength, test.length);
+    TEST_CHECK(!test.overruns, "acknowledged: %u frames before UBX-MGA-ACK", test.overruns);
+    TEST_CHECK(gps.assist.rejected == 1 && !gps.assist.pending, "acknowledged: %u rejected", gps.assist.rejected);
+
+    // ohne Bestätigung: Pause nach jedem Frame
+    TickType_t paced = test_replay(TEST_RECEIVER_PACED);
+    printf("gps: %u frames, %u bytes, replay with UBX-MGA-ACK %u ticks, paced %u ticks\n", TEST_FRAMES, test.length,
+           acknowledged, paced);
+    TEST_CHECK(test.receivedLength == test.length && !memcmp(test.received, test.file, test.length),
+               "paced: %u of %u bytes", test.receivedLength, test.length);
+    TEST_CHECK(!test.overruns, "paced: %u frames without pause", test.overruns);
+    TEST_CHECK(paced >= TEST_FRAMES * GPS_ASSIST_PACING && gps.assist.rejected == 0, "paced: %u ticks", paced);
+
+    // Empfänger bestätigt nicht mehr: nach einem Timeout abbrechen statt jedes Frame abzuwarten
+    TickType_t silent = test_replay(TEST_RECEIVER_SILENT);
+    TEST_CHECK(test.receivedFrames == 1 && !test.overruns, "silent: %u frames sent", test.receivedFrames);
+    TEST_CHECK(silent <= GPS_ACK_TIMEOUT + GPS_ASSIST_TIMEOUT, "silent: %u ticks", silent);
+    return test_result("gps");
+}
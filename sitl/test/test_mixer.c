@@ -0,0 +1,264 @@
+/*
+ * File: test_mixer.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-06
+ * ----------------------------
+ * Host-Test der Mischmatrix (mixer.c). Geprüft wird:
+ *  - wide-X entspricht dem bisherigen fest programmierten Mixer aus control.c
+ *  - jede Stellgrösse erzeugt nur das Moment ihrer Achse, für alle Frames
+ *  - bei Sättigung bleibt das Verhältnis der Achsen erhalten und die Motoren im Bereich
+ * Die Geometrie wird unabhängig von mixer.c aus den Winkeln der Arme berechnet.
+ *
+ * Aufruf: ./test_mixer
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "test.h"
+#include "mixer.h"
+
+
+/** Compiler Einstellungen **/
+
+#define TEST_EPSILON    1e-5f
+#define TEST_RANDOM     100000  // zufällige Stellgrössen pro Frame
+
+
+/** Variablendeklaration **/
+
+typedef struct {
+    float angle;    // °, Arm im Uhrzeigersinn ab vorne
+    float spin;     // Drehrichtung wie in mixer.c
+} test_arm_t;
+
+static const struct {
+    const char *name;
+    uint8_t motors;
+    test_arm_t arms[MIXER_MOTORS_MAX];
+} test_frames[MIXER_FRAME_MAX] = {
+    {"quad wide-X", 4, {{-45.0f, 1.0f}, {45.0f, -1.0f}, {-135.0f, -1.0f}, {135.0f, 1.0f}}}, // Pitch-Arm gestaucht
+    {"quad-X", 4, {{-45.0f, 1.0f}, {45.0f, -1.0f}, {-135.0f, -1.0f}, {135.0f, 1.0f}}},
+    {"quad-+", 4, {{0.0f, 1.0f}, {90.0f, -1.0f}, {180.0f, 1.0f}, {270.0f, -1.0f}}},
+    {"hexa-X", 6, {{30.0f, -1.0f}, {90.0f, 1.0f}, {150.0f, -1.0f}, {210.0f, 1.0f}, {270.0f, -1.0f}, {330.0f, 1.0f}}},
+    {"octo-X", 8, {{22.5f, -1.0f}, {67.5f, 1.0f}, {112.5f, -1.0f}, {157.5f, 1.0f}, {202.5f, -1.0f}, {247.5f, 1.0f},
+                   {292.5f, -1.0f}, {337.5f, 1.0f}}}
+};
+
+
+/** Private Functions **/
+
+/*
+ * Function: test_geometry
+ * ----------------------------
+ * Geometrie eines Frames wie in mixer.c definiert: Roll positiv links, Pitch positiv hinten.
+ *
+ * mixer_frame_t frame: Frame
+ * float a[MIXER_MOTORS_MAX][MIXER_AXES]: Ziel
+ */
+static void test_geometry(mixer_frame_t frame, float a[MIXER_MOTORS_MAX][MIXER_AXES]) {
+    for (uint8_t i = 0; i < test_frames[frame].motors; ++i) {
+        float angle = test_frames[frame].arms[i].angle * (float)M_PI / 180.0f;
+        float roll = -sinf(angle), pitch = -cosf(angle);
+        if (frame == MIXER_FRAME_QUAD_WIDE) { // wide-X, Roll-Arm 1.0 und Pitch-Arm 0.775
+            roll = copysignf(1.0f, roll);
+            pitch = copysignf(0.775f, pitch);
+        }
+        a[i][MIXER_ROLL] = roll;
+        a[i][MIXER_PITCH] = pitch;
+        a[i][MIXER_YAW] = test_frames[frame].arms[i].spin;
+        a[i][MIXER_THRUST] = 1.0f;
+    }
+}
+
+/*
+ * Function: test_effect
+ * ----------------------------
+ * Wirkung von Motorwerten auf die Achsen, A^T * out.
+ */
+static void test_effect(mixer_frame_t frame, const float out[MIXER_MOTORS_MAX], float effect[MIXER_AXES]) {
+    float a[MIXER_MOTORS_MAX][MIXER_AXES];
+    test_geometry(frame, a);
+    for (uint8_t c = 0; c < MIXER_AXES; ++c) {
+        effect[c] = 0.0f;
+        for (uint8_t i = 0; i < test_frames[frame].motors; ++i) effect[c] += a[i][c] * out[i];
+    }
+}
+
+/*
+ * Function: test_uniform
+ * ----------------------------
+ * Zufallszahl im Bereich.
+ */
+static float test_uniform(float min, float max) {
+    return min + (max - min) * (float)rand() / (float)RAND_MAX;
+}
+
+/*
+ * Function: test_wide
+ * ----------------------------
+ * Vergleicht wide-X mit dem Mixer vor mixer.c (gain.y / 0.775, fest verdrahtete Vorzeichen, Lage mit
+ * throttle skaliert, throttleBoost hebt um den negativsten Motor). Die frühere Begrenzung nach oben
+ * senkte throttle bleibend und eine Lage über den ganzen Bereich wurde nicht reduziert. Beides wird
+ * bewusst nicht nachgebildet, daher nur Fälle ohne Motor über 1.0 und mit Lage innerhalb des Bereichs.
+ */
+static void test_wide() {
+    mixer_t mixer;
+    TEST_CHECK(!mixer_build(&mixer, MIXER_FRAME_QUAD_WIDE), "wide-X build");
+    uint32_t compared = 0;
+    for (uint32_t n = 0; n < TEST_RANDOM; ++n) {
+        float x = test_uniform(-0.5f, 0.5f), y = test_uniform(-0.5f, 0.5f), z = test_uniform(-0.5f, 0.5f);
+        float throttle = test_uniform(0.0f, 1.0f);
+        bool boost = n & 1;
+        // bisheriger Mixer
+        float py = y / 0.775f;
+        float old[4] = {x - py + z, -x - py - z, x + py - z, -x + py + z};
+        float negative = 0.0f, high = 0.0f, span = 0.0f;
+        for (uint8_t i = 0; i < 4; ++i) {
+            for (uint8_t j = 0; j < 4; ++j) span = fmaxf(span, (old[i] - old[j]) * throttle);
+        }
+        for (uint8_t i = 0; i < 4; ++i) {
+            old[i] = old[i] * throttle + throttle;
+            if (old[i] < negative) negative = old[i];
+        }
+        for (uint8_t i = 0; i < 4; ++i) {
+            if (boost) old[i] -= negative;
+            high = fmaxf(high, old[i]);
+        }
+        if (high > 1.0f || span > 1.0f) continue;
+        // mixer.c
+        float command[MIXER_AXES] = {x * throttle, y * throttle, z * throttle, throttle};
+        float out[MIXER_MOTORS_MAX];
+        mixer_mix(&mixer, command, boost, out);
+        for (uint8_t i = 0; i < 4; ++i) {
+            TEST_CHECK(fabsf(out[i] - old[i]) < TEST_EPSILON, "wide-X motor %u: %f, old mixer %f", i, out[i], old[i]);
+        }
+        ++compared;
+    }
+    TEST_CHECK(compared > TEST_RANDOM / 4, "only %u unsaturated cases", compared);
+}
+
+/*
+ * Function: test_decoupling
+ * ----------------------------
+ * A^T B muss diagonal sein, Roll und Pitch mit gleicher Wirkung, grösster Roll-Faktor 1.0.
+ */
+static void test_decoupling(mixer_frame_t frame) {
+    const char *name = test_frames[frame].name;
+    mixer_t mixer;
+    memset(&mixer, 0, sizeof(mixer));
+    TEST_CHECK(mixer_motors(frame) == test_frames[frame].motors, "%s: %u motors", name, mixer_motors(frame));
+    TEST_CHECK(!mixer_build(&mixer, frame), "%s: build", name);
+    TEST_CHECK(mixer.motors == test_frames[frame].motors, "%s: built %u motors", name, mixer.motors);
+    float diagonal[MIXER_AXES], rollMax = 0.0f;
+    for (uint8_t c = 0; c < MIXER_AXES; ++c) {
+        float column[MIXER_MOTORS_MAX], effect[MIXER_AXES];
+        for (uint8_t i = 0; i < MIXER_MOTORS_MAX; ++i) column[i] = mixer.matrix[i][c];
+        test_effect(frame, column, effect);
+        for (uint8_t r = 0; r < MIXER_AXES; ++r) {
+            if (r != c) TEST_CHECK(fabsf(effect[r]) < TEST_EPSILON, "%s: axis %u acts on axis %u (%f)", name, c, r,
+                                   effect[r]);
+        }
+        diagonal[c] = effect[c];
+        TEST_CHECK(diagonal[c] > 0.0f, "%s: axis %u has no effect", name, c);
+        if (c == MIXER_ROLL) for (uint8_t i = 0; i < mixer.motors; ++i) rollMax = fmaxf(rollMax, fabsf(column[i]));
+    }
+    TEST_CHECK(fabsf(diagonal[MIXER_ROLL] - diagonal[MIXER_PITCH]) < 1e-4f * diagonal[MIXER_ROLL],
+               "%s: roll %f, pitch %f per unit", name, diagonal[MIXER_ROLL], diagonal[MIXER_PITCH]);
+    TEST_CHECK(fabsf(rollMax - 1.0f) < TEST_EPSILON, "%s: largest roll factor %f", name, rollMax);
+    for (uint8_t i = mixer.motors; i < MIXER_MOTORS_MAX; ++i) {
+        for (uint8_t c = 0; c < MIXER_AXES; ++c) TEST_CHECK(!mixer.matrix[i][c], "%s: unused motor %u mixed", name, i);
+    }
+}
+
+/*
+ * Function: test_saturation
+ * ----------------------------
+ * Zufällige, auch übersteuerte Stellgrössen. Lage wird nur gleichmässig reduziert, Motoren bleiben
+ * unter 1.0 und mit raise über 0.0, Rückgabe passt zum Ergebnis.
+ */
+static void test_saturation(mixer_frame_t frame) {
+    const char *name = test_frames[frame].name;
+    mixer_t mixer;
+    mixer_build(&mixer, frame);
+    float unit[MIXER_AXES], column[MIXER_MOTORS_MAX];
+    for (uint8_t c = 0; c < MIXER_AXES; ++c) {
+        float effect[MIXER_AXES];
+        for (uint8_t i = 0; i < MIXER_MOTORS_MAX; ++i) column[i] = mixer.matrix[i][c];
+        test_effect(frame, column, effect);
+        unit[c] = effect[c];
+    }
+    uint32_t saturated = 0, limited = 0, raised = 0;
+    for (uint32_t n = 0; n < TEST_RANDOM; ++n) {
+        float command[MIXER_AXES] = {
+            test_uniform(-1.5f, 1.5f), test_uniform(-1.5f, 1.5f), test_uniform(-1.0f, 1.0f), test_uniform(0.0f, 1.0f)
+        };
+        bool raise = n & 1;
+        float out[MIXER_MOTORS_MAX], effect[MIXER_AXES];
+        uint8_t flags = mixer_mix(&mixer, command, raise, out);
+        test_effect(frame, out, effect);
+        // Verhältnis der Achsen bleibt, reduziert wird nur bei Sättigung der Lage
+        uint8_t largest = MIXER_ROLL;
+        for (uint8_t c = MIXER_ROLL; c <= MIXER_YAW; ++c) {
+            if (fabsf(unit[c] * command[c]) > fabsf(unit[largest] * command[largest])) largest = c;
+        }
+        float scale = effect[largest] / (unit[largest] * command[largest]);
+        for (uint8_t c = MIXER_ROLL; c <= MIXER_YAW; ++c) {
+            TEST_CHECK(fabsf(effect[c] - scale * unit[c] * command[c]) < 1e-4f, "%s: axis %u %f instead of %f", name,
+                       c, effect[c], scale * unit[c] * command[c]);
+        }
+        TEST_CHECK(scale <= 1.0f + 1e-4f, "%s: attitude amplified %f", name, scale);
+        if (fabsf(scale - 1.0f) > 1e-3f) TEST_CHECK(!(flags & MIXER_SATURATED_ATTITUDE) == (scale > 1.0f),
+                                                    "%s: saturation flag %x, scale %f", name, flags, scale);
+        // Bereich der Motoren
+        float low = 1.0f, high = 0.0f;
+        for (uint8_t i = 0; i < mixer.motors; ++i) {
+            low = fminf(low, out[i]);
+            high = fmaxf(high, out[i]);
+        }
+        TEST_CHECK(high <= 1.0f + TEST_EPSILON, "%s: motor at %f", name, high);
+        if (raise) TEST_CHECK(low >= -TEST_EPSILON, "%s: motor at %f despite raise", name, low);
+        // Schub nur verschoben wenn gemeldet
+        float thrust = effect[MIXER_THRUST] / unit[MIXER_THRUST];
+        if (flags & MIXER_LIMITED_HIGH) TEST_CHECK(thrust < command[MIXER_THRUST] && high > 1.0f - 1e-4f,
+                                                   "%s: limited thrust %f of %f, high %f", name, thrust,
+                                                   command[MIXER_THRUST], high);
+        else if (flags & MIXER_RAISED_LOW) TEST_CHECK(raise && thrust > command[MIXER_THRUST] && low < 1e-4f,
+                                                      "%s: raised thrust %f of %f, low %f", name, thrust,
+                                                      command[MIXER_THRUST], low);
+        else TEST_CHECK(fabsf(thrust - command[MIXER_THRUST]) < 1e-4f, "%s: thrust %f of %f not flagged", name,
+                        thrust, command[MIXER_THRUST]);
+        saturated += !!(flags & MIXER_SATURATED_ATTITUDE);
+        limited += !!(flags & MIXER_LIMITED_HIGH);
+        raised += !!(flags & MIXER_RAISED_LOW);
+    }
+    TEST_CHECK(saturated && limited && raised, "%s: not all cases covered (%u, %u, %u)", name, saturated, limited,
+               raised);
+}
+
+
+/** Implementierung **/
+
+int main(int argc, char *argv[]) {
+    srand(1);
+    test_wide();
+    for (mixer_frame_t frame = 0; frame < MIXER_FRAME_MAX; ++frame) {
+        test_decoupling(frame);
+        test_saturation(frame);
+    }
+    // ungültiger Frame lässt die Matrix unverändert
+    mixer_t mixer, copy;
+    mixer_build(&mixer, MIXER_FRAME_QUAD_X);
+    copy = mixer;
+    TEST_CHECK(mixer_build(&mixer, MIXER_FRAME_MAX) && !memcmp(&mixer, &copy, sizeof(mixer)), "invalid frame built");
+    TEST_CHECK(!mixer_motors(MIXER_FRAME_MAX), "invalid frame has motors");
+    return test_result("mixer");
+}
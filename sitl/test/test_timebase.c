@@ -0,0 +1,184 @@
+/*
+ * File: test_timebase.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-06
+ * ----------------------------
+ * Host-Test der Zeitbasis (timebase.c) mit synthetischer Drift. Die GPS-Uhr läuft gegenüber
+ * esp_timer um TEST_DRIFT falsch, NAV-PVT kommt mit 10 Hz und streuender Latenz. Ablauf wie nach
+ * dem Einschalten: zuerst nur iTOW, dann mit PPS, dann fällt PPS wieder aus. Dazwischen liegt
+ * ein Wochenwechsel der iTOW. Geprüft werden Drift, Fehler der Abbildung und die Umkehrung.
+ *
+ * Aufruf: ./test_timebase
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdlib.h>
+#include <math.h>
+#include "esp_timer.h"
+#include "driver/gpio.h"
+
+
+/** Interne Abhängigkeiten **/
+
+#include "test.h"
+#include "intercom.h"
+#include "timebase.h"
+
+
+/** Compiler Einstellungen **/
+
+#define TEST_DRIFT          30e-6   // Gangabweichung der GPS-Uhr
+#define TEST_EPOCH          100000  // us, GPS-Zeit zwischen NAV-PVT
+#define TEST_LATENCY        45000   // us, minimale Latenz Epoche bis Frameanfang
+#define TEST_LATENCY_SPREAD 10000   // us, zusätzliche gleichverteilte Latenz
+#define TEST_PPS_JITTER     5       // us, Streuung des PPS-Interrupts
+#define TEST_WEEK           604800000000LL // us
+#define TEST_PHASE          600     // s pro Phase
+#define TEST_ASSESS         100     // s am Ende jeder Phase werden bewertet
+
+
+/** Variablendeklaration **/
+
+static struct {
+    int64_t now;            // us, esp_timer
+    gpio_isr_t isr;
+    uint32_t published;
+    uint32_t random;
+    int64_t gps;            // us, GPS-Zeit seit Beginn der ersten Woche
+} test = {
+    .gps = TEST_WEEK - 300000000LL // 5 min vor Wochenwechsel
+};
+
+typedef struct {
+    double maxError;        // us, |toLocal - wahre lokale Zeit|
+    double maxInverse;      // us, |fromLocal(toLocal) - GPS-Zeit|
+    timebase_status_t status;
+} test_phase_t;
+
+
+/** Private Functions **/
+
+/*
+ * Function: test_local
+ * ----------------------------
+ * Wahre lokale Zeit einer GPS-Zeit.
+ */
+static int64_t test_local(int64_t gps) {
+    return 5000000LL + llround((gps - (TEST_WEEK - 300000000LL)) * (1.0 + TEST_DRIFT));
+}
+
+/*
+ * Function: test_uniform
+ * ----------------------------
+ * Deterministische Zufallszahl.
+ *
+ * returns: 0 bis range - 1
+ */
+static uint32_t test_uniform(uint32_t range) {
+    test.random = test.random * 1664525u + 1013904223u;
+    return (test.random >> 8) % range;
+}
+
+/*
+ * Function: test_run
+ * ----------------------------
+ * Simuliert NAV-PVT und optional PPS über eine Phase und bewertet deren Ende.
+ *
+ * bool pps: PPS-Flanken erzeugen
+ * test_phase_t *phase: Resultat
+ */
+static void test_run(bool pps, test_phase_t *phase) {
+    phase->maxError = 0.0;
+    phase->maxInverse = 0.0;
+    int64_t end = test.gps + TEST_PHASE * 1000000LL;
+    for (; test.gps < end; test.gps += TEST_EPOCH) {
+        int64_t local = test_local(test.gps);
+        if (pps && !(test.gps % 1000000)) {
+            test.now = local + test_uniform(TEST_PPS_JITTER);
+            test.isr(NULL);
+        }
+        test.now = local + TEST_LATENCY + test_uniform(TEST_LATENCY_SPREAD);
+        timebase_gpsEpoch((test.gps % TEST_WEEK) / 1000, test.now);
+        if (end - test.gps > TEST_ASSESS * 1000000LL) continue;
+        int64_t mapped, inverse;
+        TEST_CHECK(!timebase_toLocal(TIMEBASE_GPS, test.gps, &mapped), "GPS not locked");
+        TEST_CHECK(!timebase_fromLocal(TIMEBASE_GPS, mapped, &inverse), "GPS not locked");
+        phase->maxError = fmax(phase->maxError, fabs((double)(mapped - local)));
+        phase->maxInverse = fmax(phase->maxInverse, fabs((double)(inverse - test.gps)));
+    }
+    timebase_statusGet(&phase->status);
+}
+
+
+/** Ersatz für ESP-IDF und Intercom **/
+
+int64_t esp_timer_get_time(void) {
+    return test.now;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t handler, void *arg) {
+    test.isr = handler;
+    return ESP_OK;
+}
+
+void intercom_pvPublish(QueueHandle_t publisher, uint32_t pvNum, value_t value) {
+    ++test.published;
+}
+
+
+/** Implementierung **/
+
+int main(int argc, char *argv[]) {
+    int64_t local;
+    TEST_CHECK(timebase_toLocal(TIMEBASE_GPS, 0, &local), "GPS locked before first epoch");
+
+    // nur iTOW: Drift wird gefunden, Offset um die Latenzstreuung daneben
+    test_phase_t phase;
+    test_run(false, &phase);
+    printf("iTOW: drift %.1f ppm, error %.0f us, inverse %.0f us\n", phase.status.drift, phase.maxError,
+           phase.maxInverse);
+    TEST_CHECK(phase.status.sync == TIMEBASE_SYNC_ITOW, "sync %d, expected iTOW", phase.status.sync);
+    TEST_CHECK(fabs(phase.status.drift - TEST_DRIFT * 1e6) < 3.0, "iTOW drift %.1f ppm", phase.status.drift);
+    TEST_CHECK(phase.maxError < TEST_LATENCY_SPREAD, "iTOW error %.0f us", phase.maxError);
+    TEST_CHECK(phase.maxInverse < 2.0, "iTOW inverse error %.0f us", phase.maxInverse);
+    TEST_CHECK(test.published, "nothing published");
+
+    // mit PPS: auf wenige us genau, Latenz des NAV-PVT wird gemessen
+    TEST_CHECK(!timebase_ppsInit(GPIO_NUM_0) && test.isr, "PPS init");
+    test_run(true, &phase);
+    printf("PPS: drift %.1f ppm, error %.0f us, inverse %.0f us, latency %d us\n", phase.status.drift,
+           phase.maxError, phase.maxInverse, phase.status.latency);
+    TEST_CHECK(phase.status.sync == TIMEBASE_SYNC_PPS, "sync %d, expected PPS", phase.status.sync);
+    TEST_CHECK(fabs(phase.status.drift - TEST_DRIFT * 1e6) < 1.0, "PPS drift %.1f ppm", phase.status.drift);
+    TEST_CHECK(phase.maxError < 4 * TEST_PPS_JITTER, "PPS error %.0f us", phase.maxError);
+    TEST_CHECK(phase.maxInverse < 2.0, "PPS inverse error %.0f us", phase.maxInverse);
+    int32_t mean = TEST_LATENCY + TEST_LATENCY_SPREAD / 2;
+    TEST_CHECK(abs(phase.status.latency - mean) < TEST_LATENCY_SPREAD / 4, "latency %d us, expected %d us",
+               phase.status.latency, mean);
+
+    // PPS fällt aus: zurück auf iTOW mit gemessener Latenz, Drift bleibt
+    test_run(false, &phase);
+    printf("PPS lost: drift %.1f ppm, error %.0f us, inverse %.0f us\n", phase.status.drift, phase.maxError,
+           phase.maxInverse);
+    TEST_CHECK(phase.status.sync == TIMEBASE_SYNC_ITOW, "sync %d, expected iTOW", phase.status.sync);
+    TEST_CHECK(fabs(phase.status.drift - TEST_DRIFT * 1e6) < 3.0, "PPS lost drift %.1f ppm", phase.status.drift);
+    TEST_CHECK(phase.maxError < TEST_LATENCY_SPREAD, "PPS lost error %.0f us", phase.maxError);
+
+    // lokale Zeit und sh2 unverändert
+    TEST_CHECK(!timebase_toLocal(TIMEBASE_LOCAL, 1234, &local) && local == 1234, "local not identity");
+    test.now = 0x100000010LL;
+    TEST_CHECK(!timebase_toLocal(TIMEBASE_SH2, 0x5, &local) && local == 0x100000005LL, "sh2 rollover %lld",
+               (long long)local);
+    return test_result("timebase");
+}
@@ -0,0 +1,168 @@
+/*
+ * File: test_tune.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-08
+ * ----------------------------
+ * Host-Test der Auswertung des Relais-Versuchs (tune.c) mit simulierter Strecke. Der Winkel ist das
+ * Integral der Drehrate, der Ratenregler wirkt als Verzögerung erster Ordnung, dazu Totzeit und
+ * Messrauschen. Das Relais läuft wie in control.c mit 100 Hz. Ku und Tu werden mit der analytischen
+ * Grenzschwingung der Strecke verglichen, Tu auf die Abtastung genau, Ku mit der Verstärkung der Strecke
+ * bei der gemessenen Periode. Aufzeichnungen ohne oder mit unregelmässiger Schwingung
+ * müssen abgelehnt werden.
+ *
+ * Aufruf: ./test_tune
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdlib.h>
+#include <math.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "test.h"
+#include "tune.h"
+
+
+/** Compiler Einstellungen **/
+
+#define TEST_RATE       100     // Hz, Winkelregler
+#define TEST_SUBSTEPS   10      // Integrationsschritte pro Sample
+#define TEST_LAG        0.03    // s, Zeitkonstante des Ratenreglers
+#define TEST_DELAY      1       // Samples Totzeit, 10 ms
+#define TEST_NOISE      0.002f  // rad, Messrauschen
+#define TEST_AMPLITUDE  1.0f    // rad/s, Relais
+#define TEST_HYSTERESIS 0.004f  // rad, doppeltes Rauschen
+#define TEST_TOLERANCE  0.05    // relative Abweichung von Ku
+
+
+/** Variablendeklaration **/
+
+static tune_sample_t samples[TUNE_SAMPLES];
+static uint32_t random_state = 1;
+
+
+/** Private Functions **/
+
+/*
+ * Function: test_noise
+ * ----------------------------
+ * Deterministisches, gleichverteiltes Rauschen.
+ *
+ * returns: -1.0 bis 1.0
+ */
+static float test_noise(void) {
+    random_state = random_state * 1664525u + 1013904223u;
+    return (random_state >> 8) / (float)(1 << 23) - 1.0f;
+}
+
+/*
+ * Function: test_simulate
+ * ----------------------------
+ * Relais-Versuch an der simulierten Strecke.
+ *
+ * float amplitude: Relais, 0 -> konstanter Ausgang ohne Umschalten
+ */
+static void test_simulate(float amplitude) {
+    double angle = 0.02, rate = 0.0, dt = 1.0 / (TEST_RATE * TEST_SUBSTEPS);
+    float delayed[TEST_DELAY + 1] = {0}; // letzte Befehle
+    float output = 0.0f;
+    for (uint32_t i = 0; i < TUNE_SAMPLES; ++i) {
+        float error = 0.0f - (float)angle + TEST_NOISE * test_noise();
+        output = amplitude ? tune_relay(error, output, amplitude, TEST_HYSTERESIS) : 0.1f;
+        samples[i] = (tune_sample_t){i * 1000000 / TEST_RATE, error, output};
+        for (uint32_t d = TEST_DELAY; d > 0; --d) delayed[d] = delayed[d - 1];
+        delayed[0] = output;
+        float command = delayed[TEST_DELAY];
+        for (uint32_t s = 0; s < TEST_SUBSTEPS; ++s) {
+            rate += (command - rate) * dt / TEST_LAG;
+            angle += rate * dt;
+        }
+    }
+}
+
+/*
+ * Function: test_gain
+ * ----------------------------
+ * Kehrwert der Verstärkung von e^(-sL) / (s (1 + sT)) bei einer Periode.
+ *
+ * double tu: s, Periode
+ *
+ * returns: Verstärkung die den Kreis bei dieser Periode auf 1 bringt
+ */
+static double test_gain(double tu) {
+    double w = 2.0 * M_PI / tu;
+    return w * sqrt(1.0 + w * TEST_LAG * w * TEST_LAG);
+}
+
+/*
+ * Function: test_ultimate
+ * ----------------------------
+ * Analytische kritische Periode: Phase -180° bei atan(wT) + wL = pi/2. Die Abtastung mit Halteglied
+ * wirkt wie eine halbe Periode zusätzliche Totzeit.
+ *
+ * returns: s, kritische Periode
+ */
+static double test_ultimate(void) {
+    double delay = (TEST_DELAY + 0.5) / TEST_RATE;
+    double low = 0.0, high = M_PI / 2.0 / delay;
+    for (int i = 0; i < 100; ++i) {
+        double w = (low + high) / 2.0;
+        if (atan(w * TEST_LAG) + w * delay < M_PI / 2.0) low = w;
+        else high = w;
+    }
+    return 2.0 * M_PI / low;
+}
+
+
+/** Implementierung **/
+
+int main(int argc, char *argv[]) {
+    // Relais: erster Aufruf nach Vorzeichen, danach erst jenseits der Hysterese umschalten
+    TEST_CHECK(tune_relay(0.005f, 0.0f, 1.0f, 0.01f) == 1.0f, "first call positive");
+    TEST_CHECK(tune_relay(-0.005f, 0.0f, 1.0f, 0.01f) == -1.0f, "first call negative");
+    TEST_CHECK(tune_relay(-0.005f, 1.0f, 1.0f, 0.01f) == 1.0f, "switched inside hysteresis");
+    TEST_CHECK(tune_relay(-0.02f, 1.0f, 1.0f, 0.01f) == -1.0f, "no switch beyond hysteresis");
+    TEST_CHECK(tune_relay(0.02f, -1.0f, 1.0f, 0.01f) == 1.0f, "no switch back");
+
+    // Grenzschwingung der simulierten Strecke
+    double tu = test_ultimate(), ku = test_gain(tu);
+    test_simulate(TEST_AMPLITUDE);
+    tune_result_t result;
+    TEST_CHECK(!tune_estimate(samples, TUNE_SAMPLES, TEST_AMPLITUDE, TEST_HYSTERESIS, &result), "estimate failed");
+    printf("tune: Ku %.1f (analytic %.1f, plant at Tu %.1f), Tu %.3f s (analytic %.3f s), %u periods\n", result.ku,
+           ku, test_gain(result.tu), result.tu, tu, result.periods);
+    // das Relais schaltet nur zu Samples, jede Halbperiode ist auf ein Sample genau
+    TEST_CHECK(fabs(result.tu - tu) <= 2.0 / TEST_RATE, "Tu %.3f, expected %.3f", result.tu, tu);
+    double gain = test_gain(result.tu);
+    TEST_CHECK(fabs(result.ku - gain) < TEST_TOLERANCE * gain, "Ku %.1f, plant at Tu %.1f", result.ku, gain);
+    TEST_CHECK(result.periods >= TUNE_PERIODS_MIN && result.amplitude > TEST_HYSTERESIS, "%u periods, amplitude %f",
+               result.periods, result.amplitude);
+
+    // Ziegler-Nichols "some overshoot"
+    tune_gains_t gains;
+    tune_gains(&result, &gains);
+    TEST_CHECK(fabsf(gains.kp - result.ku / 3.0f) < 1e-4f * result.ku, "Kp %f", gains.kp);
+    TEST_CHECK(fabsf(gains.ki - 2.0f * gains.kp / result.tu) < 1e-4f * gains.ki, "Ki %f", gains.ki);
+    TEST_CHECK(fabsf(gains.kd - gains.kp * result.tu / 3.0f) < 1e-4f * gains.kd, "Kd %f", gains.kd);
+
+    // ohne Schwingung
+    test_simulate(0.0f);
+    TEST_CHECK(tune_estimate(samples, TUNE_SAMPLES, TEST_AMPLITUDE, TEST_HYSTERESIS, &result), "no oscillation accepted");
+    TEST_CHECK(tune_estimate(samples, 0, TEST_AMPLITUDE, TEST_HYSTERESIS, &result), "empty recording accepted");
+
+    // unregelmässige Perioden: Relais mit wechselnder Periode von 10 und 30 Samples
+    uint32_t i = 0;
+    for (uint32_t n = 0; i < TUNE_SAMPLES; ++n) {
+        uint32_t half = (n % 4 < 2) ? 5 : 15;
+        for (uint32_t j = 0; j < half && i < TUNE_SAMPLES; ++j, ++i) {
+            float output = (n % 2) ? -TEST_AMPLITUDE : TEST_AMPLITUDE;
+            samples[i] = (tune_sample_t){i * 1000000 / TEST_RATE, -output / 10.0f, output};
+        }
+    }
+    TEST_CHECK(tune_estimate(samples, TUNE_SAMPLES, TEST_AMPLITUDE, TEST_HYSTERESIS, &result), "irregular accepted");
+    return test_result("tune");
+}
@@ -0,0 +1,284 @@
+/*
+ * File: test_uart.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-08
+ * ----------------------------
+ * Host-Test der Zeitstempel des Frameanfangs (uart_rxTimestamp) mit synthetischem Bytestrom.
+ * UBX-Frames zufälliger Länge laufen mit 115200 Baud über die Leitung, teils direkt
+ * hintereinander, teils mit Pausen. Der simulierte UART löst wie der ESP32 bei vollem rx-FIFO oder
+ * nach UART_RX_TIMEOUT Bytezeiten Ruhe einen Interrupt aus, mit zufälliger Latenz. Der Konsument
+ * liest wie gps_receive erst nach einigen Interrupts. Für jedes dekodierte Frame wird der Zeitstempel
+ * mit dem wahren Startbit des ersten Sync-Bytes verglichen.
+ *
+ * Aufruf: ./test_uart
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+
+
+/** Interne Abhängigkeiten **/
+
+#include "test.h"
+#include "frame.h"
+#include "uart.h"
+
+
+/** Compiler Einstellungen **/
+
+#define TEST_UART           UART_NUM_1
+#define TEST_BAUD           115200
+#define TEST_FRAMES         3000
+#define TEST_PAYLOAD_MAX    120     // Bytes
+#define TEST_GAP_MAX        5000    // us, Pause zwischen Frames, sonst direkt hintereinander
+#define TEST_LATENCY        20      // us, maximale Latenz des Interrupts
+#define TEST_LAG            4       // Konsument liest spätestens nach so vielen Interrupts
+#define TEST_STREAM         (TEST_FRAMES * (TEST_PAYLOAD_MAX + 8))
+
+
+/** Variablendeklaration **/
+
+uart_dev_t UART0, UART1, UART2;
+
+static struct {
+    int64_t now;                    // us, esp_timer
+    intr_handler_t isr;
+    void *arg;
+    uint32_t random;
+    // Leitung, Zeiten in ns
+    uint8_t stream[TEST_STREAM];
+    int64_t start[TEST_STREAM];     // Startbit
+    int64_t end[TEST_STREAM];       // Ende des Stopbits
+    uint32_t length;
+    // rx-FIFO
+    uint32_t fifoFirst, fifoCount;
+    uint8_t fifoByte;
+    // Auswertung
+    frame_decoder_t decoder;
+    uint8_t buffer[256];
+    uint32_t frames;
+    int64_t interrupt;              // us, Zeitpunkt des letzten Interrupts
+    double maxError, minError, sumError;
+    double maxInterrupt;            // us, Fehler bei Zeitstempel des Interrupts statt Frameanfang
+} test = {
+    .minError = INFINITY
+};
+
+
+/** Private Functions **/
+
+/*
+ * Function: test_uniform
+ * ----------------------------
+ * Deterministische Zufallszahl.
+ *
+ * returns: 0 bis range - 1
+ */
+static uint32_t test_uniform(uint32_t range) {
+    test.random = test.random * 1664525u + 1013904223u;
+    return (test.random >> 8) % range;
+}
+
+/*
+ * Function: test_fifo
+ * ----------------------------
+ * Lesezugriff auf den rx-FIFO, entnimmt das älteste Byte.
+ */
+static uint8_t *test_fifo(void) {
+    if (test.fifoCount) {
+        test.fifoByte = test.stream[test.fifoFirst++];
+        --test.fifoCount;
+    } else test.fifoByte = 0;
+    return &test.fifoByte;
+}
+
+/*
+ * Function: test_frame
+ * ----------------------------
+ * Handler des Decoders, vergleicht den Zeitstempel mit dem wahren Frameanfang.
+ */
+static void test_frame(const frame_t *frame) {
+    double truth = test.start[frame->start] / 1000.0;
+    double error = uart_rxTimestamp(TEST_UART, frame->start) - truth;
+    test.maxError = fmax(test.maxError, error);
+    test.minError = fmin(test.minError, error);
+    test.sumError += error;
+    test.maxInterrupt = fmax(test.maxInterrupt, test.interrupt - truth);
+    ++test.frames;
+}
+
+/*
+ * Function: test_consume
+ * ----------------------------
+ * Liest den rx-Ringbuffer wie gps_receive.
+ */
+static void test_consume(void) {
+    const uint8_t *data;
+    size_t available;
+    while ((available = uart_rxPeek(TEST_UART, &data))) {
+        frame_decode(&test.decoder, data, available, uart_rxPosition(TEST_UART));
+        uart_rxConsume(TEST_UART, available);
+    }
+}
+
+/*
+ * Function: test_generate
+ * ----------------------------
+ * Erzeugt den Bytestrom mit Zeitpunkten jedes Bytes.
+ */
+static void test_generate(void) {
+    double byteNs = 1e10 / TEST_BAUD, time = 1e9;
+    for (uint32_t n = 0; n < TEST_FRAMES; ++n) {
+        if (test_uniform(2)) time += 1000.0 * (1000 + test_uniform(TEST_GAP_MAX - 1000));
+        uint16_t length = test_uniform(TEST_PAYLOAD_MAX + 1);
+        uint8_t *p = test.stream + test.length;
+        p[0] = 0xb5;
+        p[1] = 0x62;
+        p[2] = 0x01;
+        p[3] = 0x07;
+        p[4] = length & 0xff;
+        p[5] = length >> 8;
+        for (uint16_t i = 0; i < length; ++i) p[6 + i] = test_uniform(256);
+        uint8_t ckA = 0, ckB = 0;
+        for (uint16_t i = 2; i < 6 + length; ++i) {
+            ckA += p[i];
+            ckB += ckA;
+        }
+        p[6 + length] = ckA;
+        p[7 + length] = ckB;
+        for (uint16_t i = 0; i < 8 + length; ++i, ++test.length) {
+            test.start[test.length] = llround(time);
+            time += byteNs;
+            test.end[test.length] = llround(time);
+        }
+    }
+}
+
+/*
+ * Function: test_interrupt
+ * ----------------------------
+ * Führt den ISR zum gegebenen Zeitpunkt aus.
+ *
+ * int64_t time: ns
+ * uint32_t status: aktive Interrupts
+ */
+static void test_interrupt(int64_t time, uint32_t status) {
+    test.now = time / 1000;
+    test.interrupt = test.now;
+    UART1.status.rxfifo_cnt = test.fifoCount;
+    UART1.int_st.val = status;
+    test.isr(test.arg);
+}
+
+
+/** Ersatz für ESP-IDF und FreeRTOS **/
+
+int64_t esp_timer_get_time(void) {
+    return test.now;
+}
+
+esp_err_t uart_set_pin(uart_port_t uartNum, int txPin, int rxPin, int rtsPin, int ctsPin) {
+    return ESP_OK;
+}
+
+void periph_module_enable(int module) {
+}
+
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void *arg, intr_handle_t *handle) {
+    test.isr = handler;
+    test.arg = arg;
+    return ESP_OK;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t wait) {
+    return pdFALSE;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken) {
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return NULL;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return test.now / 1000 / portTICK_PERIOD_MS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    test.now += ticks * portTICK_PERIOD_MS * 1000;
+}
+
+
+/** Implementierung **/
+
+int main(int argc, char *argv[]) {
+    UART1.fifo.access = &test_fifo;
+    TEST_CHECK(!uart_init(TEST_UART, UART_PIN_NO_CHANGE, GPIO_NUM_16, TEST_BAUD) && test.isr, "uart init");
+    TEST_CHECK(UART1.conf1.rx_tout_thrhd == UART_RX_TIMEOUT, "rx timeout %u", UART1.conf1.rx_tout_thrhd);
+    const frame_route_t routes[] = {{0x0107, &test_frame}};
+    frame_init(&test.decoder, FRAME_UBX, routes, 1, test.buffer, sizeof(test.buffer));
+    test_generate();
+
+    // Leitung und UART im Gleichschritt: Bytes landen am Ende ihres Stopbits im FIFO, Interrupt bei
+    // vollem FIFO oder nach UART_RX_TIMEOUT Bytezeiten ohne Empfang, jeweils mit Latenz
+    double byteNs = 1e10 / TEST_BAUD;
+    uint32_t next = 0, interrupts = 0, timeouts = 0, lag = 1;
+    int64_t pending = -1;
+    uint32_t status = 0;
+    while (next < test.length || test.fifoCount) {
+        int64_t arrival = (next < test.length) ? test.end[next] : INT64_MAX;
+        if (pending < 0 && test.fifoCount) {
+            int64_t idle = test.end[next - 1] + llround(UART_RX_TIMEOUT * byteNs);
+            if (idle < arrival) {
+                pending = idle + 1000 * (int64_t)test_uniform(TEST_LATENCY + 1);
+                status = UART_RXFIFO_TOUT_INT_ST_M;
+            }
+        }
+        if (pending >= 0 && pending <= arrival) {
+            test_interrupt(pending, status);
+            TEST_CHECK(!test.fifoCount, "fifo not drained");
+            timeouts += status == UART_RXFIFO_TOUT_INT_ST_M;
+            pending = -1;
+            if (++interrupts % lag == 0) {
+                test_consume();
+                lag = 1 + test_uniform(TEST_LAG);
+                interrupts = 0;
+            }
+            continue;
+        }
+        ++test.fifoCount;
+        ++next;
+        if (test.fifoCount >= UART_RX_FULL_THRESHOLD && pending < 0) {
+            pending = arrival + 1000 * (int64_t)test_uniform(TEST_LATENCY + 1);
+            status = UART_RXFIFO_FULL_INT_ST_M;
+        }
+    }
+    test_consume();
+
+    uart_statistics_t statistics;
+    uart_statisticsGet(TEST_UART, &statistics);
+    printf("uart: %u frames, %u bytes, %u timeouts, error %.1f to %.1f us (mean %.1f), at interrupt up to %.0f us\n",
+           test.frames, statistics.rxBytes, timeouts, test.minError, test.maxError, test.sumError / test.frames,
+           test.maxInterrupt);
+    TEST_CHECK(test.frames == TEST_FRAMES && test.decoder.statistics.errors == 0, "%u frames, %u errors", test.frames,
+               test.decoder.statistics.errors);
+    TEST_CHECK(statistics.rxBytes == test.length && !statistics.rxOverflows, "%u bytes, %u overflows",
+               statistics.rxBytes, statistics.rxOverflows);
+    TEST_CHECK(timeouts > TEST_FRAMES / 4, "only %u timeouts", timeouts);
+    // Startbit auf Latenz genau, dazu Rundung von esp_timer und Bytezeit
+    TEST_CHECK(test.minError >= -2.0 && test.maxError <= TEST_LATENCY + 2.0, "error %.1f to %.1f us", test.minError,
+               test.maxError);
+    TEST_CHECK(test.maxInterrupt > 1000.0, "interrupt time %.0f us would be as good", test.maxInterrupt);
+    return test_result("uart");
+}
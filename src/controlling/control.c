@@ -18,7 +18,12 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "esp_log.h"
+#include "nvs.h"
+#include "esp_timer.h"
 #include "driver/ledc.h"
+#include "driver/rmt.h"
+#include <math.h>
+#include <stdlib.h>
 
 
 /** Interne Abhängigkeiten **/
@@ -30,6 +35,10 @@
 #include "sensing/bno.h"
 #include "remote/remote.h" // Intercom-Events
 #include "control.h"
+#include "esc.h"
+#include "mixer.h"
+#include "thrust.h"
+#include "tune.h"
 
 
 /** Variablendeklaration **/
@@ -47,9 +56,11 @@ typedef struct {
     float band;
     float integralError;
     float prevError;
-    TickType_t lastTick;
+    int64_t lastTime;       // us, 0 -> erster Aufruf nach Reset
 } control_pid_t;
 
+#define CONTROL_PID_DT_MAX  0.1f // s, längere Pause gilt als Neustart ohne I- und D-Anteil
+
 typedef enum {
     DIRECTION_X = 0,
     DIRECTION_Y,
@@ -64,14 +75,6 @@ typedef enum {
     AXIS_MAX
 } control_axes_t;
 
-typedef enum {
-    MOTOR_FRONT_LEFT = 0,
-    MOTOR_FRONT_RIGHT,
-    MOTOR_BACK_LEFT,
-    MOTOR_BACK_RIGHT,
-    MOTOR_MAX
-} control_motors_t;
-
 struct control_t {
     bool armed;
     float throttle;
@@ -82,44 +85,143 @@ struct control_t {
     struct {
         vector_t euler;
         bool headingRate;
+        vector_t rates;         // rad/s, Körpersystem, Ausgang des Winkelreglers
         vector_t velocity;
         vector_t position;
     } setpoints;
 
     struct {
-        control_pid_t stabilize[AXIS_MAX];
+        control_pid_t stabilize[AXIS_MAX]; // äusserer Regler, Winkel -> Drehrate
+        control_pid_t rate[AXIS_MAX];       // innerer Regler, Drehrate -> Motoren
         control_pid_t direction[DIRECTION_MAX];
     } pids;
+
+    struct {
+        uint32_t rate;          // Hz, Einstellung
+        uint32_t activeRate;    // Hz, mit der der Timer läuft
+        esp_timer_handle_t timer;
+        volatile bool pending;  // Zyklus in Queue, noch nicht abgearbeitet
+        volatile uint32_t overruns;
+        uint32_t publishedOverruns;
+        int64_t lastTime;       // us, Start des letzten Zyklus
+        uint32_t angleDivider;  // Einstellung
+        uint32_t cycle;         // Zähler für Winkelregler
+        int64_t lastGyro;       // us, Zeitstempel des zuletzt geregelten Gyro-Samples
+        int64_t gyroSeen;       // us, Zyklus in dem zuletzt ein neues Gyro-Sample kam, ab Bewaffnen
+        vector_t rateOutput;    // Ausgang des Drehratenreglers, bis zum nächsten Gyro-Sample gehalten
+    } loop;
+
+    struct {
+        uint32_t protocol;      // Einstellung, esc_protocol_t
+        esc_protocol_t active;  // beim Start initialisiertes Protokoll
+        uint8_t count;          // initialisierte Ausgänge
+        portMUX_TYPE lock;      // RMT-Kanäle ohne Unterbrechung nacheinander starten
+    } motors;
+
+    struct {
+        uint32_t frame;         // Einstellung, mixer_frame_t
+        uint32_t requested;     // zuletzt versuchter Frame, Fehler nur einmal melden
+        mixer_t matrix;
+    } mixer;
+
+    struct {
+        uint32_t linear;        // Einstellung, Schub statt Throttle an die Motoren
+        float voltage;          // V, gefilterte Batteriespannung, 0 -> noch unbekannt
+        thrust_lut_t luts[2];   // doppelt, Upload schreibt in die inaktive Tabelle
+        volatile uint8_t active;
+    } thrust;
+
+    struct {
+        float amplitude;        // Einstellung, rad/s
+        control_axes_t axis;    // laufender Versuch, AXIS_MAX -> keiner
+        float output;           // rad/s, Ausgang des Relais
+        int64_t start;          // us, erstes Sample
+        tune_sample_t *samples; // beim ersten Start alloziert
+        uint32_t count;
+        control_axes_t result;  // Achse des Vorschlags, AXIS_MAX -> keiner
+        tune_gains_t gains;
+    } tune;
+};
+static struct control_t control = {
+    .motors.lock = portMUX_INITIALIZER_UNLOCKED,
+    .tune.amplitude = 0.5f,
+    .tune.axis = AXIS_MAX,
+    .tune.result = AXIS_MAX
+};
+
+#define CONTROL_THRUST_VOLTAGE_FILTER   0.1f    // Anteil neuer Messung, Spannung sinkt unter Last kurzzeitig
+#define CONTROL_THRUST_BENCHMARK        1000    // Aufrufe für die Zeitmessung beim Start
+#define CONTROL_TUNE_HYSTERESIS         0.005f  // rad, über dem Rauschen der Orientierung
+#define CONTROL_GYRO_TIMEOUT            50000   // us, ohne neues Gyro-Sample entwaffnen, deckt Wechsel vom Ratenprofil idle ab
+
+static const thrust_profile_t control_thrustDefault = { // Motorprofil aus main.c
+    .magic = THRUST_MAGIC,
+    .throttles = 10,
+    .voltages = 3,
+    .throttle = {0.03f, 0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f, 0.7f, 0.8f, 0.9f},
+    .voltage = {9.0f, 10.8f, 12.6f},
+    .thrust = {
+        { 7.0f, 22.0f, 43.0f,  62.0f,  62.0f,  62.0f,  NAN,   NAN,   NAN,   NAN},
+        {10.0f, 27.0f, 56.0f,  80.0f, 106.0f, 128.0f, 160.0f, 190.0f, 190.0f, 197.0f},
+        {16.0f, 44.0f, 79.0f, 107.0f, 145.0f, 175.0f, 211.0f, 250.0f,  NAN,   NAN}
+    }
 };
-static struct control_t control;
 
 static command_t control_commands[CONTROL_COMMAND_MAX] = {
     COMMAND("disarm"),
     COMMAND("arm"),
     COMMAND("resetStabilizePID"),
-    COMMAND("resetQueue")
+    COMMAND("resetQueue"),
+    COMMAND("autotuneRoll"),
+    COMMAND("autotunePitch"),
+    COMMAND("autotuneHeading"),
+    COMMAND("autotuneApply")
 };
 static COMMAND_LIST("control", control_commands, CONTROL_COMMAND_MAX);
 
 static setting_t control_settings[CONTROL_SETTING_MAX] = {
     SETTING("maxRollPitch",     &control.maxRollPitch,                      VALUE_TYPE_FLOAT),
 
-    SETTING("xStabilizeKp",     &control.pids.stabilize[AXIS_ROLL].Kp,      VALUE_TYPE_FLOAT),
-    SETTING("xStabilizeKi",     &control.pids.stabilize[AXIS_ROLL].Ki,      VALUE_TYPE_FLOAT),
-    SETTING("xStabilizeKd",     &control.pids.stabilize[AXIS_ROLL].Kd,      VALUE_TYPE_FLOAT),
-    SETTING("xStabilizeBand",   &control.pids.stabilize[AXIS_ROLL].band,    VALUE_TYPE_FLOAT),
+    // Winkelregler mit Ausgang Solldrehrate in rad/s, Ki pro s und Kd in s. Neue Schlüssel, damit
+    // Werte des früheren einstufigen Reglers (Ausgang Motoren, pro 10 ms Tick) nicht falsch gelesen werden
+    SETTING("xAngleKp",         &control.pids.stabilize[AXIS_ROLL].Kp,      VALUE_TYPE_FLOAT),
+    SETTING("xAngleKi",         &control.pids.stabilize[AXIS_ROLL].Ki,      VALUE_TYPE_FLOAT),
+    SETTING("xAngleKd",         &control.pids.stabilize[AXIS_ROLL].Kd,      VALUE_TYPE_FLOAT),
+    SETTING("xAngleBand",       &control.pids.stabilize[AXIS_ROLL].band,    VALUE_TYPE_FLOAT),
     
-    SETTING("yStabilizeKp",     &control.pids.stabilize[AXIS_PITCH].Kp,     VALUE_TYPE_FLOAT),
-    SETTING("yStabilizeKi",     &control.pids.stabilize[AXIS_PITCH].Ki,     VALUE_TYPE_FLOAT),
-    SETTING("yStabilizeKd",     &control.pids.stabilize[AXIS_PITCH].Kd,     VALUE_TYPE_FLOAT),
-    SETTING("yStabilizeBand",   &control.pids.stabilize[AXIS_PITCH].band,   VALUE_TYPE_FLOAT),
+    SETTING("yAngleKp",         &control.pids.stabilize[AXIS_PITCH].Kp,     VALUE_TYPE_FLOAT),
+    SETTING("yAngleKi",         &control.pids.stabilize[AXIS_PITCH].Ki,     VALUE_TYPE_FLOAT),
+    SETTING("yAngleKd",         &control.pids.stabilize[AXIS_PITCH].Kd,     VALUE_TYPE_FLOAT),
+    SETTING("yAngleBand",       &control.pids.stabilize[AXIS_PITCH].band,   VALUE_TYPE_FLOAT),
     
-    SETTING("zStabilizeKp",     &control.pids.stabilize[AXIS_HEADING].Kp,   VALUE_TYPE_FLOAT),
-    SETTING("zStabilizeKi",     &control.pids.stabilize[AXIS_HEADING].Ki,   VALUE_TYPE_FLOAT),
-    SETTING("zStabilizeKd",     &control.pids.stabilize[AXIS_HEADING].Kd,   VALUE_TYPE_FLOAT),
-    SETTING("zStabilizeBand",   &control.pids.stabilize[AXIS_HEADING].band, VALUE_TYPE_FLOAT),
+    SETTING("zAngleKp",         &control.pids.stabilize[AXIS_HEADING].Kp,   VALUE_TYPE_FLOAT),
+    SETTING("zAngleKi",         &control.pids.stabilize[AXIS_HEADING].Ki,   VALUE_TYPE_FLOAT),
+    SETTING("zAngleKd",         &control.pids.stabilize[AXIS_HEADING].Kd,   VALUE_TYPE_FLOAT),
+    SETTING("zAngleBand",       &control.pids.stabilize[AXIS_HEADING].band, VALUE_TYPE_FLOAT),
+
+    SETTING("throttleBoost",    &control.throttleBoost,                     VALUE_TYPE_UINT),
+    SETTING("loopRate",         &control.loop.rate,                         VALUE_TYPE_UINT),
+
+    SETTING("xRateKp",          &control.pids.rate[AXIS_ROLL].Kp,           VALUE_TYPE_FLOAT),
+    SETTING("xRateKi",          &control.pids.rate[AXIS_ROLL].Ki,           VALUE_TYPE_FLOAT),
+    SETTING("xRateKd",          &control.pids.rate[AXIS_ROLL].Kd,           VALUE_TYPE_FLOAT),
+    SETTING("xRateBand",        &control.pids.rate[AXIS_ROLL].band,         VALUE_TYPE_FLOAT),
 
-    SETTING("throttleBoost",    &control.throttleBoost,                     VALUE_TYPE_UINT)
+    SETTING("yRateKp",          &control.pids.rate[AXIS_PITCH].Kp,          VALUE_TYPE_FLOAT),
+    SETTING("yRateKi",          &control.pids.rate[AXIS_PITCH].Ki,          VALUE_TYPE_FLOAT),
+    SETTING("yRateKd",          &control.pids.rate[AXIS_PITCH].Kd,          VALUE_TYPE_FLOAT),
+    SETTING("yRateBand",        &control.pids.rate[AXIS_PITCH].band,        VALUE_TYPE_FLOAT),
+
+    SETTING("zRateKp",          &control.pids.rate[AXIS_HEADING].Kp,        VALUE_TYPE_FLOAT),
+    SETTING("zRateKi",          &control.pids.rate[AXIS_HEADING].Ki,        VALUE_TYPE_FLOAT),
+    SETTING("zRateKd",          &control.pids.rate[AXIS_HEADING].Kd,        VALUE_TYPE_FLOAT),
+    SETTING("zRateBand",        &control.pids.rate[AXIS_HEADING].band,      VALUE_TYPE_FLOAT),
+
+    SETTING("angleDivider",     &control.loop.angleDivider,                 VALUE_TYPE_UINT),
+    SETTING("motorProtocol",    &control.motors.protocol,                   VALUE_TYPE_UINT),
+    SETTING("frame",            &control.mixer.frame,                       VALUE_TYPE_UINT),
+    SETTING("thrustLinear",     &control.thrust.linear,                     VALUE_TYPE_UINT),
+    SETTING("tuneAmplitude",    &control.tune.amplitude,                    VALUE_TYPE_FLOAT)
 };
 static SETTING_LIST("control", control_settings, CONTROL_SETTING_MAX);
 
@@ -152,7 +254,22 @@ static pv_t control_pvs[CONTROL_PV_MAX] = {
     PV("xOut",          VALUE_TYPE_FLOAT),
     PV("yOut",          VALUE_TYPE_FLOAT),
     PV("zOut",          VALUE_TYPE_FLOAT),
-    PV("rate",          VALUE_TYPE_UINT)
+    PV("rate",          VALUE_TYPE_UINT),
+    PV("jitter",        VALUE_TYPE_INT),
+    PV("overruns",      VALUE_TYPE_UINT),
+    PV("xRateSet",      VALUE_TYPE_FLOAT),
+    PV("yRateSet",      VALUE_TYPE_FLOAT),
+    PV("zRateSet",      VALUE_TYPE_FLOAT),
+    PV("escLatency",    VALUE_TYPE_UINT),
+    PV("motor5",        VALUE_TYPE_FLOAT),
+    PV("motor6",        VALUE_TYPE_FLOAT),
+    PV("motor7",        VALUE_TYPE_FLOAT),
+    PV("motor8",        VALUE_TYPE_FLOAT),
+    PV("tuneKu",        VALUE_TYPE_FLOAT),
+    PV("tuneTu",        VALUE_TYPE_FLOAT),
+    PV("tuneKp",        VALUE_TYPE_FLOAT),
+    PV("tuneKi",        VALUE_TYPE_FLOAT),
+    PV("tuneKd",        VALUE_TYPE_FLOAT)
 };
 static PV_LIST("control", control_pvs, CONTROL_PV_MAX);
 
@@ -180,16 +297,16 @@ static void control_processCommand(control_command_t command);
 /*
  * Function: control_pidCalculate
  * ----------------------------
- * Berechnet PID Regler.
+ * Berechnet PID Regler. Ki und Kd beziehen sich auf Sekunden.
  * 
  * control_pid_t *pid: PID-Container mit gespeicherten Zuständen und Gains
  * float setpoint: Sollwert
  * float feedback: Istwert
- * TickType_t tick: aktueller Tick
+ * int64_t now: us, aktuelle Zeit von esp_timer
  * 
  * returns: gain im Bereich von - 1.0 bis + 1.0
  */
-static float control_pidCalculate(control_pid_t *pid, float setpoint, float feedback, TickType_t tick);
+static float control_pidCalculate(control_pid_t *pid, float setpoint, float feedback, int64_t now);
 
 /*
  * Function: control_pidReset
@@ -200,38 +317,159 @@ static float control_pidCalculate(control_pid_t *pid, float setpoint, float feed
  */
 static void control_pidReset(control_pid_t *pid);
 
+/*
+ * Function: control_loopTimer
+ * ----------------------------
+ * Callback des esp_timer. Stellt einen Regelzyklus vorne in die Queue, ist der vorherige noch
+ * nicht abgearbeitet wird der Zyklus als Overrun gezählt und ausgelassen.
+ *
+ * void* arg: Dummy
+ */
+static void control_loopTimer(void* arg);
+
+/*
+ * Function: control_loop
+ * ----------------------------
+ * Regelzyklus mit fester Rate. Erfasst Intervall und Jitter, übernimmt Ratenänderungen und stabilisiert.
+ */
+static void control_loop();
+
+/*
+ * Function: control_mixerUpdate
+ * ----------------------------
+ * Rechnet die Mischmatrix neu falls die Einstellung frame geändert hat. Nur unbewaffnet,
+ * ein Frame mit mehr Motoren als initialisierten Ausgängen wird abgelehnt.
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+static bool control_mixerUpdate();
+
+/*
+ * Function: control_armCheck
+ * ----------------------------
+ * Prüft ob beide Regler jeder Achse konfiguriert sind. Ohne Kp oder mit Band 0 gäbe ein Regler
+ * nichts aus und der Kopter würde ohne Lagekorrektur abheben, z.B. nach dem Update auf neue Schlüssel.
+ *
+ * returns: false -> bereit, true -> nicht bewaffnen
+ */
+static bool control_armCheck();
+
 /*
  * Function: control_stabilize
  * ----------------------------
- * Stabilisiert auf gewünschte Eulerwinkel mittles PID-Regler.
+ * Stabilisiert auf gewünschte Eulerwinkel mittles kaskadierter PID-Regler. Der äussere Winkelregler
+ * läuft in jedem angleDivider-ten Zyklus und gibt Solldrehraten vor, der innere Drehratenregler
+ * läuft höchstens einmal pro Zyklus auf dem neusten Gyro-Sample. Gemischt wird in jedem Zyklus, ohne
+ * neues Sample mit dem gehaltenen Ausgang, damit Throttle sofort wirkt. Bleiben Samples länger als
+ * CONTROL_GYRO_TIMEOUT aus, wird entwaffnet. Kommen Samples schneller als loopRate, wird nur das
+ * letzte verwendet, loopRate daher >= Gyrorate wählen.
+ *
+ * int64_t now: us, Start des Regelzyklus
+ */
+static void control_stabilize(int64_t now);
+
+/*
+ * Function: control_stabilizeAngle
+ * ----------------------------
+ * Äusserer Regler. Rechnet Winkelfehler in Änderungsraten der Eulerwinkel und bildet diese
+ * ins Körpersystem des Gyros ab. Bei headingRate wird der Sollwert heading direkt als Gierrate genommen.
+ *
+ * vector_t *euler: rad, aktuelle Orientierung
+ * int64_t now: us, Start des Regelzyklus
+ */
+static void control_stabilizeAngle(vector_t *euler, int64_t now);
+
+/*
+ * Function: control_tuneStart
+ * ----------------------------
+ * Startet den Relais-Versuch auf einer Achse. Das Relais ersetzt den Winkelregler dieser Achse,
+ * der Drehratenregler bleibt aktiv. Im Schwebeflug oder auf einem Prüfstand.
+ *
+ * control_axes_t axis: Achse
+ *
+ * returns: false -> Erfolg, true -> Error (nicht bewaffnet, läuft bereits oder kein Speicher)
+ */
+static bool control_tuneStart(control_axes_t axis);
+
+/*
+ * Function: control_tuneStep
+ * ----------------------------
+ * Ein Schritt des Relais-Versuchs im Takt des Winkelreglers. Zeichnet auf, bricht bei zu grosser
+ * Regelabweichung ab und wertet bei voller Aufzeichnung aus.
+ *
+ * vector_t *euler: aktuelle Orientierung
+ * vector_t *eulerRates: Ausgang des Winkelreglers, Achse des Versuchs wird überschrieben
+ * int64_t now: Zeitpunkt in us
  */
-static void control_stabilize();
+static void control_tuneStep(vector_t *euler, vector_t *eulerRates, int64_t now);
+
+/*
+ * Function: control_tuneApply
+ * ----------------------------
+ * Übernimmt die vorgeschlagenen Parameter des letzten erfolgreichen Versuchs als Einstellungen.
+ *
+ * returns: false -> Erfolg, true -> Error (kein Vorschlag vorhanden)
+ */
+static bool control_tuneApply();
+
+/*
+ * Function: control_motorsInit
+ * ----------------------------
+ * Initialisiert die Motorausgänge gemäss Einstellung motorProtocol. PWM über LEDC,
+ * OneShot125 und DShot über je einen RMT-Kanal pro Motor.
+ *
+ * const gpio_num_t *motors: Motorpins in Reihenfolge der Frame-Geometrie
+ * uint8_t count: Anzahl Motorpins, max. MIXER_MOTORS_MAX (je 8 Kanäle LEDC und RMT)
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+static bool control_motorsInit(const gpio_num_t *motors, uint8_t count);
 
 /*
  * Function: control_motorsThrottle
  * ----------------------------
- * Setzt Throttle der Motoren per LEDC Hardware.
- * Grundlegendes PWM-Signal erlaubt Updates mit max. 50 Hz.
- * ToDo: PWM-Signal auf Schubkraft linearisieren. (Waagenmessung & Batterieleistung)
+ * Setzt Throttle der Motoren per LEDC oder RMT Hardware und misst die Latenz ab Start des Regelzyklus.
+ * PWM übernimmt neue Werte erst mit der nächsten Periode (max. 200 Hz), RMT sendet sofort.
+ * Mit thrustLinear sind die Werte Schub und werden per Motorprofil in Throttle umgerechnet.
  *
- * float throttles[4]: Throttle der einzelnen Motoren von 0.0 bis 1.0
+ * float throttles[MIXER_MOTORS_MAX]: Throttle bzw. Schub der einzelnen Motoren von 0.0 bis 1.0
  */
-static void control_motorsThrottle(float throttle[4]);
+static void control_motorsThrottle(float throttle[MIXER_MOTORS_MAX]);
+
+/*
+ * Function: control_motorsBurst
+ * ----------------------------
+ * Kodiert alle Motoren in den RMT-Speicher und startet danach alle Kanäle direkt nacheinander,
+ * so erhalten die ESCs ihre Werte innerhalb weniger us. Unbewaffnet DShot-Stopp bzw. OneShot-Minimum.
+ *
+ * float throttles[MIXER_MOTORS_MAX]: Throttle der einzelnen Motoren von 0.0 bis 1.0
+ */
+static void control_motorsBurst(float throttle[MIXER_MOTORS_MAX]);
 
 /*
  * Function: control_motorsBoost
  * ----------------------------
- * Erhöht geforderter Throttle sodass ein äquivalenter Schub wie bei voller Batterie resultiert.
+ * Rechnet geforderten Schub in Throttle um, sodass der Schub linear und unabhängig vom Ladezustand
+ * der Batterie wie bei voller Batterie resultiert. Nur mit Einstellung thrustLinear, standardmässig aus.
+ *
+ * float *throttle: geforderter Schub 0.0 bis 1.0, wird mit Throttle überschrieben
+ */
+static void control_motorsBoost(float *throttle);
+
+/*
+ * Function: control_thrustInit
+ * ----------------------------
+ * Lädt das Motorprofil aus dem NVS (sonst das aus main.c), baut die Umkehrtabelle und misst die
+ * Laufzeit einer Auswertung.
  *
- * float throttle[4]: Throttle der geboosted werden soll
+ * returns: false -> Erfolg, true -> Error
  */
-static void control_motorsBoost(float throttle[4]);
+static bool control_thrustInit();
 
 
 /** Implementierung **/
 
-bool control_init(gpio_num_t motorFrontLeft, gpio_num_t motorFrontRight,
-                  gpio_num_t motorBackLeft, gpio_num_t motorBackRight) {
+bool control_init(const gpio_num_t *motors, uint8_t motorCount) {
     // Intercom-Queue erstellen
     xControl = xQueueCreate(16, sizeof(event_t));
     // an Intercom anbinden
@@ -239,38 +477,22 @@ bool control_init(gpio_num_t motorFrontLeft, gpio_num_t motorFrontRight,
     settingRegister(xControl, control_settings);
     parameterRegister(xControl, control_parameters);
     pvRegister(xControl, control_pvs);
-    // LEDC als Motortreiber initialisieren
-    ESP_LOGD("control", "Motors init");
-    bool ret = false;
-    ledc_timer_config_t ledcConfig = {
-        speed_mode:         LEDC_HIGH_SPEED_MODE,
-        {duty_resolution:   LEDC_TIMER_18_BIT},
-        timer_num:          LEDC_TIMER_0,
-        freq_hz:            CONTROL_MOTOR_FREQUENCY
-    };
-    ret = ledc_timer_config(&ledcConfig);
-    ledc_channel_config_t ledcChannel = {
-        speed_mode: LEDC_HIGH_SPEED_MODE,
-        intr_type:  LEDC_INTR_DISABLE,
-        timer_sel:  LEDC_TIMER_0,
-        duty:       CONTROL_MOTOR_DUTY_MIN,
-        hpoint:     0
-    };
-    ledcChannel.channel = LEDC_CHANNEL_0;
-    ledcChannel.gpio_num = motorFrontLeft;
-    ret |= ledc_channel_config(&ledcChannel);
-    ledcChannel.channel = LEDC_CHANNEL_1;
-    ledcChannel.gpio_num = motorFrontRight;
-    ret |= ledc_channel_config(&ledcChannel);
-    ledcChannel.channel = LEDC_CHANNEL_2;
-    ledcChannel.gpio_num = motorBackLeft;
-    ret |= ledc_channel_config(&ledcChannel);
-    ledcChannel.channel = LEDC_CHANNEL_3;
-    ledcChannel.gpio_num = motorBackRight;
-    ret |= ledc_channel_config(&ledcChannel);
-    ESP_LOGD("control", "Motors %s", ret ? "error" : "ok");
+    // Motortreiber initialisieren
+    bool ret = control_motorsInit(motors, motorCount);
+    ret |= control_mixerUpdate();
+    ret |= control_thrustInit();
     // installiere task
     if (xTaskCreate(&control_task, "control", 3 * 1024, NULL, xControl_PRIORITY, NULL) != pdTRUE) return true;
+    // Regelzyklus per Timer statt bei jedem Orientierungsupdate, Rate und Jitter unabhängig von Sensoren
+    esp_timer_create_args_t timerArgs = {
+        .callback = &control_loopTimer,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "control"
+    };
+    if (esp_timer_create(&timerArgs, &control.loop.timer)) return true;
+    control.loop.activeRate = control.loop.rate ? control.loop.rate : CONTROL_LOOP_RATE;
+    if (esp_timer_start_periodic(control.loop.timer, 1000000 / control.loop.activeRate)) return true;
     return ret;
 }
 
@@ -284,8 +506,8 @@ void control_task(void* arg) {
     pv_t *pvRemoteConnection = intercom_pvSubscribe(xControl, xRemote, REMOTE_PV_CONNECTIONS, 0); // UInt
     pv_t *pvRemoteTimeout = intercom_pvSubscribe(xControl, xRemote, REMOTE_PV_TIMEOUT, 0); // Event
     pv_t *pvRemoteState = intercom_pvSubscribe(xControl, xRemote, REMOTE_PV_STATE_ERROR, 0); // Event
-    pv_t *pvSensorsOrientation = intercom_pvSubscribe(xControl, xSensors, SENSORS_PV_ORIENTATION, 0); // Event
     pv_t *pvSensorsTimeout = intercom_pvSubscribe(xControl, xSensors, SENSORS_PV_TIMEOUT, 0);
+    pv_t *pvSensorsVoltage = intercom_pvSubscribe(xControl, xSensors, SENSORS_PV_VOLTAGE, 100000); // Float
     // Loop
     while (true) {
         xQueueReceive(xControl, &event, portMAX_DELAY);
@@ -295,8 +517,13 @@ void control_task(void* arg) {
                 break;
             case (EVENT_PV): { // Istwert-Änderung
                 pv_t *pv = event.data;
-                if (pv == pvSensorsOrientation) control_stabilize();
-                else if (!control.armed) break;
+                if (pv == pvSensorsVoltage) { // auch unbewaffnet, damit beim Start schon gefiltert
+                    float voltage = pvGetFloat(pv);
+                    if (control.thrust.voltage <= 0.0f) control.thrust.voltage = voltage;
+                    else control.thrust.voltage += CONTROL_THRUST_VOLTAGE_FILTER * (voltage - control.thrust.voltage);
+                    break;
+                }
+                if (!control.armed) break;
                 else if (pv == pvRemoteTimeout) {
                     ESP_LOGD("control", "got timeout");
                     control_processCommand(CONTROL_COMMAND_DISARM);
@@ -317,7 +544,10 @@ void control_task(void* arg) {
                 }
                 break;
             }
-            case (EVENT_INTERNAL):
+            case (EVENT_INTERNAL): // Regelzyklus vom Timer
+                control.loop.pending = false;
+                control_loop();
+                break;
             default:
                 // ungültig
                 break;
@@ -325,6 +555,7 @@ void control_task(void* arg) {
         // lösche wenn Platz gering wird
         if (uxQueueSpacesAvailable(xControl) <= 1) {
             xQueueReset(xControl);
+            control.loop.pending = false; // Zyklus wurde mitgelöscht
             ESP_LOGE("control", "queue reset!");
         }
     }
@@ -333,40 +564,73 @@ void control_task(void* arg) {
 static void control_processCommand(control_command_t command) {
     switch (command) {
         case (CONTROL_COMMAND_DISARM):
+            if (control.armed) intercom_commandSend(xSensors, SENSORS_COMMAND_RATE_IDLE); // Sensoren auf Ratenprofil idle
             control.armed = false;
-            float throttle[4];
+            control.tune.axis = AXIS_MAX; // laufenden Versuch abbrechen
+            float throttle[MIXER_MOTORS_MAX] = {0.0f};
             control_motorsThrottle(throttle);
             pvPublishUint(xControl, CONTROL_PV_ARMED, 0);
             control_processCommand(CONTROL_COMMAND_RESET_STABILIZE_PID);
             break;
         case (CONTROL_COMMAND_ARM):
+            if (!control.armed && control_armCheck()) {
+                ESP_LOGE("control", "angle or rate PID without Kp or band, not armed");
+                break;
+            }
+            if (!control.armed) intercom_commandSend(xSensors, SENSORS_COMMAND_RATE_ARMED); // Sensoren auf volle Rate
+            if (!control.armed) control.loop.gyroSeen = esp_timer_get_time(); // Timeout erst ab jetzt
             control.armed = true;
             pvPublishUint(xControl, CONTROL_PV_ARMED, 1);
             break;
         case (CONTROL_COMMAND_RESET_STABILIZE_PID):
-            control_pidReset(&control.pids.stabilize[AXIS_ROLL]);
-            control_pidReset(&control.pids.stabilize[AXIS_PITCH]);
-            control_pidReset(&control.pids.stabilize[AXIS_HEADING]);
+            for (control_axes_t i = 0; i < AXIS_MAX; ++i) {
+                control_pidReset(&control.pids.stabilize[i]);
+                control_pidReset(&control.pids.rate[i]);
+                control.setpoints.rates.v[i] = 0.0f;
+                control.loop.rateOutput.v[i] = 0.0f;
+            }
+            control.loop.cycle = 0; // Winkelregler im nächsten Zyklus
             break;
         case (CONTROL_COMMAND_RESET_QUEUE):
             xQueueReset(xControl);
+            control.loop.pending = false;
+            break;
+        case (CONTROL_COMMAND_AUTOTUNE_ROLL):
+        case (CONTROL_COMMAND_AUTOTUNE_PITCH):
+        case (CONTROL_COMMAND_AUTOTUNE_HEADING):
+            if (control_tuneStart(AXIS_ROLL + command - CONTROL_COMMAND_AUTOTUNE_ROLL)) {
+                ESP_LOGE("control", "autotune not started");
+            }
+            break;
+        case (CONTROL_COMMAND_AUTOTUNE_APPLY):
+            if (control_tuneApply()) ESP_LOGE("control", "no autotune result");
+            break;
         default:
             break;
     }
     return;
 }
 
-static float control_pidCalculate(control_pid_t *pid, float setpoint, float feedback, TickType_t tick) {
+static bool control_armCheck() {
+    for (control_axes_t i = 0; i < AXIS_MAX; ++i) {
+        if (!(control.pids.stabilize[i].Kp > 0.0f) || !(control.pids.stabilize[i].band > 0.0f)) return true;
+        if (!(control.pids.rate[i].Kp > 0.0f) || !(control.pids.rate[i].band > 0.0f)) return true;
+    }
+    return false;
+}
+
+static float control_pidCalculate(control_pid_t *pid, float setpoint, float feedback, int64_t now) {
     float gain;
     float error = setpoint - feedback;
-    TickType_t deltaT = tick - pid->lastTick;
-    pid->lastTick = tick;
+    float deltaT = (now - pid->lastTime) * 1e-6f; // s
+    bool valid = pid->lastTime && deltaT > 0.0f && deltaT < CONTROL_PID_DT_MAX;
+    pid->lastTime = now;
     gain = pid->Kp * error; // P
-    if (pid->Kd) { // D
-        gain += pid->Kd * (error - pid->prevError) / deltaT;
+    if (pid->Kd) { // D, beim ersten Aufruf ohne gültiges dt nur Fehler merken
+        if (valid) gain += pid->Kd * (error - pid->prevError) / deltaT;
         pid->prevError = error;
     }
-    if (pid->Ki) { // I
+    if (pid->Ki && valid) { // I
         error *= pid->Ki * deltaT;
         pid->integralError += error;
         gain += pid->integralError;
@@ -382,6 +646,7 @@ static float control_pidCalculate(control_pid_t *pid, float setpoint, float feed
 static void control_pidReset(control_pid_t *pid) {
     pid->integralError = 0.0f;
     pid->prevError = 0.0f;
+    pid->lastTime = 0;
 }
 
 static void control_position(vector_t setpoint, vector_t position) {
@@ -393,14 +658,16 @@ static void control_position(vector_t setpoint, vector_t position) {
 
 static void control_direction(vector_t setpoint, vector_t velocity) {
     // float throttle, woher kommt es, sollte dies nicht hier errechnet werden?
-    bno_toWorldFrame(&setpoint, NULL);
+    sensors_state_t state;
+    sensors_stateGet(&state);
+    bno_rotationToWorld(&setpoint, &state.rotation);
     // rechne pids
-    TickType_t tick = xTaskGetTickCount();
+    int64_t now = esp_timer_get_time();
     vector_t gain; // - 45.0 bis + 45.0
     for (control_directions_t i = 0; i < 3 ; ++i) { // x, y, z
-        gain.v[i] = control_pidCalculate(&control.pids.direction[i], setpoint.v[i], velocity.v[i], tick);
+        gain.v[i] = control_pidCalculate(&control.pids.direction[i], setpoint.v[i], velocity.v[i], now);
     }
-    bno_toLocalFrame(&gain, NULL);
+    bno_rotationToLocal(&gain, &state.rotation);
     // x, y verschiebt Sollwinkel Roll, Pitch
     float maxAngle = control.maxRollPitch / 2.0f; // Hälfte des sicheren Winkels
     if ((gain.x > maxAngle) || (gain.x < -maxAngle)) {
@@ -415,85 +682,346 @@ static void control_direction(vector_t setpoint, vector_t velocity) {
     control.throttle += gain.z;
     if (gain.z > 1.0f) gain.z = 1.0f;
     else if (gain.z < 0.0f) gain.z = 0.0f;
-    control_stabilize();
+    control_stabilize(now);
+}
+
+static void control_loopTimer(void* arg) {
+    if (__atomic_exchange_n(&control.loop.pending, true, __ATOMIC_ACQ_REL)) {
+        ++control.loop.overruns; // vorheriger Zyklus noch nicht gestartet
+        return;
+    }
+    event_t event = {EVENT_INTERNAL, NULL};
+    if (xQueueSendToFront(xControl, &event, 0) != pdTRUE) {
+        control.loop.pending = false;
+        ++control.loop.overruns;
+    }
+}
+
+static void control_loop() {
+    int64_t now = esp_timer_get_time();
+    int32_t period = 1000000 / control.loop.activeRate;
+    // Statistik
+    if (control.loop.lastTime) {
+        int32_t interval = now - control.loop.lastTime;
+        pvPublishUint(xControl, CONTROL_PV_RATE, interval);
+        pvPublishInt(xControl, CONTROL_PV_JITTER, interval - period);
+    }
+    control.loop.lastTime = now;
+    uint32_t overruns = control.loop.overruns;
+    if (overruns != control.loop.publishedOverruns) {
+        control.loop.publishedOverruns = overruns;
+        pvPublishUint(xControl, CONTROL_PV_OVERRUNS, overruns);
+    }
+    // geänderte Einstellung übernehmen
+    uint32_t rate = control.loop.rate ? control.loop.rate : CONTROL_LOOP_RATE;
+    if (rate < CONTROL_LOOP_RATE_MIN) rate = CONTROL_LOOP_RATE_MIN;
+    else if (rate > CONTROL_LOOP_RATE_MAX) rate = CONTROL_LOOP_RATE_MAX;
+    if (rate != control.loop.activeRate) {
+        esp_timer_stop(control.loop.timer);
+        if (!esp_timer_start_periodic(control.loop.timer, 1000000 / rate)) control.loop.activeRate = rate;
+        else esp_timer_start_periodic(control.loop.timer, period);
+        control.loop.lastTime = 0;
+    }
+    if (!control.armed) {
+        control_mixerUpdate();
+        // digitale ESCs brauchen ein stetiges Signal um zu initialisieren, wie LEDC mit minimalem Duty
+        float stop[MIXER_MOTORS_MAX] = {0.0f};
+        if (control.motors.active != ESC_PROTOCOL_PWM) control_motorsBurst(stop);
+    }
+    control_stabilize(now);
 }
 
-static void control_stabilize() {
-    vector_t euler; // aktuelle Orientierung (Istwert)
-    bno_toEuler(&euler, NULL);
+static bool control_mixerUpdate() {
+    if (control.mixer.frame == control.mixer.requested && control.mixer.matrix.motors) return false;
+    control.mixer.requested = control.mixer.frame;
+    if (mixer_motors(control.mixer.frame) > control.motors.count || mixer_build(&control.mixer.matrix, control.mixer.frame)) {
+        ESP_LOGE("control", "frame %u not possible with %u motors", control.mixer.frame, control.motors.count);
+        return true;
+    }
+    return false;
+}
+
+static void control_stabilize(int64_t now) {
+    sensors_state_t state;
+    sensors_stateGet(&state);
+    vector_t euler = state.rotation.euler; // aktuelle Orientierung (Istwert)
     pvPublishFloat(xControl, CONTROL_PV_ROLL, euler.x);
     pvPublishFloat(xControl, CONTROL_PV_PITCH, euler.y);
     pvPublishFloat(xControl, CONTROL_PV_HEADING, euler.z);
-    // Loop Rate
-    static int64_t lastTime = 0;
-    int64_t now = esp_timer_get_time();
-    pvPublishUint(xControl, CONTROL_PV_RATE, (uint32_t)now - lastTime);
-    lastTime = now;
     // Sicherheit
     if (!control.armed) return;
     if ((euler.x > control.maxRollPitch) || (euler.x < -control.maxRollPitch)
      || (euler.y > control.maxRollPitch) || (euler.y < -control.maxRollPitch)) {
         ESP_LOGD("control", "max angle!");
         control_processCommand(CONTROL_COMMAND_DISARM);
+        return;
     }
-    // rechne pids
-    TickType_t tick = xTaskGetTickCount();
-    vector_t gain;
-    for (control_axes_t i = 0; i < 3; ++i) { // roll, pitch, heading
-        gain.v[i] = control_pidCalculate(&control.pids.stabilize[i], control.setpoints.euler.v[i], euler.v[i], tick);
-        pvPublishFloat(xControl, CONTROL_PV_OUT_X + i, gain.v[i]);
-    }
-    // throttle mixen
-    gain.y /= 0.775f; // Korrektur für wide-X Frame gemäss https://www.iforce2d.net/mixercalc/
-    float throttles[MOTOR_MAX]; //  roll     pitch    heading
-    throttles[MOTOR_FRONT_LEFT] =   gain.x - gain.y + gain.z;
-    throttles[MOTOR_FRONT_RIGHT] = -gain.x - gain.y - gain.z;
-    throttles[MOTOR_BACK_LEFT]  =   gain.x + gain.y - gain.z;
-    throttles[MOTOR_BACK_RIGHT] =  -gain.x + gain.y + gain.z;
-    // nach oben beschränken (remanent auf throttle wirkend) wenn auf einem Motor > 1.0 verlangt wäre
-    for (control_motors_t i = 0 ; i < MOTOR_MAX; ++i) {
-        if (throttles[i] * control.throttle + control.throttle > 1.0f) {
-            control.throttle = 1.0f / (throttles[i] + 1.0f);
-            pvPublish(xControl, CONTROL_PV_THROTTLE_MAX);
+    // äusserer Regler mit reduzierter Rate
+    uint32_t divider = control.loop.angleDivider ? control.loop.angleDivider : CONTROL_ANGLE_DIVIDER;
+    if (control.loop.cycle++ % divider == 0) control_stabilizeAngle(&euler, now);
+    // innerer Regler nur wenn seit letztem Zyklus ein neues Gyro-Sample kam, dt aus dessen Zeitstempel
+    int64_t gyroTime = state.rates.timestamp;
+    vector_t *gain = &control.loop.rateOutput;
+    if (gyroTime != control.loop.lastGyro) {
+        control.loop.lastGyro = gyroTime;
+        control.loop.gyroSeen = now;
+        for (control_axes_t i = 0; i < 3; ++i) { // roll, pitch, heading
+            gain->v[i] = control_pidCalculate(&control.pids.rate[i], control.setpoints.rates.v[i], state.rates.vector.v[i], gyroTime);
+            pvPublishFloat(xControl, CONTROL_PV_OUT_X + i, gain->v[i]);
         }
+    } else if (now - control.loop.gyroSeen > CONTROL_GYRO_TIMEOUT) {
+        ESP_LOGD("control", "gyro stale!");
+        control_processCommand(CONTROL_COMMAND_DISARM);
+        return;
     }
-    for (control_motors_t i = 0 ; i < MOTOR_MAX; ++i) {
-        throttles[i] *= control.throttle;
-        throttles[i] += control.throttle;
+    // mixen, Lageanteil wie bisher mit throttle skaliert
+    float command[MIXER_AXES] = {
+        gain->x * control.throttle, gain->y * control.throttle, gain->z * control.throttle, control.throttle
+    };
+    float throttles[MIXER_MOTORS_MAX] = {0.0f};
+    // Schub temporär senken wenn ein Motor > 1.0 bzw. mit throttleBoost heben wenn einer < 0.0 verlangt wäre
+    uint8_t saturation = mixer_mix(&control.mixer.matrix, command, control.throttleBoost, throttles);
+    if (saturation & MIXER_LIMITED_HIGH) pvPublish(xControl, CONTROL_PV_THROTTLE_MAX);
+    if (saturation & MIXER_RAISED_LOW) pvPublish(xControl, CONTROL_PV_THROTTLE_MIN);
+    // https://docs.px4.io/v1.9.0/en/config_mc/pid_tuning_guide_multicopter.html
+    control_motorsThrottle(throttles);
+}
+
+static void control_stabilizeAngle(vector_t *euler, int64_t now) {
+    vector_t eulerRates; // rad/s, Änderung von roll, pitch, heading
+    for (control_axes_t i = 0; i < 3; ++i) {
+        eulerRates.v[i] = control_pidCalculate(&control.pids.stabilize[i], control.setpoints.euler.v[i], euler->v[i], now);
     }
-    // tiefen throttle heben (nur temporär auf throttle wirkend) wenn auf einem Motor < 0.0 verlangt wäre
-    if (control.throttleBoost) {
-        float negThrottle = 0.0f;
-        for (control_motors_t i = 0 ; i < MOTOR_MAX; ++i) {
-            if (throttles[i] < 0.0f && throttles[i] < negThrottle) {
-                negThrottle = throttles[i];
-                pvPublish(xControl, CONTROL_PV_THROTTLE_MIN);
-            }
+    if (control.setpoints.headingRate) eulerRates.z = control.setpoints.euler.z;
+    if (control.tune.axis != AXIS_MAX) control_tuneStep(euler, &eulerRates, now);
+    // Kinematik der Eulerwinkel (ZYX): Körperdrehraten aus Änderungsraten
+    float sinRoll = sinf(euler->x), cosRoll = cosf(euler->x);
+    float sinPitch = sinf(euler->y), cosPitch = cosf(euler->y);
+    control.setpoints.rates.x = eulerRates.x - sinPitch * eulerRates.z;
+    control.setpoints.rates.y = cosRoll * eulerRates.y + sinRoll * cosPitch * eulerRates.z;
+    control.setpoints.rates.z = -sinRoll * eulerRates.y + cosRoll * cosPitch * eulerRates.z;
+    for (control_axes_t i = 0; i < 3; ++i) {
+        pvPublishFloat(xControl, CONTROL_PV_RATE_SETPOINT_X + i, control.setpoints.rates.v[i]);
+    }
+}
+
+static bool control_tuneStart(control_axes_t axis) {
+    if (!control.armed || control.tune.axis != AXIS_MAX) return true;
+    if (axis == AXIS_HEADING && control.setpoints.headingRate) return true; // braucht Sollwinkel
+    if (!control.tune.samples) control.tune.samples = malloc(TUNE_SAMPLES * sizeof(tune_sample_t));
+    if (!control.tune.samples) return true;
+    control.tune.output = 0.0f;
+    control.tune.start = 0;
+    control.tune.count = 0;
+    control.tune.result = AXIS_MAX;
+    control.tune.axis = axis;
+    ESP_LOGI("control", "autotune axis %u, relay %.2f rad/s", axis, control.tune.amplitude);
+    return false;
+}
+
+static void control_tuneStep(vector_t *euler, vector_t *eulerRates, int64_t now) {
+    control_axes_t axis = control.tune.axis;
+    float error = control.setpoints.euler.v[axis] - euler->v[axis];
+    if (axis != AXIS_HEADING && fabsf(error) > control.maxRollPitch / 2.0f) { // Hälfte des sicheren Winkels
+        control.tune.axis = AXIS_MAX;
+        control_pidReset(&control.pids.stabilize[axis]);
+        ESP_LOGE("control", "autotune aborted, error %.2f rad", error);
+        return;
+    }
+    if (!control.tune.start) control.tune.start = now;
+    control.tune.output = tune_relay(error, control.tune.output, control.tune.amplitude, CONTROL_TUNE_HYSTERESIS);
+    eulerRates->v[axis] = control.tune.output;
+    tune_sample_t *sample = &control.tune.samples[control.tune.count++];
+    sample->time = now - control.tune.start;
+    sample->error = error;
+    sample->output = control.tune.output;
+    if (control.tune.count < TUNE_SAMPLES) return;
+    // Aufzeichnung voll, Winkelregler übernimmt wieder
+    control.tune.axis = AXIS_MAX;
+    control_pidReset(&control.pids.stabilize[axis]);
+    tune_result_t result;
+    if (tune_estimate(control.tune.samples, control.tune.count, control.tune.amplitude, CONTROL_TUNE_HYSTERESIS, &result)) {
+        ESP_LOGE("control", "autotune: no steady oscillation");
+        return;
+    }
+    tune_gains(&result, &control.tune.gains);
+    control.tune.result = axis;
+    pvPublishFloat(xControl, CONTROL_PV_TUNE_KU, result.ku);
+    pvPublishFloat(xControl, CONTROL_PV_TUNE_TU, result.tu);
+    pvPublishFloat(xControl, CONTROL_PV_TUNE_KP, control.tune.gains.kp);
+    pvPublishFloat(xControl, CONTROL_PV_TUNE_KI, control.tune.gains.ki);
+    pvPublishFloat(xControl, CONTROL_PV_TUNE_KD, control.tune.gains.kd);
+    ESP_LOGI("control", "autotune axis %u: Ku %.2f Tu %.3f s over %u periods", axis, result.ku, result.tu, result.periods);
+}
+
+static bool control_tuneApply() {
+    control_axes_t axis = control.tune.result;
+    if (axis == AXIS_MAX) return true;
+    // Einstellungen pro Achse: Kp, Ki, Kd, Band
+    uint32_t setting = CONTROL_SETTING_STABILIZE_X_KP + axis * (CONTROL_SETTING_STABILIZE_Y_KP - CONTROL_SETTING_STABILIZE_X_KP);
+    value_t value;
+    bool ret = false;
+    value.f = control.tune.gains.kp;
+    ret |= intercom_settingSet(xControl, setting, &value);
+    value.f = control.tune.gains.ki;
+    ret |= intercom_settingSet(xControl, setting + 1, &value);
+    value.f = control.tune.gains.kd;
+    ret |= intercom_settingSet(xControl, setting + 2, &value);
+    control_pidReset(&control.pids.stabilize[axis]);
+    return ret;
+}
+
+uint32_t control_tuneGet(const uint8_t **data) {
+    if (control.tune.axis != AXIS_MAX || !control.tune.samples || !control.tune.count) return 0;
+    *data = (const uint8_t*)control.tune.samples;
+    return control.tune.count * sizeof(tune_sample_t);
+}
+
+static bool control_motorsInit(const gpio_num_t *motors, uint8_t count) {
+    ESP_LOGD("control", "Motors init");
+    if (count > MIXER_MOTORS_MAX) return true;
+    control.motors.count = count;
+    bool ret = false;
+    control.motors.active = control.motors.protocol < ESC_PROTOCOL_MAX ? control.motors.protocol : ESC_PROTOCOL_PWM;
+    if (control.motors.active == ESC_PROTOCOL_PWM) { // LEDC
+        ledc_timer_config_t ledcConfig = {
+            speed_mode:         LEDC_HIGH_SPEED_MODE,
+            {duty_resolution:   LEDC_TIMER_18_BIT},
+            timer_num:          LEDC_TIMER_0,
+            freq_hz:            CONTROL_MOTOR_FREQUENCY
+        };
+        ret = ledc_timer_config(&ledcConfig);
+        ledc_channel_config_t ledcChannel = {
+            speed_mode: LEDC_HIGH_SPEED_MODE,
+            intr_type:  LEDC_INTR_DISABLE,
+            timer_sel:  LEDC_TIMER_0,
+            duty:       CONTROL_MOTOR_DUTY_MIN,
+            hpoint:     0
+        };
+        for (uint8_t i = 0; i < count; ++i) {
+            ledcChannel.channel = LEDC_CHANNEL_0 + i;
+            ledcChannel.gpio_num = motors[i];
+            ret |= ledc_channel_config(&ledcChannel);
         }
-        for (control_motors_t i = 0 ; i < MOTOR_MAX; ++i) {
-            throttles[i] += -negThrottle;
+    } else { // RMT, ein Kanal pro Motor mit vollem APB-Takt
+        rmt_config_t rmtConfig = {
+            .rmt_mode = RMT_MODE_TX,
+            .clk_div = APB_CLK_FREQ / ESC_CLOCK,
+            .mem_block_num = 1,
+            .tx_config = {
+                .loop_en = false,
+                .carrier_en = false,
+                .idle_level = RMT_IDLE_LEVEL_LOW,
+                .idle_output_en = true
+            }
+        };
+        for (uint8_t i = 0; i < count; ++i) {
+            rmtConfig.channel = RMT_CHANNEL_0 + i;
+            rmtConfig.gpio_num = motors[i];
+            ret |= rmt_config(&rmtConfig);
+            ret |= rmt_driver_install(RMT_CHANNEL_0 + i, 0, 0);
         }
-    } // https://docs.px4.io/v1.9.0/en/config_mc/pid_tuning_guide_multicopter.html
-    control_motorsThrottle(throttles);
+        float stop[MIXER_MOTORS_MAX] = {0.0f};
+        if (!ret) control_motorsBurst(stop); // ESCs sofort mit Stopp versorgen, danach in jedem Regelzyklus
+    }
+    ESP_LOGD("control", "Motors %s", ret ? "error" : "ok");
+    return ret;
 }
 
-static void control_motorsThrottle(float throttle[4]) {
+static void control_motorsThrottle(float throttle[MIXER_MOTORS_MAX]) {
     uint32_t duty;
-    for (control_motors_t i = 0; i < MOTOR_MAX; ++i) {
+    float longest = 0.0f;
+    for (uint8_t i = 0; i < control.motors.count; ++i) {
         control_motorsBoost(&throttle[i]);
         if (throttle[i] > 1.0f) throttle[i] = 1.0f;
         else if (throttle[i] < 0.0f) throttle[i] = 0.0f;
-        if (control.armed) {
+        if (throttle[i] > longest) longest = throttle[i];
+        if (control.motors.active != ESC_PROTOCOL_PWM) continue;
+        if (control.armed && i < control.mixer.matrix.motors) { // Ausgänge ausserhalb des Frames bleiben aus
             duty = throttle[i] * (CONTROL_MOTOR_DUTY_MAX - CONTROL_MOTOR_DUTY_MIN_SPIN) + CONTROL_MOTOR_DUTY_MIN_SPIN;
         } else {
             duty = CONTROL_MOTOR_DUTY_MIN;
         }
         ledc_set_duty(LEDC_HIGH_SPEED_MODE, i, duty);
         ledc_update_duty(LEDC_HIGH_SPEED_MODE, i);
-        pvPublishFloat(xControl, CONTROL_PV_THROTTLE_FRONT_LEFT + i, throttle[i]);
     }
+    if (control.motors.active != ESC_PROTOCOL_PWM) control_motorsBurst(throttle);
+    // Latenz vom Start des Regelzyklus bis der ESC den Wert kennt
+    if (control.armed && control.loop.lastTime) {
+        uint32_t latency = esp_timer_get_time() - control.loop.lastTime;
+        if (control.motors.active == ESC_PROTOCOL_PWM) latency += 1000000 / CONTROL_MOTOR_FREQUENCY; // schlimmstenfalls volle Periode
+        else latency += esc_duration(control.motors.active, longest * (1.0f - CONTROL_MOTOR_IDLE) + CONTROL_MOTOR_IDLE);
+        pvPublishUint(xControl, CONTROL_PV_ESC_LATENCY, latency);
+    }
+    for (uint8_t i = 0; i < control.motors.count; ++i) {
+        if (i < 4) pvPublishFloat(xControl, CONTROL_PV_THROTTLE_FRONT_LEFT + i, throttle[i]);
+        else pvPublishFloat(xControl, CONTROL_PV_THROTTLE_5 + i - 4, throttle[i]);
+    }
+}
+
+static void control_motorsBurst(float throttle[MIXER_MOTORS_MAX]) {
+    // vorheriger Burst ist bei max. CONTROL_LOOP_RATE_MAX längst abgeschlossen (DShot300 53 us, OneShot125 250 us)
+    static rmt_item32_t items[MIXER_MOTORS_MAX][ESC_ITEMS]; // nur vom control-Task verwendet, schont den Stack
+    for (uint8_t i = 0; i < control.motors.count; ++i) {
+        bool on = control.armed && i < control.mixer.matrix.motors; // Ausgänge ausserhalb des Frames bleiben aus
+        float value = throttle[i] * (1.0f - CONTROL_MOTOR_IDLE) + CONTROL_MOTOR_IDLE;
+        if (control.motors.active == ESC_PROTOCOL_ONESHOT125) {
+            esc_oneshotEncode(on ? value : 0.0f, (uint32_t*)items[i]);
+        } else {
+            uint16_t frame = esc_dshotFrame(on ? esc_dshotValue(value) : ESC_DSHOT_STOP, false);
+            esc_dshotEncode(frame, control.motors.active, (uint32_t*)items[i]);
+        }
+        rmt_fill_tx_items(RMT_CHANNEL_0 + i, items[i], ESC_ITEMS, 0);
+    }
+    portENTER_CRITICAL(&control.motors.lock);
+    for (uint8_t i = 0; i < control.motors.count; ++i) {
+        rmt_tx_start(RMT_CHANNEL_0 + i, true);
+    }
+    portEXIT_CRITICAL(&control.motors.lock);
+}
+
+static void control_motorsBoost(float *throttle) {
+    if (!control.thrust.linear) return;
+    *throttle = thrust_throttle(&control.thrust.luts[control.thrust.active], *throttle, control.thrust.voltage);
+}
+
+static bool control_thrustInit() {
+    thrust_profile_t profile;
+    size_t length = sizeof(profile);
+    nvs_handle nvs;
+    bool stored = !nvs_open("control", NVS_READONLY, &nvs);
+    if (stored) {
+        stored = !nvs_get_blob(nvs, "thrustProfile", &profile, &length) && length == sizeof(profile);
+        nvs_close(nvs);
+    }
+    if (!stored || thrust_build(&profile, &control.thrust.luts[0])) {
+        if (stored) ESP_LOGE("control", "stored thrust profile invalid, using default");
+        if (thrust_build(&control_thrustDefault, &control.thrust.luts[0])) return true;
+    }
+    control.thrust.active = 0;
+    // Laufzeit messen, muss neben Regler und Mischer im Regelzyklus Platz haben
+    volatile float sink = 0.0f;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < CONTROL_THRUST_BENCHMARK; ++i) {
+        sink += thrust_throttle(&control.thrust.luts[0], (float)(i % 101) / 100.0f, 9.0f + (float)(i % 37) / 10.0f);
+    }
+    uint32_t duration = esp_timer_get_time() - start;
+    ESP_LOGI("control", "thrust lut: %u ns per call, reference %.0f g", duration * 1000 / CONTROL_THRUST_BENCHMARK,
+             control.thrust.luts[0].reference);
+    return false;
 }
 
-static void control_motorsBoost(float throttle[4]) {
-    ;
+bool control_thrustProfile(const char *text, uint32_t length) {
+    thrust_profile_t profile;
+    if (thrust_parse(text, length, &profile)) return true;
+    uint8_t inactive = !control.thrust.active;
+    if (thrust_build(&profile, &control.thrust.luts[inactive])) return true;
+    nvs_handle nvs;
+    if (nvs_open("control", NVS_READWRITE, &nvs)) return true;
+    bool error = nvs_set_blob(nvs, "thrustProfile", &profile, sizeof(profile)) || nvs_commit(nvs);
+    nvs_close(nvs);
+    if (error) return true;
+    control.thrust.active = inactive; // Regelzyklus übernimmt ab dem nächsten Aufruf
+    ESP_LOGI("control", "thrust profile stored, reference %.0f g", control.thrust.luts[inactive].reference);
+    return false;
 }
@@ -26,7 +26,12 @@
 #define CONTROL_MOTOR_FREQUENCY     200
 #define CONTROL_MOTOR_DUTY_MIN      ((0x1 << LEDC_TIMER_18_BIT) - 1) / (1000 / CONTROL_MOTOR_FREQUENCY)
 #define CONTROL_MOTOR_DUTY_MAX      CONTROL_MOTOR_DUTY_MIN * 2
-#define CONTROL_MOTOR_DUTY_MIN_SPIN (0.05f * (CONTROL_MOTOR_DUTY_MAX - CONTROL_MOTOR_DUTY_MIN) + CONTROL_MOTOR_DUTY_MIN)
+#define CONTROL_MOTOR_IDLE          0.05f   // Anteil Vollgas im Leerlauf wenn bewaffnet
+#define CONTROL_MOTOR_DUTY_MIN_SPIN (CONTROL_MOTOR_IDLE * (CONTROL_MOTOR_DUTY_MAX - CONTROL_MOTOR_DUTY_MIN) + CONTROL_MOTOR_DUTY_MIN)
+#define CONTROL_LOOP_RATE           400     // Hz, Regelrate falls Einstellung loopRate 0 ist
+#define CONTROL_LOOP_RATE_MIN       50
+#define CONTROL_LOOP_RATE_MAX       1000
+#define CONTROL_ANGLE_DIVIDER       4       // Winkelregler in jedem n-ten Zyklus falls Einstellung angleDivider 0 ist
 
 
 /** Befehle **/
@@ -36,6 +41,10 @@ typedef enum {
     CONTROL_COMMAND_ARM,
     CONTROL_COMMAND_RESET_STABILIZE_PID,
     CONTROL_COMMAND_RESET_QUEUE,
+    CONTROL_COMMAND_AUTOTUNE_ROLL,      // Relais-Versuch auf dem Winkelregler einer Achse, nur bewaffnet
+    CONTROL_COMMAND_AUTOTUNE_PITCH,
+    CONTROL_COMMAND_AUTOTUNE_HEADING,
+    CONTROL_COMMAND_AUTOTUNE_APPLY,     // vorgeschlagene Parameter als Einstellungen übernehmen
     CONTROL_COMMAND_MAX
 } control_command_t;
 
@@ -57,6 +66,24 @@ typedef enum {
     CONTROL_SETTING_STABILIZE_Z_KD,
     CONTROL_SETTING_STABILIZE_Z_BAND,
     CONTROL_SETTING_THROTTLE_BOOST,
+    CONTROL_SETTING_LOOP_RATE,          // Hz, Rate des timergesteuerten Regelzyklus, >= Gyrorate (400 Hz bewaffnet)
+    CONTROL_SETTING_RATE_X_KP,          // innerer Regler auf Drehrate, Band begrenzt Ausgang
+    CONTROL_SETTING_RATE_X_KI,
+    CONTROL_SETTING_RATE_X_KD,
+    CONTROL_SETTING_RATE_X_BAND,
+    CONTROL_SETTING_RATE_Y_KP,
+    CONTROL_SETTING_RATE_Y_KI,
+    CONTROL_SETTING_RATE_Y_KD,
+    CONTROL_SETTING_RATE_Y_BAND,
+    CONTROL_SETTING_RATE_Z_KP,
+    CONTROL_SETTING_RATE_Z_KI,
+    CONTROL_SETTING_RATE_Z_KD,
+    CONTROL_SETTING_RATE_Z_BAND,
+    CONTROL_SETTING_ANGLE_DIVIDER,      // Winkelregler läuft in jedem n-ten Regelzyklus
+    CONTROL_SETTING_MOTOR_PROTOCOL,     // esc_protocol_t, PWM per LEDC oder OneShot125/DShot per RMT, ab Neustart
+    CONTROL_SETTING_FRAME,              // mixer_frame_t, wird unbewaffnet übernommen
+    CONTROL_SETTING_THRUST_LINEAR,      // 1 -> Schub per Motorprofil linearisiert und batteriekompensiert
+    CONTROL_SETTING_TUNE_AMPLITUDE,     // rad/s, Solldrehrate des Relais beim Autotuning
     CONTROL_SETTING_MAX
 } control_setting_t;
 
@@ -95,7 +122,22 @@ typedef enum {
     CONTROL_PV_OUT_X,
     CONTROL_PV_OUT_Y,
     CONTROL_PV_OUT_Z,
-    CONTROL_PV_RATE,
+    CONTROL_PV_RATE,                    // us, Intervall seit letztem Regelzyklus
+    CONTROL_PV_JITTER,                  // us, Abweichung des Intervalls von der Periode
+    CONTROL_PV_OVERRUNS,                // verpasste Regelzyklen seit Start
+    CONTROL_PV_RATE_SETPOINT_X,         // rad/s, Solldrehrate des Winkelreglers im Körpersystem
+    CONTROL_PV_RATE_SETPOINT_Y,
+    CONTROL_PV_RATE_SETPOINT_Z,
+    CONTROL_PV_ESC_LATENCY,             // us, Start des Regelzyklus bis der ESC den neuen Wert kennt
+    CONTROL_PV_THROTTLE_5,              // weitere Motoren für Hexa- und Oktokopter
+    CONTROL_PV_THROTTLE_6,
+    CONTROL_PV_THROTTLE_7,
+    CONTROL_PV_THROTTLE_8,
+    CONTROL_PV_TUNE_KU,                 // Ergebnis des Autotunings
+    CONTROL_PV_TUNE_TU,                 // s
+    CONTROL_PV_TUNE_KP,                 // vorgeschlagene Parameter
+    CONTROL_PV_TUNE_KI,
+    CONTROL_PV_TUNE_KD,
     CONTROL_PV_MAX
 } control_pv_t;
 
@@ -105,12 +147,35 @@ typedef enum {
  * ----------------------------
  * Konfiguriert die Regler und Motoren und startet Verwaltungstask.
  *
- * gpio_num_t motorFrontLeft: Motorpin von vorne links, dreht CW
- * gpio_num_t motorFrontRight: Motorpin von vorne rechts, dreht CCW
- * gpio_num_t motorBackLeft: Motorpin von hinten links, dreht CW
- * gpio_num_t motorBackRight: Motorpin von hinten rechts, dreht CCW
+ * const gpio_num_t *motors: Motorpins in Reihenfolge der Geometrie des Frames (siehe mixer.c),
+ *                           beim Quad vorne links, vorne rechts, hinten links, hinten rechts
+ * uint8_t motorCount: Anzahl Motorpins, max. 8
  *
  * returns: false -> Erfolg, true -> Error
  */
-bool control_init(gpio_num_t motorFrontLeft, gpio_num_t motorFrontRight,
-                  gpio_num_t motorBackLeft, gpio_num_t motorBackRight);
+bool control_init(const gpio_num_t *motors, uint8_t motorCount);
+
+/*
+ * Function: control_thrustProfile
+ * ----------------------------
+ * Übernimmt ein neues Motorprofil als Tabelle (Format siehe thrust_parse) und speichert es im NVS.
+ * Wird auch bewaffnet ab dem nächsten Regelzyklus verwendet.
+ *
+ * const char *text: Tabelle
+ * uint32_t length: Länge in Bytes
+ *
+ * returns: false -> Erfolg, true -> Error (ungültiges Profil oder NVS)
+ */
+bool control_thrustProfile(const char *text, uint32_t length);
+
+/*
+ * Function: control_tuneGet
+ * ----------------------------
+ * Gibt die Aufzeichnung des letzten Autotunings zurück, nur wenn keines läuft.
+ * Format: TUNE_SAMPLES mal tune_sample_t (siehe tune.h), ausgewertet mit tune_estimate auch auf dem Host.
+ *
+ * const uint8_t **data: Pointer auf den Anfang der Aufzeichnung
+ *
+ * returns: Länge in Bytes, 0 falls keine Aufzeichnung vorhanden oder noch aktiv
+ */
+uint32_t control_tuneGet(const uint8_t **data);
@@ -0,0 +1,94 @@
+/*
+ * File: esc.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-07-27
+ * ----------------------------
+ * Kodierung digitaler ESC-Protokolle (DShot, OneShot125) in Pulsfolgen für das RMT-Peripheral.
+ * https://github.com/betaflight/betaflight/blob/master/src/main/drivers/dshot.c
+ */
+
+
+/** Interne Abhängigkeiten **/
+
+#include "esc.h"
+
+
+/** Variablendeklaration **/
+
+#define ESC_TICKS_PER_US    (ESC_CLOCK / 1000000)
+
+#define ESC_ITEM(high, low) ((uint32_t)(high) | 0x1UL << 15 | (uint32_t)(low) << 16) // level1 = 0
+
+
+/** Private Functions **/
+
+/*
+ * Function: esc_bitTicks
+ * ----------------------------
+ * Bitdauer eines DShot-Protokolls in RMT-Takten.
+ *
+ * esc_protocol_t protocol: DShot-Variante
+ *
+ * returns: Takte pro Bit, 0 bei ungültigem Protokoll
+ */
+static uint32_t esc_bitTicks(esc_protocol_t protocol);
+
+
+/** Implementierung **/
+
+uint16_t esc_dshotValue(float throttle) {
+    if (throttle < 0.0f) return ESC_DSHOT_STOP;
+    if (throttle > 1.0f) throttle = 1.0f;
+    return ESC_DSHOT_MIN + (uint16_t)(throttle * (ESC_DSHOT_MAX - ESC_DSHOT_MIN) + 0.5f);
+}
+
+uint16_t esc_dshotFrame(uint16_t value, bool telemetry) {
+    uint16_t frame = (value & 0x7FF) << 1 | telemetry;
+    uint16_t crc = (frame ^ frame >> 4 ^ frame >> 8) & 0xF;
+    return frame << 4 | crc;
+}
+
+void esc_dshotEncode(uint16_t frame, esc_protocol_t protocol, uint32_t items[ESC_ITEMS]) {
+    uint32_t bit = esc_bitTicks(protocol);
+    uint32_t one = bit * 3 / 4;
+    uint32_t zero = bit * 3 / 8;
+    for (uint8_t i = 0; i < ESC_DSHOT_BITS; ++i) {
+        if (frame & (0x8000 >> i)) items[i] = ESC_ITEM(one, bit - one);
+        else items[i] = ESC_ITEM(zero, bit - zero);
+    }
+    items[ESC_DSHOT_BITS] = 0; // Endmarke
+}
+
+void esc_oneshotEncode(float throttle, uint32_t items[ESC_ITEMS]) {
+    if (throttle < 0.0f) throttle = 0.0f;
+    else if (throttle > 1.0f) throttle = 1.0f;
+    uint32_t pulse = (ESC_ONESHOT_MIN + throttle * (ESC_ONESHOT_MAX - ESC_ONESHOT_MIN)) * ESC_TICKS_PER_US;
+    items[0] = ESC_ITEM(pulse, ESC_TICKS_PER_US); // 1 us low bevor der Kanal in den Idle geht
+    items[1] = 0; // Endmarke
+}
+
+uint32_t esc_duration(esc_protocol_t protocol, float throttle) {
+    switch (protocol) {
+        case (ESC_PROTOCOL_ONESHOT125):
+            if (throttle < 0.0f) throttle = 0.0f;
+            else if (throttle > 1.0f) throttle = 1.0f;
+            return ESC_ONESHOT_MIN + throttle * (ESC_ONESHOT_MAX - ESC_ONESHOT_MIN); // fallende Flanke
+        case (ESC_PROTOCOL_DSHOT300):
+        case (ESC_PROTOCOL_DSHOT600):
+            return ESC_DSHOT_BITS * esc_bitTicks(protocol) / ESC_TICKS_PER_US;
+        default:
+            return 0;
+    }
+}
+
+static uint32_t esc_bitTicks(esc_protocol_t protocol) {
+    switch (protocol) {
+        case (ESC_PROTOCOL_DSHOT300):
+            return ESC_CLOCK / 300000;
+        case (ESC_PROTOCOL_DSHOT600):
+            return ESC_CLOCK / 600000;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ * File: esc.h
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-07-27
+ * ----------------------------
+ * Kodierung digitaler ESC-Protokolle (DShot, OneShot125) in Pulsfolgen für das RMT-Peripheral.
+ * Ein Item entspricht dem Format von rmt_item32_t (duration0:15, level0:1, duration1:15, level1:1).
+ * Bewusst ohne ESP-IDF Abhängigkeiten, damit die Kodierung auch auf dem Host geprüft werden kann.
+ */
+
+
+#pragma once
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/** Einstellungen **/
+
+#define ESC_CLOCK               80000000    // Hz, RMT-Takt (APB ohne Teiler)
+#define ESC_DSHOT_BITS          16
+#define ESC_ITEMS               (ESC_DSHOT_BITS + 1) // inkl. Endmarke
+#define ESC_DSHOT_STOP          0           // Motor aus, Befehle 1 - 47 werden nicht verwendet
+#define ESC_DSHOT_MIN           48
+#define ESC_DSHOT_MAX           2047
+#define ESC_ONESHOT_MIN         125         // us, Puls bei Throttle 0.0
+#define ESC_ONESHOT_MAX         250         // us, Puls bei Throttle 1.0
+
+
+/** Variablendeklaration **/
+
+typedef enum {
+    ESC_PROTOCOL_PWM = 0,   // LEDC, 1 - 2 ms mit CONTROL_MOTOR_FREQUENCY
+    ESC_PROTOCOL_ONESHOT125,
+    ESC_PROTOCOL_DSHOT300,
+    ESC_PROTOCOL_DSHOT600,
+    ESC_PROTOCOL_MAX
+} esc_protocol_t;
+
+
+/*
+ * Function: esc_dshotValue
+ * ----------------------------
+ * Bildet Throttle auf den DShot-Wertebereich ab.
+ *
+ * float throttle: 0.0 bis 1.0, negative Werte stoppen den Motor
+ *
+ * returns: ESC_DSHOT_STOP oder ESC_DSHOT_MIN bis ESC_DSHOT_MAX
+ */
+uint16_t esc_dshotValue(float throttle);
+
+/*
+ * Function: esc_dshotFrame
+ * ----------------------------
+ * Setzt ein DShot-Frame aus 11 Bit Wert, Telemetrie-Bit und 4 Bit CRC zusammen.
+ *
+ * uint16_t value: 0 bis 2047
+ * bool telemetry: ESC soll Telemetrie senden
+ *
+ * returns: 16 Bit Frame, MSB wird zuerst gesendet
+ */
+uint16_t esc_dshotFrame(uint16_t value, bool telemetry);
+
+/*
+ * Function: esc_dshotEncode
+ * ----------------------------
+ * Kodiert ein Frame in RMT-Items. Eine 1 ist 3/4, eine 0 ist 3/8 der Bitdauer high.
+ *
+ * uint16_t frame: DShot-Frame
+ * esc_protocol_t protocol: ESC_PROTOCOL_DSHOT300 oder ESC_PROTOCOL_DSHOT600
+ * uint32_t items[ESC_ITEMS]: Ziel, letztes Item ist die Endmarke
+ */
+void esc_dshotEncode(uint16_t frame, esc_protocol_t protocol, uint32_t items[ESC_ITEMS]);
+
+/*
+ * Function: esc_oneshotEncode
+ * ----------------------------
+ * Kodiert einen OneShot125-Puls in RMT-Items.
+ *
+ * float throttle: 0.0 bis 1.0, wird begrenzt
+ * uint32_t items[ESC_ITEMS]: Ziel, nur die ersten beiden Items werden verwendet
+ */
+void esc_oneshotEncode(float throttle, uint32_t items[ESC_ITEMS]);
+
+/*
+ * Function: esc_duration
+ * ----------------------------
+ * Übertragungsdauer eines Befehls, d.h. Verzögerung vom Start des RMT bis der ESC den Wert kennt.
+ *
+ * esc_protocol_t protocol: RMT-Protokoll
+ * float throttle: 0.0 bis 1.0, bestimmt die Pulslänge von OneShot125
+ *
+ * returns: us
+ */
+uint32_t esc_duration(esc_protocol_t protocol, float throttle);
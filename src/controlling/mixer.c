@@ -0,0 +1,198 @@
+/*
+ * File: mixer.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-07-29
+ * ----------------------------
+ * Verteilt die Stellgrössen Roll, Pitch, Yaw und Schub auf die Motoren eines Multikopters.
+ * Geometrie A (Achse x Motor) -> Mischmatrix B = A^T (A A^T)^-1, damit erzeugt jede Stellgrösse
+ * nur das Moment ihrer eigenen Achse. https://www.iforce2d.net/mixercalc/
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <math.h>
+#include <float.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "mixer.h"
+
+
+/** Variablendeklaration **/
+
+/*
+ * Geometrie pro Motor:
+ *  - roll:   Abstand quer zur Flugrichtung, positiv links (Motor hebt bei Roll nach rechts)
+ *  - pitch:  Abstand längs zur Flugrichtung, positiv hinten (Motor hebt bei Pitch nach vorne)
+ *  - yaw:    Drehrichtung, +1 wie vorne links im Quad-X
+ *  - thrust: Anteil am Schub
+ * Reihenfolge entspricht den Motorpins.
+ */
+
+static const float mixer_quadWide[4][MIXER_AXES] = {
+    { 1.0f, -0.775f,  1.0f, 1.0f}, // vorne links
+    {-1.0f, -0.775f, -1.0f, 1.0f}, // vorne rechts
+    { 1.0f,  0.775f, -1.0f, 1.0f}, // hinten links
+    {-1.0f,  0.775f,  1.0f, 1.0f}  // hinten rechts
+};
+
+static const float mixer_quadX[4][MIXER_AXES] = {
+    { 0.7071f, -0.7071f,  1.0f, 1.0f}, // vorne links
+    {-0.7071f, -0.7071f, -1.0f, 1.0f}, // vorne rechts
+    { 0.7071f,  0.7071f, -1.0f, 1.0f}, // hinten links
+    {-0.7071f,  0.7071f,  1.0f, 1.0f}  // hinten rechts
+};
+
+static const float mixer_quadPlus[4][MIXER_AXES] = {
+    { 0.0f, -1.0f,  1.0f, 1.0f}, // vorne
+    {-1.0f,  0.0f, -1.0f, 1.0f}, // rechts
+    { 0.0f,  1.0f,  1.0f, 1.0f}, // hinten
+    { 1.0f,  0.0f, -1.0f, 1.0f}  // links
+};
+
+static const float mixer_hexX[6][MIXER_AXES] = { // im Uhrzeigersinn ab 30°
+    {-0.5f, -0.866f, -1.0f, 1.0f}, // vorne rechts
+    {-1.0f,  0.0f,    1.0f, 1.0f}, // rechts
+    {-0.5f,  0.866f, -1.0f, 1.0f}, // hinten rechts
+    { 0.5f,  0.866f,  1.0f, 1.0f}, // hinten links
+    { 1.0f,  0.0f,   -1.0f, 1.0f}, // links
+    { 0.5f, -0.866f,  1.0f, 1.0f}  // vorne links
+};
+
+static const float mixer_octoX[8][MIXER_AXES] = { // im Uhrzeigersinn ab 22.5°
+    {-0.3827f, -0.9239f, -1.0f, 1.0f},
+    {-0.9239f, -0.3827f,  1.0f, 1.0f},
+    {-0.9239f,  0.3827f, -1.0f, 1.0f},
+    {-0.3827f,  0.9239f,  1.0f, 1.0f},
+    { 0.3827f,  0.9239f, -1.0f, 1.0f},
+    { 0.9239f,  0.3827f,  1.0f, 1.0f},
+    { 0.9239f, -0.3827f, -1.0f, 1.0f},
+    { 0.3827f, -0.9239f,  1.0f, 1.0f}
+};
+
+static const struct {
+    uint8_t motors;
+    const float (*geometry)[MIXER_AXES];
+} mixer_frames[MIXER_FRAME_MAX] = {
+    {4, mixer_quadWide},
+    {4, mixer_quadX},
+    {4, mixer_quadPlus},
+    {6, mixer_hexX},
+    {8, mixer_octoX}
+};
+
+
+/** Private Functions **/
+
+/*
+ * Function: mixer_invert
+ * ----------------------------
+ * Invertiert eine 4x4 Matrix nach Gauss-Jordan mit Spaltenpivotsuche.
+ *
+ * float m[MIXER_AXES][MIXER_AXES]: zu invertierende Matrix, wird überschrieben
+ * float inverse[MIXER_AXES][MIXER_AXES]: Ziel
+ *
+ * returns: false -> Erfolg, true -> Error (singulär)
+ */
+static bool mixer_invert(float m[MIXER_AXES][MIXER_AXES], float inverse[MIXER_AXES][MIXER_AXES]);
+
+
+/** Implementierung **/
+
+uint8_t mixer_motors(mixer_frame_t frame) {
+    if (frame >= MIXER_FRAME_MAX) return 0;
+    return mixer_frames[frame].motors;
+}
+
+bool mixer_build(mixer_t *mixer, mixer_frame_t frame) {
+    if (frame >= MIXER_FRAME_MAX) return true;
+    uint8_t motors = mixer_frames[frame].motors;
+    const float (*a)[MIXER_AXES] = mixer_frames[frame].geometry;
+    // A A^T
+    float aat[MIXER_AXES][MIXER_AXES];
+    for (uint8_t r = 0; r < MIXER_AXES; ++r) {
+        for (uint8_t c = 0; c < MIXER_AXES; ++c) {
+            aat[r][c] = 0.0f;
+            for (uint8_t i = 0; i < motors; ++i) aat[r][c] += a[i][r] * a[i][c];
+        }
+    }
+    float inverse[MIXER_AXES][MIXER_AXES];
+    if (mixer_invert(aat, inverse)) return true;
+    // B = A^T (A A^T)^-1
+    float b[MIXER_MOTORS_MAX][MIXER_AXES];
+    float max[MIXER_AXES] = {0.0f};
+    for (uint8_t i = 0; i < motors; ++i) {
+        for (uint8_t c = 0; c < MIXER_AXES; ++c) {
+            b[i][c] = 0.0f;
+            for (uint8_t k = 0; k < MIXER_AXES; ++k) b[i][c] += a[i][k] * inverse[k][c];
+            max[c] = fmaxf(max[c], fabsf(b[i][c]));
+        }
+    }
+    // normieren, Roll und Pitch gemeinsam damit beide Achsen gleich stark wirken
+    max[MIXER_PITCH] = max[MIXER_ROLL];
+    mixer->motors = motors;
+    for (uint8_t i = 0; i < MIXER_MOTORS_MAX; ++i) {
+        for (uint8_t c = 0; c < MIXER_AXES; ++c) {
+            mixer->matrix[i][c] = (i < motors) ? b[i][c] / max[c] : 0.0f;
+        }
+    }
+    return false;
+}
+
+uint8_t mixer_mix(const mixer_t *mixer, const float command[MIXER_AXES], bool raise, float out[MIXER_MOTORS_MAX]) {
+    float low = FLT_MAX, high = -FLT_MAX;
+    for (uint8_t i = 0; i < mixer->motors; ++i) { // Lageanteil
+        const float *m = mixer->matrix[i];
+        out[i] = m[MIXER_ROLL] * command[MIXER_ROLL] + m[MIXER_PITCH] * command[MIXER_PITCH]
+               + m[MIXER_YAW] * command[MIXER_YAW];
+        low = fminf(low, out[i]);
+        high = fmaxf(high, out[i]);
+    }
+    // Lage auf verfügbaren Bereich reduzieren, Verhältnis der Achsen bleibt erhalten
+    float scale = 1.0f / fmaxf(1.0f, high - low);
+    low *= scale;
+    high *= scale;
+    // Schub so verschieben, dass die Lage vollständig umgesetzt werden kann
+    float thrust = fminf(command[MIXER_THRUST], 1.0f - high);
+    if (raise) thrust = fmaxf(thrust, -low);
+    for (uint8_t i = 0; i < mixer->motors; ++i) {
+        out[i] = out[i] * scale + mixer->matrix[i][MIXER_THRUST] * thrust;
+    }
+    return (scale < 1.0f) * MIXER_SATURATED_ATTITUDE
+         | (thrust < command[MIXER_THRUST]) * MIXER_LIMITED_HIGH
+         | (thrust > command[MIXER_THRUST]) * MIXER_RAISED_LOW;
+}
+
+static bool mixer_invert(float m[MIXER_AXES][MIXER_AXES], float inverse[MIXER_AXES][MIXER_AXES]) {
+    for (uint8_t r = 0; r < MIXER_AXES; ++r) {
+        for (uint8_t c = 0; c < MIXER_AXES; ++c) inverse[r][c] = (r == c) ? 1.0f : 0.0f;
+    }
+    for (uint8_t c = 0; c < MIXER_AXES; ++c) {
+        uint8_t pivot = c;
+        for (uint8_t r = c + 1; r < MIXER_AXES; ++r) {
+            if (fabsf(m[r][c]) > fabsf(m[pivot][c])) pivot = r;
+        }
+        if (fabsf(m[pivot][c]) < 1e-6f) return true;
+        for (uint8_t k = 0; k < MIXER_AXES; ++k) { // Zeilen tauschen
+            float t = m[c][k]; m[c][k] = m[pivot][k]; m[pivot][k] = t;
+            t = inverse[c][k]; inverse[c][k] = inverse[pivot][k]; inverse[pivot][k] = t;
+        }
+        float f = 1.0f / m[c][c];
+        for (uint8_t k = 0; k < MIXER_AXES; ++k) {
+            m[c][k] *= f;
+            inverse[c][k] *= f;
+        }
+        for (uint8_t r = 0; r < MIXER_AXES; ++r) {
+            if (r == c) continue;
+            float g = m[r][c];
+            for (uint8_t k = 0; k < MIXER_AXES; ++k) {
+                m[r][k] -= g * m[c][k];
+                inverse[r][k] -= g * inverse[c][k];
+            }
+        }
+    }
+    return false;
+}
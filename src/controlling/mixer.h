@@ -0,0 +1,98 @@
+/*
+ * File: mixer.h
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-07-29
+ * ----------------------------
+ * Verteilt die Stellgrössen Roll, Pitch, Yaw und Schub auf die Motoren eines Multikopters.
+ * Die Geometrie eines Frames wird beim Wechsel einmalig in eine Mischmatrix umgerechnet,
+ * pro Regelzyklus bleibt nur ein Matrix-Vektor-Produkt ohne Verzweigungen.
+ * Bewusst ohne ESP-IDF Abhängigkeiten, damit die Allokation auch auf dem Host geprüft werden kann.
+ */
+
+
+#pragma once
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/** Einstellungen **/
+
+#define MIXER_MOTORS_MAX    8
+
+
+/** Variablendeklaration **/
+
+typedef enum {
+    MIXER_FRAME_QUAD_WIDE = 0,  // wide-X, Pitch-Arm 0.775 des Roll-Arms, bisheriger Frame
+    MIXER_FRAME_QUAD_X,
+    MIXER_FRAME_QUAD_PLUS,
+    MIXER_FRAME_HEX_X,
+    MIXER_FRAME_OCTO_X,
+    MIXER_FRAME_MAX
+} mixer_frame_t;
+
+typedef enum {
+    MIXER_ROLL = 0,
+    MIXER_PITCH,
+    MIXER_YAW,
+    MIXER_THRUST,
+    MIXER_AXES
+} mixer_axis_t;
+
+typedef enum { // Bits der Rückgabe von mixer_mix
+    MIXER_SATURATED_ATTITUDE = 0x1, // Lage allein überschreitet den Bereich, gleichmässig reduziert
+    MIXER_LIMITED_HIGH = 0x2,       // Schub gesenkt damit kein Motor über 1.0
+    MIXER_RAISED_LOW = 0x4          // Schub gehoben damit kein Motor unter 0.0
+} mixer_saturation_t;
+
+typedef struct {
+    uint8_t motors;
+    float matrix[MIXER_MOTORS_MAX][MIXER_AXES]; // Faktoren pro Motor und Achse
+} mixer_t;
+
+
+/*
+ * Function: mixer_motors
+ * ----------------------------
+ * Anzahl Motoren eines Frames.
+ *
+ * mixer_frame_t frame: Frame
+ *
+ * returns: Anzahl Motoren, 0 bei ungültigem Frame
+ */
+uint8_t mixer_motors(mixer_frame_t frame);
+
+/*
+ * Function: mixer_build
+ * ----------------------------
+ * Rechnet die Geometrie eines Frames per Pseudoinverse in eine Mischmatrix um. Roll und Pitch
+ * werden gemeinsam skaliert (gleiches Moment pro Stellgrösse, grösster Roll-Faktor 1.0),
+ * Yaw und Schub je auf einen grössten Faktor von 1.0.
+ *
+ * mixer_t *mixer: Ziel, bleibt bei Fehler unverändert
+ * mixer_frame_t frame: Frame
+ *
+ * returns: false -> Erfolg, true -> Error (ungültiger Frame oder singuläre Geometrie)
+ */
+bool mixer_build(mixer_t *mixer, mixer_frame_t frame);
+
+/*
+ * Function: mixer_mix
+ * ----------------------------
+ * Mischt Stellgrössen auf die Motoren. Die Lage hat Vorrang: passt sie allein nicht in den
+ * Bereich 0.0 bis 1.0 wird sie gleichmässig reduziert, danach wird der Schub so verschoben,
+ * dass kein Motor über 1.0 (und mit raise nicht unter 0.0) verlangt wird.
+ *
+ * const mixer_t *mixer: Mischmatrix
+ * const float command[MIXER_AXES]: Roll, Pitch, Yaw und Schub
+ * bool raise: Schub darf angehoben werden um negative Motoren zu vermeiden
+ * float out[MIXER_MOTORS_MAX]: Throttle der ersten mixer->motors Motoren
+ *
+ * returns: Bitfeld gemäss mixer_saturation_t
+ */
+uint8_t mixer_mix(const mixer_t *mixer, const float command[MIXER_AXES], bool raise, float out[MIXER_MOTORS_MAX]);
@@ -0,0 +1,193 @@
+/*
+ * File: thrust.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-07-31
+ * ----------------------------
+ * Linearisierung des Schubs über Throttle und Batteriespannung.
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "thrust.h"
+
+
+/** Variablendeklaration **/
+
+#define THRUST_FIELD_LENGTH 16
+
+
+/** Private Functions **/
+
+/*
+ * Function: thrust_fields
+ * ----------------------------
+ * Zerlegt eine Zeile in Zahlenfelder.
+ *
+ * const char *start: Zeilenanfang
+ * const char *end: Zeilenende (exklusiv)
+ * float *values: Ziel, leere oder ungültige Felder als NAN
+ * uint8_t max: Platz in values
+ *
+ * returns: Anzahl Felder der Zeile, kann grösser als max sein
+ */
+static uint8_t thrust_fields(const char *start, const char *end, float *values, uint8_t max);
+
+
+/** Implementierung **/
+
+bool thrust_parse(const char *text, uint32_t length, thrust_profile_t *profile) {
+    thrust_profile_t p = {.magic = THRUST_MAGIC};
+    for (uint8_t v = 0; v < THRUST_VOLTAGES_MAX; ++v) {
+        for (uint8_t i = 0; i < THRUST_POINTS_MAX; ++i) p.thrust[v][i] = NAN;
+    }
+    const char *end = text + length;
+    while (text < end) {
+        const char *lineEnd = memchr(text, '\n', end - text);
+        if (!lineEnd) lineEnd = end;
+        float values[1 + THRUST_VOLTAGES_MAX];
+        uint8_t fields = thrust_fields(text, lineEnd, values, 1 + THRUST_VOLTAGES_MAX);
+        text = lineEnd + 1;
+        if (!p.voltages) { // Kopfzeile: Bezeichnung gefolgt von Spannungen
+            if (!isnan(values[0]) || fields < 2 || isnan(values[1])) continue;
+            while (p.voltages + 1 < fields && p.voltages < THRUST_VOLTAGES_MAX && !isnan(values[p.voltages + 1])) {
+                p.voltage[p.voltages] = values[p.voltages + 1];
+                ++p.voltages;
+            }
+            if (p.voltages + 1 < fields && p.voltages == THRUST_VOLTAGES_MAX && !isnan(values[p.voltages + 1])) return true;
+        } else if (!isnan(values[0])) { // Messreihe: Throttle gefolgt von Schub je Spannung
+            if (p.throttles >= THRUST_POINTS_MAX) return true;
+            if (values[0] < 0.0f || values[0] > 1.0f) return true;
+            if (p.throttles && values[0] <= p.throttle[p.throttles - 1]) return true;
+            p.throttle[p.throttles] = values[0];
+            for (uint8_t v = 0; v < p.voltages && v + 1 < fields; ++v) p.thrust[v][p.throttles] = values[v + 1];
+            ++p.throttles;
+        }
+    }
+    if (!p.voltages || p.throttles < 2) return true;
+    // Spannungen aufsteigend sortieren, mit ihren Messreihen
+    for (uint8_t i = 1; i < p.voltages; ++i) {
+        for (uint8_t j = i; j > 0 && p.voltage[j] < p.voltage[j - 1]; --j) {
+            float t = p.voltage[j]; p.voltage[j] = p.voltage[j - 1]; p.voltage[j - 1] = t;
+            for (uint8_t k = 0; k < THRUST_POINTS_MAX; ++k) {
+                t = p.thrust[j][k]; p.thrust[j][k] = p.thrust[j - 1][k]; p.thrust[j - 1][k] = t;
+            }
+        }
+    }
+    *profile = p;
+    return false;
+}
+
+bool thrust_build(const thrust_profile_t *profile, thrust_lut_t *lut) {
+    const thrust_profile_t *p = profile;
+    if (p->magic != THRUST_MAGIC || p->throttles < 2 || p->throttles > THRUST_POINTS_MAX
+     || !p->voltages || p->voltages > THRUST_VOLTAGES_MAX) return true;
+    for (uint8_t v = 1; v < p->voltages; ++v) if (!(p->voltage[v] > p->voltage[v - 1])) return true;
+    // Kennlinien ergänzen: Ursprung, Messungen monoton steigend, linear bis Vollgas
+    float x[THRUST_VOLTAGES_MAX][THRUST_POINTS_MAX + 2];
+    float y[THRUST_VOLTAGES_MAX][THRUST_POINTS_MAX + 2];
+    uint8_t n[THRUST_VOLTAGES_MAX];
+    for (uint8_t v = 0; v < p->voltages; ++v) {
+        x[v][0] = 0.0f;
+        y[v][0] = 0.0f;
+        n[v] = 1;
+        for (uint8_t i = 0; i < p->throttles; ++i) {
+            if (isnan(p->thrust[v][i]) || !(p->throttle[i] > x[v][n[v] - 1])) continue;
+            x[v][n[v]] = p->throttle[i];
+            y[v][n[v]] = fmaxf(p->thrust[v][i], y[v][n[v] - 1]);
+            ++n[v];
+        }
+        if (n[v] < 3) return true; // mindestens zwei Messungen
+        uint8_t last = n[v] - 1;
+        if (x[v][last] < 1.0f) {
+            float slope = (y[v][last] - y[v][last - 1]) / (x[v][last] - x[v][last - 1]);
+            x[v][n[v]] = 1.0f;
+            y[v][n[v]] = y[v][last] + fmaxf(slope, 0.0f) * (1.0f - x[v][last]);
+            ++n[v];
+        }
+    }
+    float reference = y[p->voltages - 1][n[p->voltages - 1] - 1];
+    if (!(reference > 0.0f)) return true;
+    // Umkehrung pro Spannung auf gleichmässigem Raster über den Schub
+    float inverse[THRUST_VOLTAGES_MAX][THRUST_STEPS + 1];
+    for (uint8_t v = 0; v < p->voltages; ++v) {
+        uint8_t segment = 1;
+        for (uint8_t s = 0; s <= THRUST_STEPS; ++s) {
+            float target = reference * s / THRUST_STEPS;
+            while (segment < n[v] - 1 && y[v][segment] < target) ++segment;
+            if (y[v][segment] < target) { // bei dieser Spannung nicht erreichbar
+                inverse[v][s] = 1.0f;
+                continue;
+            }
+            float delta = y[v][segment] - y[v][segment - 1];
+            float fraction = (delta > 0.0f) ? (target - y[v][segment - 1]) / delta : 0.0f;
+            inverse[v][s] = x[v][segment - 1] + fraction * (x[v][segment] - x[v][segment - 1]);
+        }
+    }
+    // auf gleichmässiges Raster über die Spannung verteilen
+    lut->voltageMin = p->voltage[0];
+    lut->voltageMax = p->voltage[p->voltages - 1];
+    lut->voltageScale = (p->voltages > 1) ? (THRUST_VOLTAGE_STEPS - 1) / (lut->voltageMax - lut->voltageMin) : 0.0f;
+    lut->reference = reference;
+    for (uint8_t g = 0; g < THRUST_VOLTAGE_STEPS; ++g) {
+        float voltage = lut->voltageMin + (lut->voltageMax - lut->voltageMin) * g / (THRUST_VOLTAGE_STEPS - 1);
+        uint8_t v = 0;
+        while (v + 2 < p->voltages && p->voltage[v + 1] < voltage) ++v;
+        float fraction = 0.0f;
+        if (p->voltages > 1) {
+            fraction = (voltage - p->voltage[v]) / (p->voltage[v + 1] - p->voltage[v]);
+            fraction = fminf(fmaxf(fraction, 0.0f), 1.0f);
+        }
+        uint8_t w = (p->voltages > 1) ? v + 1 : v;
+        for (uint8_t s = 0; s <= THRUST_STEPS; ++s) {
+            lut->throttle[g][s] = inverse[v][s] + fraction * (inverse[w][s] - inverse[v][s]);
+        }
+    }
+    return false;
+}
+
+float thrust_throttle(const thrust_lut_t *lut, float thrust, float voltage) {
+    if (!(voltage > 0.0f)) voltage = lut->voltageMax;
+    float x = fminf(fmaxf(thrust, 0.0f), 1.0f) * THRUST_STEPS;
+    float y = fminf(fmaxf((voltage - lut->voltageMin) * lut->voltageScale, 0.0f), THRUST_VOLTAGE_STEPS - 1);
+    uint8_t xi = fminf(x, THRUST_STEPS - 1);
+    uint8_t yi = fminf(y, THRUST_VOLTAGE_STEPS - 2);
+    float fx = x - xi;
+    float fy = y - yi;
+    const float *low = lut->throttle[yi];
+    const float *high = lut->throttle[yi + 1];
+    float a = low[xi] + fx * (low[xi + 1] - low[xi]);
+    float b = high[xi] + fx * (high[xi + 1] - high[xi]);
+    return a + fy * (b - a);
+}
+
+static uint8_t thrust_fields(const char *start, const char *end, float *values, uint8_t max) {
+    uint8_t count = 0;
+    while (true) {
+        char field[THRUST_FIELD_LENGTH];
+        uint8_t length = 0;
+        for (; start < end && *start != '\t' && *start != ';'; ++start) {
+            if (*start == ' ' || *start == '\r') continue;
+            if (length < THRUST_FIELD_LENGTH - 1) field[length++] = (*start == ',') ? '.' : *start;
+        }
+        field[length] = '\0';
+        if (count < max) {
+            char *parsed;
+            values[count] = strtof(field, &parsed);
+            if (!length || *parsed) values[count] = NAN;
+        }
+        ++count;
+        if (start >= end) break;
+        ++start; // Trennzeichen
+    }
+    for (uint8_t i = count; i < max; ++i) values[i] = NAN;
+    return count;
+}
@@ -0,0 +1,95 @@
+/*
+ * File: thrust.h
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-07-31
+ * ----------------------------
+ * Linearisierung des Schubs über Throttle und Batteriespannung.
+ * Ein gemessenes Motorprofil (Schub bei Throttle und Spannung) wird beim Laden in eine Umkehrtabelle
+ * auf gleichmässigem Raster umgerechnet, die Auswertung ist danach eine bilineare Interpolation
+ * ohne Suche. Bewusst ohne ESP-IDF Abhängigkeiten, damit auf dem Host prüf- und messbar.
+ */
+
+
+#pragma once
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/** Einstellungen **/
+
+#define THRUST_POINTS_MAX       16      // Stützstellen Throttle im Profil
+#define THRUST_VOLTAGES_MAX     4       // Stützstellen Spannung im Profil
+#define THRUST_STEPS            16      // Raster der Umkehrtabelle über den Schub
+#define THRUST_VOLTAGE_STEPS    8       // Raster der Umkehrtabelle über die Spannung
+#define THRUST_MAGIC            0x31524854 // "THR1", Kennung des Blobs im NVS
+
+
+/** Variablendeklaration **/
+
+typedef struct { // Motorprofil, wird unverändert als Blob gespeichert
+    uint32_t magic;
+    uint8_t throttles;                                  // Anzahl Stützstellen Throttle
+    uint8_t voltages;                                   // Anzahl Stützstellen Spannung
+    uint16_t reserved;
+    float throttle[THRUST_POINTS_MAX];                  // 0.0 bis 1.0, aufsteigend
+    float voltage[THRUST_VOLTAGES_MAX];                 // V, aufsteigend
+    float thrust[THRUST_VOLTAGES_MAX][THRUST_POINTS_MAX]; // g, NAN -> nicht gemessen
+} thrust_profile_t;
+
+typedef struct { // Umkehrtabelle Schub -> Throttle
+    float voltageMin;
+    float voltageMax;
+    float voltageScale;                                 // Rasterschritte pro V
+    float reference;                                    // g, Schub bei 1.0, d.h. Vollgas bei voller Batterie
+    float throttle[THRUST_VOLTAGE_STEPS][THRUST_STEPS + 1];
+} thrust_lut_t;
+
+
+/*
+ * Function: thrust_parse
+ * ----------------------------
+ * Liest ein Motorprofil als Tabelle wie in main.c: erste Zeile Bezeichnung und Spannungen,
+ * danach pro Zeile Throttle und Schub je Spannung. Spalten getrennt durch Tab oder ';',
+ * Dezimalkomma erlaubt, leere Felder gelten als nicht gemessen, Zeilen ohne Zahl am Anfang
+ * werden übersprungen.
+ *
+ * const char *text: Tabelle
+ * uint32_t length: Länge in Bytes
+ * thrust_profile_t *profile: Ziel, Spannungen aufsteigend sortiert
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+bool thrust_parse(const char *text, uint32_t length, thrust_profile_t *profile);
+
+/*
+ * Function: thrust_build
+ * ----------------------------
+ * Rechnet ein Motorprofil in eine Umkehrtabelle um. Jede Spannung wird bei Throttle 0.0 mit Schub 0
+ * und bis 1.0 linear aus den letzten zwei Messungen ergänzt. Der Schub bei 1.0 und höchster
+ * Spannung ist die Referenz, geforderter Schub darüber oder bei tiefer Spannung nicht erreichbarer
+ * Schub ergibt Throttle 1.0.
+ *
+ * const thrust_profile_t *profile: Motorprofil
+ * thrust_lut_t *lut: Ziel
+ *
+ * returns: false -> Erfolg, true -> Error (ungültiges Profil)
+ */
+bool thrust_build(const thrust_profile_t *profile, thrust_lut_t *lut);
+
+/*
+ * Function: thrust_throttle
+ * ----------------------------
+ * Throttle für geforderten Schub bei aktueller Spannung.
+ *
+ * const thrust_lut_t *lut: Umkehrtabelle
+ * float thrust: 0.0 bis 1.0 der Referenz
+ * float voltage: V, 0 oder kleiner -> unbekannt, wie volle Batterie
+ *
+ * returns: Throttle 0.0 bis 1.0
+ */
+float thrust_throttle(const thrust_lut_t *lut, float thrust, float voltage);
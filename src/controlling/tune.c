@@ -0,0 +1,79 @@
+/*
+ * File: tune.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-02
+ * ----------------------------
+ * Autotuning per Relais-Versuch nach Åström-Hägglund.
+ * https://en.wikipedia.org/wiki/Ziegler%E2%80%93Nichols_method
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include <math.h>
+#include <float.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "tune.h"
+
+
+/** Variablendeklaration **/
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+
+/** Implementierung **/
+
+float tune_relay(float error, float previous, float amplitude, float hysteresis) {
+    if (error > hysteresis) return amplitude;
+    if (error < -hysteresis) return -amplitude;
+    if (previous == 0.0f) return (error < 0.0f) ? -amplitude : amplitude;
+    return previous;
+}
+
+bool tune_estimate(const tune_sample_t *samples, uint32_t count, float amplitude, float hysteresis, tune_result_t *result) {
+    uint32_t start = 0; // steigende Flanke am Anfang der aktuellen Periode
+    uint32_t rising = 0;
+    uint32_t periods = 0;
+    float tu = 0.0f, a = 0.0f;
+    float shortest = FLT_MAX, longest = 0.0f;
+    for (uint32_t i = 1; i < count; ++i) {
+        if (!(samples[i - 1].output < 0.0f && samples[i].output > 0.0f)) continue;
+        if (rising++ > TUNE_PERIODS_SKIP) {
+            float low = FLT_MAX, high = -FLT_MAX;
+            for (uint32_t j = start; j < i; ++j) {
+                low = fminf(low, samples[j].error);
+                high = fmaxf(high, samples[j].error);
+            }
+            float period = (samples[i].time - samples[start].time) * 1e-6f;
+            shortest = fminf(shortest, period);
+            longest = fmaxf(longest, period);
+            tu += period;
+            a += (high - low) / 2.0f;
+            ++periods;
+        }
+        start = i;
+    }
+    if (periods < TUNE_PERIODS_MIN) return true;
+    tu /= periods;
+    a /= periods;
+    // keine stabile Grenzschwingung
+    if (longest - tu > TUNE_SPREAD_MAX * tu || tu - shortest > TUNE_SPREAD_MAX * tu) return true;
+    if (!(a > hysteresis) || !(tu > 0.0f)) return true;
+    result->ku = 4.0f * amplitude / ((float)M_PI * sqrtf(a * a - hysteresis * hysteresis));
+    result->tu = tu;
+    result->amplitude = a;
+    result->periods = periods;
+    return false;
+}
+
+void tune_gains(const tune_result_t *result, tune_gains_t *gains) {
+    gains->kp = result->ku / 3.0f;
+    gains->ki = gains->kp / (result->tu / 2.0f);
+    gains->kd = gains->kp * result->tu / 3.0f;
+}
@@ -0,0 +1,95 @@
+/*
+ * File: tune.h
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-02
+ * ----------------------------
+ * Autotuning per Relais-Versuch nach Åström-Hägglund. Ein Relais mit Hysterese ersetzt den Regler
+ * einer Achse, der Regelkreis schwingt darauf in seiner kritischen Periode. Aus Periode und Amplitude
+ * der Schwingung folgen die kritische Verstärkung und daraus PID-Parameter.
+ * Bewusst ohne ESP-IDF Abhängigkeiten, damit aufgezeichnete oder simulierte Daten auf dem Host
+ * ausgewertet werden können.
+ */
+
+
+#pragma once
+
+
+/** Externe Abhängigkeiten **/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/** Einstellungen **/
+
+#define TUNE_SAMPLES        512     // Aufzeichnung, bei 100 Hz Winkelregler gut 5 s
+#define TUNE_PERIODS_SKIP   2       // Einschwingen, nicht ausgewertet
+#define TUNE_PERIODS_MIN    3       // mindestens ausgewertete Perioden
+#define TUNE_SPREAD_MAX     0.25f   // erlaubte Abweichung einzelner Perioden vom Mittel
+
+
+/** Variablendeklaration **/
+
+typedef struct { // Aufzeichnung, wird unverändert als Binärfile ausgegeben (little-endian)
+    uint32_t time;      // us seit Start
+    float error;        // Regelabweichung, Sollwert - Istwert
+    float output;       // Anregung, Ausgang des Relais
+} tune_sample_t;
+
+typedef struct {
+    float ku;           // kritische Verstärkung
+    float tu;           // s, kritische Periode
+    float amplitude;    // Amplitude der Regelabweichung
+    uint32_t periods;   // ausgewertete Perioden
+} tune_result_t;
+
+typedef struct {
+    float kp;
+    float ki;           // pro s, wie control_pidCalculate
+    float kd;           // s
+} tune_gains_t;
+
+
+/*
+ * Function: tune_relay
+ * ----------------------------
+ * Relais mit Hysterese. Wechselt erst wenn die Regelabweichung die Hysterese überschreitet,
+ * damit Rauschen keine zusätzlichen Umschaltungen auslöst.
+ *
+ * float error: Regelabweichung
+ * float previous: letzter Ausgang, 0 -> erster Aufruf
+ * float amplitude: Ausgang +/- amplitude
+ * float hysteresis: Schwelle der Regelabweichung
+ *
+ * returns: neuer Ausgang
+ */
+float tune_relay(float error, float previous, float amplitude, float hysteresis);
+
+/*
+ * Function: tune_estimate
+ * ----------------------------
+ * Wertet eine Aufzeichnung des Relais-Versuchs aus. Perioden zwischen steigenden Flanken des
+ * Relais, nach dem Einschwingen gemittelt. Ku = 4 d / (pi sqrt(a^2 - h^2)) nach der
+ * Beschreibungsfunktion des Relais mit Hysterese.
+ *
+ * const tune_sample_t *samples: Aufzeichnung
+ * uint32_t count: Anzahl Samples
+ * float amplitude: Amplitude d des Relais
+ * float hysteresis: Hysterese h des Relais
+ * tune_result_t *result: Ziel
+ *
+ * returns: false -> Erfolg, true -> Error (zu wenige oder ungleichmässige Perioden)
+ */
+bool tune_estimate(const tune_sample_t *samples, uint32_t count, float amplitude, float hysteresis, tune_result_t *result);
+
+/*
+ * Function: tune_gains
+ * ----------------------------
+ * PID-Parameter nach Ziegler-Nichols "some overshoot" (Kp = Ku/3, Ti = Tu/2, Td = Tu/3),
+ * weniger aggressiv als die klassische Regel und damit für den Flug geeignet.
+ *
+ * const tune_result_t *result: Ergebnis von tune_estimate
+ * tune_gains_t *gains: Ziel, in der Form von control_pidCalculate
+ */
+void tune_gains(const tune_result_t *result, tune_gains_t *gains);
@@ -42,6 +42,7 @@
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 
 /** Interne Abhängigkeiten **/
@@ -439,8 +440,8 @@ const char* intercom_parameterNameParameter(uint32_t ownerNum, uint32_t paramete
  *      PV_LIST("sensors", sensors_pvs, SENSORS_PV_MAX);
  *      pvRegister(xSensors, sensors_pvs);
  * 
- * 2. Subscriber-Task registriert sich für Updates maximal alle minTicks:
- *      pv_t *subscription = intercom_pvSubscribe(xRemote, xSensors, SENSORS_PV_X, minTicks);
+ * 2. Subscriber-Task registriert sich für Updates maximal alle minInterval us:
+ *      pv_t *subscription = intercom_pvSubscribe(xRemote, xSensors, SENSORS_PV_X, minInterval);
  * 
  * 2. Publisher publiziert neue Werte an Intercom welche diese in die
  *    Empfangsqueues der registrierten Subscriber sendet:
@@ -484,7 +485,7 @@ static pv_list_t *intercom_pvSearchPublisher2(uint32_t publisherNum) {
     return node;
 }
 
-pv_t *intercom_pvSubscribe(QueueHandle_t subscriber, QueueHandle_t publisher, uint32_t pvNum, TickType_t minTicks) {
+pv_t *intercom_pvSubscribe(QueueHandle_t subscriber, QueueHandle_t publisher, uint32_t pvNum, uint32_t minInterval) {
     pv_list_t *node = intercom_pvSearchPublisher(publisher);
     if (!node || pvNum >= node->length) return NULL; // Pv nicht vorhanden
     pv_t *pv = &node->pvs[pvNum];
@@ -497,15 +498,16 @@ pv_t *intercom_pvSubscribe(QueueHandle_t subscriber, QueueHandle_t publisher, ui
         }
         if (pv->subscribers[i].handle) continue;
         pv->subscribers[i].handle = subscriber;
-        pv->subscribers[i].minTicks = minTicks;
+        pv->subscribers[i].minInterval = minInterval;
+        pv->subscribers[i].lastTimestamp = 0;
         break;
     }
     return pv;
 }
 
-pv_t *intercom_pvSubscribe2(QueueHandle_t subscriber, uint32_t publisherNum, uint32_t pvNum, TickType_t minTicks) {
+pv_t *intercom_pvSubscribe2(QueueHandle_t subscriber, uint32_t publisherNum, uint32_t pvNum, uint32_t minInterval) {
     pv_list_t *node = intercom_pvSearchPublisher2(publisherNum);
-    if (node) return intercom_pvSubscribe(subscriber, node->publisher, pvNum, minTicks);
+    if (node) return intercom_pvSubscribe(subscriber, node->publisher, pvNum, minInterval);
     else return NULL;
 }
 
@@ -535,15 +537,14 @@ void intercom_pvPublish(QueueHandle_t publisher, uint32_t pvNum, value_t value)
     pv_t *pv = &node->pvs[pvNum];
     pv->value = value;
     // an alle Subscriber senden
-    pv->tick = xTaskGetTickCount();
+    pv->timestamp = esp_timer_get_time();
     event_t event = {EVENT_PV, pv};
     for (uint8_t i = 0; i < INTERCOM_PV_MAX_SUBSCRIBERS; ++i) {
         if (!pv->subscribers[i].handle) break;
-        if (pv->subscribers[i].minTicks) {
-            if (pv->tick < pv->subscribers[i].lastTick + pv->subscribers[i].minTicks) continue;
-        }
+        // Differenz statt Summe, bleibt korrekt wenn der Zeitstempel überläuft
+        if (pv->timestamp - pv->subscribers[i].lastTimestamp < pv->subscribers[i].minInterval) continue;
         if (xQueueSendToBack(pv->subscribers[i].handle, &event, 0) == pdTRUE) {
-            pv->subscribers[i].lastTick = pv->tick;
+            pv->subscribers[i].lastTimestamp = pv->timestamp;
         }
     }
 }
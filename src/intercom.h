@@ -231,8 +231,8 @@ const char* intercom_parameterNameParameter(uint32_t ownerNum, uint32_t settingN
  *      PV_LIST("sensors", sensors_pvs, SENSORS_PV_MAX);
  *      pvRegister(xSensors, sensors_pvs);
  * 
- * 2. Subscriber-Task registriert sich für Updates:
- *      pv_t *subscription = intercom_pvSubscribe(xRemote, xSensors, SENSORS_PV_X);
+ * 2. Subscriber-Task registriert sich für Updates maximal alle minInterval us:
+ *      pv_t *subscription = intercom_pvSubscribe(xRemote, xSensors, SENSORS_PV_X, minInterval);
  * 
  * 2. Publisher publiziert neue Werte an Intercom welche diese in die
  *    Empfangsqueues der registrierten Subscriber sendet:
@@ -244,15 +244,15 @@ const char* intercom_parameterNameParameter(uint32_t ownerNum, uint32_t settingN
 
 typedef struct {
     QueueHandle_t handle;
-    TickType_t lastTick;
-    TickType_t minTicks;
+    int64_t lastTimestamp;  // us, letzte Weiterleitung
+    uint32_t minInterval;   // us, 0 -> jede Publikation weiterleiten
 } pv_subscriber_t;
 
 typedef struct {
 	const char *name;
     value_type_t type;
     value_t value;
-    TickType_t tick;
+    int64_t timestamp;      // us, esp_timer der letzten Publikation
     pv_subscriber_t subscribers[INTERCOM_PV_MAX_SUBSCRIBERS];
 } pv_t;
 
@@ -270,8 +270,8 @@ typedef struct pv_list_s {
 
 void intercom_pvRegister(QueueHandle_t publisher, pv_list_t *list);
 #define pvRegister(queue, pvs)      intercom_pvRegister(queue, &(pvs##_list))
-pv_t *intercom_pvSubscribe(QueueHandle_t subscriber, QueueHandle_t publisher, uint32_t pvNum, TickType_t minTicks);
-pv_t *intercom_pvSubscribe2(QueueHandle_t subscriber, uint32_t publisherNum, uint32_t pvNum, TickType_t minTicks);
+pv_t *intercom_pvSubscribe(QueueHandle_t subscriber, QueueHandle_t publisher, uint32_t pvNum, uint32_t minInterval);
+pv_t *intercom_pvSubscribe2(QueueHandle_t subscriber, uint32_t publisherNum, uint32_t pvNum, uint32_t minInterval);
 void intercom_pvUnsubscribeAll(QueueHandle_t subscriber);
 
 void intercom_pvPublish(QueueHandle_t publisher, uint32_t pvNum, value_t value);
@@ -285,7 +285,7 @@ void intercom_pvPublish(QueueHandle_t publisher, uint32_t pvNum, value_t value);
 #define pvGetInt(pv)        ((pv && (pv->type == VALUE_TYPE_INT)) ? pv->value.i : 0L)
 #define pvGetFloat(pv)      ((pv && (pv->type == VALUE_TYPE_FLOAT)) ? pv->value.f : 0.0f)
 #define pvGetPointer(pv)    ((pv && (pv->type == VALUE_TYPE_POINTER)) ? pv->value.p : NULL)
-#define pvGetTick(pv)       (pv ? pv->tick : 0)
+#define pvGetTimestamp(pv)  (pv ? pv->timestamp : 0)
 
 const char* intercom_pvNamePublisher(uint32_t ownerNum);
 const char* intercom_pvNamePv(uint32_t ownerNum, uint32_t settingNum);
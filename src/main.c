@@ -124,7 +124,8 @@ void app_main(void* arg) {
     ESP_LOGI("quadro2", "Status Remote: %s", ret ? "Error" : "Ok");
 
     ESP_LOGI("quadro2", "Starte Control...");
-    ret = control_init(MOTOR_FRONT_LEFT, MOTOR_FRONT_RIGHT, MOTOR_BACK_LEFT, MOTOR_BACK_RIGHT);
+    const gpio_num_t motors[] = {MOTOR_FRONT_LEFT, MOTOR_FRONT_RIGHT, MOTOR_BACK_LEFT, MOTOR_BACK_RIGHT};
+    ret = control_init(motors, sizeof(motors) / sizeof(motors[0]));
     ESP_LOGI("quadro2", "Status Control: %s", ret ? "Error" : "Ok");
 
     // ESP_LOGI("quadro2", "Starte Info...");
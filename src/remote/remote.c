@@ -39,6 +39,9 @@
 
 #include "intercom.h"
 #include "resources.h"
+#include "sensing/bno.h" // Aufzeichnung SHTP
+#include "sensing/gps.h" // AssistNow Upload
+#include "controlling/control.h" // Motorprofil Upload, Aufzeichnung Autotuning
 #include "remote.h"
 
 
@@ -57,7 +60,7 @@ struct remote_t {
     esp_log_level_t logLevel;
     vprintf_like_t defaultLog;
 
-    uint32_t pvRate;
+    uint32_t pvInterval;
 } remote;
 
 static command_t remote_commands[REMOTE_COMMAND_MAX] = {
@@ -67,7 +70,7 @@ static COMMAND_LIST("remote", remote_commands, REMOTE_COMMAND_MAX);
 
 static setting_t remote_settings[REMOTE_SETTING_MAX] = {
     SETTING("logLevel", &remote.logLevel,   VALUE_TYPE_UINT),
-    SETTING("pvRate",   &remote.pvRate,     VALUE_TYPE_UINT)
+    SETTING("pvInterval", &remote.pvInterval, VALUE_TYPE_UINT)
 };
 static SETTING_LIST("remote", remote_settings, REMOTE_SETTING_MAX);
 
@@ -118,7 +121,7 @@ typedef enum {
     REMOTE_MESSAGE_COMMAND,     // JSON: [ Owner, Command ]
     REMOTE_MESSAGE_SETTING,     // JSON: [ Owner, Setting, Wert ] -> mit Wert: Schreiben, ohne: Lesen
     REMOTE_MESSAGE_PARAMETER,   // JSON: [ Owner, Parameter, Wert ] -> mit Wert: Schreiben, ohne: Lesen
-    REMOTE_MESSAGE_PV,          // JSON: [ Publisher, PV, Wert, Tick ] -> mit Wert: Publication, ohne: Subscribe
+    REMOTE_MESSAGE_PV,          // JSON: [ Publisher, PV, Typ, Wert, Zeitstempel in us ] -> mit Wert: Publication, ohne: Subscribe
     REMOTE_MESSAGE_COMMANDS,    // JSON: [ [ "owner", [ "command1", "command2", ... ] ], ... ]
     REMOTE_MESSAGE_SETTINGS,    // JSON: [ [ "owner", [ "setting1", "setting2", ... ] ], ... ]
     REMOTE_MESSAGE_PARAMETERS,  // JSON: [ [ "owner", [ "parameter1", "parameter2", ... ] ], ... ]
@@ -234,6 +237,46 @@ static void remote_wsDisconnect(Websock *ws);
  */
 static CgiStatus remote_sendEmbedded(HttpdConnData *connData);
 
+/*
+ * Function: remote_sendCapture
+ * ----------------------------
+ * Callback für httpd-Server. Stoppt eine laufende Aufzeichnung der SHTP-Transfers des BNO
+ * und sendet diese als Binärfile. Während dem Senden kann keine neue Aufzeichnung starten.
+ * 
+ * HttpdConnData *connData: aktive Verbindung
+ */
+static CgiStatus remote_sendCapture(HttpdConnData *connData);
+
+/*
+ * Function: remote_receiveAssist
+ * ----------------------------
+ * Callback für httpd-Server. Nimmt AssistNow Daten (UBX-MGA Frames) als POST-Body entgegen und übergibt
+ * sie dem GPS. Ohne Internet mit lokaler Datei testbar: curl --data-binary @mga.ubx http://<ip>/gps.mga
+ * 
+ * HttpdConnData *connData: aktive Verbindung
+ * - connData->cgiData: Zustand des Uploads
+ */
+static CgiStatus remote_receiveAssist(HttpdConnData *connData);
+
+/*
+ * Function: remote_receiveThrust
+ * ----------------------------
+ * Callback für httpd-Server. Nimmt ein Motorprofil als Tabelle (Schub pro Throttle und Spannung) als
+ * POST-Body entgegen und übergibt es der Regelung. curl --data-binary @profil.txt http://<ip>/control.thrust
+ * 
+ * HttpdConnData *connData: aktive Verbindung
+ */
+static CgiStatus remote_receiveThrust(HttpdConnData *connData);
+
+/*
+ * Function: remote_sendTune
+ * ----------------------------
+ * Callback für httpd-Server. Sendet die Aufzeichnung des letzten Autotunings als Binärfile.
+ * 
+ * HttpdConnData *connData: aktive Verbindung
+ */
+static CgiStatus remote_sendTune(HttpdConnData *connData);
+
 /*
  * Function: remote_printLog
  * ----------------------------
@@ -271,6 +314,12 @@ HttpdBuiltInUrl builtInUrls[] = {
     ROUTE_CGI_ARG2("/favicon.svg", remote_sendEmbedded, &_binary_src_remote_www_favicon_svg_gz_start, &_binary_src_remote_www_favicon_svg_gz_end),
     ROUTE_CGI_ARG2("/script.js", remote_sendEmbedded, &_binary_src_remote_www_script_min_js_start, &_binary_src_remote_www_script_min_js_end),
     ROUTE_CGI_ARG2("/style.css", remote_sendEmbedded, &_binary_src_remote_www_style_min_css_start, &_binary_src_remote_www_style_min_css_end),
+    // Debug
+    ROUTE_CGI("/bno.shtp", remote_sendCapture),
+    // GPS
+    ROUTE_CGI("/gps.mga", remote_receiveAssist),
+    ROUTE_CGI("/control.thrust", remote_receiveThrust),
+    ROUTE_CGI("/control.tune", remote_sendTune),
     ROUTE_END()
 };
 
@@ -381,20 +430,20 @@ static bool remote_initWlan(char* ssid, char* pw) {
 static void remote_pvForward(pv_t *pv) {
     uint32_t subscriberNum, pvNum;
     if (intercom_pvIndex(pv, &subscriberNum, &pvNum)) return;
-    char buffer[32];
+    char buffer[64]; // Zeitstempel in us hat bis zu 13 Stellen
     size_t length;
     switch (pv->type) {
         case (VALUE_TYPE_NONE):
-            length = snprintf(buffer, sizeof(buffer), "[%d,[%u,%u,%d,true,%u]]", REMOTE_MESSAGE_PV, subscriberNum, pvNum, VALUE_TYPE_NONE, pv->tick);
+            length = snprintf(buffer, sizeof(buffer), "[%d,[%u,%u,%d,true,%lld]]", REMOTE_MESSAGE_PV, subscriberNum, pvNum, VALUE_TYPE_NONE, pv->timestamp);
             break;
         case (VALUE_TYPE_UINT):
-            length = snprintf(buffer, sizeof(buffer), "[%d,[%u,%u,%d,%u,%u]]", REMOTE_MESSAGE_PV, subscriberNum, pvNum, VALUE_TYPE_UINT, pv->value.ui, pv->tick);
+            length = snprintf(buffer, sizeof(buffer), "[%d,[%u,%u,%d,%u,%lld]]", REMOTE_MESSAGE_PV, subscriberNum, pvNum, VALUE_TYPE_UINT, pv->value.ui, pv->timestamp);
             break;
         case (VALUE_TYPE_INT):
-            length = snprintf(buffer, sizeof(buffer), "[%d,[%u,%u,%d,%d,%u]]", REMOTE_MESSAGE_PV, subscriberNum, pvNum, VALUE_TYPE_INT, pv->value.i, pv->tick);
+            length = snprintf(buffer, sizeof(buffer), "[%d,[%u,%u,%d,%d,%lld]]", REMOTE_MESSAGE_PV, subscriberNum, pvNum, VALUE_TYPE_INT, pv->value.i, pv->timestamp);
             break;
         case (VALUE_TYPE_FLOAT):
-            length = snprintf(buffer, sizeof(buffer), "[%d,[%u,%u,%d,%.9g,%u]]", REMOTE_MESSAGE_PV, subscriberNum, pvNum, VALUE_TYPE_FLOAT, pv->value.f, pv->tick);
+            length = snprintf(buffer, sizeof(buffer), "[%d,[%u,%u,%d,%.9g,%lld]]", REMOTE_MESSAGE_PV, subscriberNum, pvNum, VALUE_TYPE_FLOAT, pv->value.f, pv->timestamp);
             break;
         default:
             return;
@@ -438,7 +487,7 @@ static void remote_messageProcess(char *message, size_t length) {
                         const json_t *jPv = (jPublisher) ? json_getSibling(jPublisher) : NULL;
                         if (jPv && json_getType(jPublisher) == JSON_INTEGER && json_getType(jPv) == JSON_INTEGER) { // valid
                             pv_t *pv;
-                            pv = intercom_pvSubscribe2(xRemote, json_getInteger(jPublisher), json_getInteger(jPv), remote.pvRate / portTICK_PERIOD_MS);
+                            pv = intercom_pvSubscribe2(xRemote, json_getInteger(jPublisher), json_getInteger(jPv), remote.pvInterval);
                             if (pv && pv->type != VALUE_TYPE_NONE) remote_pvForward(pv); // zuletzt bekannter Zustand schicken
                         }
                     }
@@ -629,6 +678,100 @@ CgiStatus remote_sendEmbedded(HttpdConnData *connData) {
     }
 }
 
+CgiStatus remote_sendCapture(HttpdConnData *connData) {
+    uint32_t *sentLength = (uint32_t*) &connData->cgiData;
+    const uint8_t *data;
+    if (connData->isConnectionClosed) { // Abbruch
+        if (*sentLength) bno_captureReadEnd();
+        return HTTPD_CGI_DONE;
+    }
+    if (*sentLength == 0) {
+        bno_captureStop();
+        if (bno_captureReadBegin()) return HTTPD_CGI_NOTFOUND; // bis zum Ende gegen Neustart sperren
+    }
+    uint32_t length = bno_captureGet(&data);
+    uint32_t remainingLength;
+    if (*sentLength == 0) {
+        httpdStartResponse(connData, 200);
+        httpdHeader(connData, "Content-Type", "application/octet-stream");
+        httpdEndHeaders(connData);
+    }
+    // sende in Chunks von 1024 Bytes
+    remainingLength = length - *sentLength;
+    if (remainingLength <= 1024) {
+        httpdSend(connData, (const char*)data + *sentLength, remainingLength);
+        *sentLength += remainingLength;
+        bno_captureReadEnd();
+        return HTTPD_CGI_DONE;
+    } else {
+        httpdSend(connData, (const char*)data + *sentLength, 1024);
+        *sentLength += 1024;
+        return HTTPD_CGI_MORE;
+    }
+}
+
+CgiStatus remote_receiveAssist(HttpdConnData *connData) {
+    enum {ASSIST_START = 0, ASSIST_RECEIVING, ASSIST_ERROR};
+    uint32_t *state = (uint32_t*) &connData->cgiData;
+    if (connData->isConnectionClosed) { // Abbruch
+        if (*state == ASSIST_RECEIVING) gps_assistEnd(false);
+        return HTTPD_CGI_DONE;
+    }
+    if (connData->requestType != HTTPD_METHOD_POST) return HTTPD_CGI_NOTFOUND;
+    if (*state == ASSIST_START) *state = gps_assistBegin(connData->post.len) ? ASSIST_ERROR : ASSIST_RECEIVING;
+    if (*state == ASSIST_RECEIVING && gps_assistWrite((const uint8_t*)connData->post.buff, connData->post.buffLen)) {
+        gps_assistEnd(false);
+        *state = ASSIST_ERROR;
+    }
+    // restliche Daten auch bei Fehler abholen, erst danach antworten
+    if (connData->post.received < connData->post.len) return HTTPD_CGI_MORE;
+    bool error = (*state == ASSIST_ERROR) || gps_assistEnd(true);
+    *state = ASSIST_ERROR; // kein zweites gps_assistEnd bei Verbindungsabbruch
+    httpdStartResponse(connData, error ? 400 : 200);
+    httpdHeader(connData, "Content-Type", "text/plain");
+    httpdEndHeaders(connData);
+    httpdSend(connData, error ? "UBX-MGA rejected" : "UBX-MGA stored", -1);
+    return HTTPD_CGI_DONE;
+}
+
+CgiStatus remote_receiveThrust(HttpdConnData *connData) {
+    if (connData->isConnectionClosed) return HTTPD_CGI_DONE;
+    if (connData->requestType != HTTPD_METHOD_POST) return HTTPD_CGI_NOTFOUND;
+    // Profil passt in einen Puffer, grössere Uploads werden nur abgeholt und abgelehnt
+    if (connData->post.received < connData->post.len) return HTTPD_CGI_MORE;
+    bool error = (connData->post.len > HTTPD_MAX_POST_LEN)
+              || control_thrustProfile(connData->post.buff, connData->post.buffLen);
+    httpdStartResponse(connData, error ? 400 : 200);
+    httpdHeader(connData, "Content-Type", "text/plain");
+    httpdEndHeaders(connData);
+    httpdSend(connData, error ? "thrust profile rejected" : "thrust profile stored", -1);
+    return HTTPD_CGI_DONE;
+}
+
+CgiStatus remote_sendTune(HttpdConnData *connData) {
+    uint32_t *sentLength = (uint32_t*) &connData->cgiData;
+    const uint8_t *data;
+    uint32_t length = control_tuneGet(&data);
+    uint32_t remainingLength;
+    if (!length) return HTTPD_CGI_NOTFOUND;
+    if (*sentLength == 0) {
+        httpdStartResponse(connData, 200);
+        httpdHeader(connData, "Content-Type", "application/octet-stream");
+        httpdEndHeaders(connData);
+    }
+    // sende in Chunks von 1024 Bytes
+    remainingLength = length - *sentLength;
+    if (remainingLength <= 1024) {
+        httpdSend(connData, (const char*)data + *sentLength, remainingLength);
+        *sentLength += remainingLength;
+        return HTTPD_CGI_DONE;
+    } else {
+        httpdSend(connData, (const char*)data + *sentLength, 1024);
+        *sentLength += 1024;
+        return HTTPD_CGI_MORE;
+    }
+}
+
 int remote_printLog(const char * format, va_list arguments) {
     if (remote.logLevel) {
         bool shouldForward = false;
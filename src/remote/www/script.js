@@ -228,6 +228,7 @@ function gotPv(pv) {
     } else {
         e.value = pv[3];
     }
+    e.qTime = pv[4]; // us, Zeitstempel der Publikation im quadro2
     e.dispatchEvent(new Event("change"));
 }
 
@@ -235,6 +236,24 @@ function clearLog() {
     empty($("#log")[0]);
 }
 
+function uploadAssist() {
+    let file = $("#mgaFile")[0].files[0];
+    if (!file) return;
+    // Datei unverändert als POST-Body, GPS prüft und speichert die UBX-MGA Frames
+    fetch("/gps.mga", {method: "POST", body: file}).then(response => {
+        if (!response.ok) console.error(`AssistNow Upload fehlgeschlagen: ${response.status}`);
+    });
+}
+
+function uploadThrust() {
+    let file = $("#thrustFile")[0].files[0];
+    if (!file) return;
+    // Tabelle wie in main.c, Regelung prüft, baut die Umkehrtabelle und speichert das Profil
+    fetch("/control.thrust", {method: "POST", body: file}).then(response => {
+        if (!response.ok) console.error(`Motorprofil Upload fehlgeschlagen: ${response.status}`);
+    });
+}
+
 function link() {
     for (let e of $("input[q-link]")) {
         let s = e.getAttribute("q-link").split("/");
@@ -303,7 +322,7 @@ function link() {
         stat.value = 0;
         stat.disabled = true;
         div.appendChild(stat);
-        csv.push(`Time;${attrib}\n`);
+        csv.push(`Time [us];${attrib}\n`);
         for (let [index, value] of values.entries()) {
             value = value.split("/");
             let input = $(`#${value[0]}s > fieldset[name=${value[1]}] > input[name=${value[2]}]`)[0];
@@ -311,7 +330,7 @@ function link() {
             input.addEventListener("change", () => {
                 if (!enabled) return;
                 let row = [];
-                row.push(Date.now());
+                row.push(input.qTime);
                 for (let i = 0; i < index; ++i) {
                     row.push("");
                 }
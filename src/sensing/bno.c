@@ -6,11 +6,15 @@
  * ----------------------------
  * Implementiert den BNO080 Sensor mittels SensorHub-2 Bibliothek von Hillcrest
  * 
- * Pinbelegung:
+ * Pinbelegung I2C (BNO_TRANSPORT_I2C):
  * - SA0, PS0 & PS1 an GND
  * - BOOT & CL0 an 3.3V
  * - EDA an SDI
  * - ECL an SCK
+ *
+ * Pinbelegung SPI (BNO_TRANSPORT_SPI):
+ * - PS1 & BOOT an 3.3V, PS0 an BNO_SPI_WAKE
+ * - SA0/MOSI, SDA/MISO, SCL/SCK & H_CSN an BNO_SPI_* Pins
  */
 
 
@@ -20,6 +24,7 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include <string.h>
+#include <stdlib.h>
 #include <math.h>
 #include "sh2.h"
 #include "sh2_hal.h"
@@ -27,6 +32,7 @@
 #include "sh2_err.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
+#include "driver/spi_master.h"
 
 
 /** Interne Abhängigkeiten **/
@@ -36,6 +42,7 @@
 #include "i2c.h"
 #include "sensor_types.h"
 #include "sensors.h"
+#include "timebase.h"
 #include "bno.h"
 
 
@@ -45,26 +52,58 @@
     #define M_PI_2 1.57079632679489661923f
 #endif
 
-typedef struct {
-    int64_t timestamp;
-} bno_event_t;
+// Zustand der Aufzeichnung, untere Bits zählen laufende Leser (bno_captureReadBegin)
+#define BNO_CAPTURE_ACTIVE      (1UL << 31) // zeichnet auf
+#define BNO_CAPTURE_STARTING    (1UL << 30) // bno_captureStart setzt den Buffer zurück
+
+// xSensors hält nur Pointer, ein Slot wird erst wieder beschrieben wenn er weder in der Queue noch in Bearbeitung ist
+#define BNO_EVENT_RING          (SENSORS_QUEUE_LENGTH + 2)
+
+static const sh2_SensorId_t bno_orientationSensors[BNO_ORIENTATION_MAX] = {
+    SH2_ROTATION_VECTOR,
+    SH2_GAME_ROTATION_VECTOR,
+    SH2_GYRO_INTEGRATED_RV
+};
 
 static struct {
     uint8_t address;
     gpio_num_t resetPin, interruptPin;
     sh2_rxCallback_t *onRx;
-    uint8_t rxBuffer[SH2_HAL_MAX_TRANSFER];
+    uint8_t rxBuffer[SH2_HAL_MAX_TRANSFER] __attribute__((aligned(4))); // DMA-fähig
+#if BNO_TRANSPORT == BNO_TRANSPORT_SPI
+    spi_device_handle_t spi;
+    uint8_t txBuffer[SH2_HAL_MAX_TRANSFER] __attribute__((aligned(4)));
+    volatile uint16_t txLength;     // ausstehende Sendung, wird beim nächsten Interrupt vollduplex übertragen
+    SemaphoreHandle_t txFree;
+#else
+    uint16_t rxRemaining;           // Rest eines fragmentierten Pakets inkl. erneutem Header
+#endif
     SemaphoreHandle_t sh2Lock;
+    TaskHandle_t task;      // erhält Interrupts als Notification, Wert = Zeitstempel in us (32 Bit)
     uint32_t timeout;
-
-    sensors_event_t acceleration;
-    sensors_event_t orientation;
-    sensors_event_t altitude;
-    sensors_event_t rotation;
+    uint16_t readPredict; // erwartete Länge des nächsten SHTP-Pakets inkl. Header
+    bno_orientation_source_t source;
+    bno_statistics_t statistics;
+
+    struct { // Aufzeichnung der SHTP-Transfers, nur bno_task schreibt
+        uint8_t *buffer;
+        volatile uint32_t length;
+        volatile uint32_t state;    // BNO_CAPTURE_ACTIVE | BNO_CAPTURE_STARTING | Anzahl Leser
+    } capture;
+
+    sensors_event_t orientation; // zuletzt weitergeleitet, Basis von cache
+    struct { // letzte Orientierungen, gebatchte Beschleunigungen werden mit der zeitlich nächsten gedreht
+        int64_t timestamp;
+        orientation_t orientation;
+    } history[BNO_HISTORY];
+    uint32_t historyNext, historyLength;
+    sensors_event_t events[BNO_EVENT_RING]; // ein Slot pro Event, auch wenn ein Transfer viele enthält
+    uint32_t eventNext;
     event_t forward;
+
+    bno_rotation_t cache; // Rotationsmatrix & Eulerwinkel der aktuellen Orientierung
 } bno;
 
-static QueueHandle_t xBno;
 
 
 /** Private Functions **/
@@ -78,6 +117,39 @@ static QueueHandle_t xBno;
  */
 void bno_task(void* arg);
 
+/*
+ * Function: bno_transportInit
+ * ----------------------------
+ * Initialisiert den zur Buildzeit gewählten Transport (BNO_TRANSPORT).
+ *
+ * uint8_t address: I2C Adresse, bei SPI ignoriert
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+static bool bno_transportInit(uint8_t address);
+
+/*
+ * Function: bno_receive
+ * ----------------------------
+ * Liest nach einem Interrupt ein SHTP-Paket (oder Fragment davon) in den rxBuffer. Bei SPI werden
+ * ausstehende Sendedaten im selben Transfer vollduplex übertragen.
+ *
+ * uint16_t *length: Anzahl gelesener Bytes für onRx
+ *
+ * returns: false -> Erfolg, true -> Error oder keine Daten
+ */
+static bool bno_receive(uint16_t *length);
+
+/*
+ * Function: bno_captureRecord
+ * ----------------------------
+ * Hängt den zuletzt gelesenen Transfer an die Aufzeichnung an, falls aktiv.
+ *
+ * uint32_t timestamp: Zeitstempel des Interrupts in us
+ * uint16_t length: Anzahl Bytes im rxBuffer
+ */
+static void bno_captureRecord(uint32_t timestamp, uint16_t length);
+
 /*
  * Function: bno_sensorEvent
  * ----------------------------
@@ -93,7 +165,8 @@ static void bno_sensorEvent(void * cookie, sh2_SensorEvent_t *event);
  * Function: bno_interrupt
  * ----------------------------
  * Interrupt-Handler wird bei CHANGE des interuptPins vom BNO aufgeführt.
- * Sendet bei negativer Flanke einen Event mit aktueller Zeit an Haupttask.
+ * Benachrichtigt bei negativer Flanke den Haupttask direkt, die aktuelle Zeit liegt im Notification-Wert.
+ * Ist noch eine Notification ausstehend, wird der Interrupt nur als zusammengefasst gezählt.
  *
  * void* arg: Dummy
  */
@@ -114,28 +187,53 @@ static void bno_initDone(void *cookie, sh2_AsyncEvent_t *event);
  * Function: bno_sensorEnable
  * ----------------------------
  * Aktiviert den angegebenen Sensor, sh2 entscheidet der gegebene oder ein ähnlicher
- * Intervall genutzt wird.
+ * Intervall genutzt wird. Mit Batchintervall puffert der SensorHub die Reports in seinem FIFO
+ * und liefert sie gesammelt in einem SHTP-Transfer, Zeitstempel bleiben dabei erhalten.
  *
  * sh2_SensorId_t sensorId: Id des Sensorreports
  * uint32_t interval_us: Intervall in Microsekunden.
+ * uint32_t batchInterval_us: maximale Verzögerung in Microsekunden, 0 -> sofort senden
  */
-static bool bno_sensorEnable(sh2_SensorId_t sensorId, uint32_t interval_us);
+static bool bno_sensorEnable(sh2_SensorId_t sensorId, uint32_t interval_us, uint32_t batchInterval_us);
+
+/*
+ * Function: bno_batchLimit
+ * ----------------------------
+ * Kürzt das Batchintervall, so dass ein Batch höchstens BNO_BATCH_MAX Reports enthält (Platz in
+ * xSensors) und seine Zeitspanne mit Reserve in der Orientierungshistorie liegt.
+ *
+ * uint32_t batchInterval: gewünschtes Batchintervall in us
+ * uint32_t rateOrientation, rateAcceleration, ratePressure: Intervalle in ms, 0 -> deaktiviert
+ *
+ * returns: zulässiges Batchintervall in us
+ */
+static uint32_t bno_batchLimit(uint32_t batchInterval, uint32_t rateOrientation, uint32_t rateAcceleration,
+                               uint32_t ratePressure);
+
+/*
+ * Function: bno_toWorldFrameAt
+ * ----------------------------
+ * Dreht einen Vektor mit der Orientierung aus der Historie, die zeitlich am nächsten beim Sample
+ * liegt. Ist das die aktuelle, wird die vorberechnete Matrix genutzt.
+ *
+ * vector_t *vector: zu drehender Vektor, lokal -> Welt
+ * int64_t timestamp: Zeitstempel des Samples in us
+ */
+static void bno_toWorldFrameAt(vector_t *vector, int64_t timestamp);
 
 
 /** Implementierung **/
 
 bool bno_init(uint8_t address, gpio_num_t interruptPin, gpio_num_t resetPin,
-              uint32_t rateOrientation, uint32_t rateAcceleration, uint32_t ratePressure, uint32_t rateGyro) {
+              uint32_t rateOrientation, uint32_t rateAcceleration, uint32_t ratePressure, uint32_t rateGyro,
+              bno_orientation_source_t source, uint32_t batchInterval) {
     // Parameter speichern
     bno.address = address;
     bno.interruptPin = interruptPin;
     bno.resetPin = resetPin;
-    // Input Queue
-    xBno = xQueueCreate(4, sizeof(bno_event_t));
-    bno.acceleration.type = SENSORS_ACCELERATION;
+    bno.source = (source < BNO_ORIENTATION_MAX) ? source : BNO_ORIENTATION_ROTATION_VECTOR;
+    if (bno_transportInit(address)) return true;
     bno.orientation.type = SENSORS_ORIENTATION;
-    bno.altitude.type = SENSORS_ALTIMETER;
-    bno.rotation.type = SENSORS_ROTATION;
     bno.forward.type = EVENT_INTERNAL;
     // konfiguriere Pins und aktiviere Interrupts
     gpio_config_t gpioConfig;
@@ -156,64 +254,233 @@ bool bno_init(uint8_t address, gpio_num_t interruptPin, gpio_num_t resetPin,
     if (gpio_isr_handler_add(interruptPin, &bno_interrupt, NULL)) return true;
     // Task starten
     bno.timeout = (rateOrientation / portTICK_PERIOD_MS) + 1;
-    if (xTaskCreate(&bno_task, "bno", 3 * 1024, NULL, xSensors_PRIORITY - 1, NULL) != pdTRUE) return true;
+    if (xTaskCreate(&bno_task, "bno", 3 * 1024, NULL, xSensors_PRIORITY - 1, &bno.task) != pdTRUE) return true;
     // SensorHub-2 Bibliothek starten
     bno.sh2Lock = xSemaphoreCreateBinary();
     SemaphoreHandle_t sInitDone = xSemaphoreCreateBinary();
     if (sh2_initialize(&bno_initDone, sInitDone)) return true;
     if (xSemaphoreTake(sInitDone, BNO_STARTUP_WAIT_MS / portTICK_PERIOD_MS) == pdFALSE) return true; // warte auf Initialisierung
     vSemaphoreDelete(sInitDone);
-    // Standartsensoren aktivieren
+    // Standartsensoren aktivieren, Orientierung & Gyro sofort, Rest darf gebatcht werden
+    batchInterval = bno_batchLimit(batchInterval, rateOrientation, rateAcceleration, ratePressure);
     if (sh2_setSensorCallback(&bno_sensorEvent, NULL)) return true;
-    if (bno_sensorEnable(SH2_ROTATION_VECTOR, rateOrientation * 1000)) return true;
-    if (bno_sensorEnable(SH2_LINEAR_ACCELERATION, rateAcceleration * 1000)) return true;
-    if (bno_sensorEnable(SH2_PRESSURE, ratePressure * 1000)) return true;
-    if (bno_sensorEnable(SH2_GYROSCOPE_CALIBRATED, rateGyro * 1000)) return true;
+    if (bno_sensorEnable(bno_orientationSensors[bno.source], rateOrientation * 1000, 0)) return true;
+    if (bno_sensorEnable(SH2_LINEAR_ACCELERATION, rateAcceleration * 1000, batchInterval)) return true;
+    if (bno_sensorEnable(SH2_PRESSURE, ratePressure * 1000, batchInterval)) return true;
+    if (bno_sensorEnable(SH2_GYROSCOPE_CALIBRATED, rateGyro * 1000, 0)) return true;
     return false;
 }
 
 void bno_task(void* arg) {
     // Variablen
-    bno_event_t event;
-    uint16_t readLength, rxRemaining = 0;
+    uint32_t notified;
+    int64_t timestamp;
+    uint16_t length;
     uint8_t timeoutCount = 0;
+    bno.readPredict = SHTP_HEADER_LEN;
     while (!bno.onRx) vTaskDelay(10); // auf sh2-Lib Registrierung (nach reset) warten
     // Loop
     while (true) {
-        if (xQueueReceive(xBno, &event, bno.timeout) == pdTRUE) {
-            // Datenlänge berechnen, mindestens Header, maximal MAX_TRANSFER
-            readLength = rxRemaining;
-            if (readLength < SHTP_HEADER_LEN) readLength = SHTP_HEADER_LEN;
-            if (readLength > SH2_HAL_MAX_TRANSFER) readLength = SH2_HAL_MAX_TRANSFER;
-            // Lesen
-            if (i2c_read(bno.address, bno.rxBuffer, readLength)) continue;
-            // Ermittle Datenlänge des SHTP-Packets
-            uint16_t cargoLength;
-            cargoLength = ((bno.rxBuffer[1] << 8) + (bno.rxBuffer[0])) & 0x7fff;
-            if (!cargoLength) continue;
-            // verbleibende Daten berechnen
-            if (cargoLength > readLength) {
-                rxRemaining = (cargoLength - readLength) + SHTP_HEADER_LEN;
-            } else rxRemaining = 0;
-            // an sh2-Lib übergeben
-            bno.onRx(NULL, bno.rxBuffer, readLength, event.timestamp);
-            timeoutCount = 0;
+        if (xTaskNotifyWait(0, 0, &notified, bno.timeout) == pdTRUE) {
+            // 32 Bit Zeitstempel des Interrupts auf 64 Bit erweitern
+            timestamp = esp_timer_get_time();
+            timestamp -= (uint32_t)((uint32_t)timestamp - notified);
         } else { // vermutlich ein Interrupt verpasst, prüfe
-            if (gpio_get_level(bno.interruptPin) == 0 || ++timeoutCount > 3) {
-                if (timeoutCount > 3) pvPublishUint(xSensors, SENSORS_PV_TIMEOUT, (0x1 << SENSORS_ORIENTATION)); // DEBUG, FixMe
-                event.timestamp = esp_timer_get_time();
-                xQueueSendToBack(xBno, &event, 0);
-            }
+            if (gpio_get_level(bno.interruptPin) != 0 && ++timeoutCount <= 3) continue;
+            if (timeoutCount > 3) pvPublishUint(xSensors, SENSORS_PV_TIMEOUT, (0x1 << SENSORS_ORIENTATION)); // DEBUG, FixMe
+            timestamp = esp_timer_get_time();
         }
+        if (bno_receive(&length)) continue;
+        bno_captureRecord(timestamp, length);
+        // an sh2-Lib übergeben
+        bno.onRx(NULL, bno.rxBuffer, length, timestamp);
+        timeoutCount = 0;
     }
 }
 
+#if BNO_TRANSPORT == BNO_TRANSPORT_SPI
+
+static bool bno_transportInit(uint8_t address) {
+    // Wake (PS0) hoch, auch während Reset für SPI-Modus
+    gpio_config_t gpioConfig;
+    gpioConfig.pin_bit_mask = ((1ULL) << BNO_SPI_WAKE);
+    gpioConfig.mode = GPIO_MODE_OUTPUT;
+    gpioConfig.pull_up_en = GPIO_PULLUP_DISABLE;
+    gpioConfig.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    gpioConfig.intr_type = GPIO_INTR_DISABLE;
+    gpio_config(&gpioConfig);
+    gpio_set_level(BNO_SPI_WAKE, 1);
+    // Bus mit DMA, Modus 3
+    spi_bus_config_t busConfig = {
+        .mosi_io_num = BNO_SPI_MOSI,
+        .miso_io_num = BNO_SPI_MISO,
+        .sclk_io_num = BNO_SPI_SCK,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = SH2_HAL_MAX_TRANSFER
+    };
+    spi_device_interface_config_t deviceConfig = {
+        .mode = 3,
+        .clock_speed_hz = BNO_SPI_CLOCK,
+        .spics_io_num = BNO_SPI_CS,
+        .queue_size = 1
+    };
+    if (spi_bus_initialize(BNO_SPI_HOST, &busConfig, BNO_SPI_DMA_CHANNEL)) return true;
+    if (spi_bus_add_device(BNO_SPI_HOST, &deviceConfig, &bno.spi)) return true;
+    bno.txFree = xSemaphoreCreateBinary();
+    if (!bno.txFree) return true;
+    xSemaphoreGive(bno.txFree);
+    return false;
+}
+
+static bool bno_receive(uint16_t *length) {
+    gpio_set_level(BNO_SPI_WAKE, 1); // Hub ist bereit, Wake-Anforderung zurücknehmen
+    uint16_t txLength = bno.txLength;
+    spi_transaction_t t = {0};
+    int64_t start = esp_timer_get_time();
+    if (spi_device_acquire_bus(bno.spi, portMAX_DELAY)) return true;
+    // Header lesen (und senden), CS bleibt aktiv
+    t.flags = SPI_TRANS_CS_KEEP_ACTIVE;
+    t.length = SHTP_HEADER_LEN * 8;
+    t.tx_buffer = txLength ? bno.txBuffer : NULL;
+    t.rx_buffer = bno.rxBuffer;
+    bool error = spi_device_polling_transmit(bno.spi, &t);
+    // Rest im selben Transfer, so lang wie das grössere Paket beider Richtungen
+    uint16_t cargoLength = ((bno.rxBuffer[1] << 8) + (bno.rxBuffer[0])) & 0x7fff;
+    uint16_t total = (cargoLength > txLength) ? cargoLength : txLength;
+    if (total > SH2_HAL_MAX_TRANSFER) total = SH2_HAL_MAX_TRANSFER; // Rest folgt als Fortsetzung
+    if (total <= SHTP_HEADER_LEN) total = SHTP_HEADER_LEN + 1; // CS wird erst mit zweitem Transfer freigegeben
+    t.flags = 0;
+    t.length = (total - SHTP_HEADER_LEN) * 8;
+    t.tx_buffer = (txLength > SHTP_HEADER_LEN) ? bno.txBuffer + SHTP_HEADER_LEN : NULL;
+    t.rx_buffer = bno.rxBuffer + SHTP_HEADER_LEN;
+    error |= spi_device_transmit(bno.spi, &t);
+    spi_device_release_bus(bno.spi);
+    bno.statistics.busTime += (uint32_t)(esp_timer_get_time() - start);
+    bno.statistics.transfers += 2;
+    // Sendung abgeschlossen
+    if (txLength) {
+        bno.txLength = 0;
+        xSemaphoreGive(bno.txFree);
+    }
+    if (error || !cargoLength) return true;
+    bno.statistics.bytes += total;
+    *length = total;
+    return false;
+}
+
+#else
+
+static bool bno_transportInit(uint8_t address) {
+    return i2c_deviceAdd(I2C_DEVICE_BNO, address);
+}
+
+static bool bno_receive(uint16_t *length) {
+    // Datenlänge: Rest eines angefangenen Pakets oder gelernte Paketlänge, so wird ein Paket
+    // meist in einem Transfer gelesen statt zuerst nur den Header, mindestens Header, maximal MAX_TRANSFER
+    uint16_t readLength = bno.rxRemaining ? bno.rxRemaining : bno.readPredict;
+    if (readLength < SHTP_HEADER_LEN) readLength = SHTP_HEADER_LEN;
+    if (readLength > SH2_HAL_MAX_TRANSFER) readLength = SH2_HAL_MAX_TRANSFER;
+    // Lesen
+    int64_t start = esp_timer_get_time();
+    bool error = i2c_read(I2C_DEVICE_BNO, bno.rxBuffer, readLength);
+    bno.statistics.busTime += (uint32_t)(esp_timer_get_time() - start);
+    ++bno.statistics.transfers;
+    if (error) return true;
+    bno.statistics.bytes += readLength;
+    // Ermittle Datenlänge des SHTP-Packets
+    uint16_t cargoLength;
+    cargoLength = ((bno.rxBuffer[1] << 8) + (bno.rxBuffer[0])) & 0x7fff;
+    if (!cargoLength) return true;
+    // Paketlänge lernen: sofort auf grössere Pakete, langsam zurück auf kleinere. Schritt aufgerundet,
+    // sonst bleibt die Länge bis zu 7 Bytes über den kleinen Paketen stehen
+    if (!bno.rxRemaining) {
+        uint16_t predict = (cargoLength > SH2_HAL_MAX_TRANSFER) ? SH2_HAL_MAX_TRANSFER : cargoLength;
+        if (predict > bno.readPredict) bno.readPredict = predict;
+        else bno.readPredict -= (bno.readPredict - predict + 7) / 8;
+    }
+    // verbleibende Daten berechnen
+    if (cargoLength > readLength) {
+        bno.rxRemaining = (cargoLength - readLength) + SHTP_HEADER_LEN;
+    } else bno.rxRemaining = 0;
+    *length = readLength;
+    return false;
+}
+
+#endif
+
+bool bno_captureStart() {
+    // nur ohne laufende Aufzeichnung und ohne Leser, sonst würde ein Download überschrieben
+    uint32_t idle = 0;
+    if (!__atomic_compare_exchange_n(&bno.capture.state, &idle, BNO_CAPTURE_STARTING, false, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED)) return true;
+    if (!bno.capture.buffer) {
+        bno.capture.buffer = malloc(BNO_CAPTURE_SIZE);
+        if (!bno.capture.buffer) {
+            __atomic_store_n(&bno.capture.state, 0, __ATOMIC_RELEASE);
+            return true;
+        }
+        const uint32_t version = 1;
+        memcpy(bno.capture.buffer, "SHTP", 4);
+        memcpy(bno.capture.buffer + 4, &version, sizeof(version));
+    }
+    bno.capture.length = 8; // nach Header
+    __atomic_store_n(&bno.capture.state, BNO_CAPTURE_ACTIVE, __ATOMIC_RELEASE);
+    return false;
+}
+
+void bno_captureStop() {
+    __atomic_fetch_and(&bno.capture.state, ~BNO_CAPTURE_ACTIVE, __ATOMIC_RELEASE);
+}
+
+uint32_t bno_captureGet(const uint8_t **data) {
+    if (__atomic_load_n(&bno.capture.state, __ATOMIC_ACQUIRE) & (BNO_CAPTURE_ACTIVE | BNO_CAPTURE_STARTING)
+        || !bno.capture.buffer) return 0;
+    *data = bno.capture.buffer;
+    return __atomic_load_n(&bno.capture.length, __ATOMIC_ACQUIRE);
+}
+
+bool bno_captureReadBegin() {
+    uint32_t state = __atomic_load_n(&bno.capture.state, __ATOMIC_RELAXED);
+    do {
+        if (state & (BNO_CAPTURE_ACTIVE | BNO_CAPTURE_STARTING) || !bno.capture.buffer) return true;
+    } while (!__atomic_compare_exchange_n(&bno.capture.state, &state, state + 1, true, __ATOMIC_ACQUIRE,
+                                          __ATOMIC_RELAXED));
+    return false;
+}
+
+void bno_captureReadEnd() {
+    __atomic_fetch_sub(&bno.capture.state, 1, __ATOMIC_RELEASE);
+}
+
+static void bno_captureRecord(uint32_t timestamp, uint16_t length) {
+    if (!(__atomic_load_n(&bno.capture.state, __ATOMIC_ACQUIRE) & BNO_CAPTURE_ACTIVE)) return;
+    uint32_t position = bno.capture.length;
+    if (position + sizeof(timestamp) + sizeof(length) + length > BNO_CAPTURE_SIZE) { // voll
+        bno_captureStop();
+        ESP_LOGI("bno", "capture full: %u bytes", position);
+        return;
+    }
+    uint8_t *p = bno.capture.buffer + position;
+    memcpy(p, &timestamp, sizeof(timestamp));
+    memcpy(p + sizeof(timestamp), &length, sizeof(length));
+    memcpy(p + sizeof(timestamp) + sizeof(length), bno.rxBuffer, length);
+    // Länge zuletzt, so sieht ein Leser nur vollständige Einträge
+    __atomic_store_n(&bno.capture.length, position + sizeof(timestamp) + sizeof(length) + length, __ATOMIC_RELEASE);
+}
+
+void bno_statisticsGet(bno_statistics_t *statistics) {
+    *statistics = bno.statistics;
+}
+
 void bno_toWorldFrame(vector_t *vector, orientation_t *quaternion) {
+    if (!quaternion) { // vorberechnete Matrix nutzen
+        bno_rotationToWorld(vector, &bno.cache);
+        return;
+    }
     // (q.r * q.r - dot(q, q)) * v + 2.0f * dot(q, v) * q + 2.0f * q.r * cross(q, v);
     vector_t v = *vector;
-    orientation_t q;
-    if (quaternion) q = *quaternion;
-    else q = bno.orientation.orientation;
+    orientation_t q = *quaternion;
     float factor;
 
     factor  = q.real * q.real;
@@ -242,9 +509,11 @@ void bno_toWorldFrame(vector_t *vector, orientation_t *quaternion) {
 }
 
 void bno_toLocalFrame(vector_t *vector, orientation_t *quaternion) {
-    orientation_t q;
-    if (quaternion) q = *quaternion;
-    else q = bno.orientation.orientation;
+    if (!quaternion) { // vorberechnete Matrix nutzen
+        bno_rotationToLocal(vector, &bno.cache);
+        return;
+    }
+    orientation_t q = *quaternion;
     // Invertiere Quaternion mittels Conjugate. Normalisierung nicht nötig da Einheitsquaternion.
     // Conjugate des Quaternions
     q.i = -q.i;
@@ -255,9 +524,11 @@ void bno_toLocalFrame(vector_t *vector, orientation_t *quaternion) {
 
 // https://math.stackexchange.com/questions/2975109/how-to-convert-euler-angles-to-quaternions-and-get-the-same-euler-angles-back-fr
 void bno_toEuler(vector_t *euler, orientation_t *quaternion) {
-    orientation_t q;
-    if (quaternion) q = *quaternion;
-    else q = bno.orientation.orientation;
+    if (!quaternion) { // vorberechnete Winkel nutzen
+        *euler = bno.cache.euler;
+        return;
+    }
+    orientation_t q = *quaternion;
     float i2 = q.i * q.i;
     float j2 = q.j * q.j;
     float k2 = q.k * q.k;
@@ -274,7 +545,7 @@ void bno_toEuler(vector_t *euler, orientation_t *quaternion) {
     return;
 }
 
-static bool bno_sensorEnable(sh2_SensorId_t sensorId, uint32_t interval_us) {
+static bool bno_sensorEnable(sh2_SensorId_t sensorId, uint32_t interval_us, uint32_t batchInterval_us) {
     sh2_SensorConfig_t config = {
         changeSensitivityEnabled : false,
         wakeupEnabled : false,
@@ -282,7 +553,7 @@ static bool bno_sensorEnable(sh2_SensorId_t sensorId, uint32_t interval_us) {
         alwaysOnEnabled : true,
         changeSensitivity : 0,
         reportInterval_us : interval_us,
-        batchInterval_us: 0
+        batchInterval_us : batchInterval_us
     };
     if (sh2_setSensorConfig(sensorId, &config)) return true;
     return false;
@@ -291,6 +562,7 @@ static bool bno_sensorEnable(sh2_SensorId_t sensorId, uint32_t interval_us) {
 static void bno_sensorEvent(void * cookie, sh2_SensorEvent_t *event) {
     sh2_SensorValue_t value;
     if (sh2_decodeSensorEvent(&value, event)) return;
+    sensors_event_t *forward = &bno.events[bno.eventNext];
     // Daten verarbeitet an Sensortask weitergeben
     switch (value.sensorId) {
         case (SH2_LINEAR_ACCELERATION): { // Beschleunigung in globalem Koordinatensystem
@@ -298,54 +570,135 @@ static void bno_sensorEvent(void * cookie, sh2_SensorEvent_t *event) {
             v.x = value.un.linearAcceleration.x;
             v.y = value.un.linearAcceleration.y;
             v.z = value.un.linearAcceleration.z;
-            bno_toWorldFrame(&v, NULL);
-            bno.acceleration.vector = v;
-            bno.acceleration.accuracy = value.status & 0b00000011;
-            bno.acceleration.timestamp = value.timestamp;
-            bno.forward.data = &bno.acceleration;
+            forward->type = SENSORS_ACCELERATION;
+            timebase_toLocal(TIMEBASE_SH2, value.timestamp, &forward->timestamp);
+            bno_toWorldFrameAt(&v, forward->timestamp); // gebatcht älter als die aktuelle Orientierung
+            forward->vector = v;
+            forward->accuracy = value.status & 0b00000011;
             break;
         }
         case (SH2_ROTATION_VECTOR):
-            bno.orientation.orientation.i = value.un.rotationVector.i;
-            bno.orientation.orientation.j = value.un.rotationVector.j;
-            bno.orientation.orientation.k = value.un.rotationVector.k;
-            bno.orientation.orientation.real = value.un.rotationVector.real;
-            bno.orientation.accuracy = value.un.rotationVector.accuracy;
-            bno.orientation.timestamp = value.timestamp;
-            bno.forward.data = &bno.orientation;
+        case (SH2_GAME_ROTATION_VECTOR):
+        case (SH2_GYRO_INTEGRATED_RV): {
+            if (value.sensorId != bno_orientationSensors[bno.source]) return; // nicht gewählte Quelle
+            // jeder Report hat seine eigene Struktur in der Union, Quaternion aus der passenden lesen
+            float i, j, k, real;
+            if (value.sensorId == SH2_ROTATION_VECTOR) {
+                i = value.un.rotationVector.i;
+                j = value.un.rotationVector.j;
+                k = value.un.rotationVector.k;
+                real = value.un.rotationVector.real;
+                bno.orientation.accuracy = value.un.rotationVector.accuracy;
+            } else if (value.sensorId == SH2_GYRO_INTEGRATED_RV) {
+                i = value.un.gyroIntegratedRV.i;
+                j = value.un.gyroIntegratedRV.j;
+                k = value.un.gyroIntegratedRV.k;
+                real = value.un.gyroIntegratedRV.real;
+                bno.orientation.accuracy = 0.0f; // keine Schätzung vorhanden
+            } else {
+                i = value.un.gameRotationVector.i;
+                j = value.un.gameRotationVector.j;
+                k = value.un.gameRotationVector.k;
+                real = value.un.gameRotationVector.real;
+                bno.orientation.accuracy = 0.0f; // keine Schätzung vorhanden
+            }
+            bno.orientation.orientation.i = i;
+            bno.orientation.orientation.j = j;
+            bno.orientation.orientation.k = k;
+            bno.orientation.orientation.real = real;
+            timebase_toLocal(TIMEBASE_SH2, value.timestamp, &bno.orientation.timestamp);
+            bno_rotationUpdate(&bno.cache, &bno.orientation); // einmal pro Sample rechnen
+            bno.history[bno.historyNext].timestamp = bno.orientation.timestamp;
+            bno.history[bno.historyNext].orientation = bno.orientation.orientation;
+            bno.historyNext = (bno.historyNext + 1) % BNO_HISTORY;
+            if (bno.historyLength < BNO_HISTORY) ++bno.historyLength;
+            ++bno.statistics.orientations;
+            *forward = bno.orientation;
             break;
+        }
         case (SH2_PRESSURE): // Druck in Meter über Meer umrechnen
-            bno.altitude.vector.z = (228.15f / 0.0065f) * (1.0f - powf(value.un.pressure.value / 1013.25f, (1.0f / 5.255f)));
-            bno.altitude.accuracy = value.status & 0b00000011;
-            bno.altitude.timestamp = value.timestamp;
-            bno.forward.data = &bno.altitude;
+            forward->type = SENSORS_ALTIMETER;
+            forward->vector.x = 0.0f;
+            forward->vector.y = 0.0f;
+            forward->vector.z = (228.15f / 0.0065f) * (1.0f - powf(value.un.pressure.value / 1013.25f, (1.0f / 5.255f)));
+            forward->accuracy = value.status & 0b00000011;
+            timebase_toLocal(TIMEBASE_SH2, value.timestamp, &forward->timestamp);
             break;
         case (SH2_GYROSCOPE_CALIBRATED):
-            bno.rotation.vector.x = value.un.gyroscope.x;
-            bno.rotation.vector.y = value.un.gyroscope.y;
-            bno.rotation.vector.z = value.un.gyroscope.z;
-            bno.rotation.timestamp = value.timestamp;
-            bno.forward.data = &bno.rotation;
+            forward->type = SENSORS_ROTATION;
+            forward->vector.x = value.un.gyroscope.x;
+            forward->vector.y = value.un.gyroscope.y;
+            forward->vector.z = value.un.gyroscope.z;
+            forward->accuracy = 0.0f; // nicht ausgewertet
+            timebase_toLocal(TIMEBASE_SH2, value.timestamp, &forward->timestamp);
             break;
         default:
             return;
     }
+    // Slot weiterschalten, gebatchte Reports eines Transfers liegen gleichzeitig in der Queue
+    bno.eventNext = (bno.eventNext + 1) % BNO_EVENT_RING;
+    bno.forward.data = forward;
     xQueueSendToBack(xSensors, &bno.forward, 0);
     return;
 }
 
+static uint32_t bno_batchLimit(uint32_t batchInterval, uint32_t rateOrientation, uint32_t rateAcceleration,
+                               uint32_t ratePressure) {
+    // Beschleunigung & Druck zusammen max. BNO_BATCH_MAX Reports: t * (1 / a + 1 / p) <= n
+    uint64_t limit = UINT32_MAX;
+    if (rateAcceleration && ratePressure) {
+        limit = (uint64_t)BNO_BATCH_MAX * 1000 * rateAcceleration * ratePressure / (rateAcceleration + ratePressure);
+    } else if (rateAcceleration || ratePressure) {
+        limit = (uint64_t)BNO_BATCH_MAX * 1000 * (rateAcceleration + ratePressure);
+    }
+    // halbe Historie, Rest als Reserve für die Verzögerung bis der Batch gelesen ist
+    if (rateOrientation && (uint64_t)(BNO_HISTORY / 2) * 1000 * rateOrientation < limit) {
+        limit = (uint64_t)(BNO_HISTORY / 2) * 1000 * rateOrientation;
+    }
+    if (batchInterval <= limit) return batchInterval;
+    ESP_LOGW("bno", "batch interval %u us limited to %u us", batchInterval, (uint32_t)limit);
+    return limit;
+}
+
+static void bno_toWorldFrameAt(vector_t *vector, int64_t timestamp) {
+    // von der neusten Orientierung rückwärts, solange der Abstand kleiner wird
+    uint32_t newest = (bno.historyNext + BNO_HISTORY - 1) % BNO_HISTORY, best = newest;
+    int64_t bestDistance = INT64_MAX;
+    for (uint32_t age = 0; age < bno.historyLength; ++age) {
+        uint32_t index = (newest + BNO_HISTORY - age) % BNO_HISTORY;
+        int64_t distance = llabs(bno.history[index].timestamp - timestamp);
+        if (distance >= bestDistance) break;
+        best = index;
+        bestDistance = distance;
+    }
+    if (best == newest) { // aktuelle, vorberechnete Matrix
+        bno_toWorldFrame(vector, NULL);
+        return;
+    }
+    // gleiche Matrix wie der Cache, so drehen gebatchte und einzelne Samples identisch
+    sensors_event_t orientation;
+    orientation.timestamp = bno.history[best].timestamp;
+    orientation.orientation = bno.history[best].orientation;
+    bno_rotation_t rotation = {.timestamp = orientation.timestamp - 1};
+    bno_rotationUpdate(&rotation, &orientation);
+    bno_rotationToWorld(vector, &rotation);
+}
+
+
 static void IRAM_ATTR bno_interrupt(void* arg) {
-    BaseType_t woken;
-    bno_event_t event;
+    BaseType_t woken = pdFALSE;
     bool level;
     if (bno.interruptPin < 32) { // gpio_get_level ist nicht im IRAM
         level = (GPIO.in >> bno.interruptPin) & 0x1;
     } else {
         level = (GPIO.in1.data >> (bno.interruptPin - 32)) & 0x1;
     }
-    if (!level) {
-        event.timestamp = esp_timer_get_time();
-        xQueueSendToBackFromISR(xBno, &event, &woken);
+    if (!level && bno.task) {
+        ++bno.statistics.interrupts;
+        uint32_t timestamp = esp_timer_get_time();
+        if (xTaskNotifyFromISR(bno.task, timestamp, eSetValueWithoutOverwrite, &woken) != pdPASS) {
+            ++bno.statistics.coalesced; // Task hat vorherigen Interrupt noch nicht abgeholt
+        }
         if (woken == pdTRUE) portYIELD_FROM_ISR();
     }
 }
@@ -356,18 +709,27 @@ static void bno_initDone(void *cookie, sh2_AsyncEvent_t *event) {
     }
 }
 
-void bno_updateRate(uint32_t rateOrientation, uint32_t rateAcceleration, uint32_t ratePressure, uint32_t rateGyro) {
+void bno_updateRate(uint32_t rateOrientation, uint32_t rateAcceleration, uint32_t ratePressure, uint32_t rateGyro,
+                    bno_orientation_source_t source, uint32_t batchInterval) {
+    // kein sh2_reinitialize(), Reports werden einzeln umkonfiguriert und laufen ohne Unterbruch weiter
     int32_t result;
-    result = sh2_reinitialize();
-    ESP_LOGD("bno", "reinit: %i", result);
+    if (source >= BNO_ORIENTATION_MAX) source = BNO_ORIENTATION_ROTATION_VECTOR;
+    bno_orientation_source_t previous = bno.source;
     bno.timeout = (rateOrientation / portTICK_PERIOD_MS) + 1;
-    result = bno_sensorEnable(SH2_ROTATION_VECTOR, rateOrientation * 1000);
+    batchInterval = bno_batchLimit(batchInterval, rateOrientation, rateAcceleration, ratePressure);
+    // bei Quellenwechsel zuerst neue Quelle aktivieren, dann umschalten und erst danach alte deaktivieren
+    result = bno_sensorEnable(bno_orientationSensors[source], rateOrientation * 1000, 0);
+    bno.source = source;
     ESP_LOGD("bno", "enable quat: %i", result);
-    result = bno_sensorEnable(SH2_LINEAR_ACCELERATION, rateAcceleration * 1000);
+    if (previous != source) {
+        result = bno_sensorEnable(bno_orientationSensors[previous], 0, 0);
+        ESP_LOGD("bno", "disable quat: %i", result);
+    }
+    result = bno_sensorEnable(SH2_LINEAR_ACCELERATION, rateAcceleration * 1000, batchInterval);
     ESP_LOGD("bno", "enable accel: %i", result);
-    result = bno_sensorEnable(SH2_PRESSURE, ratePressure * 1000);
+    result = bno_sensorEnable(SH2_PRESSURE, ratePressure * 1000, batchInterval);
     ESP_LOGD("bno", "enable press: %i", result);
-    result = bno_sensorEnable(SH2_GYROSCOPE_CALIBRATED, rateGyro * 1000);
+    result = bno_sensorEnable(SH2_GYROSCOPE_CALIBRATED, rateGyro * 1000, 0);
     ESP_LOGD("bno", "enable gyro: %i", result);
 }
 
@@ -375,6 +737,9 @@ void bno_updateRate(uint32_t rateOrientation, uint32_t rateAcceleration, uint32_
 int sh2_hal_reset(bool dfuMode, sh2_rxCallback_t *onRx, void *cookie) {
     // DFU-Modus nicht unterstützt
     configASSERT(!dfuMode);
+#if BNO_TRANSPORT == BNO_TRANSPORT_SPI
+    gpio_set_level(BNO_SPI_WAKE, 1); // PS0 hoch wählt beim Start SPI
+#endif
     // Sensor-Reset
     gpio_set_level(bno.resetPin, 0);
     vTaskDelay(100 / portTICK_PERIOD_MS);
@@ -386,7 +751,17 @@ int sh2_hal_reset(bool dfuMode, sh2_rxCallback_t *onRx, void *cookie) {
 }
 
 int sh2_hal_tx(uint8_t *pData, uint32_t len) {
-    return i2c_write(bno.address, pData, len);
+#if BNO_TRANSPORT == BNO_TRANSPORT_SPI
+    // SPI ist vollduplex und hubgesteuert: Daten vormerken, per Wake anfordern, bno_task sendet beim Interrupt
+    if (len > SH2_HAL_MAX_TRANSFER) return SH2_ERR;
+    if (xSemaphoreTake(bno.txFree, BNO_STARTUP_WAIT_MS / portTICK_PERIOD_MS) == pdFALSE) return SH2_ERR;
+    memcpy(bno.txBuffer, pData, len);
+    bno.txLength = len;
+    gpio_set_level(BNO_SPI_WAKE, 0);
+    return SH2_OK;
+#else
+    return i2c_write(I2C_DEVICE_BNO, pData, len);
+#endif
 }
 
 int sh2_hal_rx(uint8_t *pData, uint32_t len) {
@@ -21,6 +21,52 @@
 /** Einstellungen **/
 
 #define BNO_STARTUP_WAIT_MS         1000    // 1 s
+#define BNO_CAPTURE_SIZE            (32 * 1024) // Bytes, RAM für Aufzeichnung der SHTP-Transfers
+#define BNO_BATCH_MAX               32      // Reports pro Batch, längere Batchintervalle werden gekürzt
+#define BNO_HISTORY                 64      // Orientierungen, zum Drehen gebatchter Beschleunigungen
+
+// Transport zum BNO, zur Buildzeit wählbar (z.B. per -DBNO_TRANSPORT=BNO_TRANSPORT_SPI)
+#define BNO_TRANSPORT_I2C           0       // PS0 & PS1 an GND, max. 400 kHz
+#define BNO_TRANSPORT_SPI           1       // PS0 (Wake) & PS1 an 3.3V, max. 3 MHz mit DMA
+#ifndef BNO_TRANSPORT
+    #define BNO_TRANSPORT           BNO_TRANSPORT_I2C
+#endif
+
+#if BNO_TRANSPORT == BNO_TRANSPORT_SPI
+    #define BNO_SPI_HOST            HSPI_HOST
+    #define BNO_SPI_DMA_CHANNEL     1
+    #define BNO_SPI_CLOCK           3000000
+    #define BNO_SPI_SCK             GPIO_NUM_14
+    #define BNO_SPI_MISO            GPIO_NUM_27
+    #define BNO_SPI_MOSI            GPIO_NUM_13
+    #define BNO_SPI_CS              GPIO_NUM_26
+    #define BNO_SPI_WAKE            GPIO_NUM_25 // PS0, low -> Host möchte senden
+#endif
+
+
+/** Variablendeklaration **/
+
+typedef enum { // Quelle der Orientierung
+    BNO_ORIENTATION_ROTATION_VECTOR = 0,    // Gyro, Beschleunigung & Magnetometer, mit Genauigkeit
+    BNO_ORIENTATION_GAME_ROTATION_VECTOR,   // Gyro & Beschleunigung, ohne Magnetometer
+    BNO_ORIENTATION_GYRO_INTEGRATED_RV,     // hochfrequent (bis 1 kHz) mit minimaler Latenz, eigener SHTP-Kanal
+    BNO_ORIENTATION_MAX
+} bno_orientation_source_t;
+
+typedef struct { // aus einer Orientierung vorberechnete Rotation
+    int64_t timestamp;      // Zeitstempel der Orientierung, dient als Version des Caches
+    float matrix[3][3];     // Rotationsmatrix lokal -> Welt
+    vector_t euler;         // Roll (x), Pitch (y), Heading (z) in rad
+} bno_rotation_t;
+
+typedef struct { // kumulierte Buszähler seit Start
+    uint32_t interrupts;    // vom BNO ausgelöste Interrupts
+    uint32_t coalesced;     // Interrupts während noch eine Notification ausstehend war
+    uint32_t transfers;     // I2C Lesezugriffe
+    uint32_t bytes;         // gelesene Bytes
+    uint32_t busTime;       // us, Summe der Dauer aller Lesezugriffe
+    uint32_t orientations;  // weitergeleitete Orientierungen, ergibt Bytes pro Orientierung
+} bno_statistics_t;
 
 
 /*
@@ -28,18 +74,22 @@
  * ----------------------------
  * Initialisiert Sensor, installiert Hintergrundtask und blockiert währenddem.
  *
- * uint8_t bnoAddr: BNO I2C Adresse
+ * uint8_t bnoAddr: BNO I2C Adresse, bei SPI ignoriert
  * gpio_num_t bnoInterrupt: BNO Interrupt Pin (Data ready)
  * gpio_num_t bnoReset: BNO Reset Pin
  * uint32_t rateOrientation: Datenrate Orientierung
  * uint32_t rateAcceleration: Datenrate Beschleunigung
  * uint32_t ratePressure: Datenrate Barometer
  * uint32_t rateGyro: Datenrate Gyroskop
+ * bno_orientation_source_t source: Sensorreport der als Orientierung genutzt wird
+ * uint32_t batchInterval: Batchintervall in us für Beschleunigung & Barometer, 0 -> sofort senden,
+ *                         gekürzt auf BNO_BATCH_MAX Reports und BNO_HISTORY / 2 Orientierungen
  *
  * returns: false -> Erfolg, true -> Error
  */
 bool bno_init(uint8_t address, gpio_num_t interruptPin, gpio_num_t resetPin,
-              uint32_t rateOrientation, uint32_t rateAcceleration, uint32_t ratePressure, uint32_t rateGyro);
+              uint32_t rateOrientation, uint32_t rateAcceleration, uint32_t ratePressure, uint32_t rateGyro,
+              bno_orientation_source_t source, uint32_t batchInterval);
 
 /*
  * Function: bno_toWorldFrame
@@ -73,15 +123,113 @@ void bno_toLocalFrame(vector_t *vector, orientation_t *quaternion);
  */
 void bno_toEuler(vector_t *euler, orientation_t *quaternion);
 
+/*
+ * Function: bno_rotationUpdate
+ * ----------------------------
+ * Berechnet Rotationsmatrix und Eulerwinkel einer Orientierung. Hat der Cache bereits
+ * den Zeitstempel der Orientierung, wird nichts neu gerechnet.
+ *
+ * bno_rotation_t *rotation: zu aktualisierender Cache
+ * sensors_event_t *orientation: Orientierung (SENSORS_ORIENTATION) mit Zeitstempel
+ *
+ * returns: false -> Cache war aktuell, true -> neu berechnet
+ */
+bool bno_rotationUpdate(bno_rotation_t *rotation, const sensors_event_t *orientation);
+
+/*
+ * Function: bno_rotationToWorld
+ * ----------------------------
+ * Rotiere Vektor mittels vorberechneter Rotationsmatrix vom Lokalen Referenzsystem in Weltkoordinaten.
+ *
+ * vector_t *vector: zu rotierender Vektor
+ * bno_rotation_t *rotation: vorberechnete Rotation
+ */
+void bno_rotationToWorld(vector_t *vector, const bno_rotation_t *rotation);
+
+/*
+ * Function: bno_rotationToLocal
+ * ----------------------------
+ * Rotiere Vektor mittels vorberechneter Rotationsmatrix (transponiert) von Weltkoordinaten
+ * in Lokales Referenzsystem.
+ *
+ * vector_t *vector: zu rotierender Vektor
+ * bno_rotation_t *rotation: vorberechnete Rotation
+ */
+void bno_rotationToLocal(vector_t *vector, const bno_rotation_t *rotation);
+
 /*
  * Function: bno_updateRate
  * ----------------------------
- * Setze Sensorreports auf gewünschte Datenraten.
+ * Setze Sensorreports auf gewünschte Datenraten. Jeder Report wird einzeln per sh2_setSensorConfig
+ * umkonfiguriert, ohne Reset des SensorHubs. Die Orientierung läuft dabei ohne Lücke weiter.
  * Kann Fehlerhafte Sensoren reaktivieren.
  *
  * uint32_t rateOrientation: Datenrate Orientierung
  * uint32_t rateAcceleration: Datenrate Beschleunigung
  * uint32_t ratePressure: Datenrate Barometer
  * uint32_t rateGyro: Datenrate Gyroskop
+ * bno_orientation_source_t source: Sensorreport der als Orientierung genutzt wird
+ * uint32_t batchInterval: Batchintervall in us für Beschleunigung & Barometer, 0 -> sofort senden,
+ *                         gekürzt auf BNO_BATCH_MAX Reports und BNO_HISTORY / 2 Orientierungen
+ */
+void bno_updateRate(uint32_t rateOrientation, uint32_t rateAcceleration, uint32_t ratePressure, uint32_t rateGyro,
+                    bno_orientation_source_t source, uint32_t batchInterval);
+
+/*
+ * Function: bno_statisticsGet
+ * ----------------------------
+ * Kopiert die kumulierten Buszähler. Differenzen zweier Abfragen ergeben Interrupts,
+ * Transfers und Buszeit pro Zeitintervall, z.B. um den Nutzen von Batching zu messen.
+ *
+ * bno_statistics_t *statistics: Ziel der Kopie
+ */
+void bno_statisticsGet(bno_statistics_t *statistics);
+
+/*
+ * Function: bno_captureStart
+ * ----------------------------
+ * Startet die Aufzeichnung aller vom BNO gelesenen SHTP-Transfers in einen RAM-Buffer
+ * (BNO_CAPTURE_SIZE, wird beim ersten Start alloziert). Stoppt automatisch wenn voll.
+ *
+ * Format (little-endian):
+ * - Header: "SHTP" | uint32_t Version (1)
+ * - pro Transfer: uint32_t Zeitstempel des Interrupts in us | uint16_t Länge | Länge Bytes wie an onRx übergeben
+ *
+ * returns: false -> Erfolg, true -> Error (läuft bereits, wird gerade gelesen oder kein Speicher)
+ */
+bool bno_captureStart();
+
+/*
+ * Function: bno_captureStop
+ * ----------------------------
+ * Stoppt die Aufzeichnung, Daten bleiben bis zum nächsten Start erhalten.
+ */
+void bno_captureStop();
+
+/*
+ * Function: bno_captureGet
+ * ----------------------------
+ * Gibt die Aufzeichnung zurück, nur bei gestoppter Aufzeichnung.
+ *
+ * const uint8_t **data: Pointer auf den Anfang der Aufzeichnung
+ *
+ * returns: Länge in Bytes, 0 falls keine Aufzeichnung vorhanden oder noch aktiv
+ */
+uint32_t bno_captureGet(const uint8_t **data);
+
+/*
+ * Function: bno_captureReadBegin
+ * ----------------------------
+ * Sperrt die gestoppte Aufzeichnung gegen einen Neustart, solange sie gelesen wird (z.B. Download
+ * über mehrere HTTP-Chunks). Jeder erfolgreiche Aufruf muss mit bno_captureReadEnd beendet werden.
+ *
+ * returns: false -> Erfolg, true -> Error (keine Aufzeichnung vorhanden oder noch aktiv)
+ */
+bool bno_captureReadBegin();
+
+/*
+ * Function: bno_captureReadEnd
+ * ----------------------------
+ * Beendet das mit bno_captureReadBegin begonnene Lesen.
  */
-void bno_updateRate(uint32_t rateOrientation, uint32_t rateAcceleration, uint32_t ratePressure, uint32_t rateGyro);
+void bno_captureReadEnd();
@@ -0,0 +1,94 @@
+/*
+ * File: frame.h
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-07-20
+ * ----------------------------
+ * Fortsetzbarer Frame-Decoder für UBX (u-blox) und MSPv2 (Multiwii Serial Protokoll).
+ * Nimmt beliebig zerstückelte Daten entgegen und leitet vollständige Frames anhand der Id an
+ * Handler weiter. Liegt ein Frame vollständig im übergebenen Chunk, wird nicht kopiert.
+ */
+
+
+#pragma once
+
+
+/** Externe Abhängigkeiten **/
+
+#include "esp_system.h"
+
+
+/** Variablendeklaration **/
+
+typedef enum {
+    FRAME_UBX,      // Sync 0xb5 0x62 | Class | ID | Size | Payload | Fletcher-8
+    FRAME_MSPV2     // $ X < | Flags | Id | Size | Payload | CRC8 DVB-S2
+} frame_protocol_t;
+
+typedef struct {
+    uint16_t id;                // UBX: Class << 8 | ID, MSPv2: Funktion
+    const uint8_t *payload;     // nur während Handleraufruf gültig
+    uint16_t length;
+    uint32_t start;             // Stromposition des ersten Sync-Bytes, für Zeitstempel des Frameanfangs
+} frame_t;
+
+typedef void (*frame_handler_t)(const frame_t *frame);
+
+typedef struct {
+    uint16_t id;
+    frame_handler_t handler;
+} frame_route_t;
+
+typedef struct { // kumulierte Statistik eines Decoders
+    uint32_t frames;            // weitergeleitete Frames
+    uint32_t copied;            // davon über Decoder-Buffer zusammengesetzt
+    uint32_t errors;            // Prüfsumme fehlerhaft
+    uint32_t dropped;           // unbekannte Id oder zu lang für Buffer
+} frame_statistics_t;
+
+typedef struct {
+    frame_protocol_t protocol;
+    const frame_route_t *routes;
+    uint8_t routeCount;
+    uint8_t *buffer;            // für Frames die über mehrere Chunks verteilt sind
+    uint16_t bufferSize;
+    // Zustand
+    uint8_t state;
+    const frame_route_t *route;
+    uint16_t id;
+    uint16_t length;
+    uint16_t pos;
+    uint8_t ckA;                // UBX: Fletcher A, MSPv2: CRC
+    uint8_t ckB;
+    uint32_t start;
+    frame_statistics_t statistics;
+} frame_decoder_t;
+
+
+/*
+ * Function: frame_init
+ * ----------------------------
+ * Initialisiert einen Decoder.
+ *
+ * frame_decoder_t *decoder: zu initialisierender Decoder
+ * frame_protocol_t protocol: UBX oder MSPv2
+ * const frame_route_t *routes: Tabelle der Handler nach Id, muss gültig bleiben
+ * uint8_t routeCount: Anzahl Einträge der Tabelle
+ * uint8_t *buffer: Buffer für zerstückelte Frames, bestimmt maximale Payloadlänge
+ * uint16_t bufferSize: Grösse des Buffers
+ */
+void frame_init(frame_decoder_t *decoder, frame_protocol_t protocol, const frame_route_t *routes, uint8_t routeCount,
+                uint8_t *buffer, uint16_t bufferSize);
+
+/*
+ * Function: frame_decode
+ * ----------------------------
+ * Dekodiert einen Chunk und ruft für jedes gültige Frame den passenden Handler auf.
+ * Ein unvollständiges Frame am Ende wird beim nächsten Aufruf fortgesetzt.
+ *
+ * frame_decoder_t *decoder: Decoder
+ * const uint8_t *data: Chunk
+ * size_t length: Länge des Chunks
+ * uint32_t position: Stromposition des ersten Bytes im Chunk
+ */
+void frame_decode(frame_decoder_t *decoder, const uint8_t *data, size_t length, uint32_t position);
@@ -18,8 +18,11 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include <string.h>
+#include <stdlib.h>
 #include <math.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
 
 
 /** Interne Abhängigkeiten **/
@@ -27,7 +30,10 @@
 #include "intercom.h"
 #include "resources.h"
 #include "sensor_types.h"
+#include "sensors.h"
 #include "uart.h"
+#include "frame.h"
+#include "timebase.h"
 #include "gps.h"
 
 
@@ -97,13 +103,130 @@ typedef struct __attribute__((packed)) {
     uint16_t magneticAccuracy;      // °
 } gps_ubx_nav_pvt_t;
 
+#define GPS_UBX_ACK_NAK     0x0500
+#define GPS_UBX_ACK_ACK     0x0501
+#define GPS_UBX_NAV_PVT     0x0107
+#define GPS_UBX_CFG_PRT     0x0600
+#define GPS_UBX_CFG_MSG     0x0601
+#define GPS_UBX_CFG_RATE    0x0608
+#define GPS_UBX_CFG_NAV5    0x0624
+#define GPS_UBX_CFG_GNSS    0x063e
+#define GPS_UBX_CFG_PMS     0x0686
+#define GPS_UBX_UPD_SOS     0x0914
+#define GPS_UBX_MGA_ACK     0x1360
+#define GPS_FRAME_BUFFER    sizeof(gps_ubx_nav_pvt_t) // grösstes empfangenes Frame
+#define GPS_ACK_MAX         8   // gleichzeitig ausstehende Bestätigungen
+#define GPS_ACK_TIMEOUT     (1000 / portTICK_PERIOD_MS)
+#define GPS_POLL_TIMEOUT    (200 / portTICK_PERIOD_MS)
+#define GPS_DETECT_TIMEOUT  (500 / portTICK_PERIOD_MS) // bei 9600 Baud kann die Antwort hinter NMEA warten
+#define GPS_BAUD_SWITCH_MS  20  // Pause bis das GPS die neue Baudrate übernommen hat
+#define GPS_BACKUP_TIMEOUT  (2000 / portTICK_PERIOD_MS) // Schreiben des Flashs im Empfänger
+#define GPS_ASSIST_BLOCK    1024 // Grösse eines NVS Blobs, ältere ESP-IDF können keine grossen Blobs
+#define GPS_ASSIST_TIMEOUT  (100 / portTICK_PERIOD_MS) // UBX-MGA-ACK eines Frames
+#define GPS_ASSIST_PACING   (10 / portTICK_PERIOD_MS + 1) // Pause nach jedem Frame falls ohne UBX-MGA-ACK
+
+typedef enum {
+    GPS_ACK_PENDING,
+    GPS_ACK_ACK,
+    GPS_ACK_NAK
+} gps_ack_result_t;
+
 static struct {
     sensors_event_t position;
     sensors_event_t speed;
     event_t forward;
+    frame_decoder_t decoder;
+    uint8_t frameBuffer[GPS_FRAME_BUFFER];
+    struct {
+        struct {
+            uint8_t class;          // erwartete Bestätigung
+            uint8_t id;
+            gps_ack_result_t result;
+        } entries[GPS_ACK_MAX];
+        uint8_t count;
+    } ack;
+    struct {
+        uint16_t id;                // erwartete Antwort auf Poll, 0 -> keine
+        uint8_t *buffer;
+        uint16_t size;
+        uint16_t length;
+        bool done;
+    } poll;
+    struct {
+        uint16_t active;            // ms, vom GPS bestätigte Rate
+        volatile uint16_t pending;  // ms, 0 -> keine Änderung ausstehend
+        uint16_t requested;         // ms, vom GPS-Task übernommene Anforderung, 0 -> keine
+        uint8_t retries;            // nur vom GPS-Task verändert
+    } rate;
+    struct {
+        uint8_t *buffer;            // Upload im RAM, NULL -> kein Upload aktiv
+        uint32_t size;
+        uint32_t length;
+        volatile bool pending;      // gespeicherte Daten erneut einspielen
+        uint8_t id;                 // Id des gesendeten Frames, erwartet im UBX-MGA-ACK
+        gps_ack_result_t ack;
+        uint16_t rejected;          // vom Empfänger abgelehnte Frames der letzten Wiedergabe
+    } assist;
+    struct {
+        int64_t start;              // us, Start des Empfängers, 0 entspricht dem Einschalten
+        uint32_t time;              // ms, 0 -> noch kein Fix
+    } ttff;
+    volatile bool backup;           // Sicherung per UBX-UPD-SOS ausstehend
 } gps;
 
-static QueueHandle_t xGps;
+#define GPS_RATE_RETRIES 3
+
+typedef struct {
+    uint8_t *message;               // vollständige UBX-CFG-Nachricht
+    uint8_t length;
+    uint8_t pollLength;             // Payload des Polls, entspricht dem Anfang des Nachrichten-Payloads
+    bool (*matches)(const uint8_t *actual, uint16_t length, const uint8_t *desired); // Soll bereits gesetzt?
+} gps_config_t;
+
+static const uint32_t gps_bauds[] = {GPS_BAUD, 9600, 115200, 38400, 57600}; // zuerst bereits konfiguriert
+
+// UBX-CFG-PRT: NMEA deaktivieren, UART Baudrate auf 256000 setzen
+static uint8_t gps_msgPort[] = {0xB5, 0x62, 0x06, 0x00, 0x14, 0x00, 0x01,
+                                0x00, 0x00, 0x00, 0xC0, 0x08, 0x00, 0x00,
+                                0x00, 0xE8, 0x03, 0x00, 0x01, 0x00, 0x01,
+                                0x00, 0x00, 0x00, 0x00, 0x00, 0xd0, 0xf8};
+// UBX-CFG-PMS: Auf Full Power setzen
+static uint8_t gps_msgPower[] = {0xB5, 0x62, 0x06, 0x86, 0x08, 0x00, 0x00, 0x00,
+                                 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x94, 0x5A};
+// UBX-CFG-NAV5: Navigationsmodus auf Airborne <2g setzen
+static uint8_t gps_msgNav[] = {0xB5, 0x62, 0x06, 0x24, 0x24, 0x00, 0x01, 0x00,
+                               0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x56, 0xD6};
+// UBX-CFG-GNSS: Aktiviere Galileo, deaktiviere QZSS
+static uint8_t gps_msgGNSS[] = {0xB5, 0x62, 0x06, 0x3e, 0x3c, 0x00, 0x00, 0x20, 0xFF, 0x07, // 32 aktivierte Kanäle
+                                0x00, 0x08, 0x10, 0x00, 0x01, 0x00, 0x01, 0x01, // GPS mit min 8 max 16 Kanäle Aktiviert
+                                0x01, 0x01, 0x03, 0x00, 0x01, 0x00, 0x01, 0x01, // SBAS mit min 0 max 3 Kanäle Aktiviert
+                                0x02, 0x08, 0x0a, 0x00, 0x01, 0x00, 0x01, 0x01, // Galileo mit min 8 max 10 Kanäle Aktiviert
+                                0x03, 0x08, 0x10, 0x00, 0x00, 0x00, 0x01, 0x01, // BeiDou Deaktiviert
+                                0x04, 0x00, 0x08, 0x00, 0x00, 0x00, 0x01, 0x03, // IMAS Deaktiviert
+                                0x05, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01, 0x05, // QZSS Deaktiviert
+                                0x06, 0x08, 0x0e, 0x00, 0x01, 0x00, 0x01, 0x01, // GOLONASS mit min 8 max 14 Kanäle Aktiviert
+                                0x00, 0x00};
+// UBX-CFG-MSG: Zu empfangende Nachrichten setzen, UBX-NAV-PVT (0x01 0x07)
+static uint8_t gps_msgMessages[] = {0xB5, 0x62, 0x06, 0x01, 0x03, 0x00, 0x01, 0x07, 0x01, 0x13, 0x51};
+// UBX-CFG-CFG: aktuelle Konfiguration in BBR und Flash speichern
+static uint8_t gps_msgSave[] = {0xB5, 0x62, 0x06, 0x09, 0x0d, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                0x1f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00};
+// UBX-CFG-RST: GNSS kontrolliert stoppen, Ephemeriden bleiben erhalten
+static uint8_t gps_msgStop[] = {0xB5, 0x62, 0x06, 0x04, 0x04, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00};
+// UBX-CFG-RST: GNSS starten
+static uint8_t gps_msgStart[] = {0xB5, 0x62, 0x06, 0x04, 0x04, 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00};
+// UBX-UPD-SOS: Sicherung im Flash des Empfängers löschen
+static uint8_t gps_msgBackupClear[] = {0xB5, 0x62, 0x09, 0x14, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
+// UBX-CFG-NAVX5: nur ackAiding setzen (mask1 Bit 10), jedes MGA Frame wird dann per UBX-MGA-ACK bestätigt
+static uint8_t gps_msgAckAiding[] = {0xB5, 0x62, 0x06, 0x23, 0x28, 0x00, 0x02, 0x00, 0x00, 0x04, 0x00, 0x00,
+                                     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+                                     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x58, 0x74};
+
 
 
 /** Private Functions **/
@@ -124,29 +247,217 @@ void gps_task(void* arg);
  * Sende ein vorbereitetes UBX-Frame an das GPS
  *
  * uint8_t *buffer: Pointer zur Nachricht, ckA und ckB können NULL sein -> werden dann berechnet
- * uint8_t length: gesamtlänge der Nachricht (Header & Payload)
+ * uint16_t length: gesamtlänge der Nachricht (Header & Payload)
  * bool aknowledge: false -> nur senden, true -> warte auf positive Bestätigung
  * TickType_t timeout: maximale Blockzeit
  *
  * returns: false -> Erfolg, true -> Error
  */
-static bool gps_sendUBX(uint8_t *buffer, uint8_t length, bool aknowledge, TickType_t timeout);
+static bool gps_sendUBX(uint8_t *buffer, uint16_t length, bool aknowledge, TickType_t timeout);
+
+/*
+ * Function: gps_receive
+ * ----------------------------
+ * Warte auf Empfang und leite alle vollständigen UBX-Frames an ihre Handler weiter.
+ *
+ * TickType_t timeout: maximale Blockzeit
+ *
+ * returns: false -> Erfolg, true -> Timeout
+ */
+static bool gps_receive(TickType_t timeout);
+
+/*
+ * Function: gps_processAck
+ * ----------------------------
+ * Handler für UBX-ACK-ACK und UBX-ACK-NAK. Wertet die erwartete Bestätigung aus.
+ *
+ * const frame_t *frame: empfangenes Frame
+ */
+static void gps_processAck(const frame_t *frame);
+
+/*
+ * Function: gps_processNavPvt
+ * ----------------------------
+ * Handler für UBX-NAV-PVT. Verarbeitet Position und Geschwindigkeit und leitet diese an sensors-Queue weiter.
+ *
+ * const frame_t *frame: empfangenes Frame
+ */
+static void gps_processNavPvt(const frame_t *frame);
+
+/*
+ * Function: gps_processPoll
+ * ----------------------------
+ * Handler für Antworten auf UBX-CFG Polls. Kopiert die erwartete Antwort in den Poll-Buffer.
+ *
+ * const frame_t *frame: empfangenes Frame
+ */
+static void gps_processPoll(const frame_t *frame);
+
+/*
+ * Function: gps_processAssistAck
+ * ----------------------------
+ * Handler für UBX-MGA-ACK. Vermerkt ob der Empfänger das zuletzt gesendete MGA Frame übernommen hat.
+ *
+ * const frame_t *frame: empfangenes Frame
+ */
+static void gps_processAssistAck(const frame_t *frame);
+
+static const frame_route_t gps_routes[] = {
+    {GPS_UBX_NAV_PVT, &gps_processNavPvt},
+    {GPS_UBX_ACK_ACK, &gps_processAck},
+    {GPS_UBX_ACK_NAK, &gps_processAck},
+    {GPS_UBX_CFG_PRT, &gps_processPoll},
+    {GPS_UBX_CFG_MSG, &gps_processPoll},
+    {GPS_UBX_CFG_RATE, &gps_processPoll},
+    {GPS_UBX_CFG_NAV5, &gps_processPoll},
+    {GPS_UBX_CFG_GNSS, &gps_processPoll},
+    {GPS_UBX_CFG_PMS, &gps_processPoll},
+    {GPS_UBX_UPD_SOS, &gps_processPoll},
+    {GPS_UBX_MGA_ACK, &gps_processAssistAck}
+};
+
+/*
+ * Function: gps_queueUBX
+ * ----------------------------
+ * Sende ein vorbereitetes UBX-Frame und merke die Bestätigung vor, ohne auf diese zu warten.
+ * So können mehrere Nachrichten direkt hintereinander gesendet werden.
+ *
+ * uint8_t *buffer: Pointer zur Nachricht, ckA und ckB können NULL sein -> werden dann berechnet
+ * uint16_t length: gesamtlänge der Nachricht (Header & Payload)
+ * TickType_t timeout: maximale Blockzeit für Platz im tx-Ringbuffer
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+static bool gps_queueUBX(uint8_t *buffer, uint16_t length, TickType_t timeout);
+
+/*
+ * Function: gps_waitAck
+ * ----------------------------
+ * Warte auf alle vorgemerkten Bestätigungen und setze die Liste zurück.
+ *
+ * TickType_t timeout: maximale Blockzeit
+ *
+ * returns: false -> alle bestätigt, true -> NAK oder Timeout
+ */
+static bool gps_waitAck(TickType_t timeout);
 
 /*
- * Function: gps_receiveUBX
+ * Function: gps_pollUBX
  * ----------------------------
- * Empfange ein UBX-Frame
+ * Frage eine Nachricht beim GPS ab und warte auf die Antwort gleicher Class und Id.
  *
- * uint8_t *payload: Buffer für Payload des Frames (mindestens so gross wie length)
- * uint8_t class: Class der zu empfangenden Nachricht
- * uint8_t id: Id der zu empfangenden Nachricht
- * uint8_t length: Länge des Payloads
+ * uint8_t class: Class der Nachricht
+ * uint8_t id: Id der Nachricht
+ * const uint8_t *request: Payload des Polls
+ * uint8_t requestLength: Länge des Poll-Payloads, max. 4
+ * uint8_t *response: Buffer für Payload der Antwort
+ * uint16_t size: Grösse des Buffers
+ * uint16_t *length: wird gefüllt mit der Länge der Antwort
  * TickType_t timeout: maximale Blockzeit
- * int64_t *timestamp: wird gefüllt mit dem Zeitpunkt des Empfanges
+ *
+ * returns: false -> Erfolg, true -> Timeout
+ */
+static bool gps_pollUBX(uint8_t class, uint8_t id, const uint8_t *request, uint8_t requestLength,
+                        uint8_t *response, uint16_t size, uint16_t *length, TickType_t timeout);
+
+/*
+ * Function: gps_configure
+ * ----------------------------
+ * Erkennt die Baudrate des Empfängers, liest dessen Konfiguration zurück und sendet nur
+ * abweichende Einstellungen, diese ohne Warten nacheinander. Läuft im GPS-Task.
+ */
+static void gps_configure();
+
+/*
+ * Function: gps_detectBaud
+ * ----------------------------
+ * Sucht die Baudrate mit der der Empfänger auf einen UBX-CFG-PRT Poll antwortet.
+ *
+ * returns: gefundene Baudrate oder 0 wenn keine
+ */
+static uint32_t gps_detectBaud();
+
+static bool gps_matchPort(const uint8_t *actual, uint16_t length, const uint8_t *desired);
+static bool gps_matchPower(const uint8_t *actual, uint16_t length, const uint8_t *desired);
+static bool gps_matchNav(const uint8_t *actual, uint16_t length, const uint8_t *desired);
+static bool gps_matchGNSS(const uint8_t *actual, uint16_t length, const uint8_t *desired);
+static bool gps_matchMessages(const uint8_t *actual, uint16_t length, const uint8_t *desired);
+
+static const gps_config_t gps_configs[] = { // ohne UBX-CFG-PRT, dieser wechselt die Baudrate und wird vorab gesendet
+    {gps_msgPower, sizeof(gps_msgPower), 0, &gps_matchPower},
+    {gps_msgNav, sizeof(gps_msgNav), 0, &gps_matchNav},
+    {gps_msgGNSS, sizeof(gps_msgGNSS), 0, &gps_matchGNSS},
+    {gps_msgMessages, sizeof(gps_msgMessages), 2, &gps_matchMessages}
+};
+
+/*
+ * Function: gps_applyRate
+ * ----------------------------
+ * Sende eine ausstehende Ratenänderung per UBX-CFG-RATE und werte die Bestätigung aus.
+ * Darf nur vom GPS-Task aufgerufen werden, da dieser alleine den UART liest.
+ */
+static void gps_applyRate();
+
+/*
+ * Function: gps_backupRestored
+ * ----------------------------
+ * Fragt per UBX-UPD-SOS ab ob der Empfänger beim Start eine Sicherung wiederhergestellt hat
+ * und löscht diese danach, so wird kein veralteter Zustand ein zweites Mal geladen.
+ */
+static void gps_backupRestored();
+
+/*
+ * Function: gps_backupSave
+ * ----------------------------
+ * Stoppt GNSS, sichert den Zustand per UBX-UPD-SOS im Flash des Empfängers und startet GNSS wieder.
+ * Die TTFF wird danach neu gemessen und entspricht so einem Warmstart.
+ */
+static void gps_backupSave();
+
+/*
+ * Function: gps_assistCheck
+ * ----------------------------
+ * Prüft ob die Daten ausschliesslich aus vollständigen UBX-MGA Frames mit gültiger Prüfsumme bestehen.
+ *
+ * const uint8_t *data: hochgeladene Daten
+ * uint32_t length: Anzahl Bytes
+ *
+ * returns: Anzahl Frames, 0 -> ungültig
+ */
+static uint16_t gps_assistCheck(const uint8_t *data, uint32_t length);
+
+/*
+ * Function: gps_assistStore
+ * ----------------------------
+ * Speichert die Daten in Blöcken im NVS. Die Länge wird zuletzt geschrieben, ein abgebrochenes
+ * Speichern hinterlässt so keine halben Daten.
  *
  * returns: false -> Erfolg, true -> Error
  */
-static bool gps_receiveUBX(uint8_t *payload, uint8_t class, uint8_t id, uint16_t length, TickType_t timeout, int64_t *timestamp);
+static bool gps_assistStore(const uint8_t *data, uint32_t length);
+
+/*
+ * Function: gps_assistReplay
+ * ----------------------------
+ * Liest die gespeicherten AssistNow Daten aus dem NVS und sendet sie Frame für Frame an den Empfänger.
+ * Bestätigt der Empfänger per UBX-MGA-ACK, folgt jedes Frame erst nach der Bestätigung des vorherigen.
+ */
+static void gps_assistReplay();
+
+/*
+ * Function: gps_assistSend
+ * ----------------------------
+ * Sendet ein MGA Frame mit Flusskontrolle, sonst läuft der Empfangsbuffer des Empfängers unbemerkt
+ * über. Mit Bestätigung wird auf das UBX-MGA-ACK gewartet, ohne nach dem Senden GPS_ASSIST_PACING
+ * pausiert. Empfangene Frames werden währenddessen normal verarbeitet.
+ *
+ * uint8_t *frame: vollständiges UBX-MGA Frame
+ * uint16_t length: Länge des Frames
+ * bool acknowledged: Empfänger sendet UBX-MGA-ACK
+ *
+ * returns: false -> gesendet (abgelehnte Frames in gps.assist.rejected), true -> Error oder Timeout
+ */
+static bool gps_assistSend(uint8_t *frame, uint16_t length, bool acknowledged);
 
 
 /** Implementierung **/
@@ -156,187 +467,471 @@ bool gps_init(gpio_num_t rxPin, gpio_num_t txPin, uint32_t rate) {
     gps.position.type = SENSORS_POSITION;
     gps.speed.type = SENSORS_GROUNDSPEED;
     gps.forward.type = EVENT_INTERNAL;
-    xGps = xQueueCreate(2, sizeof(int64_t));
-    // eigener UART Treiber installieren
-    uart_init(GPS_UART, txPin, rxPin, 9600, xGps);
-    // u-Blox Chip konfigurieren
-    // UBX-CFG-PRT: NMEA deaktivieren, UART Baudrate auf 256000 setzen
-    uint8_t msgPort[] = {0xB5, 0x62, 0x06, 0x00, 0x14, 0x00, 0x01,
-                         0x00, 0x00, 0x00, 0xC0, 0x08, 0x00, 0x00,
-                         0x00, 0xE8, 0x03, 0x00, 0x01, 0x00, 0x01,
-                         0x00, 0x00, 0x00, 0x00, 0x00, 0xd0, 0xf8};
-    gps_sendUBX(msgPort, sizeof(msgPort), true, 1000 / portTICK_PERIOD_MS); // AK aktivieren aber nicht auswerten, so wird auf tx done gewartet
-    // eigener UART auf neue Baudrate setzen und Buffer löschen
-    uart_baud(GPS_UART, 256000);
-    uart_rxFifoReset(GPS_UART);
-    // UBX-CFG-PMS: Auf Full Power setzen
-    uint8_t msgPower[] = {0xB5, 0x62, 0x06, 0x86, 0x08, 0x00, 0x00, 0x00,
-                          0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x94, 0x5A};
-    if (gps_sendUBX(msgPower, sizeof(msgPower), true, 1000 / portTICK_PERIOD_MS)) return true; // NAK Empfangen
-    // UBX-CFG-NAV5: Navigationsmodus auf Airborne <2g setzen
-    uint8_t msgNav[] = {0xB5, 0x62, 0x06, 0x24, 0x24, 0x00, 0x01, 0x00,
-                        0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                        0x00, 0x00, 0x56, 0xD6};
-    if (gps_sendUBX(msgNav, sizeof(msgNav), true, 1000 / portTICK_PERIOD_MS)) return true; // NAK Empfangen
-    // UBX-CFG-GNSS: Aktiviere Galileo, deaktiviere QZSS
-    uint8_t msgGNSS[] = {0xB5, 0x62, 0x06, 0x3e, 0x3c, 0x00, 0x00, 0x20, 0xFF, 0x07, // 32 aktivierte Kanäle
-                         0x00, 0x08, 0x10, 0x00, 0x01, 0x00, 0x01, 0x01, // GPS mit min 8 max 16 Kanäle Aktiviert
-                         0x01, 0x01, 0x03, 0x00, 0x01, 0x00, 0x01, 0x01, // SBAS mit min 0 max 3 Kanäle Aktiviert
-                         0x02, 0x08, 0x0a, 0x00, 0x01, 0x00, 0x01, 0x01, // Galileo mit min 8 max 10 Kanäle Aktiviert
-                         0x03, 0x08, 0x10, 0x00, 0x00, 0x00, 0x01, 0x01, // BeiDou Deaktiviert
-                         0x04, 0x00, 0x08, 0x00, 0x00, 0x00, 0x01, 0x03, // IMAS Deaktiviert
-                         0x05, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01, 0x05, // QZSS Deaktiviert
-                         0x06, 0x08, 0x0e, 0x00, 0x01, 0x00, 0x01, 0x01, // GOLONASS mit min 8 max 14 Kanäle Aktiviert
-                         NULL, NULL};
-    if (gps_sendUBX(msgGNSS, sizeof(msgGNSS), true, 1000 / portTICK_PERIOD_MS)) return true; // NAK Empfangen
-    // UBX-CFG-MSG: Zu empfangende Nachrichten setzen, UBX-NAV-PVT (0x01 0x07)
-    uint8_t msgMessages[] = {0xB5, 0x62, 0x06, 0x01, 0x03, 0x00, 0x01, 0x07, 0x01, 0x13, 0x51};
-    if (gps_sendUBX(msgMessages, sizeof(msgMessages), true, 1000 / portTICK_PERIOD_MS)) return true; // NAK Empfangen
-    // UBX-CFG-RATE: Daten-Rate setzen
-    uint8_t msgRate[] = {0xB5, 0x62, 0x06, 0x08, 0x06, 0x00, (0xff & rate),
-                        (rate >> 8), 0x01, 0x00, 0x00, 0x00, NULL, NULL};
-    if (gps_sendUBX(msgRate, sizeof(msgRate), true, 1000 / portTICK_PERIOD_MS)) return true; // NAK Empfangen
+    frame_init(&gps.decoder, FRAME_UBX, gps_routes, sizeof(gps_routes) / sizeof(frame_route_t),
+               gps.frameBuffer, sizeof(gps.frameBuffer));
+    // eigener UART Treiber installieren, Baudrate wird im Task erkannt
+    if (uart_init(GPS_UART, txPin, rxPin, GPS_BAUD)) return true;
+#ifdef GPS_PPS_PIN
+    if (timebase_ppsInit(GPS_PPS_PIN)) return true;
+#endif
+    // Rate wird nach der Konfiguration vom Task gesetzt
+    gps_updateRate(rate);
     // Task starten
     if (xTaskCreate(&gps_task, "gps", 3 * 1024, NULL, xSensors_PRIORITY - 1, NULL) != pdTRUE) return true;
     return false;
 }
 
 void gps_task(void* arg) {
-    // Variablen
-    uint8_t buffer[sizeof(gps_ubx_nav_pvt_t)];
-    gps_ubx_nav_pvt_t *nav;
-    vector_t v;
-    // UBX-NAV-PVT Frames parsen
+    gps_configure();
+    gps_backupRestored();
+    gps_assistReplay();
+    // Frames werden in gps_receive an die Handler verteilt
     while (true) {
-        gps_receiveUBX(buffer, 0x01, 0x07, sizeof(gps_ubx_nav_pvt_t), portMAX_DELAY, &gps.position.timestamp);
-        gps.speed.timestamp = gps.position.timestamp;
-        nav = (gps_ubx_nav_pvt_t*)&buffer[0];
-        // Fix-Typ & Satelitenanzahl
-        if (nav->fixType == 0 || nav->fixType == 5) continue; // noch kein Fix oder nur Zeit-Fix
-        // Position als y = Longitude / x = Latitude / z = Altitude
-        // Laitude - Quer / Logitude - oben nach unten
-        v.y = nav->latitude * 1e-7;     // °
-        v.x = nav->longitude * 1e-7;    // °
-        v.z = nav->heightMSL / 1e+3;    // m
-        gps.position.accuracy = nav->HDOP / 1e+3; // HDOP
-        // Longitude & Latitude in Meter umrechnen
-        // -> https://gis.stackexchange.com/questions/2951
-        gps.position.vector.y = v.y * 111111.0f * cosf(v.x * M_PI / 180.0f);
-        gps.position.vector.x = v.x * 111111.0f;
-        gps.position.vector.z = v.z;
-        gps.forward.data = &gps.position;
-        xQueueSendToBack(xSensors, &gps.forward, 0);
-        // Geschwindigkeit
-        // Koordinatensystem wechseln: GPS ist im NED, quadro ist im ENU
-        gps.speed.vector.y = nav->velocityNorth / 1e+3;
-        gps.speed.vector.x = nav->velocityEast / 1e+3;
-        gps.speed.vector.z = -nav->velocityDown / 1e+3;
-        gps.speed.accuracy = nav->velocityAccuracy / 1e+3;
-        gps.forward.data = &gps.speed;
-        xQueueSendToBack(xSensors, &gps.forward, 0);
+        if (gps.rate.pending) gps_applyRate();
+        if (gps.assist.pending) gps_assistReplay();
+        if (gps.backup) gps_backupSave();
+        gps_receive(portMAX_DELAY);
     }
 }
 
 void gps_updateRate(uint32_t rate) {
+    // nur vormerken, GPS-Task sendet nach dem nächsten Frame, so liest nur ein Task den UART
+    if (!rate || rate > UINT16_MAX) return;
+    gps.rate.pending = rate;
+}
+
+static void gps_applyRate() {
+    uint16_t rate = gps.rate.pending;
+    if (rate == gps.rate.active) {
+        gps.rate.pending = 0;
+        gps.rate.requested = 0;
+        return;
+    }
+    // neue Anforderung übernommen, Versuche zurücksetzen
+    if (rate != gps.rate.requested) {
+        gps.rate.requested = rate;
+        gps.rate.retries = GPS_RATE_RETRIES;
+    }
     // UBX-CFG-RATE: Daten-Rate setzen
     uint8_t msgRate[] = {0xB5, 0x62, 0x06, 0x08, 0x06, 0x00, (0xff & rate),
-                        (rate >> 8), 0x01, 0x00, 0x00, 0x00, NULL, NULL};
-    bool result = gps_sendUBX(msgRate, sizeof(msgRate), false, 0); // kein NAK Empfang, sonst kriegt GPS-Task Probleme aus irgend einem Grund (semphr?)
-    ESP_LOGD("gps", "update rate: %u", result);
+                        (rate >> 8), 0x01, 0x00, 0x00, 0x00, 0x00, 0x00}; // Prüfsumme wird berechnet
+    bool result = gps_sendUBX(msgRate, sizeof(msgRate), true, 200 / portTICK_PERIOD_MS);
+    ESP_LOGD("gps", "update rate %u: %u", rate, result);
+    if (!result) gps.rate.active = rate;
+    else if (gps.rate.retries && --gps.rate.retries) return; // beim nächsten Frame erneut versuchen
+    // erledigt, ausser es wurde inzwischen eine neue Rate angefordert
+    gps.rate.requested = 0;
+    __atomic_compare_exchange_n(&gps.rate.pending, &rate, 0, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+void gps_backup() {
+    // nur vormerken, wie gps_updateRate
+    gps.backup = true;
+}
+
+bool gps_assistBegin(uint32_t length) {
+    if (!length || length > GPS_ASSIST_SIZE || gps.assist.buffer) return true;
+    gps.assist.buffer = malloc(length);
+    if (!gps.assist.buffer) return true;
+    gps.assist.size = length;
+    gps.assist.length = 0;
+    return false;
+}
+
+bool gps_assistWrite(const uint8_t *data, uint32_t length) {
+    if (!gps.assist.buffer || length > gps.assist.size - gps.assist.length) return true;
+    memcpy(gps.assist.buffer + gps.assist.length, data, length);
+    gps.assist.length += length;
+    return false;
+}
+
+bool gps_assistEnd(bool store) {
+    uint8_t *buffer = gps.assist.buffer;
+    uint32_t length = gps.assist.length;
+    if (!buffer) return true;
+    uint16_t frames = store ? gps_assistCheck(buffer, length) : 0;
+    bool error = !frames || gps_assistStore(buffer, length);
+    gps.assist.buffer = NULL;
+    free(buffer);
+    if (error) {
+        if (store) ESP_LOGE("gps", "AssistNow upload rejected (%u bytes, %u frames)", length, frames);
+        return true;
+    }
+    ESP_LOGI("gps", "AssistNow stored: %u frames, %u bytes", frames, length);
+    gps.assist.pending = true; // sofort einspielen, nicht erst beim nächsten Start
+    return false;
+}
+
+static void gps_configure() {
+    int64_t start = esp_timer_get_time();
+    uint8_t payload[GPS_FRAME_BUFFER];
+    uint16_t length;
+    uint8_t sent = 0;
+    // Baudrate erkennen, konfigurierter Empfänger antwortet sofort
+    uint32_t baud = gps_detectBaud();
+    if (!baud) {
+        ESP_LOGW("gps", "no response to UBX poll, configuring blind at 9600 baud");
+        uart_baud(GPS_UART, 9600);
+    }
+    // UBX-CFG-PRT: nur senden wenn Baudrate oder Protokolle abweichen
+    if (baud != GPS_BAUD
+        || gps_pollUBX(0x06, 0x00, &gps_msgPort[6], 1, payload, sizeof(payload), &length, GPS_POLL_TIMEOUT)
+        || !gps_matchPort(payload, length, &gps_msgPort[6])) {
+        gps_sendUBX(gps_msgPort, sizeof(gps_msgPort), false, GPS_ACK_TIMEOUT);
+        // erst nach dem letzten Byte und der Umstellung im GPS die eigene Baudrate wechseln
+        uart_txWait(GPS_UART, GPS_ACK_TIMEOUT);
+        vTaskDelay(GPS_BAUD_SWITCH_MS / portTICK_PERIOD_MS + 1);
+        uart_baud(GPS_UART, GPS_BAUD);
+        uart_rxFifoReset(GPS_UART);
+        ++sent;
+    }
+    // übrige Konfiguration zurücklesen, Abweichungen ohne Warten hintereinander senden
+    for (uint8_t i = 0; i < sizeof(gps_configs) / sizeof(gps_config_t); ++i) {
+        const gps_config_t *config = &gps_configs[i];
+        if (!gps_pollUBX(config->message[2], config->message[3], &config->message[6], config->pollLength,
+                         payload, sizeof(payload), &length, GPS_POLL_TIMEOUT)
+            && config->matches(payload, length, &config->message[6])) continue;
+        if (gps_queueUBX(config->message, config->length, GPS_ACK_TIMEOUT)) break;
+        ++sent;
+    }
+    bool error = gps_waitAck(GPS_ACK_TIMEOUT);
+    // aktuelle Rate übernehmen, gps_applyRate sendet dann nur bei Abweichung
+    if (!gps_pollUBX(0x06, 0x08, NULL, 0, payload, sizeof(payload), &length, GPS_POLL_TIMEOUT) && length >= 2) {
+        gps.rate.active = payload[0] | (payload[1] << 8);
+    }
+#if GPS_CONFIG_PERSIST
+    // nur bei Änderungen speichern, schont den Flash des GPS
+    if (sent && !error) error = gps_sendUBX(gps_msgSave, sizeof(gps_msgSave), true, GPS_ACK_TIMEOUT);
+#endif
+    uint32_t duration = (esp_timer_get_time() - start) / 1000;
+    if (error) ESP_LOGE("gps", "configuration not acknowledged");
+    ESP_LOGI("gps", "configured in %u ms in gps task instead of at boot (detected %u baud, %u CFG sent)",
+             duration, baud, sent);
+}
+
+static uint32_t gps_detectBaud() {
+    uint8_t payload[GPS_FRAME_BUFFER];
+    uint16_t length;
+    for (uint8_t i = 0; i < sizeof(gps_bauds) / sizeof(uint32_t); ++i) {
+        uart_baud(GPS_UART, gps_bauds[i]);
+        uart_rxFifoReset(GPS_UART);
+        if (!gps_pollUBX(0x06, 0x00, &gps_msgPort[6], 1, payload, sizeof(payload), &length, GPS_DETECT_TIMEOUT)) {
+            return gps_bauds[i];
+        }
+    }
+    return 0;
+}
+
+static bool gps_matchPort(const uint8_t *actual, uint16_t length, const uint8_t *desired) {
+    return length >= 16 && !memcmp(&actual[8], &desired[8], 8); // Baudrate, Ein- und Ausgabeprotokolle
+}
+
+static bool gps_matchPower(const uint8_t *actual, uint16_t length, const uint8_t *desired) {
+    return length >= 2 && actual[1] == desired[1]; // powerSetupValue
+}
+
+static bool gps_matchNav(const uint8_t *actual, uint16_t length, const uint8_t *desired) {
+    return length >= 3 && actual[2] == desired[2]; // dynModel
+}
+
+static bool gps_matchGNSS(const uint8_t *actual, uint16_t length, const uint8_t *desired) {
+    // jeder gewünschte Block muss mit gleicher Aktivierung vorhanden sein, Reihenfolge beliebig
+    if (length < 4) return false;
+    for (uint8_t i = 0; i < desired[3]; ++i) {
+        const uint8_t *block = &desired[4 + 8 * i];
+        bool found = false;
+        for (uint16_t j = 4; j + 8 <= length; j += 8) {
+            if (actual[j] != block[0]) continue;
+            found = (actual[j + 4] & 0x01) == (block[4] & 0x01);
+            break;
+        }
+        if (!found) return false;
+    }
+    return true;
 }
 
-static bool gps_sendUBX(uint8_t *buffer, uint8_t length, bool aknowledge, TickType_t timeout) {
+static bool gps_matchMessages(const uint8_t *actual, uint16_t length, const uint8_t *desired) {
+    return length >= 8 && actual[3] == desired[2]; // Rate auf UART1
+}
+
+static bool gps_sendUBX(uint8_t *buffer, uint16_t length, bool aknowledge, TickType_t timeout) {
+    gps.ack.count = 0;
+    if (!aknowledge) { // nur Schreiben, wartet falls tx-Ringbuffer noch belegt
+        bool error = gps_queueUBX(buffer, length, timeout);
+        gps.ack.count = 0;
+        return error;
+    }
     TickType_t startTick = xTaskGetTickCount();
+    if (gps_queueUBX(buffer, length, timeout)) return true;
+    if (timeout != portMAX_DELAY) {
+        TickType_t dTick = xTaskGetTickCount() - startTick;
+        timeout = (dTick >= timeout) ? 0 : timeout - dTick;
+    }
+    return gps_waitAck(timeout);
+}
+
+static bool gps_queueUBX(uint8_t *buffer, uint16_t length, TickType_t timeout) {
+    if (gps.ack.count >= GPS_ACK_MAX) return true;
     // Prüfsumme rechnen
     if (!(buffer[length - 2] || buffer[length - 1])) {
-        for (uint8_t i = 2; i < (length - 2); ++i) {
+        for (uint16_t i = 2; i < (length - 2); ++i) {
             buffer[length - 2] = buffer[length - 2] + buffer[i];
             buffer[length - 1] = buffer[length - 1] + buffer[length - 2];
         }
     }
-    // Schreiben
-    if (uart_txAvailable(GPS_UART) < length) return true;
-    for (uint8_t i = 0; i < length; i++) {
-        uart_write(GPS_UART, buffer[i]);
+    // erwartete Bestätigung vormerken
+    gps.ack.entries[gps.ack.count].class = buffer[2];
+    gps.ack.entries[gps.ack.count].id = buffer[3];
+    gps.ack.entries[gps.ack.count].result = GPS_ACK_PENDING;
+    ++gps.ack.count;
+    // Schreiben, wartet falls tx-Ringbuffer noch belegt
+    return uart_writeBlock(GPS_UART, buffer, length, timeout);
+}
+
+static bool gps_waitAck(TickType_t timeout) {
+    TickType_t startTick = xTaskGetTickCount();
+    bool error = false;
+    // AK / NAK, währenddessen empfangene Frames werden normal verarbeitet
+    for (uint8_t i = 0; i < gps.ack.count; ++i) {
+        while (gps.ack.entries[i].result == GPS_ACK_PENDING) {
+            TickType_t remaining = portMAX_DELAY;
+            if (timeout != portMAX_DELAY) {
+                TickType_t dTick = xTaskGetTickCount() - startTick;
+                if (dTick >= timeout) break;
+                remaining = timeout - dTick;
+            }
+            gps_receive(remaining);
+        }
+        if (gps.ack.entries[i].result != GPS_ACK_ACK) error = true;
+    }
+    gps.ack.count = 0;
+    return error;
+}
+
+static bool gps_pollUBX(uint8_t class, uint8_t id, const uint8_t *request, uint8_t requestLength,
+                        uint8_t *response, uint16_t size, uint16_t *length, TickType_t timeout) {
+    uint8_t message[6 + 4 + 2]; // Poll-Payload ist höchstens 4 Bytes (UBX-UPD-SOS)
+    if (requestLength > 4) return true;
+    message[0] = 0xB5;
+    message[1] = 0x62;
+    message[2] = class;
+    message[3] = id;
+    message[4] = requestLength;
+    message[5] = 0x00;
+    memcpy(&message[6], request, requestLength);
+    uint8_t ckA = 0, ckB = 0;
+    for (uint8_t i = 2; i < 6 + requestLength; ++i) {
+        ckA += message[i];
+        ckB += ckA;
     }
-    // AK / NAK
-    if (!aknowledge) return false; // kein AK erforderlich
-    if (timeout != portMAX_DELAY) {
+    message[6 + requestLength] = ckA;
+    message[7 + requestLength] = ckB;
+    // Antwort erwarten
+    gps.poll.id = class << 8 | id;
+    gps.poll.buffer = response;
+    gps.poll.size = size;
+    gps.poll.done = false;
+    TickType_t startTick = xTaskGetTickCount();
+    if (uart_writeBlock(GPS_UART, message, 8 + requestLength, timeout)) return true;
+    while (!gps.poll.done) {
         TickType_t dTick = xTaskGetTickCount() - startTick;
-        if (dTick >= timeout) timeout = 0;
-        else timeout -= dTick;
+        if (dTick >= timeout) break;
+        gps_receive(timeout - dTick);
     }
-    uint8_t akPayload[2];
+    gps.poll.id = 0;
+    *length = gps.poll.length;
+    return !gps.poll.done;
+}
+
+static bool gps_receive(TickType_t timeout) {
+    const uint8_t *data;
+    size_t available;
     int64_t timestamp;
-    if (gps_receiveUBX(akPayload, 0x05, 0x01, 2, timeout, &timestamp)) return true;
-    if (akPayload[0] == buffer[2] && akPayload[1] == buffer[3]) return false;
-    else return true;
+    if (uart_rxWait(GPS_UART, &timestamp, timeout)) return true;
+    // Ringbuffer ohne Kopie dekodieren, Frames werden direkt an Handler weitergeleitet
+    while ((available = uart_rxPeek(GPS_UART, &data))) {
+        frame_decode(&gps.decoder, data, available, uart_rxPosition(GPS_UART));
+        uart_rxConsume(GPS_UART, available);
+    }
+    return false;
 }
 
-static bool gps_receiveUBX(uint8_t *payload, uint8_t class, uint8_t id, uint16_t length, TickType_t timeout, int64_t *timestamp) {
-    TickType_t startTick = xTaskGetTickCount();
-    while (timeout) {
-        if (timeout != portMAX_DELAY) {
-            TickType_t dTick = xTaskGetTickCount() - startTick;
-            if (dTick >= timeout) timeout = 0;
-            else timeout -= dTick;
-        }
-        uart_rxInterrupt(GPS_UART, true);
-        if (xQueueReceive(xGps, timestamp, timeout) == pdFALSE) break;
-        uint8_t c, step = 0, ckA = 0, ckB = 0;
-        uint16_t pos = 0;
-        while (uart_rxAvailable(GPS_UART)) {
-            c = uart_read(GPS_UART);
-            switch (step) {
-                case 0: // Sync 1
-                    if (c == 0xb5) {
-                        ckA = 0;
-                        ckB = 0;
-                        pos = 0;
-                        step++; // ToDo: mitzählen wie viel übersprungen wurde und timestamp neu rechnen
-                    }
-                    break;
-                case 1: // Sync 2
-                    if (c == 0x62) step++;
-                    else step = 0;
-                    break;
-                case 2: // Class
-                    if (c == class) step++;
-                    else step = 0;
-                    break;
-                case 3: // Id
-                    if (c == id) step++;
-                    else step = 0;
-                    break;
-                case 4: // Size LSB
-                    if (c == (length & 0x00ff)) step++;
-                    else step = 0;
-                    break;
-                case 5: // Size MSB
-                    if (c == (length >> 8)) step++;
-                    else step = 0;
-                    break;
-                case 6: // Payload
-                    payload[pos++] = c;
-                    if (pos == length) step++;
-                    break;
-                case 7: // ckA
-                    if (c == ckA) step++;
-                    else return true; // Prüfsumme A fehlerhaft
-                    break;
-                case 8: // ckB
-                    if (c == ckB) return false; // erfolgreich empfangen
-                    else return true; // Prüfsumme B fehlerhaft
-                    break;
-            }
-            if (step > 2 && step < 8) { // Prüfsumme ab Class bis vor ckA rechnen
-                ckA += c;
-                ckB += ckA;
-            }
+static void gps_processAck(const frame_t *frame) {
+    if (frame->length != 2) return;
+    // erste noch offene Bestätigung dieser Nachricht, das GPS bestätigt in Empfangsreihenfolge
+    for (uint8_t i = 0; i < gps.ack.count; ++i) {
+        if (gps.ack.entries[i].result != GPS_ACK_PENDING) continue;
+        if (frame->payload[0] != gps.ack.entries[i].class || frame->payload[1] != gps.ack.entries[i].id) continue;
+        gps.ack.entries[i].result = (frame->id == GPS_UBX_ACK_ACK) ? GPS_ACK_ACK : GPS_ACK_NAK;
+        return;
+    }
+}
+
+static void gps_processPoll(const frame_t *frame) {
+    if (frame->id != gps.poll.id || gps.poll.done) return; // Antwort wurde nicht erwartet
+    uint16_t length = frame->length < gps.poll.size ? frame->length : gps.poll.size;
+    memcpy(gps.poll.buffer, frame->payload, length);
+    gps.poll.length = length;
+    gps.poll.done = true;
+}
+
+static void gps_processNavPvt(const frame_t *frame) {
+    if (frame->length != sizeof(gps_ubx_nav_pvt_t)) return;
+    const gps_ubx_nav_pvt_t *nav = (const gps_ubx_nav_pvt_t*)frame->payload;
+    vector_t v;
+    gps.position.timestamp = uart_rxTimestamp(GPS_UART, frame->start); // Beginn des Frames
+    gps.speed.timestamp = gps.position.timestamp;
+    // GPS-Zeit nachführen, auch ohne Positionsfix
+    if (nav->valid.validTime) timebase_gpsEpoch(nav->iTow, gps.position.timestamp);
+    // Fix-Typ & Satelitenanzahl
+    if (nav->fixType == 0 || nav->fixType == 5) return; // noch kein Fix oder nur Zeit-Fix
+    // Time To First Fix
+    if (!gps.ttff.time && nav->flags1.gnssFixOk) {
+        gps.ttff.time = (gps.position.timestamp - gps.ttff.start) / 1000;
+        if (!gps.ttff.time) gps.ttff.time = 1;
+        pvPublishUint(xSensors, SENSORS_PV_GPS_TTFF, gps.ttff.time);
+        ESP_LOGI("gps", "first fix after %u ms", gps.ttff.time);
+    }
+    // Position als y = Longitude / x = Latitude / z = Altitude
+    // Laitude - Quer / Logitude - oben nach unten
+    v.y = nav->latitude * 1e-7;     // °
+    v.x = nav->longitude * 1e-7;    // °
+    v.z = nav->heightMSL / 1e+3;    // m
+    gps.position.accuracy = nav->HDOP / 1e+3; // HDOP
+    // Longitude & Latitude in Meter umrechnen
+    // -> https://gis.stackexchange.com/questions/2951
+    gps.position.vector.y = v.y * 111111.0f * cosf(v.x * M_PI / 180.0f);
+    gps.position.vector.x = v.x * 111111.0f;
+    gps.position.vector.z = v.z;
+    gps.forward.data = &gps.position;
+    xQueueSendToBack(xSensors, &gps.forward, 0);
+    // Geschwindigkeit
+    // Koordinatensystem wechseln: GPS ist im NED, quadro ist im ENU
+    gps.speed.vector.y = nav->velocityNorth / 1e+3;
+    gps.speed.vector.x = nav->velocityEast / 1e+3;
+    gps.speed.vector.z = -nav->velocityDown / 1e+3;
+    gps.speed.accuracy = nav->velocityAccuracy / 1e+3;
+    gps.forward.data = &gps.speed;
+    xQueueSendToBack(xSensors, &gps.forward, 0);
+}
+
+static void gps_processAssistAck(const frame_t *frame) {
+    // UBX-MGA-ACK-DATA0: type 1 -> übernommen, sonst Grund in infoCode, msgId ist die Id des MGA Frames
+    if (frame->length != 8 || gps.assist.ack != GPS_ACK_PENDING || frame->payload[3] != gps.assist.id) return;
+    gps.assist.ack = (frame->payload[0] == 1) ? GPS_ACK_ACK : GPS_ACK_NAK;
+    if (gps.assist.ack == GPS_ACK_NAK) ESP_LOGD("gps", "MGA 0x%02x rejected: %u", frame->payload[3], frame->payload[2]);
+}
+
+static void gps_backupRestored() {
+    static const char *results[] = {"unknown", "failed", "restored", "no backup"};
+    uint8_t payload[8];
+    uint16_t length;
+    if (gps_pollUBX(0x09, 0x14, NULL, 0, payload, sizeof(payload), &length, GPS_POLL_TIMEOUT)
+        || length < 5 || payload[0] != 3 || payload[4] > 3) return; // Empfänger ohne UBX-UPD-SOS
+    ESP_LOGI("gps", "receiver state at startup: %s", results[payload[4]]);
+    if (payload[4] == 2) gps_sendUBX(gps_msgBackupClear, sizeof(gps_msgBackupClear), false, GPS_ACK_TIMEOUT);
+}
+
+static void gps_backupSave() {
+    uint8_t create[4] = {0x00, 0x00, 0x00, 0x00}; // cmd 0: Sicherung erstellen
+    uint8_t payload[8];
+    uint16_t length;
+    gps.backup = false;
+    if (!gps.ttff.time) { // ohne Fix gibt es nichts Brauchbares zu sichern
+        ESP_LOGW("gps", "no fix, receiver state not saved");
+        return;
+    }
+    gps_sendUBX(gps_msgStop, sizeof(gps_msgStop), false, GPS_ACK_TIMEOUT);
+    // Empfänger antwortet mit UBX-UPD-SOS cmd 2, response 1 -> gesichert
+    bool error = gps_pollUBX(0x09, 0x14, create, sizeof(create), payload, sizeof(payload), &length, GPS_BACKUP_TIMEOUT)
+                 || length < 5 || payload[0] != 2 || payload[4] != 1;
+    gps_sendUBX(gps_msgStart, sizeof(gps_msgStart), false, GPS_ACK_TIMEOUT);
+    gps.ttff.start = esp_timer_get_time();
+    gps.ttff.time = 0;
+    if (error) ESP_LOGE("gps", "receiver state not saved");
+    else ESP_LOGI("gps", "receiver state saved with UBX-UPD-SOS");
+}
+
+static uint16_t gps_assistCheck(const uint8_t *data, uint32_t length) {
+    uint16_t frames = 0;
+    for (uint32_t i = 0; i < length; ++frames) {
+        if (length - i < 8 || data[i] != 0xb5 || data[i + 1] != 0x62 || data[i + 2] != 0x13) return 0; // nur UBX-MGA
+        uint32_t frameLength = 8 + (data[i + 4] | data[i + 5] << 8);
+        if (frameLength > length - i) return 0;
+        uint8_t ckA = 0, ckB = 0;
+        for (uint32_t j = i + 2; j < i + frameLength - 2; ++j) {
+            ckA += data[j];
+            ckB += ckA;
         }
+        if (ckA != data[i + frameLength - 2] || ckB != data[i + frameLength - 1]) return 0;
+        i += frameLength;
+    }
+    return frames;
+}
+
+static bool gps_assistStore(const uint8_t *data, uint32_t length) {
+    nvs_handle nvs;
+    char key[] = "mga0";
+    if (nvs_open("gps", NVS_READWRITE, &nvs)) return true;
+    bool error = nvs_set_u32(nvs, "mga", 0);
+    for (uint32_t i = 0; !error && i < length; i += GPS_ASSIST_BLOCK) {
+        key[3] = '0' + i / GPS_ASSIST_BLOCK;
+        error = nvs_set_blob(nvs, key, data + i, (length - i < GPS_ASSIST_BLOCK) ? length - i : GPS_ASSIST_BLOCK);
     }
-    return true; // timeout
+    if (!error) error = nvs_set_u32(nvs, "mga", length);
+    if (!error) error = nvs_commit(nvs);
+    nvs_close(nvs);
+    return error;
+}
+
+static void gps_assistReplay() {
+    nvs_handle nvs;
+    uint32_t length = 0;
+    char key[] = "mga0";
+    gps.assist.pending = false;
+    if (nvs_open("gps", NVS_READONLY, &nvs)) return; // noch nie etwas hochgeladen
+    if (nvs_get_u32(nvs, "mga", &length) || !length || length > GPS_ASSIST_SIZE) {
+        nvs_close(nvs);
+        return;
+    }
+    uint8_t *data = malloc(length);
+    bool error = !data;
+    for (uint32_t i = 0; !error && i < length; i += GPS_ASSIST_BLOCK) {
+        size_t blockLength = (length - i < GPS_ASSIST_BLOCK) ? length - i : GPS_ASSIST_BLOCK;
+        key[3] = '0' + i / GPS_ASSIST_BLOCK;
+        error = nvs_get_blob(nvs, key, data + i, &blockLength);
+    }
+    nvs_close(nvs);
+    // Frames wurden beim Hochladen geprüft, MGA wird nicht per UBX-ACK bestätigt sondern per UBX-MGA-ACK
+    bool acknowledged = !error && !gps_sendUBX(gps_msgAckAiding, sizeof(gps_msgAckAiding), true, GPS_ACK_TIMEOUT);
+    uint16_t frames = 0;
+    gps.assist.rejected = 0;
+    for (uint32_t i = 0; !error && i + 8 <= length; i += 8 + (data[i + 4] | data[i + 5] << 8)) {
+        error = gps_assistSend(&data[i], 8 + (data[i + 4] | data[i + 5] << 8), acknowledged);
+        if (!error) ++frames;
+    }
+    free(data);
+    if (error) ESP_LOGE("gps", "AssistNow replay failed after %u frames", frames);
+    else ESP_LOGI("gps", "AssistNow replayed: %u frames, %u bytes, %u rejected (%s)", frames, length,
+                  gps.assist.rejected, acknowledged ? "UBX-MGA-ACK" : "paced");
+}
+
+static bool gps_assistSend(uint8_t *frame, uint16_t length, bool acknowledged) {
+    gps.assist.id = frame[3];
+    gps.assist.ack = GPS_ACK_PENDING;
+    if (gps_sendUBX(frame, length, false, GPS_ACK_TIMEOUT)) return true;
+    TickType_t startTick = xTaskGetTickCount();
+    if (!acknowledged) {
+        // fest pausieren, NAV-PVT wird trotzdem verarbeitet
+        TickType_t dTick;
+        while ((dTick = xTaskGetTickCount() - startTick) < GPS_ASSIST_PACING) gps_receive(GPS_ASSIST_PACING - dTick);
+        return false;
+    }
+    while (gps.assist.ack == GPS_ACK_PENDING) {
+        TickType_t dTick = xTaskGetTickCount() - startTick;
+        if (dTick >= GPS_ASSIST_TIMEOUT) return true;
+        gps_receive(GPS_ASSIST_TIMEOUT - dTick);
+    }
+    if (gps.assist.ack == GPS_ACK_NAK) ++gps.assist.rejected;
+    return false;
 }
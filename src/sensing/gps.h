@@ -20,12 +20,19 @@
 /** Einstellungen **/
 
 #define GPS_UART                UART_NUM_1
+#define GPS_BAUD                256000
+#ifndef GPS_CONFIG_PERSIST
+    #define GPS_CONFIG_PERSIST  1       // geänderte Konfiguration per UBX-CFG-CFG im GPS speichern
+#endif
+// #define GPS_PPS_PIN          GPIO_NUM_18 // optionaler PPS-Eingang, BN-880Q führt PPS nicht heraus
+#define GPS_ASSIST_SIZE         8192    // max. Grösse der AssistNow Daten, in NVS Blöcken à 1024 Bytes gespeichert
 
 
 /*
  * Function: gps_init
  * ----------------------------
- * Initialisiert Sensor und startet zyklisches Update.
+ * Initialisiert Sensor und startet zyklisches Update. Die Konfiguration des Empfängers
+ * läuft im GPS-Task und blockiert den Systemstart nicht.
  * 
  * gpio_num_t rxPin: UART Data-In
  * gpio_num_t txPin: UART Data-Out
@@ -38,8 +45,55 @@ bool gps_init(gpio_num_t rxPin, gpio_num_t txPin, uint32_t rate);
 /*
  * Function: gps_updateRate
  * ----------------------------
- * Setze Sensorreport auf gewünschte Datenraten.
+ * Setze Sensorreport auf gewünschte Datenraten. Die Änderung wird nur vorgemerkt und vom GPS-Task
+ * nach dem nächsten empfangenen Frame per UBX-CFG-RATE mit Bestätigung übernommen.
  *
  * uint32_t rate: neue Datenrate
  */
 void gps_updateRate(uint32_t rate);
+
+/*
+ * Function: gps_backup
+ * ----------------------------
+ * Merkt eine Sicherung des Empfängerzustands per UBX-UPD-SOS vor. Der GPS-Task stoppt dazu GNSS,
+ * lässt Ephemeriden und Almanach im Flash des Empfängers sichern und startet GNSS wieder.
+ * Beim nächsten Start stellt der Empfänger den Zustand selbst wieder her. Nur mit vorhandenem Fix.
+ * Nur auf ausdrücklichen Befehl (gpsBackup), GNSS ist während der Sicherung einige Sekunden aus.
+ */
+void gps_backup();
+
+/*
+ * Function: gps_assistBegin
+ * ----------------------------
+ * Beginnt das Hochladen von AssistNow Daten (UBX-MGA Frames wie von u-center oder dem
+ * AssistNow Offline Dienst geliefert). Die Daten werden im RAM gesammelt.
+ *
+ * uint32_t length: Gesamtlänge der Datei
+ *
+ * returns: false -> Erfolg, true -> Error (zu gross oder bereits ein Upload aktiv)
+ */
+bool gps_assistBegin(uint32_t length);
+
+/*
+ * Function: gps_assistWrite
+ * ----------------------------
+ * Hängt einen Teil der Datei an.
+ *
+ * const uint8_t *data: empfangene Daten
+ * uint32_t length: Anzahl Bytes
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+bool gps_assistWrite(const uint8_t *data, uint32_t length);
+
+/*
+ * Function: gps_assistEnd
+ * ----------------------------
+ * Schliesst das Hochladen ab. Nur vollständige UBX-MGA Frames mit gültiger Prüfsumme werden im NVS
+ * gespeichert, bei jedem Start und sofort nach dem Upload spielt der GPS-Task sie per UART ein.
+ *
+ * bool store: false -> Upload verwerfen, true -> prüfen und speichern
+ *
+ * returns: false -> Erfolg, true -> Error (ungültige Daten)
+ */
+bool gps_assistEnd(bool store);
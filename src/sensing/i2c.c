@@ -5,13 +5,17 @@
  * Date:   2019-12-06
  * ----------------------------
  * I2C-Busfunktionen als Wrapper für ESP-IDF i2c-Treiber.
+ * Aufträge werden als Bit in einer Maske vorgemerkt, der Bustask führt immer den
+ * ausstehenden Auftrag mit höchster Priorität (tiefstes Bit) aus.
  */
 
 
 /** Externe Abhängigkeiten **/
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "esp_timer.h"
 
 
 /** Interne Abhängigkeiten **/
@@ -22,7 +26,92 @@
 
 /** Variablendeklaration **/
 
-static SemaphoreHandle_t sI2C;
+#ifdef I2C_LINK_RECOMMENDED_SIZE
+    #define I2C_LINK_SIZE I2C_LINK_RECOMMENDED_SIZE(1) // Start, Adresse, Daten, Stop
+#endif
+
+typedef void (*i2c_callback_t)(void *cookie, bool error); // Abschluss einer Transaktion, läuft im Bustask
+
+typedef struct {
+    uint8_t address;
+    bool registered;
+    // Auftrag
+    i2c_rw_t direction;
+    uint8_t *data;
+    size_t length;
+    i2c_callback_t callback;
+    void *cookie;
+    bool busy;
+    bool error;
+    int64_t submitted;
+    SemaphoreHandle_t lock; // serialisiert blockierende Aufrufe verschiedener Tasks auf dasselbe Gerät
+    SemaphoreHandle_t done; // für blockierende Aufrufe
+#ifdef I2C_LINK_SIZE
+    uint8_t link[I2C_LINK_SIZE];
+#endif
+    i2c_statistics_t statistics;
+} i2c_transaction_t;
+
+typedef struct { // blockierender Aufruf, liegt auf dessen Stack
+    SemaphoreHandle_t done;
+    bool error;
+} i2c_waiter_t;
+
+static struct {
+    i2c_transaction_t devices[I2C_DEVICE_MAX];
+    volatile uint32_t pending; // Bit pro Gerät
+    TaskHandle_t task;
+} i2c;
+
+
+/** Private Functions **/
+
+/*
+ * Function: i2c_task
+ * ----------------------------
+ * Bustask. Führt vorgemerkte Transaktionen nach Priorität aus.
+ *
+ * void* arg: Dummy für FreeRTOS
+ */
+void i2c_task(void* arg);
+
+/*
+ * Function: i2c_transaction
+ * ----------------------------
+ * Blockierende Transaktion. Wartet auf den Slot des Geräts und dann auf den Abschluss.
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+static bool i2c_transaction(i2c_device_t device, i2c_rw_t direction, uint8_t* pData, size_t dataLength);
+
+/*
+ * Function: i2c_submit
+ * ----------------------------
+ * Belegt den Slot eines Geräts und merkt die Transaktion beim Bustask vor.
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+static bool i2c_submit(i2c_device_t device, i2c_rw_t direction, uint8_t* pData, size_t dataLength,
+                       i2c_callback_t callback, void *cookie);
+
+/*
+ * Function: i2c_transfer
+ * ----------------------------
+ * Führt die Transaktion eines Geräts auf dem Bus aus.
+ *
+ * i2c_transaction_t *t: auszuführende Transaktion
+ */
+static void i2c_transfer(i2c_transaction_t *t);
+
+/*
+ * Function: i2c_wait
+ * ----------------------------
+ * Callback für blockierende Aufrufe, übergibt das Ergebnis und gibt den Semaphor des Geräts frei.
+ *
+ * void *cookie: i2c_waiter_t des wartenden Aufrufs
+ * bool error: Ergebnis der Transaktion
+ */
+static void i2c_wait(void *cookie, bool error);
 
 
 /** Implementierung **/
@@ -45,38 +134,120 @@ bool i2c_init(gpio_num_t scl, gpio_num_t sda) {
     || i2c_set_start_timing(I2C_NUM, cycleThird, cycleThird)
     || i2c_set_stop_timing(I2C_NUM, cycleThird, cycleThird)
     || i2c_set_data_timing(I2C_NUM, cycleThird, cycleThird)) return true;
-    // Sempahor einrichten
-    sI2C = xSemaphoreCreateMutex();
-    if (!sI2C) return true;
+    // Bustask starten
+    if (xTaskCreate(&i2c_task, "i2c", 2 * 1024, NULL, I2C_TASK_PRIORITY, &i2c.task) != pdTRUE) return true;
     return false;
 }
 
-bool i2c_write(uint8_t deviceAddr, uint8_t* pData, size_t dataLength) {
-    i2c_cmd_handle_t cmd;
-    esp_err_t err;
-    cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, deviceAddr << 1 | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, pData, dataLength, true);
-    i2c_master_stop(cmd);
-    if (xSemaphoreTake(sI2C, I2C_LOCK_TIMEOUT_MS / portTICK_RATE_MS) == pdFALSE) return true;
-    err = i2c_master_cmd_begin(I2C_NUM, cmd, I2C_BUS_TIMEOUT_MS / portTICK_RATE_MS);
-    xSemaphoreGive(sI2C);
-    i2c_cmd_link_delete(cmd);
-    return err;
+bool i2c_deviceAdd(i2c_device_t device, uint8_t deviceAddr) {
+    if (device >= I2C_DEVICE_MAX) return true;
+    i2c_transaction_t *t = &i2c.devices[device];
+    if (!t->lock) t->lock = xSemaphoreCreateMutex();
+    if (!t->done) t->done = xSemaphoreCreateBinary();
+    if (!t->lock || !t->done) return true;
+    t->address = deviceAddr;
+    t->registered = true;
+    return false;
+}
+
+void i2c_task(void* arg) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // solange Aufträge offen sind, immer den wichtigsten zuerst
+        uint32_t pending;
+        while ((pending = __atomic_load_n(&i2c.pending, __ATOMIC_ACQUIRE))) {
+            i2c_device_t device = __builtin_ctz(pending);
+            __atomic_fetch_and(&i2c.pending, ~(1UL << device), __ATOMIC_ACQ_REL);
+            i2c_transaction_t *t = &i2c.devices[device];
+            i2c_transfer(t);
+            // Slot freigeben vor Callback, so kann im Callback direkt neu beauftragt werden
+            i2c_callback_t callback = t->callback;
+            void *cookie = t->cookie;
+            bool error = t->error;
+            __atomic_store_n(&t->busy, false, __ATOMIC_RELEASE);
+            if (callback) callback(cookie, error);
+        }
+    }
 }
 
-bool i2c_read(uint8_t deviceAddr, uint8_t* pData, size_t dataLength) {
+bool i2c_write(i2c_device_t device, uint8_t* pData, size_t dataLength) {
+    return i2c_transaction(device, I2C_MASTER_WRITE, pData, dataLength);
+}
+
+bool i2c_read(i2c_device_t device, uint8_t* pData, size_t dataLength) {
+    return i2c_transaction(device, I2C_MASTER_READ, pData, dataLength);
+}
+
+void i2c_statisticsGet(i2c_device_t device, i2c_statistics_t *statistics) {
+    if (device >= I2C_DEVICE_MAX) return;
+    *statistics = i2c.devices[device].statistics;
+}
+
+static bool i2c_transaction(i2c_device_t device, i2c_rw_t direction, uint8_t* pData, size_t dataLength) {
+    if (device >= I2C_DEVICE_MAX) return true;
+    i2c_transaction_t *t = &i2c.devices[device];
+    if (!t->registered) return true;
+    xSemaphoreTake(t->lock, portMAX_DELAY);
+    // Ergebnis kommt über den Callback, der Slot ist dann schon wieder frei
+    i2c_waiter_t waiter = {.done = t->done, .error = true};
+    bool error = i2c_submit(device, direction, pData, dataLength, &i2c_wait, &waiter);
+    // max. I2C_DEVICE_MAX Transaktionen mit je I2C_BUS_TIMEOUT_MS vor diesem, Wartezeit also begrenzt
+    if (!error) {
+        xSemaphoreTake(t->done, portMAX_DELAY);
+        error = waiter.error;
+    }
+    xSemaphoreGive(t->lock);
+    return error;
+}
+
+static bool i2c_submit(i2c_device_t device, i2c_rw_t direction, uint8_t* pData, size_t dataLength,
+                       i2c_callback_t callback, void *cookie) {
+    if (device >= I2C_DEVICE_MAX || !dataLength) return true;
+    i2c_transaction_t *t = &i2c.devices[device];
+    if (!t->registered) return true; // Gerät unbekannt
+    if (__atomic_exchange_n(&t->busy, true, __ATOMIC_ACQUIRE)) return true; // Slot belegt
+    t->direction = direction;
+    t->data = pData;
+    t->length = dataLength;
+    t->callback = callback;
+    t->cookie = cookie;
+    t->submitted = esp_timer_get_time();
+    __atomic_fetch_or(&i2c.pending, 1UL << device, __ATOMIC_RELEASE);
+    xTaskNotifyGive(i2c.task);
+    return false;
+}
+
+static void i2c_transfer(i2c_transaction_t *t) {
     i2c_cmd_handle_t cmd;
-    esp_err_t err;
-    cmd = i2c_cmd_link_create();
+    int64_t start = esp_timer_get_time();
+#ifdef I2C_LINK_SIZE
+    cmd = i2c_cmd_link_create_static(t->link, sizeof(t->link));
+#else
+    cmd = i2c_cmd_link_create(); // ältere ESP-IDF ohne statische Command-Links
+#endif
     i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, deviceAddr << 1 | I2C_MASTER_READ, true);
-    i2c_master_read(cmd, pData, dataLength, I2C_MASTER_LAST_NACK);
+    i2c_master_write_byte(cmd, t->address << 1 | t->direction, true);
+    if (t->direction == I2C_MASTER_READ) i2c_master_read(cmd, t->data, t->length, I2C_MASTER_LAST_NACK);
+    else i2c_master_write(cmd, t->data, t->length, true);
     i2c_master_stop(cmd);
-    if (xSemaphoreTake(sI2C, I2C_LOCK_TIMEOUT_MS / portTICK_RATE_MS) == pdFALSE) return true;
-    err = i2c_master_cmd_begin(I2C_NUM, cmd, I2C_BUS_TIMEOUT_MS / portTICK_RATE_MS);
-    xSemaphoreGive(sI2C);
+    t->error = i2c_master_cmd_begin(I2C_NUM, cmd, I2C_BUS_TIMEOUT_MS / portTICK_RATE_MS);
+#ifdef I2C_LINK_SIZE
+    i2c_cmd_link_delete_static(cmd);
+#else
     i2c_cmd_link_delete(cmd);
-    return err;
-}
\ No newline at end of file
+#endif
+    // Statistik
+    int64_t end = esp_timer_get_time();
+    uint32_t wait = start - t->submitted;
+    ++t->statistics.transfers;
+    if (t->error) ++t->statistics.errors;
+    t->statistics.busTime += end - start;
+    t->statistics.waitTime += wait;
+    if (wait > t->statistics.waitMax) t->statistics.waitMax = wait;
+}
+
+static void i2c_wait(void *cookie, bool error) {
+    i2c_waiter_t *waiter = (i2c_waiter_t*)cookie;
+    waiter->error = error;
+    xSemaphoreGive(waiter->done);
+}
@@ -5,6 +5,8 @@
  * Date:   2019-12-06
  * ----------------------------
  * I2C-Busfunktionen als Wrapper für ESP-IDF i2c-Treiber.
+ * Ein Bustask arbeitet die Transaktionen nach Priorität der Geräte ab. Jedes Gerät hat genau
+ * einen vorallozierten Transaktionsslot inkl. statischem Command-Link, keine Heap-Allokation pro Transfer.
  */
 
 
@@ -22,14 +24,32 @@
 
 #define I2C_NUM             I2C_NUM_0
 #define I2C_CLOCK           400000
-#define I2C_LOCK_TIMEOUT_MS 100
 #define I2C_BUS_TIMEOUT_MS  10
+#define I2C_TASK_PRIORITY   (xSensors_PRIORITY + 1) // über allen Busnutzern
+
+
+/** Variablendeklaration **/
+
+typedef enum { // Busteilnehmer, Reihenfolge entspricht Priorität (kleiner -> wichtiger)
+    I2C_DEVICE_BNO = 0,
+    I2C_DEVICE_INA,
+    I2C_DEVICE_DISPLAY,
+    I2C_DEVICE_MAX
+} i2c_device_t;
+
+typedef struct { // kumulierte Statistik eines Geräts
+    uint32_t transfers;
+    uint32_t errors;
+    uint32_t busTime;       // us, Summe der Transferdauer
+    uint32_t waitTime;      // us, Summe der Wartezeit vom Auftrag bis Busbeginn
+    uint32_t waitMax;       // us, längste Wartezeit
+} i2c_statistics_t;
 
 
 /*
  * Function: i2c_init
  * ----------------------------
- * Aktiviert I2C-Master auf gegebenen Pins.
+ * Aktiviert I2C-Master auf gegebenen Pins und startet den Bustask.
  *
  * gpio_num_t scl: Serial Clock
  * gpio_num_t sda: Serial Data
@@ -39,27 +59,49 @@
 bool i2c_init(gpio_num_t scl, gpio_num_t sda);
 
 /*
- * Function: i2c_write
+ * Function: i2c_deviceAdd
  * ----------------------------
- * Schreibe Bytes in Slave.
+ * Meldet ein Gerät am Bus an.
  *
+ * i2c_device_t device: Slot und damit Priorität des Geräts
  * uint8_t deviceAddr: Adresse des Slaves
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+bool i2c_deviceAdd(i2c_device_t device, uint8_t deviceAddr);
+
+/*
+ * Function: i2c_write
+ * ----------------------------
+ * Schreibe Bytes in Slave. Blockiert bis die Transaktion abgeschlossen ist.
+ *
+ * i2c_device_t device: angemeldetes Gerät
  * uint8_t* pData: Pointer zu Daten
  * size_t dataLength: Anzahl zu sendender Bytes
  *
  * returns: false -> Erfolg, true -> Error
  */
-bool i2c_write(uint8_t deviceAddr, uint8_t* pData, size_t dataLength);
+bool i2c_write(i2c_device_t device, uint8_t* pData, size_t dataLength);
 
 /*
  * Function: i2c_read
  * ----------------------------
- * Lese Bytes aus Slave.
+ * Lese Bytes aus Slave. Blockiert bis die Transaktion abgeschlossen ist.
  *
- * uint8_t deviceAddr: Adresse des Slaves
+ * i2c_device_t device: angemeldetes Gerät
  * uint8_t* pData: Pointer zu Daten
  * size_t dataLength: Anzahl der zu empfangender Bytes
  *
  * returns: false -> Erfolg, true -> Error
  */
-bool i2c_read(uint8_t deviceAddr, uint8_t* pData, size_t dataLength);
\ No newline at end of file
+bool i2c_read(i2c_device_t device, uint8_t* pData, size_t dataLength);
+
+/*
+ * Function: i2c_statisticsGet
+ * ----------------------------
+ * Kopiert die kumulierte Bus- und Wartezeit eines Geräts.
+ *
+ * i2c_device_t device: angemeldetes Gerät
+ * i2c_statistics_t *statistics: Ziel der Kopie
+ */
+void i2c_statisticsGet(i2c_device_t device, i2c_statistics_t *statistics);
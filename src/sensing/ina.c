@@ -61,9 +61,10 @@ bool ina_init(uint8_t address, uint32_t *rate) {
     ina.forward.data = &ina.voltage;
     // konfiguriere Sensor
     uint8_t config[] = {0x00, 0b00111001, 0b10011111}; // +-320 mV - 532 us - kontinuierlich
-    if (i2c_write(address, config, sizeof(config))) return true;
+    if (i2c_deviceAdd(I2C_DEVICE_INA, address)) return true;
+    if (i2c_write(I2C_DEVICE_INA, config, sizeof(config))) return true;
     uint8_t reg = 0x02;
-    if (i2c_write(address, &reg, 1)) return true; // setze Registerpointer auf "Bus voltage"
+    if (i2c_write(I2C_DEVICE_INA, &reg, 1)) return true; // setze Registerpointer auf "Bus voltage"
     // Task starten
     if (xTaskCreate(&ina_task, "ina", 1 * 1024, NULL, xSensors_PRIORITY - 1, NULL) != pdTRUE) return true;
     return false;
@@ -78,7 +79,7 @@ void ina_task(void* arg) {
         // warte auf nächste Messung
         vTaskDelayUntil(&lastWakeTime, *ina.rate / portTICK_PERIOD_MS);
         // Messung aus Register lesen und umrechnen
-        if (i2c_read(ina.address, raw, 2)) continue;
+        if (i2c_read(I2C_DEVICE_INA, raw, 2)) continue;
         ina.voltage.value = ((uint16_t)(raw[0] << 8 | raw[1]) >> 3) * 0.004f; // LSB: 4 mV -> 0.004 V
         ina.voltage.timestamp = esp_timer_get_time();
         // Spannung weiterleiten an Sensortask
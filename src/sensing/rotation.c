@@ -0,0 +1,69 @@
+/*
+ * File: rotation.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-08-04
+ * ----------------------------
+ * Rotationsmatrix und Eulerwinkel einer BNO-Orientierung. Aus bno.c ausgelagert, da ohne
+ * Hardwareabhängigkeit und so auch in der Simulation (sitl/) verwendbar. Deklarationen in bno.h.
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include "esp_system.h"
+#include <math.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "sensor_types.h"
+#include "bno.h"
+
+
+/** Implementierung **/
+
+bool bno_rotationUpdate(bno_rotation_t *rotation, const sensors_event_t *orientation) {
+    if (rotation->timestamp == orientation->timestamp) return false; // Cache bereits aktuell
+    const orientation_t *q = &orientation->orientation;
+    float ii = q->i * q->i, jj = q->j * q->j, kk = q->k * q->k;
+    float ij = q->i * q->j, ik = q->i * q->k, jk = q->j * q->k;
+    float ir = q->i * q->real, jr = q->j * q->real, kr = q->k * q->real;
+    float (*m)[3] = rotation->matrix;
+    // Rotationsmatrix des Einheitsquaternions
+    m[0][0] = 1.0f - 2.0f * (jj + kk);
+    m[0][1] = 2.0f * (ij - kr);
+    m[0][2] = 2.0f * (ik + jr);
+    m[1][0] = 2.0f * (ij + kr);
+    m[1][1] = 1.0f - 2.0f * (ii + kk);
+    m[1][2] = 2.0f * (jk - ir);
+    m[2][0] = 2.0f * (ik - jr);
+    m[2][1] = 2.0f * (jk + ir);
+    m[2][2] = 1.0f - 2.0f * (ii + jj);
+    // Eulerwinkel direkt aus Matrixelementen (identisch zu bno_toEuler)
+    float sinPitch = -m[2][0];
+    if (sinPitch > 1.0f) sinPitch = 1.0f;
+    if (sinPitch < -1.0f) sinPitch = -1.0f;
+    rotation->euler.x = atan2f(m[2][1], m[2][2]); // roll
+    rotation->euler.y = asinf(sinPitch); // pitch
+    rotation->euler.z = atan2f(m[1][0], m[0][0]); // yaw
+    rotation->timestamp = orientation->timestamp;
+    return true;
+}
+
+void bno_rotationToWorld(vector_t *vector, const bno_rotation_t *rotation) {
+    vector_t v = *vector;
+    const float (*m)[3] = rotation->matrix;
+    vector->x = m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z;
+    vector->y = m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z;
+    vector->z = m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z;
+}
+
+void bno_rotationToLocal(vector_t *vector, const bno_rotation_t *rotation) {
+    // Inverse einer Rotationsmatrix ist ihre Transponierte
+    vector_t v = *vector;
+    const float (*m)[3] = rotation->matrix;
+    vector->x = m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z;
+    vector->y = m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z;
+    vector->z = m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z;
+}
@@ -63,6 +63,7 @@
 #include "flow.h"
 #include "gps.h"
 #include "ina.h"
+#include "uart.h"
 #include "eekf.h"
 #include "sensor_types.h"
 #include "sensors.h"
@@ -70,6 +71,25 @@
 
 /** Variablendeklaration **/
 
+typedef struct { // Eingangsstatistik eines Sensortyps, Zeiten als 32 Bit us da sh2-Zeitstempel so basieren
+    bool started;
+    uint32_t last;              // Zeitstempel des letzten Samples
+    uint32_t windowStart;
+    // laufendes Fenster
+    uint32_t count;
+    float mean, m2;             // Welford für Ankunftsabstand
+    uint32_t min, max;
+    float ageSum;
+    // Resultat des letzten Fensters
+    float rate;                 // Hz
+    uint32_t intervalMin, intervalMax; // us
+    float intervalStd;          // us
+    float age;                  // us, Mittel von Verarbeitung - Zeitstempel
+    // kumuliert seit Start / Reset
+    uint32_t outOfOrder;
+    uint32_t ageHistogram[SENSORS_STATISTICS_BINS];
+} sensors_statistics_t;
+
 struct sensors_t {
     uint32_t timeout; // in us
     uint32_t timedOut; // Bitfeld der inaktiven Sensoren, Bits gem. sensors_event_type_t
@@ -78,7 +98,8 @@ struct sensors_t {
         uint32_t fast;   // schnelle Sensorik: Orientierung
         uint32_t medium; // mittlere Sensorik: Beschleunigung, Ultraschall
         uint32_t slow;   // langsame Sensorik: GPS, Barometer
-    } rate;
+    } rate, rateIdle, rateActive; // ms, rateIdle gilt unbewaffnet (0 -> wie bewaffnet), rateActive ist aktuell gesetzt
+    bool armed;
 
     struct { // Fusion der Z Achse (Altitude)
         eekf_context ekf;
@@ -109,6 +130,7 @@ struct sensors_t {
     struct { // verarbeitete Sensordaten:  Struktur     Elemente        Einheit     Quelle
         sensors_event_t orientation;    // orientation  i j k real      Quaternion  bno
         sensors_event_t euler;          // vector       pitch roll yaw  rad         bno
+        bno_rotation_t rotationCache;   // Rotationsmatrix & Eulerwinkel der Orientierung
         sensors_event_t rotation;       // vector       x y z           rad/s       bno
         sensors_event_t acceleration;   // vector       x y z           m/s^2       bno
         sensors_event_t altitude;       // value                        m           bme
@@ -120,10 +142,14 @@ struct sensors_t {
         // Sensorfusion
         sensors_event_t velocity;       // vector       x y z           m/s         fusion
         sensors_event_t position;       // vector       x y z           m           fusion
-        // Semaphor
-        SemaphoreHandle_t lock;
     } data;
 
+    struct { // Doppelpuffer des Navigationszustands für Leser anderer Tasks
+        sensors_state_t buffer[2];
+        volatile uint32_t generation;   // zuletzt vollständig geschriebene Version
+        volatile uint32_t writing;      // Version die gerade geschrieben wird
+    } state;
+
     struct {
         float altitude;
         float distance;
@@ -139,7 +165,24 @@ struct sensors_t {
         float scaleX;
         float scaleY;
     } flow;
+
+    struct { // Eingang der Orientierung
+        uint32_t source;        // bno_orientation_source_t
+        uint32_t batchInterval; // us, für nicht-Lage Reports des BNO
+        bno_statistics_t bus;   // Buszähler bei letzter Publikation
+        int64_t busTimestamp;
+    } orientationInput;
+
+    struct { // Eingangsstatistik pro Sensortyp
+        uint32_t sensor;        // sensors_event_type_t für stat-PVs
+        sensors_statistics_t input[SENSORS_MAX];
+    } statistics;
 };
+
+// obere Grenzen der Histogrammklassen in us, letzte Klasse nimmt alles Grössere auf
+static const uint32_t sensors_statisticsBins[SENSORS_STATISTICS_BINS - 1] = {250, 500, 1000, 2000, 5000, 10000, 20000};
+static const char *sensors_statisticsNames[SENSORS_MAX] = {"acc", "ori", "rot", "alt", "pos", "spd", "volt", "flow", "lidar"};
+static const char *sensors_i2cNames[I2C_DEVICE_MAX] = {"bno", "ina", "display"};
 static struct sensors_t sensors;
 
 static command_t sensors_commands[SENSORS_COMMAND_MAX] = {
@@ -147,7 +190,14 @@ static command_t sensors_commands[SENSORS_COMMAND_MAX] = {
     COMMAND("setAltimeterToGPS"),
     COMMAND("resetFusion"),
     COMMAND("resetQueue"),
-    COMMAND("updateRate")
+    COMMAND("updateRate"),
+    COMMAND("rateIdle"),
+    COMMAND("rateArmed"),
+    COMMAND("logStatistics"),
+    COMMAND("resetStatistics"),
+    COMMAND("bnoCaptureStart"),
+    COMMAND("bnoCaptureStop"),
+    COMMAND("gpsBackup")
 };
 static COMMAND_LIST("sensors", sensors_commands, SENSORS_COMMAND_MAX);
 
@@ -156,6 +206,9 @@ static setting_t sensors_settings[SENSORS_SETTING_MAX] = {
     SETTING("rateFast",         &sensors.rate.fast,             VALUE_TYPE_UINT),
     SETTING("rateMedium",       &sensors.rate.medium,           VALUE_TYPE_UINT),
     SETTING("rateSlow",         &sensors.rate.slow,             VALUE_TYPE_UINT),
+    SETTING("rateIdleFast",     &sensors.rateIdle.fast,         VALUE_TYPE_UINT),
+    SETTING("rateIdleMedium",   &sensors.rateIdle.medium,       VALUE_TYPE_UINT),
+    SETTING("rateIdleSlow",     &sensors.rateIdle.slow,         VALUE_TYPE_UINT),
 
     SETTING("zErrAccel",        &sensors.Z.errorAcceleration,   VALUE_TYPE_FLOAT),
     SETTING("zErrLidar",        &sensors.Z.errorLidar,          VALUE_TYPE_FLOAT),
@@ -177,7 +230,12 @@ static setting_t sensors_settings[SENSORS_SETTING_MAX] = {
     SETTING("voltLow",          &sensors.voltage.low,           VALUE_TYPE_FLOAT),
 
     SETTING("flowXScale",       &sensors.flow.scaleX,           VALUE_TYPE_FLOAT),
-    SETTING("flowYScale",       &sensors.flow.scaleY,           VALUE_TYPE_FLOAT)
+    SETTING("flowYScale",       &sensors.flow.scaleY,           VALUE_TYPE_FLOAT),
+
+    SETTING("oriSource",        &sensors.orientationInput.source, VALUE_TYPE_UINT), // NVS-Schlüssel max. 15 Zeichen
+    SETTING("bnoBatch",         &sensors.orientationInput.batchInterval, VALUE_TYPE_UINT),
+
+    SETTING("statSensor",       &sensors.statistics.sensor,     VALUE_TYPE_UINT)
 };
 static SETTING_LIST("sensors", sensors_settings, SENSORS_SETTING_MAX);
 
@@ -197,7 +255,23 @@ static pv_t sensors_pvs[SENSORS_PV_MAX] = {
     PV("flowY", VALUE_TYPE_FLOAT),
     PV("gyroX", VALUE_TYPE_FLOAT),
     PV("gyroY", VALUE_TYPE_FLOAT),
-    PV("gyroZ", VALUE_TYPE_FLOAT)
+    PV("gyroZ", VALUE_TYPE_FLOAT),
+    PV("orientationRate", VALUE_TYPE_FLOAT),
+    PV("orientationLatency", VALUE_TYPE_UINT),
+    PV("bnoInterrupts", VALUE_TYPE_UINT),
+    PV("bnoTransfers", VALUE_TYPE_UINT),
+    PV("bnoBusTime", VALUE_TYPE_UINT),
+    PV("bnoBytesPerSample", VALUE_TYPE_FLOAT),
+    PV("statRate", VALUE_TYPE_FLOAT),
+    PV("statIntervalMin", VALUE_TYPE_UINT),
+    PV("statIntervalMax", VALUE_TYPE_UINT),
+    PV("statIntervalStd", VALUE_TYPE_FLOAT),
+    PV("statAge", VALUE_TYPE_UINT),
+    PV("statOutOfOrder", VALUE_TYPE_UINT),
+    PV("gpsTtff", VALUE_TYPE_UINT),
+    PV("timeSync", VALUE_TYPE_UINT),
+    PV("timeDrift", VALUE_TYPE_FLOAT),
+    PV("timeResidual", VALUE_TYPE_INT)
 };
 static PV_LIST("sensors", sensors_pvs, SENSORS_PV_MAX);
 
@@ -216,7 +290,13 @@ void sensors_task(void* arg);
 // ToDo
 static void sensors_processCommand(sensors_command_t command);
 static void sensors_processData(sensors_event_t *event);
+static void sensors_rateSelect();
+static void sensors_rateApply();
 static void sensors_detectTimeout(int64_t timestamp);
+static void sensors_statisticsUpdate(sensors_event_type_t type, int64_t timestamp);
+static void sensors_statisticsPublish(sensors_event_type_t type);
+static void sensors_statisticsLog();
+static void sensors_statePublish(int64_t timestamp);
 static inline void sensors_resetTimeout(sensors_event_type_t sensor);
 static inline void sensors_setTimeout(sensors_event_type_t sensor);
 static void sensors_fuseZ_reset();
@@ -241,22 +321,24 @@ bool sensors_init(gpio_num_t scl, gpio_num_t sda,
                   gpio_num_t gpsRxPin, gpio_num_t gpsTxPin,                         // GPS
                   uint8_t inaAddress) {                                             // INA219
     // Intercom-Queue erstellen
-    xSensors = xQueueCreate(16, sizeof(event_t));
+    xSensors = xQueueCreate(SENSORS_QUEUE_LENGTH, sizeof(event_t));
     // an Intercom anbinden
     commandRegister(xSensors, sensors_commands);
     settingRegister(xSensors, sensors_settings);
     pvRegister(xSensors, sensors_pvs);
-    // Datenzugriffsschutz
-    sensors.data.lock = xSemaphoreCreateMutex();
-    xSemaphoreGive(sensors.data.lock);
     // I2C initialisieren
     bool ret = false;
     ESP_LOGD("sensors", "I2C init");
     ret = i2c_init(scl, sda);
     ESP_LOGD("sensors", "I2C %s", ret ? "error" : "ok");
+    // nach dem Start unbewaffnet, Sensoren laufen mit Ratenprofil idle
+    sensors.armed = false;
+    sensors_rateSelect();
     // BNO initialisieren + Reports für Beschleunigung, Orientierung, Druck und Rotation aktivieren
     ESP_LOGD("sensors", "BNO init");
-    ret = bno_init(bnoAddress, bnoInterrupt, bnoReset, sensors.rate.fast, sensors.rate.medium, sensors.rate.slow, sensors.rate.medium);
+    ret = bno_init(bnoAddress, bnoInterrupt, bnoReset, sensors.rateActive.fast, sensors.rateActive.medium, sensors.rateActive.slow,
+                   sensors.rateActive.medium, (bno_orientation_source_t)sensors.orientationInput.source,
+                   sensors.orientationInput.batchInterval);
     ESP_LOGD("sensors", "BNO %s", ret ? "error" : "ok");
     // Optischer Fluss initialisieren
     ESP_LOGD("sensors", "Flow init");
@@ -264,11 +346,11 @@ bool sensors_init(gpio_num_t scl, gpio_num_t sda,
     ESP_LOGD("sensors", "Flow %s", ret ? "error" : "ok");
     // GPS initialisieren
     ESP_LOGD("sensors", "GPS init");
-    ret = gps_init(gpsRxPin, gpsTxPin, sensors.rate.slow);
+    ret = gps_init(gpsRxPin, gpsTxPin, sensors.rateActive.slow);
     ESP_LOGD("sensors", "GPS %s", ret ? "error" : "ok");
     // Spannungssensor INA initialisieren
     ESP_LOGD("sensors", "INA init");
-    ret = ina_init(inaAddress, &sensors.rate.slow);
+    ret = ina_init(inaAddress, &sensors.rateActive.slow);
     ESP_LOGD("sensors", "INA %s", ret ? "error" : "ok");
     // Kalman Filter Z initialisieren
     EEKF_CALLOC_MATRIX(sensors.Z.x, 2, 1); // 2 States: Position, Geschwindigkeit
@@ -350,8 +432,32 @@ static void sensors_processCommand(sensors_command_t command) {
             xQueueReset(xSensors);
             break;
         case (SENSORS_COMMAND_UPDATE_RATE):
-            bno_updateRate(sensors.rate.fast, sensors.rate.medium, sensors.rate.slow, sensors.rate.medium);
-            gps_updateRate(sensors.rate.slow);
+            sensors_rateApply();
+            break;
+        case (SENSORS_COMMAND_RATE_IDLE):
+            sensors.armed = false;
+            sensors_rateApply();
+            break;
+        case (SENSORS_COMMAND_RATE_ARMED):
+            sensors.armed = true;
+            sensors_rateApply();
+            break;
+        case (SENSORS_COMMAND_STATISTICS_LOG):
+            sensors_statisticsLog();
+            break;
+        case (SENSORS_COMMAND_STATISTICS_RESET):
+            memset(sensors.statistics.input, 0, sizeof(sensors.statistics.input));
+            break;
+        case (SENSORS_COMMAND_BNO_CAPTURE_START):
+            if (bno_captureStart()) ESP_LOGE("sensors", "capture start failed");
+            break;
+        case (SENSORS_COMMAND_BNO_CAPTURE_STOP):
+            bno_captureStop();
+            break;
+        case (SENSORS_COMMAND_GPS_BACKUP):
+            // GNSS wird dafür gestoppt, Position und Geschwindigkeit fehlen einige Sekunden
+            if (sensors.armed) ESP_LOGE("sensors", "gps backup refused while armed");
+            else gps_backup();
             break;
         default:
             break;
@@ -359,13 +465,31 @@ static void sensors_processCommand(sensors_command_t command) {
     return;
 }
 
+static void sensors_rateSelect() {
+    sensors.rateActive = sensors.rate;
+    if (sensors.armed) return;
+    if (sensors.rateIdle.fast) sensors.rateActive.fast = sensors.rateIdle.fast;
+    if (sensors.rateIdle.medium) sensors.rateActive.medium = sensors.rateIdle.medium;
+    if (sensors.rateIdle.slow) sensors.rateActive.slow = sensors.rateIdle.slow;
+}
+
+static void sensors_rateApply() {
+    sensors_rateSelect();
+    // Reports werden einzeln umkonfiguriert, kein Reset vom BNO nötig
+    bno_updateRate(sensors.rateActive.fast, sensors.rateActive.medium, sensors.rateActive.slow, sensors.rateActive.medium,
+                   (bno_orientation_source_t)sensors.orientationInput.source, sensors.orientationInput.batchInterval);
+    gps_updateRate(sensors.rateActive.slow);
+    ESP_LOGD("sensors", "rate %s: %u / %u / %u ms", sensors.armed ? "armed" : "idle",
+             sensors.rateActive.fast, sensors.rateActive.medium, sensors.rateActive.slow);
+}
+
 static void sensors_processData(sensors_event_t *event) {
     int64_t timestamp = event->timestamp;
     sensors_event_type_t type = event->type;
+    // Eingangsstatistik
+    sensors_statisticsUpdate(type, timestamp);
     // Sensorzustand speichern
     sensors.rawData[type] = event;
-    // Datenzugriff sperren
-    if (xSemaphoreTake(sensors.data.lock, SENSORS_DATA_LOCK / portTICK_PERIOD_MS) == pdFALSE) configASSERT(false);
     // Verarbeiten
     switch (type) {
         case (SENSORS_ACCELERATION):
@@ -376,9 +500,9 @@ static void sensors_processData(sensors_event_t *event) {
             break;
         case (SENSORS_ORIENTATION):
             sensors.data.orientation = *event;
-            bno_toEuler(&sensors.data.euler.vector, &sensors.data.orientation.orientation);
+            bno_rotationUpdate(&sensors.data.rotationCache, &sensors.data.orientation);
+            sensors.data.euler.vector = sensors.data.rotationCache.euler;
             sensors.data.euler.timestamp = timestamp;
-            pvPublish(xSensors, SENSORS_PV_ORIENTATION);
             break;
         case (SENSORS_ALTIMETER):
             sensors.data.altitude.value = event->vector.z - sensors.homes.altitude;
@@ -451,7 +575,7 @@ static void sensors_processData(sensors_event_t *event) {
         }
         case (SENSORS_LIDAR): {
             vector_t distance = {.x = 0.0f, .y = 0.0f, .z = -event->value};
-            bno_toWorldFrame(&distance, &sensors.data.orientation.orientation);
+            bno_rotationToWorld(&distance, &sensors.data.rotationCache);
             sensors.data.distance.value = (-distance.z) - sensors.homes.distance;
             sensors.data.distance.timestamp = timestamp;
             sensors_fuseZ(SENSORS_LIDAR, sensors.data.distance.value, timestamp);
@@ -460,16 +584,159 @@ static void sensors_processData(sensors_event_t *event) {
         default:
             break;
     }
-    // Datenzugriff freigeben
-    xSemaphoreGive(sensors.data.lock);
     // Timeoutkontrolle
     uint32_t timedOut = sensors.timedOut;
     sensors_resetTimeout(event->type); // Timeout des aktuellen Sensors zurücksetzen
     sensors_detectTimeout(event->timestamp); // Timeout der anderen Sensoren erkennen
+    // Zustand publizieren, erst danach Abonnenten benachrichtigen
+    sensors_statePublish(timestamp);
+    if (type == SENSORS_ORIENTATION) pvPublish(xSensors, SENSORS_PV_ORIENTATION);
     // bei Änderung ob neuerdings offline oder online, melden
     if (timedOut != sensors.timedOut) pvPublishUint(xSensors, SENSORS_PV_TIMEOUT, sensors.timedOut);
 }
 
+/*
+ * Doppelpuffer mit Versionszähler:
+ * Geschrieben wird immer in den Puffer der nicht zuletzt publiziert wurde. Ein Leser muss seine Kopie
+ * nur verwerfen, wenn währenddessen der Schreiber bereits wieder in seinen Puffer schreibt (writing
+ * mindestens zwei Versionen weiter als die gelesene).
+ */
+static void sensors_statePublish(int64_t timestamp) {
+    uint32_t generation = sensors.state.generation + 1;
+    __atomic_store_n(&sensors.state.writing, generation, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // writing vor Pufferinhalt sichtbar
+    sensors_state_t *state = &sensors.state.buffer[generation & 0x1];
+    state->generation = generation;
+    state->timestamp = timestamp;
+    state->valid = ~sensors.timedOut & ((0x1 << SENSORS_MAX) - 1);
+    state->orientation = sensors.data.orientation;
+    state->rotation = sensors.data.rotationCache;
+    state->rates = sensors.data.rotation;
+    state->position = sensors.data.position;
+    state->velocity = sensors.data.velocity;
+    __atomic_store_n(&sensors.state.generation, generation, __ATOMIC_RELEASE);
+}
+
+void sensors_stateGet(sensors_state_t *state) {
+    uint32_t generation;
+    do {
+        generation = __atomic_load_n(&sensors.state.generation, __ATOMIC_ACQUIRE);
+        *state = sensors.state.buffer[generation & 0x1];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE); // Kopie vor writing lesen
+    } while (__atomic_load_n(&sensors.state.writing, __ATOMIC_RELAXED) - generation >= 2);
+}
+
+static void sensors_statisticsUpdate(sensors_event_type_t type, int64_t timestamp) {
+    sensors_statistics_t *s = &sensors.statistics.input[type];
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    uint32_t time = (uint32_t)timestamp;
+    // Alter des Samples bei Verarbeitung
+    uint32_t age = now - time;
+    uint8_t bin = 0;
+    while (bin < SENSORS_STATISTICS_BINS - 1 && age >= sensors_statisticsBins[bin]) ++bin;
+    ++s->ageHistogram[bin];
+    // erstes Sample startet nur das Fenster
+    if (!s->started) {
+        s->started = true;
+        s->last = time;
+        s->windowStart = time;
+        return;
+    }
+    // Ankunftsabstand, wrap-sicher über 32 Bit
+    int32_t interval = (int32_t)(time - s->last);
+    if (interval < 0) {
+        ++s->outOfOrder;
+        return; // älter als letztes Sample, nicht in Abstand einrechnen
+    }
+    if (interval == 0) return; // Duplikat, z.B. gleicher GPS-Frame
+    s->last = time;
+    ++s->count;
+    float delta = interval - s->mean;
+    s->mean += delta / s->count;
+    s->m2 += delta * (interval - s->mean);
+    if (s->count == 1 || (uint32_t)interval < s->min) s->min = interval;
+    if ((uint32_t)interval > s->max) s->max = interval;
+    s->ageSum += age;
+    // Fenster abschliessen
+    if (time - s->windowStart < SENSORS_STATISTICS_INTERVAL) return;
+    s->rate = (s->mean > 0.0f) ? 1e6f / s->mean : 0.0f;
+    s->intervalMin = s->min;
+    s->intervalMax = s->max;
+    s->intervalStd = (s->count > 1) ? sqrtf(s->m2 / (s->count - 1)) : 0.0f;
+    s->age = s->ageSum / s->count;
+    s->windowStart = time;
+    s->count = 0;
+    s->mean = 0.0f;
+    s->m2 = 0.0f;
+    s->max = 0;
+    s->ageSum = 0.0f;
+    sensors_statisticsPublish(type);
+}
+
+static void sensors_statisticsPublish(sensors_event_type_t type) {
+    sensors_statistics_t *s = &sensors.statistics.input[type];
+    if (type == SENSORS_ORIENTATION) {
+        pvPublishFloat(xSensors, SENSORS_PV_ORIENTATION_RATE, s->rate);
+        pvPublishUint(xSensors, SENSORS_PV_ORIENTATION_LATENCY, (uint32_t)s->age);
+        // Buslast des BNO im selben Fenster, auf eine Sekunde normiert
+        bno_statistics_t bus;
+        bno_statisticsGet(&bus);
+        int64_t now = esp_timer_get_time();
+        float scale = 1e6f / (now - sensors.orientationInput.busTimestamp);
+        if (sensors.orientationInput.busTimestamp) {
+            pvPublishUint(xSensors, SENSORS_PV_BNO_INTERRUPTS, (bus.interrupts - sensors.orientationInput.bus.interrupts) * scale);
+            pvPublishUint(xSensors, SENSORS_PV_BNO_TRANSFERS, (bus.transfers - sensors.orientationInput.bus.transfers) * scale);
+            pvPublishUint(xSensors, SENSORS_PV_BNO_BUS_TIME, (bus.busTime - sensors.orientationInput.bus.busTime) * scale);
+            uint32_t samples = bus.orientations - sensors.orientationInput.bus.orientations;
+            if (samples) pvPublishFloat(xSensors, SENSORS_PV_BNO_BYTES_PER_SAMPLE,
+                                        (float)(bus.bytes - sensors.orientationInput.bus.bytes) / samples);
+        }
+        sensors.orientationInput.bus = bus;
+        sensors.orientationInput.busTimestamp = now;
+    }
+    if (type != sensors.statistics.sensor) return;
+    pvPublishFloat(xSensors, SENSORS_PV_STATISTICS_RATE, s->rate);
+    pvPublishUint(xSensors, SENSORS_PV_STATISTICS_INTERVAL_MIN, s->intervalMin);
+    pvPublishUint(xSensors, SENSORS_PV_STATISTICS_INTERVAL_MAX, s->intervalMax);
+    pvPublishFloat(xSensors, SENSORS_PV_STATISTICS_INTERVAL_STD, s->intervalStd);
+    pvPublishUint(xSensors, SENSORS_PV_STATISTICS_AGE, (uint32_t)s->age);
+    pvPublishUint(xSensors, SENSORS_PV_STATISTICS_OUT_OF_ORDER, s->outOfOrder);
+}
+
+static void sensors_statisticsLog() {
+    // kompakt: name rate Hz min/max/std us, mittleres Alter us, out-of-order, Alter-Histogramm
+    char buffer[1024];
+    size_t length = 0;
+    for (sensors_event_type_t i = 0; i < SENSORS_MAX && length < sizeof(buffer); ++i) {
+        sensors_statistics_t *s = &sensors.statistics.input[i];
+        length += snprintf(buffer + length, sizeof(buffer) - length, "%s %.1f %u/%u/%.0f %.0f %u [%u",
+                           sensors_statisticsNames[i], s->rate, s->intervalMin, s->intervalMax, s->intervalStd,
+                           s->age, s->outOfOrder, s->ageHistogram[0]);
+        for (uint8_t j = 1; j < SENSORS_STATISTICS_BINS && length < sizeof(buffer); ++j) {
+            length += snprintf(buffer + length, sizeof(buffer) - length, ",%u", s->ageHistogram[j]);
+        }
+        if (length < sizeof(buffer)) length += snprintf(buffer + length, sizeof(buffer) - length, "]; ");
+    }
+    ESP_LOGI("sensors", "statistics: %s", buffer);
+    // zusammengefasste Interrupts und Überläufe der Treiber
+    bno_statistics_t bus;
+    uart_statistics_t gps, flow;
+    bno_statisticsGet(&bus);
+    uart_statisticsGet(GPS_UART, &gps);
+    uart_statisticsGet(FLOW_UART, &flow);
+    ESP_LOGI("sensors", "coalesced: bno %u gps %u flow %u; overflows (ring/fifo): gps %u/%u flow %u/%u", bus.coalesced,
+             gps.coalesced, flow.coalesced, gps.rxOverflows, gps.fifoOverflows, flow.rxOverflows, flow.fifoOverflows);
+    // kumulierte Bus- und Wartezeit pro I2C-Gerät, Wartezeit zeigt wie lange wichtigere Geräte den Bus belegen
+    length = 0;
+    for (i2c_device_t i = 0; i < I2C_DEVICE_MAX && length < sizeof(buffer); ++i) {
+        i2c_statistics_t s;
+        i2c_statisticsGet(i, &s);
+        length += snprintf(buffer + length, sizeof(buffer) - length, "%s %u/%u %u %u/%u; ", sensors_i2cNames[i],
+                           s.transfers, s.errors, s.busTime, s.transfers ? s.waitTime / s.transfers : 0, s.waitMax);
+    }
+    ESP_LOGI("sensors", "i2c (transfers/errors, bus us, wait mean/max us): %s", buffer);
+}
+
 static void sensors_detectTimeout(int64_t timestamp) {
     for (sensors_event_type_t i = 0; i < SENSORS_MAX; ++i) {
         if (!sensors.rawData[i]) {
@@ -562,8 +829,10 @@ static void sensors_fuseZ(sensors_event_type_t type, float z, int64_t timestamp)
     //ESP_LOGD("sensors", "Fz,%f,%f,Z,%f,%f,%f", *EEKF_MAT_EL(sensors.Z.x, 0, 0), *EEKF_MAT_EL(sensors.Z.x, 1, 0), *EEKF_MAT_EL(sensors.Z.z, 0, 0), *EEKF_MAT_EL(sensors.Z.z, 1, 0), *EEKF_MAT_EL(sensors.Z.z, 2, 0));
     // Publish
     sensors.data.position.vector.z = *EEKF_MAT_EL(sensors.Z.x, 0, 0);
+    sensors.data.position.timestamp = timestamp;
     pvPublishFloat(xSensors, SENSORS_PV_Z, *EEKF_MAT_EL(sensors.Z.x, 0, 0));
     sensors.data.velocity.vector.z = *EEKF_MAT_EL(sensors.Z.x, 1, 0);
+    sensors.data.velocity.timestamp = timestamp;
     pvPublishFloat(xSensors, SENSORS_PV_VZ, *EEKF_MAT_EL(sensors.Z.x, 1, 0));
 }
 
@@ -680,8 +949,10 @@ static void sensors_fuseY(sensors_event_type_t type, float y, int64_t timestamp)
     //ESP_LOGD("sensors", "Fy,%f,%f,Z,%f,%f", *EEKF_MAT_EL(sensors.Y.x, 0, 0), *EEKF_MAT_EL(sensors.Y.x, 1, 0), *EEKF_MAT_EL(sensors.Y.z, 0, 0), *EEKF_MAT_EL(sensors.Y.z, 1, 0));
     // Publish
     sensors.data.position.vector.y = *EEKF_MAT_EL(sensors.Y.x, 0, 0);
+    sensors.data.position.timestamp = timestamp;
     pvPublishFloat(xSensors, SENSORS_PV_Y, *EEKF_MAT_EL(sensors.Y.x, 0, 0));
     sensors.data.velocity.vector.y = *EEKF_MAT_EL(sensors.Y.x, 1, 0);
+    sensors.data.velocity.timestamp = timestamp;
     pvPublishFloat(xSensors, SENSORS_PV_VY, *EEKF_MAT_EL(sensors.Y.x, 1, 0));
 }
 
@@ -795,8 +1066,10 @@ static void sensors_fuseX(sensors_event_type_t type, float x, int64_t timestamp)
     //ESP_LOGD("sensors", "Fx,%f,%f,Z,%f,%f", *EEKF_MAT_EL(sensors.X.x, 0, 0), *EEKF_MAT_EL(sensors.X.x, 1, 0), *EEKF_MAT_EL(sensors.X.z, 0, 0), *EEKF_MAT_EL(sensors.X.z, 1, 0));
     // Publish
     sensors.data.position.vector.x = *EEKF_MAT_EL(sensors.X.x, 0, 0);
+    sensors.data.position.timestamp = timestamp;
     pvPublishFloat(xSensors, SENSORS_PV_X, *EEKF_MAT_EL(sensors.X.x, 0, 0));
     sensors.data.velocity.vector.x = *EEKF_MAT_EL(sensors.X.x, 1, 0);
+    sensors.data.velocity.timestamp = timestamp;
     pvPublishFloat(xSensors, SENSORS_PV_VX, *EEKF_MAT_EL(sensors.X.x, 1, 0));
 }
 
@@ -48,9 +48,17 @@
 #include "driver/gpio.h"
 
 
+/** Interne Abhängigkeiten **/
+
+#include "sensor_types.h"
+#include "bno.h"
+
+
 /** Compiler Einstellungen **/
 
-#define SENSORS_DATA_LOCK       10
+#define SENSORS_QUEUE_LENGTH            (16 + BNO_BATCH_MAX) // Events, ein ganzer Batch des BNO passt hinein
+#define SENSORS_STATISTICS_INTERVAL     1000000 // us, Auswertefenster und Publikationsintervall der Eingangsstatistik
+#define SENSORS_STATISTICS_BINS         8       // Anzahl Klassen im Histogramm des Sample-Alters
 
 
 /** Befehle **/
@@ -61,6 +69,13 @@ typedef enum {
     SENSORS_COMMAND_RESET_FUSION,
     SENSORS_COMMAND_RESET_QUEUE,
     SENSORS_COMMAND_UPDATE_RATE,
+    SENSORS_COMMAND_RATE_IDLE,      // Ratenprofil für unbewaffneten Zustand
+    SENSORS_COMMAND_RATE_ARMED,     // Ratenprofil für bewaffneten Zustand
+    SENSORS_COMMAND_STATISTICS_LOG,     // Eingangsstatistik aller Sensoren als eine Meldung loggen
+    SENSORS_COMMAND_STATISTICS_RESET,
+    SENSORS_COMMAND_BNO_CAPTURE_START,  // SHTP-Transfers aufzeichnen, Download unter /bno.shtp
+    SENSORS_COMMAND_BNO_CAPTURE_STOP,
+    SENSORS_COMMAND_GPS_BACKUP,         // Zustand des GPS-Empfängers per UBX-UPD-SOS sichern
     SENSORS_COMMAND_MAX
 } sensors_command_t;
 
@@ -73,6 +88,9 @@ typedef enum {
     SENSOR_SETTING_RATE_FAST,
     SENSOR_SETTING_RATE_MEDIUM,
     SENSOR_SETTING_RATE_SLOW,
+    SENSOR_SETTING_RATE_IDLE_FAST,
+    SENSOR_SETTING_RATE_IDLE_MEDIUM,
+    SENSOR_SETTING_RATE_IDLE_SLOW,
     // Fuse Z
     SENSORS_SETTING_FUSE_Z_ERROR_ACCELERATION,
     SENSORS_SETTING_FUSE_Z_ERROR_ULTRASONIC,
@@ -95,6 +113,11 @@ typedef enum {
     // Flow Skalierung
     SENSORS_SETTING_FLOW_SCALE_X,
     SENSORS_SETTING_FLOW_SCALE_Y,
+    // Orientierung
+    SENSORS_SETTING_ORIENTATION_SOURCE,
+    SENSORS_SETTING_BNO_BATCH,          // us, Batchintervall für Beschleunigung & Barometer, max. BNO_BATCH_MAX Reports
+    // Eingangsstatistik
+    SENSORS_SETTING_STATISTICS_SENSOR,  // sensors_event_type_t, welcher Sensor in den stat-PVs publiziert wird
     SENSORS_SETTING_MAX
 } sensors_setting_t;
 
@@ -121,10 +144,40 @@ typedef enum {
     SENSORS_PV_GYRO_X,
     SENSORS_PV_GYRO_Y,
     SENSORS_PV_GYRO_Z,
+    SENSORS_PV_ORIENTATION_RATE,
+    SENSORS_PV_ORIENTATION_LATENCY,
+    SENSORS_PV_BNO_INTERRUPTS,          // pro Sekunde
+    SENSORS_PV_BNO_TRANSFERS,           // I2C Lesezugriffe pro Sekunde
+    SENSORS_PV_BNO_BUS_TIME,            // us Buszeit pro Sekunde
+    SENSORS_PV_BNO_BYTES_PER_SAMPLE,    // gelesene I2C Bytes pro Orientierung
+    SENSORS_PV_STATISTICS_RATE,
+    SENSORS_PV_STATISTICS_INTERVAL_MIN,
+    SENSORS_PV_STATISTICS_INTERVAL_MAX,
+    SENSORS_PV_STATISTICS_INTERVAL_STD,
+    SENSORS_PV_STATISTICS_AGE,
+    SENSORS_PV_STATISTICS_OUT_OF_ORDER,
+    SENSORS_PV_GPS_TTFF,                // ms bis zum ersten Fix
+    SENSORS_PV_TIME_SYNC,               // timebase_sync_t der GPS-Zeit
+    SENSORS_PV_TIME_DRIFT,              // ppm, Gangabweichung GPS gegenüber esp_timer
+    SENSORS_PV_TIME_RESIDUAL,           // us, Fehler der letzten Korrektur
     SENSORS_PV_MAX
 } sensors_pv_t;
 
 
+/** Navigationszustand **/
+
+typedef struct { // unveränderlicher Schnappschuss des Systemstatus, alle Werte mit eigenem Zeitstempel
+    uint32_t generation;            // Version, bei jeder Aktualisierung inkrementiert
+    int64_t timestamp;              // Zeitpunkt der letzten Aktualisierung
+    uint32_t valid;                 // Bitfeld der aktiven Sensoren, Bits gem. sensors_event_type_t
+    sensors_event_t orientation;    // orientation  i j k real      Quaternion
+    bno_rotation_t rotation;        // Rotationsmatrix & Eulerwinkel der Orientierung
+    sensors_event_t rates;          // vector       x y z           rad/s
+    sensors_event_t position;       // vector       x y z           m       (Fusion)
+    sensors_event_t velocity;       // vector       x y z           m/s     (Fusion)
+} sensors_state_t;
+
+
 /*
  * Function: sensors_init
  * ----------------------------
@@ -147,3 +200,13 @@ bool sensors_init(gpio_num_t scl, gpio_num_t sda,
                   gpio_num_t flowRxPin,                                             // Optischer Fluss & Lidar
                   gpio_num_t gpsRxPin, gpio_num_t gpsTxPin,
                   uint8_t inaAddress);
+
+/*
+ * Function: sensors_stateGet
+ * ----------------------------
+ * Kopiert den zuletzt publizierten Navigationszustand. Blockiert nicht und benötigt keinen Mutex,
+ * kann somit aus jedem Task aufgerufen werden.
+ *
+ * sensors_state_t *state: Ziel der Kopie
+ */
+void sensors_stateGet(sensors_state_t *state);
@@ -0,0 +1,250 @@
+/*
+ * File: timebase.c
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-07-24
+ * ----------------------------
+ * Gemeinsame Zeitbasis aller Sensoren.
+ * Modell einer Uhr: lokal = Quelle + offset + drift * (Quelle - reference).
+ * Beobachtungen (Quelle, lokal) enthalten eine nicht negative Latenz, pro Fenster wird deshalb nur die
+ * Beobachtung mit kleinstem Residual (untere Einhüllende) verwendet. Offset und Drift werden damit
+ * wie bei einer PLL proportional und integral nachgeführt.
+ */
+
+
+/** Externe Abhängigkeiten **/
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+
+
+/** Interne Abhängigkeiten **/
+
+#include "intercom.h"
+#include "resources.h"
+#include "sensors.h"
+#include "timebase.h"
+
+
+/** Variablendeklaration **/
+
+#define TIMEBASE_WEEK_MS    604800000LL
+#define TIMEBASE_LATENCY    50000   // us, Startwert der NAV-PVT Latenz bis PPS diese gemessen hat
+
+typedef struct {
+    bool locked;
+    int64_t reference;      // us, Quellzeit des Ankers
+    int64_t offset;         // us, lokal - Quelle am Anker
+    float drift;            // us/us
+    // Fenster der unteren Einhüllenden
+    int64_t windowStart;    // us, lokal
+    int64_t windowResidual;
+    int64_t windowRemote;
+    int32_t residual;       // Fehler der letzten Korrektur
+} timebase_clock_t;
+
+static struct {
+    portMUX_TYPE lock;      // schützt das Modell gegen Leser aus anderen Tasks
+    timebase_clock_t gps;
+    timebase_sync_t sync;
+    int32_t latency;        // us, NAV-PVT Frameanfang nach Epoche
+    uint32_t weeks;         // Wochenwechsel seit Start
+    uint32_t lastItow;
+    struct {
+        volatile uint32_t edge; // us, untere 32 Bit von esp_timer, vom ISR geschrieben
+        volatile uint32_t count;
+        uint32_t seen;
+        int64_t last;           // us, lokal, letzte zugeordnete Flanke
+    } pps;
+} timebase = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+    .latency = TIMEBASE_LATENCY
+};
+
+
+/** Private Functions **/
+
+/*
+ * Function: timebase_ppsInterrupt
+ * ----------------------------
+ * ISR der PPS-Flanke. Merkt sich nur den Zeitpunkt, die Zuordnung zur GPS-Sekunde macht der GPS-Task.
+ *
+ * void* arg: Dummy
+ */
+static void timebase_ppsInterrupt(void* arg);
+
+/*
+ * Function: timebase_observe
+ * ----------------------------
+ * Beobachtung einer Uhr. Rastet beim ersten Aufruf ein, danach wird pro Fenster korrigiert.
+ *
+ * timebase_clock_t *clock: zu führende Uhr
+ * int64_t remote: us, Zeit der Quelle
+ * int64_t local: us, gleicher Zeitpunkt in esp_timer zuzüglich unbekannter Latenz
+ * int64_t window: us, Länge des Fensters
+ *
+ * returns: true -> Fenster abgeschlossen und Modell korrigiert
+ */
+static bool timebase_observe(timebase_clock_t *clock, int64_t remote, int64_t local, int64_t window);
+
+/*
+ * Function: timebase_map
+ * ----------------------------
+ * Bildet Quellzeit nach lokal ab. Aufrufer hält den Lock oder ist der einzige Schreiber.
+ */
+static int64_t timebase_map(const timebase_clock_t *clock, int64_t remote);
+
+
+/** Implementierung **/
+
+bool timebase_ppsInit(gpio_num_t ppsPin) {
+    gpio_config_t gpioConfig;
+    gpioConfig.pin_bit_mask = 1ULL << ppsPin;
+    gpioConfig.mode = GPIO_MODE_INPUT;
+    gpioConfig.pull_up_en = GPIO_PULLUP_DISABLE;
+    gpioConfig.pull_down_en = GPIO_PULLDOWN_ENABLE;
+    gpioConfig.intr_type = GPIO_INTR_POSEDGE;
+    if (gpio_config(&gpioConfig)) return true;
+    gpio_install_isr_service(ESP_INTR_FLAG_IRAM); // bereits installiert falls BNO vorab initialisiert
+    if (gpio_isr_handler_add(ppsPin, &timebase_ppsInterrupt, NULL)) return true;
+    return false;
+}
+
+void timebase_gpsEpoch(uint32_t iTow, int64_t timestamp) {
+    // iTOW über Wochenwechsel fortsetzen
+    if (iTow < timebase.lastItow && timebase.lastItow - iTow > TIMEBASE_WEEK_MS / 2) ++timebase.weeks;
+    timebase.lastItow = iTow;
+    int64_t gpsTime = (timebase.weeks * TIMEBASE_WEEK_MS + iTow) * 1000;
+    int64_t epoch = timestamp - timebase.latency; // lokaler Zeitpunkt der Epoche
+    bool corrected = false;
+    // neue PPS-Flanke der vollen Sekunde zuordnen, in der sie laut iTOW lag
+    uint32_t count = timebase.pps.count;
+    uint32_t edgeLow = timebase.pps.edge;
+    if (count != timebase.pps.seen && count == timebase.pps.count) {
+        timebase.pps.seen = count;
+        int64_t edge = timestamp - (uint32_t)((uint32_t)timestamp - edgeLow);
+        if (timestamp - edge < 1000000) {
+            int64_t second = (gpsTime - (epoch - edge) + 500000) / 1000000 * 1000000;
+            portENTER_CRITICAL(&timebase.lock);
+            corrected = timebase_observe(&timebase.gps, second, edge, TIMEBASE_WINDOW_PPS);
+            portEXIT_CRITICAL(&timebase.lock);
+            timebase.pps.last = edge;
+        }
+    }
+    if (timebase.pps.last && timestamp - timebase.pps.last < TIMEBASE_PPS_TIMEOUT) {
+        // mit PPS wird die Latenz des NAV-PVT gemessen, hilft falls PPS später ausfällt
+        timebase.sync = TIMEBASE_SYNC_PPS;
+        int32_t latency = timestamp - timebase_map(&timebase.gps, gpsTime);
+        if (latency > 0 && latency < 1000000) timebase.latency += (latency - timebase.latency) / 8;
+    } else {
+        timebase.sync = TIMEBASE_SYNC_ITOW;
+        portENTER_CRITICAL(&timebase.lock);
+        corrected = timebase_observe(&timebase.gps, gpsTime, epoch, TIMEBASE_WINDOW_ITOW);
+        portEXIT_CRITICAL(&timebase.lock);
+    }
+    if (!corrected) return;
+    pvPublishFloat(xSensors, SENSORS_PV_TIME_DRIFT, timebase.gps.drift * 1e6f);
+    pvPublishInt(xSensors, SENSORS_PV_TIME_RESIDUAL, timebase.gps.residual);
+    pvPublishUint(xSensors, SENSORS_PV_TIME_SYNC, timebase.sync);
+}
+
+bool timebase_toLocal(timebase_source_t source, int64_t timestamp, int64_t *local) {
+    switch (source) {
+        case (TIMEBASE_LOCAL):
+            *local = timestamp;
+            return false;
+        case (TIMEBASE_SH2): {
+            // sh2 rechnet mit den esp_timer Zeitstempeln der Interrupts, erweitert diese aber mit eigenem
+            // Überlaufzähler auf 64 Bit. Untere 32 Bit zur aktuellen Zeit hin erweitern, Sample liegt nahe.
+            int64_t now = esp_timer_get_time();
+            *local = now - (int32_t)((uint32_t)now - (uint32_t)timestamp);
+            return false;
+        }
+        case (TIMEBASE_GPS): {
+            portENTER_CRITICAL(&timebase.lock);
+            bool error = !timebase.gps.locked;
+            *local = timebase_map(&timebase.gps, timestamp);
+            portEXIT_CRITICAL(&timebase.lock);
+            return error;
+        }
+        default:
+            return true;
+    }
+}
+
+bool timebase_fromLocal(timebase_source_t source, int64_t local, int64_t *timestamp) {
+    switch (source) {
+        case (TIMEBASE_LOCAL):
+        case (TIMEBASE_SH2): // gleiche Zeitbasis, nur andere Erweiterung der oberen Bits
+            *timestamp = local;
+            return false;
+        case (TIMEBASE_GPS): {
+            portENTER_CRITICAL(&timebase.lock);
+            const timebase_clock_t *clock = &timebase.gps;
+            bool error = !clock->locked;
+            // Umkehrung in erster Ordnung, Drift ist klein
+            int64_t delta = local - clock->offset - clock->reference;
+            *timestamp = clock->reference + delta - (int64_t)(clock->drift * delta);
+            portEXIT_CRITICAL(&timebase.lock);
+            return error;
+        }
+        default:
+            return true;
+    }
+}
+
+void timebase_statusGet(timebase_status_t *status) {
+    portENTER_CRITICAL(&timebase.lock);
+    status->sync = timebase.gps.locked ? timebase.sync : TIMEBASE_SYNC_NONE;
+    status->offset = timebase.gps.offset;
+    status->drift = timebase.gps.drift * 1e6f;
+    status->residual = timebase.gps.residual;
+    status->latency = timebase.latency;
+    portEXIT_CRITICAL(&timebase.lock);
+}
+
+static void IRAM_ATTR timebase_ppsInterrupt(void* arg) {
+    timebase.pps.edge = esp_timer_get_time();
+    ++timebase.pps.count; // nach edge, Task prüft count vor und nach dem Lesen
+}
+
+static bool timebase_observe(timebase_clock_t *clock, int64_t remote, int64_t local, int64_t window) {
+    if (!clock->locked) {
+        clock->locked = true;
+        clock->reference = remote;
+        clock->offset = local - remote;
+        clock->drift = 0.0f;
+        clock->windowStart = local;
+        clock->windowResidual = INT64_MAX;
+        return false;
+    }
+    int64_t residual = local - timebase_map(clock, remote);
+    if (residual < clock->windowResidual) { // untere Einhüllende, kleinste Latenz
+        clock->windowResidual = residual;
+        clock->windowRemote = remote;
+    }
+    if (local - clock->windowStart < window) return false;
+    // Fenster abschliessen, Anker auf die beste Beobachtung verschieben
+    residual = clock->windowResidual;
+    int64_t span = clock->windowRemote - clock->reference;
+    clock->offset += (int64_t)(clock->drift * span);
+    clock->reference = clock->windowRemote;
+    if (llabs(residual) > TIMEBASE_STEP) { // Sprung, z.B. nach Neustart des GPS
+        clock->offset += residual;
+    } else {
+        clock->offset += (int64_t)(TIMEBASE_OFFSET_GAIN * residual);
+        if (span > 0) clock->drift += TIMEBASE_DRIFT_GAIN * residual / span;
+        if (clock->drift > TIMEBASE_DRIFT_MAX) clock->drift = TIMEBASE_DRIFT_MAX;
+        else if (clock->drift < -TIMEBASE_DRIFT_MAX) clock->drift = -TIMEBASE_DRIFT_MAX;
+    }
+    clock->residual = residual;
+    clock->windowStart = local;
+    clock->windowResidual = INT64_MAX;
+    return true;
+}
+
+static int64_t timebase_map(const timebase_clock_t *clock, int64_t remote) {
+    return remote + clock->offset + (int64_t)(clock->drift * (remote - clock->reference));
+}
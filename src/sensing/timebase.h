@@ -0,0 +1,112 @@
+/*
+ * File: timebase.h
+ * ----------------------------
+ * Author: Niklaus Leuenberger
+ * Date:   2020-07-24
+ * ----------------------------
+ * Gemeinsame Zeitbasis aller Sensoren. Referenz ist esp_timer in us, monoton seit dem Start.
+ * Zeitstempel anderer Uhren werden über Offset und Drift in diese Zeitbasis abgebildet.
+ * Die GPS-Zeit wird per iTOW aus UBX-NAV-PVT und wenn vorhanden per PPS-Flanke nachgeführt.
+ */
+
+
+#pragma once
+
+
+/** Externe Abhängigkeiten **/
+
+#include "esp_system.h"
+#include "driver/gpio.h"
+
+
+/** Einstellungen **/
+
+#define TIMEBASE_WINDOW_PPS     1000000 // us, Fenster der unteren Einhüllenden, eine Korrektur pro Fenster
+#define TIMEBASE_WINDOW_ITOW    10000000 // us, länger da die Latenz des NAV-PVT um ms streut
+#define TIMEBASE_OFFSET_GAIN    0.5f    // Anteil des Offsetfehlers der pro Fenster korrigiert wird
+#define TIMEBASE_DRIFT_GAIN     0.1f    // Anteil des Fehlers der pro Fenster in die Drift einfliesst
+#define TIMEBASE_DRIFT_MAX      500e-6f // maximal angenommene Gangabweichung zweier Quarze
+#define TIMEBASE_STEP           100000  // us, grössere Abweichung -> neu einrasten statt nachführen
+#define TIMEBASE_PPS_TIMEOUT    2000000 // us ohne PPS-Flanke -> wieder iTOW
+
+
+/** Variablendeklaration **/
+
+typedef enum {
+    TIMEBASE_LOCAL = 0, // esp_timer, gemeinsame Zeitbasis aller sensors_event_t.timestamp
+    TIMEBASE_SH2,       // Sample-Zeitstempel der sh2-Lib (BNO)
+    TIMEBASE_GPS,       // GPS-Zeit in us seit Beginn der ersten empfangenen GPS-Woche
+    TIMEBASE_MAX
+} timebase_source_t;
+
+typedef enum {
+    TIMEBASE_SYNC_NONE = 0,
+    TIMEBASE_SYNC_ITOW,     // über Empfangszeit von UBX-NAV-PVT, Latenz des Empfängers geschätzt
+    TIMEBASE_SYNC_PPS       // über PPS-Flanke
+} timebase_sync_t;
+
+typedef struct {
+    timebase_sync_t sync;
+    int64_t offset;     // us, lokal - GPS-Zeit
+    float drift;        // ppm, Gangabweichung des GPS gegenüber esp_timer
+    int32_t residual;   // us, Fehler der letzten Korrektur
+    int32_t latency;    // us, Verzögerung von Epoche bis Frameanfang UBX-NAV-PVT
+} timebase_status_t;
+
+
+/*
+ * Function: timebase_ppsInit
+ * ----------------------------
+ * Aktiviert die Erfassung der PPS-Flanke des GPS. Ohne PPS wird nur per iTOW nachgeführt.
+ *
+ * gpio_num_t ppsPin: Eingang des PPS-Signals, steigende Flanke entspricht voller GPS-Sekunde
+ *
+ * returns: false -> Erfolg, true -> Error
+ */
+bool timebase_ppsInit(gpio_num_t ppsPin);
+
+/*
+ * Function: timebase_gpsEpoch
+ * ----------------------------
+ * Beobachtung einer Navigationsepoche. Wird vom GPS-Task für jedes UBX-NAV-PVT mit gültiger Zeit
+ * aufgerufen und ordnet auch eine zwischenzeitlich erfasste PPS-Flanke der richtigen Sekunde zu.
+ *
+ * uint32_t iTow: ms, GPS time of week der Epoche
+ * int64_t timestamp: us, lokaler Zeitpunkt des Frameanfangs
+ */
+void timebase_gpsEpoch(uint32_t iTow, int64_t timestamp);
+
+/*
+ * Function: timebase_toLocal
+ * ----------------------------
+ * Bildet einen Zeitstempel einer Quelle in die gemeinsame Zeitbasis ab.
+ *
+ * timebase_source_t source: Uhr des Zeitstempels
+ * int64_t timestamp: us, Zeitstempel der Quelle
+ * int64_t *local: us, Zeitstempel in esp_timer
+ *
+ * returns: false -> Erfolg, true -> Error (Quelle noch nicht synchronisiert)
+ */
+bool timebase_toLocal(timebase_source_t source, int64_t timestamp, int64_t *local);
+
+/*
+ * Function: timebase_fromLocal
+ * ----------------------------
+ * Bildet einen Zeitstempel der gemeinsamen Zeitbasis in die Uhr einer Quelle ab.
+ *
+ * timebase_source_t source: Ziel-Uhr
+ * int64_t local: us, Zeitstempel in esp_timer
+ * int64_t *timestamp: us, Zeitstempel der Quelle
+ *
+ * returns: false -> Erfolg, true -> Error (Quelle noch nicht synchronisiert)
+ */
+bool timebase_fromLocal(timebase_source_t source, int64_t local, int64_t *timestamp);
+
+/*
+ * Function: timebase_statusGet
+ * ----------------------------
+ * Kopiert den Zustand der GPS-Synchronisation.
+ *
+ * timebase_status_t *status: Ziel der Kopie
+ */
+void timebase_statusGet(timebase_status_t *status);
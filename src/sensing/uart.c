@@ -5,13 +5,18 @@
  * Date:   2020-07-20
  * ----------------------------
  * UART Treiber für simplerere Handhabung gegenüber idf Treiber.
+ * Ringbuffer mit freilaufenden Indizes: head wird nur vom Produzenten, tail nur vom Konsumenten
+ * geschrieben. Für rx ist der ISR Produzent, für tx Konsument.
  */
 
 
 /** Externe Abhängigkeiten **/
 
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <string.h>
 
 
 /** Interne Abhängigkeiten **/
@@ -21,18 +26,44 @@
 
 /** Variablendeklaration **/
 
+#define UART_RX_MASK (UART_RX_BUFFER_SIZE - 1)
+#define UART_TX_MASK (UART_TX_BUFFER_SIZE - 1)
+#define UART_ANCHOR_MASK (UART_RX_ANCHORS - 1)
+
+typedef struct {
+    uint8_t *buffer;
+    volatile uint32_t head; // nur vom Produzenten geschrieben
+    volatile uint32_t tail; // nur vom Konsumenten geschrieben
+} uart_ring_t;
+
+typedef struct {
+    uint32_t position;      // Stromposition nach dem letzten Byte des Batches
+    int64_t time;           // us, Ende des letzten Bytes des Batches
+} uart_anchor_t;
+
+typedef struct {
+    uart_ring_t rx;
+    uart_anchor_t anchors[UART_RX_ANCHORS];
+    uint32_t anchorCount;
+    uint32_t byteNs;        // Dauer eines Bytes (Start, 8 Daten, Stop) in ns
+    uart_ring_t tx;
+    TaskHandle_t task;      // wird bei rx mit Zeitstempel benachrichtigt
+    portMUX_TYPE lock;      // schützt int_ena und anchors gegen gleichzeitigen Zugriff von Task und ISR
+    uart_statistics_t statistics;
+} uart_port_state_t;
+
 extern uart_dev_t UART0;
 extern uart_dev_t UART1;
 extern uart_dev_t UART2;
 DRAM_ATTR uart_dev_t* const UART[UART_NUM_MAX] = {&UART0, &UART1, &UART2};
-static QueueHandle_t rxQueues[UART_NUM_MAX]; // Queues die bei rx mit Zeitstempeln gefüllt wird
-static int64_t rxDelaysUs[UART_NUM_MAX]; // Zeit die zum Empfang von einem Byte benötigt wird
+static DRAM_ATTR uart_port_state_t ports[UART_NUM_MAX];
 
 
 /*
  * Function: uart_interrupt
  * ----------------------------
- * ISR. Ausgeführt bei UART-Events. Setzt UART zurück bei Fehler oder füllt Queues.
+ * ISR. Ausgeführt bei UART-Events. Leert den rx-FIFO in den Ringbuffer, benachrichtigt
+ * wartenden Task und füllt den tx-FIFO nach.
  *
  * void* arg: [(uart_port_t) uartNum]: entsprechende UART-Nummer
  */
@@ -41,8 +72,20 @@ static void uart_interrupt(void* arg);
 
 /** Implementierung **/
 
-bool uart_init(uart_port_t uartNum, gpio_num_t txPin, gpio_num_t rxPin, uint32_t baud_rate, QueueHandle_t rxTimestamp) {
+bool uart_init(uart_port_t uartNum, gpio_num_t txPin, gpio_num_t rxPin, uint32_t baud_rate) {
     uart_dev_t *uart = UART[uartNum];
+    uart_port_state_t *port = &ports[uartNum];
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    port->lock = unlocked;
+    // Ringbuffer
+    if (rxPin != UART_PIN_NO_CHANGE && !port->rx.buffer) {
+        port->rx.buffer = malloc(UART_RX_BUFFER_SIZE);
+        if (!port->rx.buffer) return true;
+    }
+    if (txPin != UART_PIN_NO_CHANGE && !port->tx.buffer) {
+        port->tx.buffer = malloc(UART_TX_BUFFER_SIZE);
+        if (!port->tx.buffer) return true;
+    }
     // Aktivieren
     periph_module_enable(uartNum + 1);
     // Data-Bits
@@ -63,15 +106,15 @@ bool uart_init(uart_port_t uartNum, gpio_num_t txPin, gpio_num_t rxPin, uint32_t
     // Baud
     uart_baud(uartNum, baud_rate);
     // Interrupt Handler registrieren
-    if (rxTimestamp) {
-        if (esp_intr_alloc(ETS_UART0_INTR_SOURCE + uartNum, 0, uart_interrupt, (void*)uartNum, NULL)) return true;
-        // Interrupts aktivieren
-        uart->int_clr.val = UART_INTR_MASK;
-        uart->conf1.rx_tout_thrhd = 10; // Interrupt nach Ende eines Frames
+    uart->int_ena.val = 0;
+    uart->int_clr.val = UART_INTR_MASK;
+    if (esp_intr_alloc(ETS_UART0_INTR_SOURCE + uartNum, 0, uart_interrupt, (void*)uartNum, NULL)) return true;
+    uart->conf1.txfifo_empty_thrhd = UART_TX_EMPTY_THRESHOLD;
+    if (port->rx.buffer) { // tx-Interrupt wird erst mit Daten im Ringbuffer aktiviert
+        uart->conf1.rx_tout_thrhd = UART_RX_TIMEOUT; // Interrupt nach Ende eines Frames
         uart->conf1.rx_tout_en = 1;
-        uart->conf1.rxfifo_full_thrhd = 100; // Interrupt kurz vor rx-FIFO Überlauf damit dieser noch ohne Verlust geleert werden kann
-        uart->int_ena.val = UART_RXFIFO_FULL_INT_ENA_M;
-        rxQueues[uartNum] = rxTimestamp;
+        uart->conf1.rxfifo_full_thrhd = UART_RX_FULL_THRESHOLD;
+        uart->int_ena.val = UART_RXFIFO_FULL_INT_ENA_M | UART_RXFIFO_TOUT_INT_ENA_M | UART_RXFIFO_OVF_INT_ENA_M;
     }
     return false;
 }
@@ -83,61 +126,196 @@ bool uart_baud(uart_port_t uartNum, uint32_t baud_rate) {
         UART[uartNum]->clk_div.div_int = clk_div >> 4;
         UART[uartNum]->clk_div.div_frag = clk_div & 0xf;
     }
-    // rx Delay berechnen
+    // Bytezeit berechnen, ganzzahlig in ns damit der ISR ohne FPU auskommt
     // 10 Bits per 1 Byte / baud = Zeit in Sekunden
-    rxDelaysUs[uartNum] = 10.0 / baud_rate / 1000.0 / 1000.0;
+    ports[uartNum].byteNs = 10000000000ULL / baud_rate;
     return false;
 }
 
-IRAM_ATTR void uart_rxFifoReset(uart_port_t uartNum) {
+void uart_rxFifoReset(uart_port_t uartNum) {
     uart_dev_t *uart = UART[uartNum];
+    uart_ring_t *rx = &ports[uartNum].rx;
+    portENTER_CRITICAL(&ports[uartNum].lock);
     while (uart->status.rxfifo_cnt) {
         (volatile void) uart->fifo.rw_byte;
     }
+    portEXIT_CRITICAL(&ports[uartNum].lock);
+    __atomic_store_n(&rx->tail, __atomic_load_n(&rx->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
 }
 
-IRAM_ATTR void uart_rxInterrupt(uart_port_t uartNum, bool enabled) {
-    uart_dev_t *uart = UART[uartNum];
-    uart->int_ena.rxfifo_tout = enabled;
-    uart->int_ena.rxfifo_full = enabled;
+bool uart_rxWait(uart_port_t uartNum, int64_t *timestamp, TickType_t timeout) {
+    uint32_t notified;
+    ports[uartNum].task = xTaskGetCurrentTaskHandle();
+    if (xTaskNotifyWait(0, 0, &notified, timeout) == pdFALSE) return true;
+    // 32 Bit Zeitstempel des Interrupts auf 64 Bit erweitern
+    *timestamp = esp_timer_get_time();
+    *timestamp -= (uint32_t)((uint32_t)*timestamp - notified);
+    return false;
 }
 
-uint8_t uart_txAvailable(uart_port_t uartNum) {
-    uart_dev_t *uart = UART[uartNum];
-    return (UART_FIFO_LEN - uart->status.txfifo_cnt);
+int64_t uart_rxTimestamp(uart_port_t uartNum, uint32_t position) {
+    uart_port_state_t *port = &ports[uartNum];
+    uart_anchor_t anchor = {0};
+    portENTER_CRITICAL(&port->lock);
+    // ältester Batch der die Position enthält, ist dieser schon überschrieben wird vom ältesten bekannten zurückgerechnet
+    uint32_t count = port->anchorCount;
+    uint32_t known = count < UART_RX_ANCHORS ? count : UART_RX_ANCHORS;
+    for (uint32_t i = count - known; i != count; ++i) {
+        anchor = port->anchors[i & UART_ANCHOR_MASK];
+        if ((int32_t)(anchor.position - position) > 0) break;
+    }
+    uint32_t byteNs = port->byteNs;
+    portEXIT_CRITICAL(&port->lock);
+    // Startbit des Bytes liegt (Anzahl Bytes bis Batchende) Bytezeiten vor dem Ende des Batches
+    int32_t bytes = anchor.position - position;
+    if (bytes < 0) bytes = 0;
+    return anchor.time - (int64_t)bytes * byteNs / 1000;
 }
 
-void uart_write(uart_port_t uartNum, uint8_t value) {
-    uart_dev_t *uart = UART[uartNum];
-    uart->fifo.rw_byte = value;
+uint32_t uart_rxPosition(uart_port_t uartNum) {
+    return ports[uartNum].rx.tail;
 }
 
-uint8_t uart_rxAvailable(uart_port_t uartNum) {
-    uart_dev_t *uart = UART[uartNum];
-    return uart->status.rxfifo_cnt;
+size_t uart_rxAvailable(uart_port_t uartNum) {
+    uart_ring_t *rx = &ports[uartNum].rx;
+    return __atomic_load_n(&rx->head, __ATOMIC_ACQUIRE) - rx->tail;
+}
+
+size_t uart_rxPeek(uart_port_t uartNum, const uint8_t **data) {
+    uart_ring_t *rx = &ports[uartNum].rx;
+    uint32_t available = __atomic_load_n(&rx->head, __ATOMIC_ACQUIRE) - rx->tail;
+    uint32_t offset = rx->tail & UART_RX_MASK;
+    *data = &rx->buffer[offset];
+    if (available > UART_RX_BUFFER_SIZE - offset) available = UART_RX_BUFFER_SIZE - offset; // bis Umbruch
+    return available;
+}
+
+void uart_rxConsume(uart_port_t uartNum, size_t length) {
+    uart_ring_t *rx = &ports[uartNum].rx;
+    __atomic_store_n(&rx->tail, rx->tail + length, __ATOMIC_RELEASE);
 }
 
 uint8_t uart_read(uart_port_t uartNum) {
-    uart_dev_t *uart = UART[uartNum];
-    return uart->fifo.rw_byte;
+    uint8_t value = 0;
+    uart_readBlock(uartNum, &value, 1);
+    return value;
+}
+
+size_t uart_readBlock(uart_port_t uartNum, uint8_t *data, size_t length) {
+    const uint8_t *chunk;
+    size_t read = 0, available;
+    while (read < length && (available = uart_rxPeek(uartNum, &chunk))) {
+        if (available > length - read) available = length - read;
+        memcpy(data + read, chunk, available);
+        uart_rxConsume(uartNum, available);
+        read += available;
+    }
+    return read;
+}
+
+size_t uart_txAvailable(uart_port_t uartNum) {
+    uart_ring_t *tx = &ports[uartNum].tx;
+    if (!tx->buffer) return 0;
+    return UART_TX_BUFFER_SIZE - (tx->head - __atomic_load_n(&tx->tail, __ATOMIC_ACQUIRE));
+}
+
+bool uart_write(uart_port_t uartNum, uint8_t value) {
+    return uart_writeBlock(uartNum, &value, 1, 0);
+}
+
+bool uart_writeBlock(uart_port_t uartNum, const uint8_t *data, size_t length, TickType_t timeout) {
+    uart_port_state_t *port = &ports[uartNum];
+    uart_ring_t *tx = &port->tx;
+    if (!tx->buffer || length > UART_TX_BUFFER_SIZE) return true;
+    // auf Platz warten, ISR leert den Ringbuffer mit der Baudrate
+    TickType_t startTick = xTaskGetTickCount();
+    while (uart_txAvailable(uartNum) < length) {
+        if (timeout != portMAX_DELAY && xTaskGetTickCount() - startTick >= timeout) return true;
+        vTaskDelay(1);
+    }
+    // kopieren, evtl. in zwei Teilen bei Umbruch
+    uint32_t offset = tx->head & UART_TX_MASK;
+    size_t first = UART_TX_BUFFER_SIZE - offset;
+    if (first > length) first = length;
+    memcpy(&tx->buffer[offset], data, first);
+    memcpy(&tx->buffer[0], data + first, length - first);
+    __atomic_store_n(&tx->head, tx->head + length, __ATOMIC_RELEASE);
+    // tx-Interrupt aktivieren, ISR füllt FIFO sofort nach
+    portENTER_CRITICAL(&port->lock);
+    UART[uartNum]->int_ena.txfifo_empty = 1;
+    portEXIT_CRITICAL(&port->lock);
+    return false;
+}
+
+bool uart_txWait(uart_port_t uartNum, TickType_t timeout) {
+    TickType_t startTick = xTaskGetTickCount();
+    while (uart_txAvailable(uartNum) < UART_TX_BUFFER_SIZE || UART[uartNum]->status.txfifo_cnt) {
+        if (timeout != portMAX_DELAY && xTaskGetTickCount() - startTick >= timeout) return true;
+        vTaskDelay(1);
+    }
+    return false;
+}
+
+void uart_statisticsGet(uart_port_t uartNum, uart_statistics_t *statistics) {
+    *statistics = ports[uartNum].statistics;
 }
 
 IRAM_ATTR static void uart_interrupt(void* arg) {
     uart_port_t uartNum = (uart_port_t)arg;
     uart_dev_t *uart = UART[uartNum];
+    uart_port_state_t *port = &ports[uartNum];
     BaseType_t woken = pdFALSE;
     uint32_t status = uart->int_st.val;
     uart->int_clr.val = status; // aktive Interrupts zurücksetzen
-    if (status & UART_RXFIFO_TOUT_INT_ST_M || // rx-Frame erhalten
-        status & UART_RXFIFO_FULL_INT_ST_M) { // rx-FIFO bald voll
-        uart_rxInterrupt(uartNum, false); // rx-Interrupts deaktivieren
-        if (rxQueues[uartNum]) {
-            int64_t timestamp = esp_timer_get_time();
-            timestamp -= uart->status.rxfifo_cnt * rxDelaysUs[uartNum]; // ToDo: Zeit für TOUT Interrupt-generierung abziehen
-            xQueueSendFromISR(rxQueues[uartNum], &timestamp, &woken); // rx beendet, entsperren
+    if (status & (UART_RXFIFO_TOUT_INT_ST_M | UART_RXFIFO_FULL_INT_ST_M | UART_RXFIFO_OVF_INT_ST_M)) {
+        if (status & UART_RXFIFO_OVF_INT_ST_M) ++port->statistics.fifoOverflows; // Daten verloren, Rest trotzdem übernehmen
+        uint8_t count = uart->status.rxfifo_cnt;
+        // Ende des letzten Bytes, beim Timeout ist seither UART_RX_TIMEOUT Bytezeiten nichts mehr gekommen
+        int64_t timestamp = esp_timer_get_time();
+        if (status & UART_RXFIFO_TOUT_INT_ST_M) timestamp -= UART_RX_TIMEOUT * port->byteNs / 1000;
+        // rx-FIFO in Ringbuffer leeren
+        uart_ring_t *rx = &port->rx;
+        uint32_t head = rx->head;
+        uint32_t tail = __atomic_load_n(&rx->tail, __ATOMIC_ACQUIRE);
+        for (uint8_t i = 0; i < count; ++i) {
+            uint8_t c = uart->fifo.rw_byte;
+            if (head - tail < UART_RX_BUFFER_SIZE) rx->buffer[head++ & UART_RX_MASK] = c;
+            else ++port->statistics.rxOverflows; // Konsument zu langsam
+        }
+        // Batch für Zeitstempel merken, verworfene Bytes zählen nicht zum Strom. Vor der Freigabe der
+        // Bytes, sonst findet der Konsument für sie noch keinen Anker und rechnet vom vorherigen zurück
+        if (count) {
+            portENTER_CRITICAL_ISR(&port->lock);
+            uart_anchor_t *anchor = &port->anchors[port->anchorCount & UART_ANCHOR_MASK];
+            anchor->position = head;
+            anchor->time = timestamp;
+            ++port->anchorCount;
+            portEXIT_CRITICAL_ISR(&port->lock);
+        }
+        __atomic_store_n(&rx->head, head, __ATOMIC_RELEASE);
+        port->statistics.rxBytes += count;
+        // wartenden Task wecken
+        if (count && port->task) {
+            if (xTaskNotifyFromISR(port->task, (uint32_t)timestamp, eSetValueWithoutOverwrite, &woken) != pdPASS) {
+                ++port->statistics.coalesced; // Task hat vorherigen Empfang noch nicht abgeholt
+            }
+        }
+    }
+    if (status & UART_TXFIFO_EMPTY_INT_ST_M) {
+        // tx-FIFO aus Ringbuffer nachfüllen
+        uart_ring_t *tx = &port->tx;
+        uint32_t tail = tx->tail;
+        uint32_t head = __atomic_load_n(&tx->head, __ATOMIC_ACQUIRE);
+        uint8_t space = UART_FIFO_LEN - uart->status.txfifo_cnt;
+        while (space-- && tail != head) {
+            uart->fifo.rw_byte = tx->buffer[tail++ & UART_TX_MASK];
+            ++port->statistics.txBytes;
         }
-    } else if (status & UART_RXFIFO_OVF_INT_ST_M) { // rx-FIFO Überlauf
-        uart_rxFifoReset(uartNum); // FIFO zurücksetzten
+        __atomic_store_n(&tx->tail, tail, __ATOMIC_RELEASE);
+        // Ringbuffer leer, tx-Interrupt bis zum nächsten uart_writeBlock deaktivieren
+        portENTER_CRITICAL_ISR(&port->lock);
+        if (tail == __atomic_load_n(&tx->head, __ATOMIC_ACQUIRE)) uart->int_ena.txfifo_empty = 0;
+        portEXIT_CRITICAL_ISR(&port->lock);
     }
     if (woken == pdTRUE) portYIELD_FROM_ISR();
 }
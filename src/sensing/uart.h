@@ -5,6 +5,10 @@
  * Date:   2020-07-20
  * ----------------------------
  * UART Treiber für simplerere Handhabung gegenüber idf Treiber.
+ * Der ISR kopiert empfangene Bytes in einen rx-Ringbuffer und füllt den tx-FIFO aus einem
+ * tx-Ringbuffer nach. Beide Ringbuffer sind lock-frei mit genau einem Produzenten und einem Konsumenten.
+ * Pro rx-Batch merkt sich der ISR Stromposition und Empfangszeit, daraus wird die Startzeit
+ * beliebiger Bytes (z.B. Frameanfang) über die Baudrate zurückgerechnet.
  */
 
 
@@ -18,21 +22,39 @@
 
 /** Einstellungen **/
 
+#define UART_RX_BUFFER_SIZE     512 // Zweierpotenz
+#define UART_TX_BUFFER_SIZE     512 // Zweierpotenz
+#define UART_RX_FULL_THRESHOLD  64  // Interrupt bei halbvollem rx-FIFO, ausreichend Reserve bis zum Überlauf
+#define UART_TX_EMPTY_THRESHOLD 16  // tx-FIFO nachfüllen bevor er leer ist
+#define UART_RX_TIMEOUT         10  // Bytezeiten ohne Empfang bis Timeout-Interrupt
+#define UART_RX_ANCHORS         8   // gemerkte rx-Batches für Zeitstempel, Zweierpotenz
+
+
+/** Variablendeklaration **/
+
+typedef struct { // kumulierte Statistik eines UARTs
+    uint32_t rxBytes;
+    uint32_t txBytes;
+    uint32_t rxOverflows;   // verworfene Bytes da rx-Ringbuffer voll
+    uint32_t fifoOverflows; // Überläufe des rx-FIFOs, ISR kam zu spät
+    uint32_t coalesced;     // Empfang während noch eine Notification ausstehend war
+} uart_statistics_t;
+
 
 /*
  * Function: uart_init
  * ----------------------------
  * Aktiviere eigener UART Treiber auf den gegebenen Pins und setze Baud.
+ * Für jede verwendete Richtung wird ein Ringbuffer alloziert.
  *
  * uart_port_t uartNum: entsprechender UART
  * gpio_num_t txPin: Host Data-Out, Receiver Data-In, oder UART_PIN_NO_CHANGE
  * gpio_num_t rxPin: Host Data-In, Receiver Data-Out, oder UART_PIN_NO_CHANGE
  * uint32_t baud_rate: Baud e.g. 9600
- * QueueHandle_t rxTimestamp: Queue mit mind. grösse 1 die mit int64_t des Empfangszeitpunkts gefüllt wird
  * 
  * returns: false -> Erfolg, true -> Error
  */
-bool uart_init(uart_port_t uartNum, gpio_num_t txPin, gpio_num_t rxPin, uint32_t baud_rate, QueueHandle_t rxTimestamp);
+bool uart_init(uart_port_t uartNum, gpio_num_t txPin, gpio_num_t rxPin, uint32_t baud_rate);
 
 /*
  * Function: uart_baud
@@ -49,33 +71,118 @@ bool uart_baud(uart_port_t uartNum, uint32_t baud_rate);
 /*
  * Function: uart_rxFifoReset
  * ----------------------------
- * Leere UART FIFO.
+ * Leere UART FIFO und rx-Ringbuffer.
  * 
  * uart_port_t uartNum: entsprechender UART
  */
-IRAM_ATTR void uart_rxFifoReset(uart_port_t uartNum);
+void uart_rxFifoReset(uart_port_t uartNum);
 
 /*
- * Function: uart_rxInterrupt
+ * Function: uart_rxWait
  * ----------------------------
- * Aktiviere RX Timeout und RX FIFO Überlauf als Interrupts.
- * Interrupt wird im ISR automatisch deaktiviert.
- * 
+ * Warte auf Empfang. Der aufrufende Task wird vom ISR direkt per Notification geweckt,
+ * der Zeitstempel liegt im Notification-Wert.
+ *
+ * uart_port_t uartNum: entsprechender UART
+ * int64_t *timestamp: Empfangszeitpunkt in us
+ * TickType_t timeout: maximale Wartezeit
+ *
+ * returns: false -> Empfangen, true -> Timeout
+ */
+bool uart_rxWait(uart_port_t uartNum, int64_t *timestamp, TickType_t timeout);
+
+/*
+ * Function: uart_rxTimestamp
+ * ----------------------------
+ * Rechnet den Empfangsbeginn (Startbit) eines Bytes aus dessen Stromposition zurück.
+ * Berücksichtigt Baudrate und die Verzögerung des rx-Timeout Interrupts.
+ *
+ * uart_port_t uartNum: entsprechender UART
+ * uint32_t position: Stromposition des Bytes, siehe uart_rxPosition
+ *
+ * returns: Zeitpunkt in us
+ */
+int64_t uart_rxTimestamp(uart_port_t uartNum, uint32_t position);
+
+/*
+ * Function: uart_rxPosition
+ * ----------------------------
+ * Gibt die Stromposition des ältesten ungelesenen Bytes zurück. Zählt alle je empfangenen Bytes.
+ *
+ * uart_port_t uartNum: entsprechender UART
+ *
+ * returns: Stromposition
+ */
+uint32_t uart_rxPosition(uart_port_t uartNum);
+
+/*
+ * Function: uart_rxAvailable
+ * ----------------------------
+ * Gibt Anzahl der verfügbaren Bytes im rx-Ringbuffer zurück.
+ *
+ * uart_port_t uartNum: entsprechender UART
+ *
+ * returns: Anzahl Bytes im rx-Ringbuffer
+ */
+size_t uart_rxAvailable(uart_port_t uartNum);
+
+/*
+ * Function: uart_rxPeek
+ * ----------------------------
+ * Gibt die zusammenhängend lesbaren Bytes im rx-Ringbuffer ohne Kopie zurück.
+ * Bei Umbruch des Ringbuffers muss nach uart_rxConsume erneut aufgerufen werden.
+ *
+ * uart_port_t uartNum: entsprechender UART
+ * const uint8_t **data: wird auf das älteste ungelesene Byte gesetzt
+ *
+ * returns: Anzahl zusammenhängender Bytes
+ */
+size_t uart_rxPeek(uart_port_t uartNum, const uint8_t **data);
+
+/*
+ * Function: uart_rxConsume
+ * ----------------------------
+ * Gibt gelesene Bytes im rx-Ringbuffer frei.
+ *
+ * uart_port_t uartNum: entsprechender UART
+ * size_t length: Anzahl freizugebender Bytes, höchstens uart_rxAvailable
+ */
+void uart_rxConsume(uart_port_t uartNum, size_t length);
+
+/*
+ * Function: uart_read
+ * ----------------------------
+ * Lese Byte aus UART. Wenn Ringbuffer leer ist wird 0 zurückgegeben.
+ *
+ * uart_port_t uartNum: entsprechender UART
+ *
+ * returns: Byte aus rx-Ringbuffer
+ */
+uint8_t uart_read(uart_port_t uartNum);
+
+/*
+ * Function: uart_readBlock
+ * ----------------------------
+ * Kopiere bis zu length Bytes aus dem rx-Ringbuffer. Blockiert nicht.
+ *
  * uart_port_t uartNum: entsprechender UART
- * bool enabled: True -> aktiviere Intr, False -> Deaktiviere Intr
+ * uint8_t *data: Ziel
+ * size_t length: maximale Anzahl Bytes
+ *
+ * returns: Anzahl gelesener Bytes
  */
-IRAM_ATTR void uart_rxInterrupt(uart_port_t uartNum, bool enabled);
+size_t uart_readBlock(uart_port_t uartNum, uint8_t *data, size_t length);
 
 /*
  * Function: uart_txAvailable
  * ----------------------------
- * Gibt verfügbarer Platz in Bytes im tx-FIFO zurück.
+ * Gibt verfügbarer Platz in Bytes im tx-Ringbuffer zurück.
  *
  * uart_port_t uartNum: entsprechender UART
  *
- * returns: Verbleibender Platz an Bytes im tx-FIFO
+ * returns: Verbleibender Platz an Bytes im tx-Ringbuffer
  */
-uint8_t uart_txAvailable(uart_port_t uartNum);
+size_t uart_txAvailable(uart_port_t uartNum);
 
 /*
  * Function: uart_write
@@ -84,27 +191,44 @@ uint8_t uart_txAvailable(uart_port_t uartNum);
  *
  * uart_port_t uartNum: entsprechender UART
  * uint8_t value: zu sendender Wert
+ *
+ * returns: false -> Erfolg, true -> Error, tx-Ringbuffer voll
  */
-void uart_write(uart_port_t uartNum, uint8_t value);
+bool uart_write(uart_port_t uartNum, uint8_t value);
 
 /*
- * Function: uart_rxAvailable
+ * Function: uart_writeBlock
  * ----------------------------
- * Gibt Anzahl der verfügbaren Bytes im rx-FIFO zurück.
+ * Schreibe Bytes in UART. Blockiert bis der tx-Ringbuffer Platz für alle Bytes hat,
+ * so werden Frames nie nur teilweise gesendet.
  *
  * uart_port_t uartNum: entsprechender UART
+ * const uint8_t *data: zu sendende Bytes
+ * size_t length: Anzahl Bytes
+ * TickType_t timeout: maximale Wartezeit auf Platz
  *
- * returns: Anzahl Bytes im rx-FIFO
+ * returns: false -> Erfolg, true -> Error, Timeout oder länger als tx-Ringbuffer
  */
-uint8_t uart_rxAvailable(uart_port_t uartNum);
+bool uart_writeBlock(uart_port_t uartNum, const uint8_t *data, size_t length, TickType_t timeout);
 
 /*
- * Function: uart_read
+ * Function: uart_txWait
  * ----------------------------
- * Lese Byte aus UART. Wenn FIFO leer ist wird 0 zurückgegeben.
+ * Warte bis tx-Ringbuffer und tx-FIFO leer sind, z.B. vor einem Wechsel der Baudrate.
  *
  * uart_port_t uartNum: entsprechender UART
+ * TickType_t timeout: maximale Wartezeit
  *
- * returns: Byte auf rx-FIFO
+ * returns: false -> Erfolg, true -> Timeout
  */
-uint8_t uart_read(uart_port_t uartNum);
+bool uart_txWait(uart_port_t uartNum, TickType_t timeout);
+
+/*
+ * Function: uart_statisticsGet
+ * ----------------------------
+ * Kopiert die kumulierte Statistik eines UARTs.
+ *
+ * uart_port_t uartNum: entsprechender UART
+ * uart_statistics_t *statistics: Ziel der Kopie
+ */
+void uart_statisticsGet(uart_port_t uartNum, uart_statistics_t *statistics);